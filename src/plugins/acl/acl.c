@@ -19,6 +19,7 @@
 #include <vnet/plugin/plugin.h>
 #include <acl/acl.h>
 #include <acl/l2sess.h>
+#include <acl/hash_lookup.h>
 
 #include <vnet/l2/l2_classify.h>
 #include <vnet/classify/input_acl.h>
@@ -169,6 +170,8 @@ acl_add_list (u32 count, vl_api_acl_rule_t rules[],
   acl_list_t *a;
   acl_rule_t *r;
   acl_rule_t *acl_new_rules;
+  acl_rule_t *old_rules;
+  acl_hash_t *new_hash, *old_hash;
   int i;
 
   if (*acl_list_index != ~0)
@@ -227,11 +230,21 @@ acl_add_list (u32 count, vl_api_acl_rule_t rules[],
   else
     {
       a = am->acls + *acl_list_index;
-      /* Get rid of the old rules */
-      clib_mem_free (a->rules);
     }
+  /*
+   * Compile the new rules before publishing them, so the ACL
+   * switches from the old rule set to the new one in one step.
+   */
+  new_hash = hash_acl_build (*acl_list_index, acl_new_rules, count);
+  old_rules = a->rules;
+  old_hash = a->hash;
   a->rules = acl_new_rules;
   a->count = count;
+  a->hash = new_hash;
+  /* Get rid of the old rules */
+  if (old_rules)
+    clib_mem_free (old_rules);
+  hash_acl_free (old_hash);
   memcpy (a->tag, tag, sizeof (a->tag));
 
   return 0;
@@ -282,6 +295,8 @@ acl_del_list (u32 acl_list_index)
 
   /* now we can delete the ACL itself */
   a = &am->acls[acl_list_index];
+  hash_acl_free (a->hash);
+  a->hash = 0;
   if (a->rules)
     {
       clib_mem_free (a->rules);
@@ -618,6 +633,8 @@ acl_interface_in_enable_disable (acl_main_t * am, u32 sw_if_index,
 			  sw_if_index))
     return VNET_API_ERROR_INVALID_SW_IF_INDEX;
 
+  acl_fa_enable_disable (sw_if_index, 1, enable_disable);
+
   if (enable_disable)
     {
       rv = acl_hook_l2_input_classify (am, sw_if_index);
@@ -641,6 +658,8 @@ acl_interface_out_enable_disable (acl_main_t * am, u32 sw_if_index,
 			  sw_if_index))
     return VNET_API_ERROR_INVALID_SW_IF_INDEX;
 
+  acl_fa_enable_disable (sw_if_index, 0, enable_disable);
+
   if (enable_disable)
     {
       rv = acl_hook_l2_output_classify (am, sw_if_index);
@@ -759,30 +778,6 @@ acl_interface_add_del_inout_acl (u32 sw_if_index, u8 is_add, u8 is_input,
 }
 
 
-static void *
-get_ptr_to_offset (vlib_buffer_t * b0, int offset)
-{
-  u8 *p = vlib_buffer_get_current (b0) + offset;
-  return p;
-}
-
-static u8
-acl_get_l4_proto (vlib_buffer_t * b0, int node_is_ip6)
-{
-  u8 proto;
-  int proto_offset;
-  if (node_is_ip6)
-    {
-      proto_offset = 20;
-    }
-  else
-    {
-      proto_offset = 23;
-    }
-  proto = *((u8 *) vlib_buffer_get_current (b0) + proto_offset);
-  return proto;
-}
-
 static int
 acl_match_addr (ip46_address_t * addr1, ip46_address_t * addr2, int prefixlen,
 		int is_ip6)
@@ -801,10 +796,11 @@ acl_match_addr (ip46_address_t * addr1, ip46_address_t * addr2, int prefixlen,
 	}
       if (prefixlen % 8)
 	{
-	  u8 b1 = *((u8 *) addr1 + 1 + prefixlen / 8);
-	  u8 b2 = *((u8 *) addr2 + 1 + prefixlen / 8);
+	  u8 b1 = *((u8 *) addr1 + prefixlen / 8);
+	  u8 b2 = *((u8 *) addr2 + prefixlen / 8);
 	  u8 mask0 = (0xff - ((1 << (8 - (prefixlen % 8))) - 1));
-	  return (b1 & mask0) == b2;
+	  /* the rule address may carry host bits, mask both sides */
+	  return (b1 & mask0) == (b2 & mask0);
 	}
       else
 	{
@@ -816,8 +812,8 @@ acl_match_addr (ip46_address_t * addr1, ip46_address_t * addr2, int prefixlen,
     {
       uint32_t a1 = ntohl (addr1->ip4.as_u32);
       uint32_t a2 = ntohl (addr2->ip4.as_u32);
-      uint32_t mask0 = 0xffffffff - ((1 << (32 - prefixlen)) - 1);
-      return (a1 & mask0) == a2;
+      uint32_t mask0 = 0xffffffff << (32 - prefixlen);
+      return (a1 & mask0) == (a2 & mask0);
     }
 }
 
@@ -827,87 +823,41 @@ acl_match_port (u16 port, u16 port_first, u16 port_last, int is_ip6)
   return ((port >= port_first) && (port <= port_last));
 }
 
+/*
+ * Extract the 5-tuple of the packet once, so it can be matched
+ * against any number of ACLs. Returns 0 for non-IP packets.
+ */
 static int
-acl_packet_match (acl_main_t * am, u32 acl_index, vlib_buffer_t * b0,
-		  u8 * r_action, int *r_is_ip6, u32 * r_acl_match_p,
-		  u32 * r_rule_match_p, u32 * trace_bitmap)
+acl_fill_5tuple (vlib_buffer_t * b0, acl_5tuple_t * p5tuple,
+		 u32 * trace_bitmap)
 {
   ethernet_header_t *h0;
   u16 type0;
 
-  ip46_address_t src, dst;
-  int is_ip6;
-  int is_ip4;
-  u8 proto;
-  u16 src_port = 0;
-  u16 dst_port = 0;
-  u8 tcp_flags = 0;
-  int i;
-  acl_list_t *a;
-  acl_rule_t *r;
-
   h0 = vlib_buffer_get_current (b0);
   type0 = clib_net_to_host_u16 (h0->type);
-  is_ip4 = (type0 == ETHERNET_TYPE_IP4);
-  is_ip6 = (type0 == ETHERNET_TYPE_IP6);
 
-  if (!(is_ip4 || is_ip6))
-    {
-      return 0;
-    }
-  /* The bunch of hardcoded offsets here is intentional to get rid of them
-     ASAP, when getting to a faster matching code */
-  if (is_ip4)
-    {
-      clib_memcpy (&src.ip4, get_ptr_to_offset (b0, 26), 4);
-      clib_memcpy (&dst.ip4, get_ptr_to_offset (b0, 30), 4);
-      proto = acl_get_l4_proto (b0, 0);
-      if (1 == proto)
-	{
-	  *trace_bitmap |= 0x00000001;
-	  /* type */
-	  src_port = ((u16) (*(u8 *) get_ptr_to_offset (b0, 34)));
-	  /* code */
-	  dst_port = ((u16) (*(u8 *) get_ptr_to_offset (b0, 35)));
-	} else {
-	  /* assume TCP/UDP */
-	  src_port = ntohs ((u16) (*(u16 *) get_ptr_to_offset (b0, 34)));
-	  dst_port = ntohs ((u16) (*(u16 *) get_ptr_to_offset (b0, 36)));
-	  /* UDP gets ability to check on an oddball data byte as a bonus */
-	  tcp_flags = *(u8 *) get_ptr_to_offset (b0, 14 + 20 + 13);
-	}
-    }
-  else /* is_ipv6 implicitly */
-    {
-      clib_memcpy (&src, get_ptr_to_offset (b0, 22), 16);
-      clib_memcpy (&dst, get_ptr_to_offset (b0, 38), 16);
-      proto = acl_get_l4_proto (b0, 1);
-      if (58 == proto)
-	{
-	  *trace_bitmap |= 0x00000002;
-	  /* type */
-	  src_port = (u16) (*(u8 *) get_ptr_to_offset (b0, 54));
-	  /* code */
-	  dst_port = (u16) (*(u8 *) get_ptr_to_offset (b0, 55));
-	}
-      else
-	{
-	  /* assume TCP/UDP */
-	  src_port = ntohs ((u16) (*(u16 *) get_ptr_to_offset (b0, 54)));
-	  dst_port = ntohs ((u16) (*(u16 *) get_ptr_to_offset (b0, 56)));
-	  tcp_flags = *(u8 *) get_ptr_to_offset (b0, 14 + 40 + 13);
-	}
-    }
-  if (pool_is_free_index (am->acls, acl_index))
-    {
-      if (r_acl_match_p)
-	*r_acl_match_p = acl_index;
-      if (r_rule_match_p)
-	*r_rule_match_p = -1;
-      /* the ACL does not exist but is used for policy. Block traffic. */
-      return 0;
-    }
-  a = am->acls + acl_index;
+  if (type0 == ETHERNET_TYPE_IP4)
+    acl_fill_5tuple_l3 (b0, sizeof (*h0), 0, p5tuple, trace_bitmap);
+  else if (type0 == ETHERNET_TYPE_IP6)
+    acl_fill_5tuple_l3 (b0, sizeof (*h0), 1, p5tuple, trace_bitmap);
+  else
+    return 0;
+  return 1;
+}
+
+static int
+acl_linear_match_5tuple (acl_list_t * a, acl_5tuple_t * pkt_5tuple,
+			 u32 * r_rule_index)
+{
+  int is_ip6 = pkt_5tuple->l4.is_ip6;
+  u8 proto = pkt_5tuple->l4.proto;
+  u16 src_port = pkt_5tuple->l4.port[0];
+  u16 dst_port = pkt_5tuple->l4.port[1];
+  u8 tcp_flags = pkt_5tuple->l4.tcp_flags;
+  acl_rule_t *r;
+  int i;
+
   for (i = 0; i < a->count; i++)
     {
       r = a->rules + i;
@@ -915,9 +865,11 @@ acl_packet_match (acl_main_t * am, u32 acl_index, vlib_buffer_t * b0,
 	{
 	  continue;
 	}
-      if (!acl_match_addr (&dst, &r->dst, r->dst_prefixlen, is_ip6))
+      if (!acl_match_addr (&pkt_5tuple->addr[1], &r->dst, r->dst_prefixlen,
+			   is_ip6))
 	continue;
-      if (!acl_match_addr (&src, &r->src, r->src_prefixlen, is_ip6))
+      if (!acl_match_addr (&pkt_5tuple->addr[0], &r->src, r->src_prefixlen,
+			   is_ip6))
 	continue;
       if (r->proto)
 	{
@@ -931,90 +883,210 @@ acl_packet_match (acl_main_t * am, u32 acl_index, vlib_buffer_t * b0,
 	      (dst_port, r->dst_port_or_code_first, r->dst_port_or_code_last,
 	       is_ip6))
 	    continue;
-	  /* No need for check of proto == TCP, since in other rules both fields should be zero, so this match will succeed */
-	  if ((tcp_flags & r->tcp_flags_mask) != r->tcp_flags_value)
+	  /* TCP flags are only meaningful for TCP rules, see hash_lookup.c */
+	  if (r->proto == IP_PROTOCOL_TCP
+	      && (tcp_flags & r->tcp_flags_mask) != r->tcp_flags_value)
 	    continue;
 	}
       /* everything matches! */
-      *r_action = r->is_permit;
-      *r_is_ip6 = is_ip6;
-      if (r_acl_match_p)
-	*r_acl_match_p = acl_index;
-      if (r_rule_match_p)
-	*r_rule_match_p = i;
+      *r_rule_index = i;
       return 1;
     }
   return 0;
 }
 
-void
-input_acl_packet_match (u32 sw_if_index, vlib_buffer_t * b0, u32 * nextp,
-			u32 * acl_match_p, u32 * rule_match_p,
-			u32 * trace_bitmap)
+static int
+acl_match_5tuple (acl_main_t * am, u32 acl_index, acl_5tuple_t * pkt_5tuple,
+		  u8 * r_action, u32 * r_acl_match_p, u32 * r_rule_match_p)
 {
-  acl_main_t *am = &acl_main;
-  uint8_t action = 0;
-  int is_ip6 = 0;
-  int i;
-  vec_validate (am->input_acl_vec_by_sw_if_index, sw_if_index);
-  for (i = 0; i < vec_len (am->input_acl_vec_by_sw_if_index[sw_if_index]);
-       i++)
+  acl_list_t *a;
+  u32 rule_index;
+  int match;
+
+  if (pool_is_free_index (am->acls, acl_index))
     {
-      if (acl_packet_match
-	  (am, am->input_acl_vec_by_sw_if_index[sw_if_index][i], b0, &action,
-	   &is_ip6, acl_match_p, rule_match_p, trace_bitmap))
-	{
-	  if (is_ip6)
-	    {
-	      *nextp = am->acl_in_ip6_match_next[action];
-	    }
-	  else
-	    {
-	      *nextp = am->acl_in_ip4_match_next[action];
-	    }
-	  return;
-	}
+      if (r_acl_match_p)
+	*r_acl_match_p = acl_index;
+      if (r_rule_match_p)
+	*r_rule_match_p = -1;
+      /* the ACL does not exist but is used for policy. Block traffic. */
+      return 0;
     }
-  if (vec_len (am->input_acl_vec_by_sw_if_index[sw_if_index]) > 0)
+  a = am->acls + acl_index;
+  if (am->use_hash_acl_matching && a->hash)
+    match = hash_acl_match_5tuple (a->hash, a->rules, pkt_5tuple,
+				   &rule_index);
+  else
+    match = acl_linear_match_5tuple (a, pkt_5tuple, &rule_index);
+
+  if (!match)
+    return 0;
+
+  *r_action = a->rules[rule_index].is_permit;
+  if (r_acl_match_p)
+    *r_acl_match_p = acl_index;
+  if (r_rule_match_p)
+    *r_rule_match_p = rule_index;
+  return 1;
+}
+
+int
+acl_match_5tuple_vec (acl_main_t * am, u32 * acl_vector,
+		      acl_5tuple_t * pkt_5tuple, u8 * r_action,
+		      u32 * r_acl_match_p, u32 * r_rule_match_p)
+{
+  int i;
+
+  for (i = 0; i < vec_len (acl_vector); i++)
     {
-      /* If there are ACLs and none matched, deny by default */
-      *nextp = 0;
+      if (acl_match_5tuple
+	  (am, acl_vector[i], pkt_5tuple, r_action, r_acl_match_p,
+	   r_rule_match_p))
+	return 1;
     }
+  return 0;
+}
 
+static_always_inline void
+acl_batch_fill_one (vlib_buffer_t * b0, int rx_tx, acl_5tuple_t * p5tuple,
+		    u8 * is_ip, u32 * sw_if_index, u32 * feature_bitmap,
+		    u32 * trace_bitmap)
+{
+  *sw_if_index = vnet_buffer (b0)->sw_if_index[rx_tx];
+  *feature_bitmap = vnet_buffer (b0)->l2.feature_bitmap;
+  *trace_bitmap = 0;
+  *is_ip = acl_fill_5tuple (b0, p5tuple, trace_bitmap);
 }
 
+/*
+ * Match a frame worth of packets in two passes. The first pass only
+ * pulls the 5-tuples out of the buffers, four at a time with the next
+ * four prefetched, the second one runs all of them against the ACLs
+ * back to back, so the rules and the lookup hash stay in the cache.
+ */
 void
-output_acl_packet_match (u32 sw_if_index, vlib_buffer_t * b0, u32 * nextp,
-			 u32 * acl_match_p, u32 * rule_match_p,
-			 u32 * trace_bitmap)
+acl_packet_match_batch (vlib_main_t * vm, u32 * buffers, u32 n_buffers,
+			int is_input, u32 * nexts, u32 * acl_match,
+			u32 * rule_match, u32 * trace_bitmaps)
 {
   acl_main_t *am = &acl_main;
-  uint8_t action = 0;
-  int is_ip6 = 0;
-  int i;
-  vec_validate (am->output_acl_vec_by_sw_if_index, sw_if_index);
-  for (i = 0; i < vec_len (am->output_acl_vec_by_sw_if_index[sw_if_index]);
-       i++)
+  acl_5tuple_t pkt_5tuple[VLIB_FRAME_SIZE];
+  u32 sw_if_index[VLIB_FRAME_SIZE];
+  u32 feature_bitmap[VLIB_FRAME_SIZE];
+  u8 is_ip[VLIB_FRAME_SIZE];
+  u32 **acl_vec_by_sw_if_index;
+  u32 *ip4_match_next, *ip6_match_next, *feat_next_node_index;
+  u32 *acl_vector = 0;
+  u32 last_sw_if_index = ~0;
+  int rx_tx;
+  u8 action;
+  u32 i;
+
+  ASSERT (n_buffers <= VLIB_FRAME_SIZE);
+
+  if (is_input)
     {
-      if (acl_packet_match
-	  (am, am->output_acl_vec_by_sw_if_index[sw_if_index][i], b0, &action,
-	   &is_ip6, acl_match_p, rule_match_p, trace_bitmap))
+      rx_tx = VLIB_RX;
+      acl_vec_by_sw_if_index = am->input_acl_vec_by_sw_if_index;
+      ip4_match_next = am->acl_in_ip4_match_next;
+      ip6_match_next = am->acl_in_ip6_match_next;
+      feat_next_node_index = am->acl_in_node_feat_next_node_index;
+    }
+  else
+    {
+      rx_tx = VLIB_TX;
+      acl_vec_by_sw_if_index = am->output_acl_vec_by_sw_if_index;
+      ip4_match_next = am->acl_out_ip4_match_next;
+      ip6_match_next = am->acl_out_ip6_match_next;
+      feat_next_node_index = am->acl_out_node_feat_next_node_index;
+    }
+
+  for (i = 0; i + 4 <= n_buffers; i += 4)
+    {
+      vlib_buffer_t *b0, *b1, *b2, *b3;
+
+      /* Prefetch next iteration. */
+      if (i + 8 <= n_buffers)
 	{
-	  if (is_ip6)
-	    {
-	      *nextp = am->acl_out_ip6_match_next[action];
-	    }
-	  else
-	    {
-	      *nextp = am->acl_out_ip4_match_next[action];
-	    }
-	  return;
+	  vlib_buffer_t *p4, *p5, *p6, *p7;
+
+	  p4 = vlib_get_buffer (vm, buffers[i + 4]);
+	  p5 = vlib_get_buffer (vm, buffers[i + 5]);
+	  p6 = vlib_get_buffer (vm, buffers[i + 6]);
+	  p7 = vlib_get_buffer (vm, buffers[i + 7]);
+
+	  vlib_prefetch_buffer_header (p4, LOAD);
+	  vlib_prefetch_buffer_header (p5, LOAD);
+	  vlib_prefetch_buffer_header (p6, LOAD);
+	  vlib_prefetch_buffer_header (p7, LOAD);
+
+	  CLIB_PREFETCH (p4->data, CLIB_CACHE_LINE_BYTES, LOAD);
+	  CLIB_PREFETCH (p5->data, CLIB_CACHE_LINE_BYTES, LOAD);
+	  CLIB_PREFETCH (p6->data, CLIB_CACHE_LINE_BYTES, LOAD);
+	  CLIB_PREFETCH (p7->data, CLIB_CACHE_LINE_BYTES, LOAD);
 	}
+
+      b0 = vlib_get_buffer (vm, buffers[i]);
+      b1 = vlib_get_buffer (vm, buffers[i + 1]);
+      b2 = vlib_get_buffer (vm, buffers[i + 2]);
+      b3 = vlib_get_buffer (vm, buffers[i + 3]);
+
+      acl_batch_fill_one (b0, rx_tx, &pkt_5tuple[i], &is_ip[i],
+			  &sw_if_index[i], &feature_bitmap[i],
+			  &trace_bitmaps[i]);
+      acl_batch_fill_one (b1, rx_tx, &pkt_5tuple[i + 1], &is_ip[i + 1],
+			  &sw_if_index[i + 1], &feature_bitmap[i + 1],
+			  &trace_bitmaps[i + 1]);
+      acl_batch_fill_one (b2, rx_tx, &pkt_5tuple[i + 2], &is_ip[i + 2],
+			  &sw_if_index[i + 2], &feature_bitmap[i + 2],
+			  &trace_bitmaps[i + 2]);
+      acl_batch_fill_one (b3, rx_tx, &pkt_5tuple[i + 3], &is_ip[i + 3],
+			  &sw_if_index[i + 3], &feature_bitmap[i + 3],
+			  &trace_bitmaps[i + 3]);
+    }
+
+  for (; i < n_buffers; i++)
+    {
+      vlib_buffer_t *b0 = vlib_get_buffer (vm, buffers[i]);
+
+      acl_batch_fill_one (b0, rx_tx, &pkt_5tuple[i], &is_ip[i],
+			  &sw_if_index[i], &feature_bitmap[i],
+			  &trace_bitmaps[i]);
     }
-  if (vec_len (am->output_acl_vec_by_sw_if_index[sw_if_index]) > 0)
+
+  for (i = 0; i < n_buffers; i++)
     {
-      /* If there are ACLs and none matched, deny by default */
-      *nextp = 0;
+      u32 next = ~0;
+
+      /* Frames mostly come from one interface, look its ACLs up once */
+      if (sw_if_index[i] != last_sw_if_index)
+	{
+	  last_sw_if_index = sw_if_index[i];
+	  acl_vector = last_sw_if_index < vec_len (acl_vec_by_sw_if_index) ?
+	    acl_vec_by_sw_if_index[last_sw_if_index] : 0;
+	}
+
+      acl_match[i] = ~0;
+      rule_match[i] = ~0;
+      if (is_ip[i]
+	  && acl_match_5tuple_vec (am, acl_vector, &pkt_5tuple[i], &action,
+				   &acl_match[i], &rule_match[i]))
+	{
+	  if (pkt_5tuple[i].l4.is_ip6)
+	    next = ip6_match_next[action];
+	  else
+	    next = ip4_match_next[action];
+	}
+      else if (vec_len (acl_vector) > 0)
+	{
+	  /* If there are ACLs and none matched, deny by default */
+	  next = 0;
+	}
+
+      if (next == ~0)
+	next = feat_bitmap_get_next_node_index (feat_next_node_index,
+						feature_bitmap[i]);
+      nexts[i] = next;
     }
 }
 
@@ -1904,6 +1976,253 @@ acl_setup_nodes (void)
 
 
 
+static clib_error_t *
+acl_set_aclplugin_fn (vlib_main_t * vm,
+		      unformat_input_t * input, vlib_cli_command_t * cmd)
+{
+  acl_main_t *am = &acl_main;
+  clib_error_t *error = 0;
+  uword memory_size;
+  u32 val;
+
+  if (unformat (input, "use-hash-acl-matching %u", &val))
+    am->use_hash_acl_matching = (val != 0);
+  else if (unformat (input, "session max-entries %u", &val))
+    {
+      /* the session pools are preallocated when first used */
+      if (vec_len (am->per_worker_data))
+	error = clib_error_return (0, "session tables already allocated");
+      else
+	am->fa_conn_table_max_entries = val;
+    }
+  else if (unformat (input, "session hash-memory %U",
+		     unformat_memory_size, &memory_size))
+    {
+      /* per worker, allocated together with the session pools */
+      if (vec_len (am->per_worker_data))
+	error = clib_error_return (0, "session tables already allocated");
+      else
+	am->fa_conn_table_hash_memory_size = memory_size;
+    }
+#define _(sym, name, str, sec)                                          \
+  else if (unformat (input, "session timeout " str " %u", &val))        \
+    am->session_timeout_sec[ACL_TIMEOUT_##sym] = val;
+  foreach_acl_fa_timeout
+#undef _
+  else
+    error = clib_error_return (0, "unknown input `%U'",
+			       format_unformat_error, input);
+  return error;
+}
+
+static clib_error_t *
+acl_show_aclplugin_fn (vlib_main_t * vm,
+		       unformat_input_t * input, vlib_cli_command_t * cmd)
+{
+  acl_main_t *am = &acl_main;
+  acl_list_t *a;
+  u32 acl_index = ~0;
+
+  unformat (input, "index %u", &acl_index);
+
+  vlib_cli_output (vm, "ACL plugin version %d.%d, %s matching",
+		   ACL_PLUGIN_VERSION_MAJOR, ACL_PLUGIN_VERSION_MINOR,
+		   am->use_hash_acl_matching ? "hash" : "linear");
+  /* *INDENT-OFF* */
+  pool_foreach (a, am->acls,
+  ({
+    if (acl_index != ~0 && acl_index != a - am->acls)
+      continue;
+    vlib_cli_output (vm, "acl-index %d tag %s: %d rules, %U",
+		     a - am->acls, a->tag, a->count, format_acl_hash,
+		     a->hash);
+  }));
+  /* *INDENT-ON* */
+  return 0;
+}
+
+/*
+ * Build a synthetic ACL the way tenant ACLs tend to look (a few prefix
+ * lengths, exact destination ports, an occasional port range) and time
+ * the linear walk against the compiled lookup on packets hitting
+ * random rules. Both must agree on every packet, so the rules also
+ * carry the awkward cases: prefixes which are not byte-aligned, rule
+ * addresses with host bits set and TCP flags on UDP rules.
+ */
+static clib_error_t *
+acl_test_lookup_bench_fn (vlib_main_t * vm,
+			  unformat_input_t * input, vlib_cli_command_t * cmd)
+{
+  acl_main_t *am = &acl_main;
+  static u8 plens[] = { 8, 12, 16, 20, 24, 27, 32 };
+  vl_api_acl_rule_t *api_rules = 0, *ar;
+  acl_5tuple_t *pkts = 0, *p;
+  u8 *results[2] = { 0, 0 };
+  u32 n_rules = 1000;
+  u32 n_pkts = 100000;
+  u32 seed = 0xdeadbeef;
+  u32 acl_index = ~0;
+  u32 acl_match, rule_match;
+  int saved_use_hash = am->use_hash_acl_matching;
+  u64 clocks[2];
+  u8 tag[64];
+  u32 n_mismatch = 0;
+  int i, pass;
+
+  while (unformat_check_input (input) != UNFORMAT_END_OF_INPUT)
+    {
+      if (unformat (input, "rules %u", &n_rules))
+	;
+      else if (unformat (input, "packets %u", &n_pkts))
+	;
+      else if (unformat (input, "seed %u", &seed))
+	;
+      else
+	return clib_error_return (0, "unknown input `%U'",
+				  format_unformat_error, input);
+    }
+  if (n_rules == 0 || n_pkts == 0)
+    return clib_error_return (0, "rules and packets must be non-zero");
+
+  vec_validate (api_rules, n_rules - 1);
+  for (i = 0; i < n_rules; i++)
+    {
+      u32 src = random_u32 (&seed);
+      u32 dst = random_u32 (&seed);
+      u8 src_plen = plens[random_u32 (&seed) % ARRAY_LEN (plens)];
+      u8 dst_plen = plens[random_u32 (&seed) % ARRAY_LEN (plens)];
+      u16 dport = 1 + random_u32 (&seed) % 1024;
+
+      ar = &api_rules[i];
+      ar->is_permit = i & 1;
+      ar->is_ipv6 = 0;
+      /* every third rule keeps host bits, which must not matter */
+      if (i % 3)
+	{
+	  src &= 0xffffffff << (32 - src_plen);
+	  dst &= 0xffffffff << (32 - dst_plen);
+	}
+      src = clib_host_to_net_u32 (src);
+      dst = clib_host_to_net_u32 (dst);
+      memcpy (ar->src_ip_addr, &src, 4);
+      memcpy (ar->dst_ip_addr, &dst, 4);
+      ar->src_ip_prefix_len = src_plen;
+      ar->dst_ip_prefix_len = dst_plen;
+      ar->proto = (random_u32 (&seed) & 1) ? IP_PROTOCOL_TCP :
+	IP_PROTOCOL_UDP;
+      ar->srcport_or_icmptype_first = 0;
+      ar->srcport_or_icmptype_last = clib_host_to_net_u16 (65535);
+      ar->dstport_or_icmpcode_first = clib_host_to_net_u16 (dport);
+      /* every tenth rule opens a port range */
+      ar->dstport_or_icmpcode_last = clib_host_to_net_u16 (dport +
+							   ((i % 10) ? 0 :
+							    100));
+      /* SYN-only on some rules, ignored unless the rule is TCP */
+      if (0 == (i % 4))
+	{
+	  ar->tcp_flags_mask = 0x12;
+	  ar->tcp_flags_value = 0x02;
+	}
+    }
+
+  memset (tag, 0, sizeof (tag));
+  strncpy ((char *) tag, "lookup-bench", sizeof (tag) - 1);
+  if (acl_add_list (n_rules, api_rules, &acl_index, tag))
+    {
+      vec_free (api_rules);
+      return clib_error_return (0, "could not create the ACL");
+    }
+
+  vec_validate (pkts, n_pkts - 1);
+  vec_foreach (p, pkts)
+  {
+    acl_rule_t *r = &am->acls[acl_index].rules[random_u32 (&seed) % n_rules];
+    u32 host_bits;
+
+    memset (p, 0, sizeof (*p));
+    host_bits = r->src_prefixlen == 32 ? 0 :
+      random_u32 (&seed) & ((1 << (32 - r->src_prefixlen)) - 1);
+    p->addr[0].ip4.as_u32 = r->src.ip4.as_u32 &
+      clib_host_to_net_u32 (0xffffffff << (32 - r->src_prefixlen));
+    p->addr[0].ip4.as_u32 |= clib_host_to_net_u32 (host_bits);
+    host_bits = r->dst_prefixlen == 32 ? 0 :
+      random_u32 (&seed) & ((1 << (32 - r->dst_prefixlen)) - 1);
+    p->addr[1].ip4.as_u32 = r->dst.ip4.as_u32 &
+      clib_host_to_net_u32 (0xffffffff << (32 - r->dst_prefixlen));
+    p->addr[1].ip4.as_u32 |= clib_host_to_net_u32 (host_bits);
+    p->l4.proto = r->proto;
+    p->l4.tcp_flags = random_u32 (&seed);
+    p->l4.port[0] = random_u32 (&seed);
+    p->l4.port[1] = r->dst_port_or_code_first;
+    p->l4.l4_valid = 1;
+  }
+
+  for (pass = 0; pass < 2; pass++)
+    {
+      u64 start;
+      u8 action;
+
+      am->use_hash_acl_matching = pass;
+      vec_validate_init_empty (results[pass], n_pkts - 1, 0);
+      start = clib_cpu_time_now ();
+      for (i = 0; i < n_pkts; i++)
+	{
+	  action = 0xff;
+	  rule_match = ~0;
+	  acl_match_5tuple (am, acl_index, &pkts[i], &action, &acl_match,
+			    &rule_match);
+	  results[pass][i] = action;
+	}
+      clocks[pass] = clib_cpu_time_now () - start;
+    }
+  am->use_hash_acl_matching = saved_use_hash;
+
+  for (i = 0; i < n_pkts; i++)
+    n_mismatch += results[0][i] != results[1][i];
+
+  vlib_cli_output (vm, "%d rules, %d packets: %U",
+		   n_rules, n_pkts, format_acl_hash,
+		   am->acls[acl_index].hash);
+  vlib_cli_output (vm, "linear: %.2f clocks/pkt, hash: %.2f clocks/pkt, "
+		   "%d mismatches", (f64) clocks[0] / n_pkts,
+		   (f64) clocks[1] / n_pkts, n_mismatch);
+
+  acl_del_list (acl_index);
+  vec_free (api_rules);
+  vec_free (pkts);
+  vec_free (results[0]);
+  vec_free (results[1]);
+
+  if (n_mismatch)
+    return clib_error_return (0, "linear and hash lookups disagree");
+  return 0;
+}
+
+/* *INDENT-OFF* */
+VLIB_CLI_COMMAND (aclplugin_set_command, static) = {
+    .path = "set acl-plugin",
+    .short_help = "set acl-plugin use-hash-acl-matching <0|1> | "
+                  "session max-entries <n> | "
+                  "session hash-memory <size> | "
+                  "session timeout {udp idle|tcp idle|tcp transient} <sec>",
+    .function = acl_set_aclplugin_fn,
+};
+
+VLIB_CLI_COMMAND (aclplugin_show_command, static) = {
+    .path = "show acl-plugin",
+    .short_help = "show acl-plugin [index <acl-index>]",
+    .function = acl_show_aclplugin_fn,
+};
+
+VLIB_CLI_COMMAND (aclplugin_test_lookup_bench_command, static) = {
+    .path = "test acl-plugin lookup-bench",
+    .short_help = "test acl-plugin lookup-bench [rules <n>] [packets <n>] "
+                  "[seed <n>]",
+    .function = acl_test_lookup_bench_fn,
+};
+/* *INDENT-ON* */
+
+
 static clib_error_t *
 acl_init (vlib_main_t * vm)
 {
@@ -1912,6 +2231,14 @@ acl_init (vlib_main_t * vm)
   memset (am, 0, sizeof (*am));
   am->vlib_main = vm;
   am->vnet_main = vnet_get_main ();
+  am->use_hash_acl_matching = 1;
+
+  am->fa_conn_table_max_entries = ACL_FA_DEFAULT_MAX_SESSIONS_PER_WORKER;
+  am->fa_conn_table_hash_num_buckets = ACL_FA_DEFAULT_HASH_NUM_BUCKETS;
+  am->fa_conn_table_hash_memory_size = ACL_FA_DEFAULT_HASH_MEMORY_SIZE;
+#define _(sym, name, str, sec) am->session_timeout_sec[ACL_TIMEOUT_##sym] = sec;
+  foreach_acl_fa_timeout
+#undef _
 
   u8 *name = format (0, "acl_%08x%c", api_version, 0);
 
@@ -24,14 +24,16 @@
 #include <vppinfra/error.h>
 #include <vppinfra/elog.h>
 
+#include <acl/hash_lookup_types.h>
+#include <acl/fa_node.h>
+
 #define  ACL_PLUGIN_VERSION_MAJOR 1
 #define  ACL_PLUGIN_VERSION_MINOR 1
 
 extern vlib_node_registration_t acl_in_node;
 extern vlib_node_registration_t acl_out_node;
 
-void input_acl_packet_match(u32 sw_if_index, vlib_buffer_t * b0, u32 *nextp, u32 *acl_match_p, u32 *rule_match_p, u32 *trace_bitmap);
-void output_acl_packet_match(u32 sw_if_index, vlib_buffer_t * b0, u32 *nextp, u32 *acl_match_p, u32 *rule_match_p, u32 *trace_bitmap);
+void acl_packet_match_batch(vlib_main_t * vm, u32 * buffers, u32 n_buffers, int is_input, u32 *nexts, u32 *acl_match, u32 *rule_match, u32 *trace_bitmaps);
 
 enum address_e { IP4, IP6 };
 typedef struct
@@ -81,6 +83,8 @@ typedef struct
   u8 tag[64];
   u32 count;
   acl_rule_t *rules;
+  /* Compiled lookup structure, 0 if the rules are walked linearly */
+  acl_hash_t *hash;
 } acl_list_t;
 
 typedef struct
@@ -133,6 +137,17 @@ typedef struct {
   u32 acl_out_ip6_match_next[256];
   u32 n_match_actions;
 
+  /* Use the compiled tuple-space lookup rather than the linear walk */
+  int use_hash_acl_matching;
+
+  /* Stateful ACLs on the ip4/ip6 feature arcs, see fa_node.h */
+  acl_fa_per_worker_data_t *per_worker_data;
+  uword *fa_in_acl_on_sw_if_index;
+  uword *fa_out_acl_on_sw_if_index;
+  u32 fa_conn_table_max_entries;
+  u32 fa_conn_table_hash_num_buckets;
+  uword fa_conn_table_hash_memory_size;
+  f64 session_timeout_sec[ACL_N_TIMEOUTS];
 
   /* convenience */
   vlib_main_t * vlib_main;
@@ -141,5 +156,9 @@ typedef struct {
 
 extern acl_main_t acl_main;
 
+int acl_match_5tuple_vec (acl_main_t * am, u32 * acl_vector,
+			  acl_5tuple_t * pkt_5tuple, u8 * r_action,
+			  u32 * r_acl_match_p, u32 * r_rule_match_p);
+
 
 #endif
@@ -0,0 +1,679 @@
+/*
+ * Copyright (c) 2017 Cisco and/or its affiliates.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <vlib/vlib.h>
+#include <vnet/vnet.h>
+#include <vnet/pg/pg.h>
+#include <vnet/feature/feature.h>
+#include <vppinfra/error.h>
+#include <acl/acl.h>
+#include <acl/l2sess.h>
+
+typedef struct
+{
+  u32 next_index;
+  u32 sw_if_index;
+  u32 match_acl_index;
+  u32 match_rule_index;
+  u32 trace_bitmap;
+  u8 action;
+  u8 session_hit;
+} acl_fa_trace_t;
+
+/* packet trace format function */
+static u8 *
+format_acl_fa_trace (u8 * s, va_list * args)
+{
+  CLIB_UNUSED (vlib_main_t * vm) = va_arg (*args, vlib_main_t *);
+  CLIB_UNUSED (vlib_node_t * node) = va_arg (*args, vlib_node_t *);
+  acl_fa_trace_t *t = va_arg (*args, acl_fa_trace_t *);
+
+  s =
+    format (s,
+	    "acl-plugin: sw_if_index %d, next index %d, action: %d, %s"
+	    " match: acl %d rule %d trace_bits %08x",
+	    t->sw_if_index, t->next_index, t->action,
+	    t->session_hit ? "session hit," : "", t->match_acl_index,
+	    t->match_rule_index, t->trace_bitmap);
+  return s;
+}
+
+#define foreach_acl_fa_error \
+_(ACL_CHECK, "checked packets")                                 \
+_(ACL_DROP, "ACL deny packets")                                 \
+_(ACL_PERMIT, "ACL permit packets")                             \
+_(ACL_NEW_SESSION, "new sessions added")                        \
+_(ACL_EXIST_SESSION, "existing session packets")                \
+_(ACL_TOO_MANY_SESSIONS, "too many sessions to add new")
+
+typedef enum
+{
+#define _(sym,str) ACL_FA_ERROR_##sym,
+  foreach_acl_fa_error
+#undef _
+    ACL_FA_N_ERROR,
+} acl_fa_error_t;
+
+static char *acl_fa_error_strings[] = {
+#define _(sym,string) string,
+  foreach_acl_fa_error
+#undef _
+};
+
+typedef enum
+{
+  ACL_FA_ERROR_DROP,
+  ACL_FA_N_NEXT,
+} acl_fa_next_t;
+
+/* The match actions, as set up by acl_setup_nodes () */
+#define ACL_FA_ACTION_DENY 0
+#define ACL_FA_ACTION_PERMIT_REFLECT 2
+
+always_inline int
+acl_fa_session_l4_proto_ok (acl_5tuple_t * p5tuple)
+{
+  return (p5tuple->l4.l4_valid
+	  && (p5tuple->l4.proto == IP_PROTOCOL_TCP
+	      || p5tuple->l4.proto == IP_PROTOCOL_UDP));
+}
+
+/*
+ * Build the session key of a packet. Sessions are keyed in the
+ * direction of the packet which created them as seen on input,
+ * so the output side swaps the addresses and ports.
+ */
+always_inline void
+acl_fa_make_session_key (acl_5tuple_t * p5tuple, u32 sw_if_index,
+			 int is_input, clib_bihash_kv_48_8_t * kv)
+{
+  acl_5tuple_t *key = (acl_5tuple_t *) & kv->key;
+
+  if (is_input)
+    {
+      *key = *p5tuple;
+    }
+  else
+    {
+      key->addr[0] = p5tuple->addr[1];
+      key->addr[1] = p5tuple->addr[0];
+      key->l4.as_u64 = p5tuple->l4.as_u64;
+      key->l4.port[0] = p5tuple->l4.port[1];
+      key->l4.port[1] = p5tuple->l4.port[0];
+    }
+  /* the flags change during the life of the session */
+  key->l4.tcp_flags = 0;
+  key->pkt.mask_type_index = 0;
+  key->pkt.sw_if_index = sw_if_index;
+  kv->value = ~0ULL;
+}
+
+always_inline acl_fa_session_t *
+acl_fa_session_at (acl_main_t * am, u64 value)
+{
+  acl_fa_per_worker_data_t *pw = &am->per_worker_data[value >> 32];
+  return pool_elt_at_index (pw->sessions, value & 0xffffffff);
+}
+
+/*
+ * Look up the own table first, then the ones of the other workers.
+ * Only the owner ever adds to or deletes from its table, so the bihash
+ * readers are safe.
+ */
+always_inline int
+acl_fa_find_session (acl_main_t * am, u32 thread_index,
+		     clib_bihash_kv_48_8_t * kv)
+{
+  u32 i;
+
+  if (0 == clib_bihash_search_48_8
+      (&am->per_worker_data[thread_index].session_hash, kv, kv))
+    return 1;
+
+  for (i = 0; i < vec_len (am->per_worker_data); i++)
+    {
+      if (i == thread_index)
+	continue;
+      if (0 == clib_bihash_search_48_8
+	  (&am->per_worker_data[i].session_hash, kv, kv))
+	return 1;
+    }
+  return 0;
+}
+
+/*
+ * Refresh a session on a hit. The session may belong to another
+ * worker, which can be doing the same concurrently: the flags are
+ * or-ed in atomically, and only written when a new flag shows up.
+ */
+always_inline void
+acl_fa_session_update (acl_fa_session_t * s, f64 now, u16 tcp_flags)
+{
+  if (s->last_active_time != now)
+    s->last_active_time = now;
+  if (PREDICT_FALSE ((s->tcp_flags_seen & tcp_flags) != tcp_flags))
+    __sync_fetch_and_or (&s->tcp_flags_seen, tcp_flags);
+}
+
+static u32
+acl_fa_session_timeout_type (acl_fa_session_t * s)
+{
+  u16 syn_ack = TCP_FLAGS_ACKSYN | (TCP_FLAGS_ACKSYN << 8);
+  u16 fin_rst = (TCP_FLAG_FIN | TCP_FLAG_RST) |
+    ((TCP_FLAG_FIN | TCP_FLAG_RST) << 8);
+
+  if (s->info.l4.proto != IP_PROTOCOL_TCP)
+    return ACL_TIMEOUT_UDP_IDLE;
+  if ((s->tcp_flags_seen & syn_ack) == syn_ack
+      && !(s->tcp_flags_seen & fin_rst))
+    return ACL_TIMEOUT_TCP_IDLE;
+  return ACL_TIMEOUT_TCP_TRANSIENT;
+}
+
+static u32
+acl_fa_session_timer_ticks (acl_main_t * am, f64 remaining)
+{
+  u32 ticks;
+
+  if (remaining <= 0)
+    return 1;
+  ticks = (u32) (remaining / ACL_FA_TIMER_INTERVAL) + 1;
+  return clib_min (ticks, ACL_FA_TIMER_MAX_TICKS);
+}
+
+static void
+acl_fa_delete_session (acl_main_t * am, acl_fa_per_worker_data_t * pw,
+		       acl_fa_session_t * s)
+{
+  clib_bihash_kv_48_8_t kv;
+
+  clib_memcpy (kv.key, &s->info, sizeof (kv.key));
+  clib_bihash_add_del_48_8 (&pw->session_hash, &kv, 0 /* is_add */ );
+  pool_put (pw->sessions, s);
+  pw->sessions_deleted++;
+}
+
+/*
+ * The timer is not moved on every packet: when it fires, a session
+ * which was active in the meantime is simply rescheduled.
+ */
+static void
+acl_fa_expired_timer_callback (u32 * expired_timers)
+{
+  acl_main_t *am = &acl_main;
+  acl_fa_per_worker_data_t *pw =
+    &am->per_worker_data[os_get_cpu_number ()];
+  acl_fa_session_t *s;
+  f64 timeout, remaining;
+  u32 session_index;
+  int i;
+
+  for (i = 0; i < vec_len (expired_timers); i++)
+    {
+      session_index = expired_timers[i] & 0x7FFFFFFF;
+      if (pool_is_free_index (pw->sessions, session_index))
+	continue;
+      s = pool_elt_at_index (pw->sessions, session_index);
+      timeout = am->session_timeout_sec[acl_fa_session_timeout_type (s)];
+      remaining = s->last_active_time + timeout - pw->now;
+      if (remaining > 0)
+	s->timer_handle =
+	  tw_timer_start_2t_1w_2048sl (&pw->timer_wheel, session_index, 0,
+				       acl_fa_session_timer_ticks (am,
+								   remaining));
+      else
+	acl_fa_delete_session (am, pw, s);
+    }
+}
+
+static int
+acl_fa_add_session (acl_main_t * am, acl_fa_per_worker_data_t * pw,
+		    u32 thread_index, clib_bihash_kv_48_8_t * kv,
+		    int is_input, u8 tcp_flags, f64 now)
+{
+  acl_fa_session_t *s;
+  f64 timeout;
+
+  if (pool_elts (pw->sessions) >= am->fa_conn_table_max_entries)
+    {
+      pw->session_table_full++;
+      return 0;
+    }
+
+  pool_get_aligned (pw->sessions, s, CLIB_CACHE_LINE_BYTES);
+  memset (s, 0, sizeof (*s));
+  clib_memcpy (&s->info, kv->key, sizeof (s->info));
+  s->is_output = !is_input;
+  s->last_active_time = now;
+  s->tcp_flags_seen = tcp_flags;
+
+  kv->value = ((u64) thread_index << 32) | (s - pw->sessions);
+  clib_bihash_add_del_48_8 (&pw->session_hash, kv, 1 /* is_add */ );
+
+  timeout = am->session_timeout_sec[acl_fa_session_timeout_type (s)];
+  s->timer_handle =
+    tw_timer_start_2t_1w_2048sl (&pw->timer_wheel, s - pw->sessions, 0,
+				 acl_fa_session_timer_ticks (am, timeout));
+  pw->sessions_added++;
+  return 1;
+}
+
+always_inline uword
+acl_fa_node_fn (vlib_main_t * vm,
+		vlib_node_runtime_t * node, vlib_frame_t * frame, int is_ip6,
+		int is_input)
+{
+  acl_main_t *am = &acl_main;
+  u32 n_left_from, *from, *to_next;
+  acl_fa_next_t next_index;
+  u32 thread_index = os_get_cpu_number ();
+  acl_fa_per_worker_data_t *pw = &am->per_worker_data[thread_index];
+  u32 **acl_vec_by_sw_if_index = is_input ?
+    am->input_acl_vec_by_sw_if_index : am->output_acl_vec_by_sw_if_index;
+  f64 now = vlib_time_now (vm);
+  u32 pkts_acl_checked = 0;
+  u32 pkts_new_session = 0;
+  u32 pkts_exist_session = 0;
+  u32 pkts_acl_permit = 0;
+  u32 pkts_acl_drop = 0;
+  u32 pkts_too_many_sessions = 0;
+  u32 trace_bitmap = 0;
+
+  /* age out the idle sessions of this worker */
+  pw->now = now;
+  tw_timer_expire_timers_2t_1w_2048sl (&pw->timer_wheel, now);
+
+  from = vlib_frame_vector_args (frame);
+  n_left_from = frame->n_vectors;
+  next_index = node->cached_next_index;
+
+  while (n_left_from > 0)
+    {
+      u32 n_left_to_next;
+
+      vlib_get_next_frame (vm, node, next_index, to_next, n_left_to_next);
+
+      while (n_left_from > 0 && n_left_to_next > 0)
+	{
+	  u32 bi0;
+	  vlib_buffer_t *b0;
+	  u32 next0 = 0;
+	  u32 feature_next0;
+	  u8 action = ACL_FA_ACTION_DENY;
+	  u32 sw_if_index0;
+	  u32 *acl_vector0;
+	  u32 match_acl_index = ~0;
+	  u32 match_rule_index = ~0;
+	  acl_5tuple_t fa_5tuple;
+	  clib_bihash_kv_48_8_t kv;
+	  int session_hit = 0;
+
+	  /* speculatively enqueue b0 to the current next frame */
+	  bi0 = from[0];
+	  to_next[0] = bi0;
+	  from += 1;
+	  to_next += 1;
+	  n_left_from -= 1;
+	  n_left_to_next -= 1;
+
+	  b0 = vlib_get_buffer (vm, bi0);
+
+	  sw_if_index0 = vnet_buffer (b0)->sw_if_index[is_input ? VLIB_RX :
+						       VLIB_TX];
+	  vnet_feature_next (sw_if_index0, &feature_next0, b0);
+
+	  acl_fill_5tuple_l3 (b0,
+			      is_input ? 0 :
+			      vnet_buffer (b0)->ip.save_rewrite_length,
+			      is_ip6, &fa_5tuple, &trace_bitmap);
+	  if (is_input)
+	    acl_fill_5tuple_reass (b0, is_ip6, &fa_5tuple);
+
+	  if (acl_fa_session_l4_proto_ok (&fa_5tuple))
+	    {
+	      acl_fa_make_session_key (&fa_5tuple, sw_if_index0, is_input,
+				       &kv);
+	      if (acl_fa_find_session (am, thread_index, &kv))
+		{
+		  acl_fa_session_t *s = acl_fa_session_at (am, kv.value);
+		  int is_reverse = (is_input == s->is_output);
+
+		  acl_fa_session_update (s, now,
+					 ((u16) fa_5tuple.l4.tcp_flags) <<
+					 (is_reverse ? 8 : 0));
+		  session_hit = 1;
+		  action = 1;
+		  pkts_exist_session += 1;
+		  pw->session_hits++;
+		}
+	      else
+		{
+		  pw->session_misses++;
+		}
+	    }
+
+	  if (!session_hit)
+	    {
+	      acl_vector0 = sw_if_index0 < vec_len (acl_vec_by_sw_if_index) ?
+		acl_vec_by_sw_if_index[sw_if_index0] : 0;
+	      if (0 == vec_len (acl_vector0))
+		{
+		  /* No ACLs applied, nothing to enforce */
+		  action = 1;
+		}
+	      else if (!acl_match_5tuple_vec (am, acl_vector0, &fa_5tuple,
+					      &action, &match_acl_index,
+					      &match_rule_index))
+		{
+		  /* If there are ACLs and none matched, deny by default */
+		  action = ACL_FA_ACTION_DENY;
+		}
+	      pkts_acl_checked += 1;
+
+	      if (action == ACL_FA_ACTION_PERMIT_REFLECT
+		  && acl_fa_session_l4_proto_ok (&fa_5tuple))
+		{
+		  if (acl_fa_add_session (am, pw, thread_index, &kv, is_input,
+					  fa_5tuple.l4.tcp_flags, now))
+		    pkts_new_session += 1;
+		  else
+		    pkts_too_many_sessions += 1;
+		}
+	    }
+
+	  if (action != ACL_FA_ACTION_DENY)
+	    {
+	      next0 = feature_next0;
+	      pkts_acl_permit += 1;
+	    }
+	  else
+	    {
+	      next0 = ACL_FA_ERROR_DROP;
+	      pkts_acl_drop += 1;
+	    }
+
+	  if (PREDICT_FALSE ((node->flags & VLIB_NODE_FLAG_TRACE)
+			     && (b0->flags & VLIB_BUFFER_IS_TRACED)))
+	    {
+	      acl_fa_trace_t *t = vlib_add_trace (vm, node, b0, sizeof (*t));
+	      t->sw_if_index = sw_if_index0;
+	      t->next_index = next0;
+	      t->match_acl_index = match_acl_index;
+	      t->match_rule_index = match_rule_index;
+	      t->trace_bitmap = trace_bitmap;
+	      t->action = action;
+	      t->session_hit = session_hit;
+	    }
+
+	  /* verify speculative enqueue, maybe switch current next frame */
+	  vlib_validate_buffer_enqueue_x1 (vm, node, next_index,
+					   to_next, n_left_to_next,
+					   bi0, next0);
+	}
+
+      vlib_put_next_frame (vm, node, next_index, n_left_to_next);
+    }
+
+  vlib_node_increment_counter (vm, node->node_index,
+			       ACL_FA_ERROR_ACL_CHECK, pkts_acl_checked);
+  vlib_node_increment_counter (vm, node->node_index,
+			       ACL_FA_ERROR_ACL_PERMIT, pkts_acl_permit);
+  vlib_node_increment_counter (vm, node->node_index,
+			       ACL_FA_ERROR_ACL_DROP, pkts_acl_drop);
+  vlib_node_increment_counter (vm, node->node_index,
+			       ACL_FA_ERROR_ACL_NEW_SESSION,
+			       pkts_new_session);
+  vlib_node_increment_counter (vm, node->node_index,
+			       ACL_FA_ERROR_ACL_EXIST_SESSION,
+			       pkts_exist_session);
+  vlib_node_increment_counter (vm, node->node_index,
+			       ACL_FA_ERROR_ACL_TOO_MANY_SESSIONS,
+			       pkts_too_many_sessions);
+  return frame->n_vectors;
+}
+
+static uword
+acl_in_ip4_fa_node_fn (vlib_main_t * vm,
+		       vlib_node_runtime_t * node, vlib_frame_t * frame)
+{
+  return acl_fa_node_fn (vm, node, frame, 0 /* is_ip6 */ , 1 /* is_input */ );
+}
+
+static uword
+acl_in_ip6_fa_node_fn (vlib_main_t * vm,
+		       vlib_node_runtime_t * node, vlib_frame_t * frame)
+{
+  return acl_fa_node_fn (vm, node, frame, 1 /* is_ip6 */ , 1 /* is_input */ );
+}
+
+static uword
+acl_out_ip4_fa_node_fn (vlib_main_t * vm,
+			vlib_node_runtime_t * node, vlib_frame_t * frame)
+{
+  return acl_fa_node_fn (vm, node, frame, 0 /* is_ip6 */ , 0 /* is_input */ );
+}
+
+static uword
+acl_out_ip6_fa_node_fn (vlib_main_t * vm,
+			vlib_node_runtime_t * node, vlib_frame_t * frame)
+{
+  return acl_fa_node_fn (vm, node, frame, 1 /* is_ip6 */ , 0 /* is_input */ );
+}
+
+/* *INDENT-OFF* */
+VLIB_REGISTER_NODE (acl_in_ip4_fa_node) =
+{
+  .function = acl_in_ip4_fa_node_fn,
+  .name = "acl-plugin-in-ip4-fa",
+  .vector_size = sizeof (u32),
+  .format_trace = format_acl_fa_trace,
+  .type = VLIB_NODE_TYPE_INTERNAL,
+  .n_errors = ARRAY_LEN (acl_fa_error_strings),
+  .error_strings = acl_fa_error_strings,
+  .n_next_nodes = ACL_FA_N_NEXT,
+  .next_nodes =
+  {
+    [ACL_FA_ERROR_DROP] = "error-drop",
+  }
+};
+
+VNET_FEATURE_INIT (acl_in_ip4_fa_feature, static) =
+{
+  .arc_name = "ip4-unicast",
+  .node_name = "acl-plugin-in-ip4-fa",
+  .runs_before = VNET_FEATURES ("ip4-lookup"),
+  .runs_after = VNET_FEATURES ("ip4-reassembly"),
+};
+
+VLIB_REGISTER_NODE (acl_in_ip6_fa_node) =
+{
+  .function = acl_in_ip6_fa_node_fn,
+  .name = "acl-plugin-in-ip6-fa",
+  .vector_size = sizeof (u32),
+  .format_trace = format_acl_fa_trace,
+  .type = VLIB_NODE_TYPE_INTERNAL,
+  .n_errors = ARRAY_LEN (acl_fa_error_strings),
+  .error_strings = acl_fa_error_strings,
+  .n_next_nodes = ACL_FA_N_NEXT,
+  .next_nodes =
+  {
+    [ACL_FA_ERROR_DROP] = "error-drop",
+  }
+};
+
+VNET_FEATURE_INIT (acl_in_ip6_fa_feature, static) =
+{
+  .arc_name = "ip6-unicast",
+  .node_name = "acl-plugin-in-ip6-fa",
+  .runs_before = VNET_FEATURES ("ip6-lookup"),
+  .runs_after = VNET_FEATURES ("ip6-reassembly"),
+};
+
+VLIB_REGISTER_NODE (acl_out_ip4_fa_node) =
+{
+  .function = acl_out_ip4_fa_node_fn,
+  .name = "acl-plugin-out-ip4-fa",
+  .vector_size = sizeof (u32),
+  .format_trace = format_acl_fa_trace,
+  .type = VLIB_NODE_TYPE_INTERNAL,
+  .n_errors = ARRAY_LEN (acl_fa_error_strings),
+  .error_strings = acl_fa_error_strings,
+  .n_next_nodes = ACL_FA_N_NEXT,
+  .next_nodes =
+  {
+    [ACL_FA_ERROR_DROP] = "error-drop",
+  }
+};
+
+VNET_FEATURE_INIT (acl_out_ip4_fa_feature, static) =
+{
+  .arc_name = "ip4-output",
+  .node_name = "acl-plugin-out-ip4-fa",
+  .runs_before = VNET_FEATURES ("interface-output"),
+};
+
+VLIB_REGISTER_NODE (acl_out_ip6_fa_node) =
+{
+  .function = acl_out_ip6_fa_node_fn,
+  .name = "acl-plugin-out-ip6-fa",
+  .vector_size = sizeof (u32),
+  .format_trace = format_acl_fa_trace,
+  .type = VLIB_NODE_TYPE_INTERNAL,
+  .n_errors = ARRAY_LEN (acl_fa_error_strings),
+  .error_strings = acl_fa_error_strings,
+  .n_next_nodes = ACL_FA_N_NEXT,
+  .next_nodes =
+  {
+    [ACL_FA_ERROR_DROP] = "error-drop",
+  }
+};
+
+VNET_FEATURE_INIT (acl_out_ip6_fa_feature, static) =
+{
+  .arc_name = "ip6-output",
+  .node_name = "acl-plugin-out-ip6-fa",
+  .runs_before = VNET_FEATURES ("interface-output"),
+};
+/* *INDENT-ON* */
+
+static void
+acl_fa_init_per_worker_data (acl_main_t * am)
+{
+  vlib_thread_main_t *tm = vlib_get_thread_main ();
+  acl_fa_per_worker_data_t *pw;
+  u8 *name;
+
+  if (vec_len (am->per_worker_data))
+    return;
+
+  vec_validate_aligned (am->per_worker_data, tm->n_vlib_mains - 1,
+			CLIB_CACHE_LINE_BYTES);
+  vec_foreach (pw, am->per_worker_data)
+  {
+    name = format (0, "acl session table %d%c",
+		   pw - am->per_worker_data, 0);
+    clib_bihash_init_48_8 (&pw->session_hash, (char *) name,
+			   am->fa_conn_table_hash_num_buckets,
+			   am->fa_conn_table_hash_memory_size);
+    /* never reallocated, other workers read the sessions */
+    pool_alloc_aligned (pw->sessions, am->fa_conn_table_max_entries,
+			CLIB_CACHE_LINE_BYTES);
+    tw_timer_wheel_init_2t_1w_2048sl (&pw->timer_wheel,
+				      acl_fa_expired_timer_callback,
+				      ACL_FA_TIMER_INTERVAL,
+				      ACL_FA_MAX_EXPIRATIONS_PER_RUN);
+    pw->timer_wheel.last_run_time = vlib_time_now (am->vlib_main);
+  }
+}
+
+void
+acl_fa_enable_disable (u32 sw_if_index, int is_input, int enable_disable)
+{
+  acl_main_t *am = &acl_main;
+  uword **bitmap = is_input ? &am->fa_in_acl_on_sw_if_index :
+    &am->fa_out_acl_on_sw_if_index;
+
+  enable_disable = (enable_disable != 0);
+  /* the feature arc refcounts, so only act on a change */
+  if (clib_bitmap_get (*bitmap, sw_if_index) == enable_disable)
+    return;
+
+  if (enable_disable)
+    acl_fa_init_per_worker_data (am);
+
+  if (is_input)
+    {
+      vnet_feature_enable_disable ("ip4-unicast", "acl-plugin-in-ip4-fa",
+				   sw_if_index, enable_disable, 0, 0);
+      vnet_feature_enable_disable ("ip6-unicast", "acl-plugin-in-ip6-fa",
+				   sw_if_index, enable_disable, 0, 0);
+    }
+  else
+    {
+      vnet_feature_enable_disable ("ip4-output", "acl-plugin-out-ip4-fa",
+				   sw_if_index, enable_disable, 0, 0);
+      vnet_feature_enable_disable ("ip6-output", "acl-plugin-out-ip6-fa",
+				   sw_if_index, enable_disable, 0, 0);
+    }
+  *bitmap = clib_bitmap_set (*bitmap, sw_if_index, enable_disable);
+}
+
+static clib_error_t *
+acl_show_aclplugin_sessions_fn (vlib_main_t * vm,
+				unformat_input_t * input,
+				vlib_cli_command_t * cmd)
+{
+  acl_main_t *am = &acl_main;
+  acl_fa_per_worker_data_t *pw;
+  u64 total = 0;
+
+  vlib_cli_output (vm, "Session table hash memory per worker: %U",
+		   format_memory_size, am->fa_conn_table_hash_memory_size);
+  vlib_cli_output (vm, "Session timeouts (sec):");
+#define _(sym, name, str, sec)                                          \
+  vlib_cli_output (vm, "  %s: %.0f", str,                               \
+                   am->session_timeout_sec[ACL_TIMEOUT_##sym]);
+  foreach_acl_fa_timeout
+#undef _
+    vec_foreach (pw, am->per_worker_data)
+  {
+    vlib_cli_output (vm, "Thread #%d: %d of %d sessions in use",
+		     pw - am->per_worker_data, pool_elts (pw->sessions),
+		     am->fa_conn_table_max_entries);
+    vlib_cli_output (vm, "  session hits: %lld, misses: %lld",
+		     pw->session_hits, pw->session_misses);
+    vlib_cli_output (vm, "  sessions added: %lld, deleted: %lld, "
+		     "table full: %lld", pw->sessions_added,
+		     pw->sessions_deleted, pw->session_table_full);
+    total += pool_elts (pw->sessions);
+  }
+  vlib_cli_output (vm, "Total sessions: %lld", total);
+  return 0;
+}
+
+/* *INDENT-OFF* */
+VLIB_CLI_COMMAND (aclplugin_show_sessions_command, static) = {
+    .path = "show acl-plugin sessions",
+    .short_help = "show acl-plugin sessions",
+    .function = acl_show_aclplugin_sessions_fn,
+};
+/* *INDENT-ON* */
+
+/*
+ * fd.io coding-style-patch-verification: ON
+ *
+ * Local Variables:
+ * eval: (c-set-style "gnu")
+ * End:
+ */
@@ -0,0 +1,188 @@
+/*
+ * Copyright (c) 2017 Cisco and/or its affiliates.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef included_acl_fa_node_h
+#define included_acl_fa_node_h
+
+#include <vnet/ip/ip.h>
+#include <vppinfra/bihash_48_8.h>
+#include <vppinfra/tw_timer_2t_1w_2048sl.h>
+#include <acl/hash_lookup_types.h>
+
+/*
+ * Stateful ACL processing on the ip4/ip6 feature arcs.
+ *
+ * Each worker owns a session table (bihash + pool) and a timer wheel.
+ * A session is keyed by the 5-tuple of the packet which created it and
+ * the interface, packets of the reverse direction on the other side of
+ * the interface (input vs. output) are looked up with the addresses and
+ * ports swapped. Packets hitting a session skip the ACL evaluation.
+ *
+ * Only the owning worker adds, ages and deletes its sessions. Lookups
+ * which miss the own table probe the tables of the other workers, so
+ * the two directions of a flow do not have to land on the same worker.
+ * A worker hitting a session of another worker does update its
+ * last_active_time and tcp_flags_seen: the former is a single aligned
+ * store only read by the owner when the timer fires, the latter is
+ * updated with an atomic or (see acl_fa_session_update).
+ */
+
+#define ACL_FA_DEFAULT_MAX_SESSIONS_PER_WORKER 100000
+#define ACL_FA_DEFAULT_HASH_NUM_BUCKETS (64 * 1024)
+/* per worker, so keep it modest: sized for the default max-entries */
+#define ACL_FA_DEFAULT_HASH_MEMORY_SIZE (64 << 20)
+#define ACL_FA_MAX_EXPIRATIONS_PER_RUN 256
+/* timer wheel: one second ticks, a single ring of 2048 slots */
+#define ACL_FA_TIMER_INTERVAL 1.0
+#define ACL_FA_TIMER_MAX_TICKS 2047
+
+#define foreach_acl_fa_timeout                          \
+_(UDP_IDLE, udp_idle, "udp idle", 600)                  \
+_(TCP_IDLE, tcp_idle, "tcp idle", 3600 * 24)            \
+_(TCP_TRANSIENT, tcp_transient, "tcp transient", 120)
+
+typedef enum
+{
+#define _(sym, name, str, sec) ACL_TIMEOUT_##sym,
+  foreach_acl_fa_timeout
+#undef _
+    ACL_N_TIMEOUTS,
+} acl_fa_timeout_t;
+
+typedef struct
+{
+  /* 5-tuple of the packet which created the session, the hash key */
+  acl_5tuple_t info;
+  f64 last_active_time;
+  u32 timer_handle;
+  /* TCP flags seen, low byte forward direction, high byte reverse */
+  u16 tcp_flags_seen;
+  /* created by an output ACL */
+  u8 is_output;
+  u8 pad;
+} acl_fa_session_t;
+
+typedef struct
+{
+  CLIB_CACHE_LINE_ALIGN_MARK (cacheline0);
+  /* Session pool, preallocated so other workers can read it safely */
+  acl_fa_session_t *sessions;
+  clib_bihash_48_8_t session_hash;
+  tw_timer_wheel_2t_1w_2048sl_t timer_wheel;
+  /* Time of the current timer wheel run, for the expiry callback */
+  f64 now;
+
+  /* Counters */
+  u64 session_hits;
+  u64 session_misses;
+  u64 sessions_added;
+  u64 sessions_deleted;
+  u64 session_table_full;
+} acl_fa_per_worker_data_t;
+
+/*
+ * Extract the 5-tuple of an IP packet whose L3 header starts
+ * l3_offset bytes after the current data.
+ */
+always_inline void
+acl_fill_5tuple_l3 (vlib_buffer_t * b0, int l3_offset, int is_ip6,
+		    acl_5tuple_t * p5tuple, u32 * trace_bitmap)
+{
+  u8 *l3 = (u8 *) vlib_buffer_get_current (b0) + l3_offset;
+  u8 *l4;
+  u8 icmp_proto;
+
+  memset (p5tuple, 0, sizeof (*p5tuple));
+  if (is_ip6)
+    {
+      ip6_header_t *ip6 = (ip6_header_t *) l3;
+      clib_memcpy (&p5tuple->addr[0], &ip6->src_address, 16);
+      clib_memcpy (&p5tuple->addr[1], &ip6->dst_address, 16);
+      p5tuple->l4.proto = ip6->protocol;
+      p5tuple->l4.is_ip6 = 1;
+      l4 = l3 + sizeof (ip6_header_t);
+      icmp_proto = IP_PROTOCOL_ICMP6;
+    }
+  else
+    {
+      ip4_header_t *ip4 = (ip4_header_t *) l3;
+      p5tuple->addr[0].ip4 = ip4->src_address;
+      p5tuple->addr[1].ip4 = ip4->dst_address;
+      p5tuple->l4.proto = ip4->protocol;
+      /* Non-first fragments carry no L4 header */
+      if (PREDICT_FALSE (ip4_get_fragment_offset (ip4)))
+	return;
+      l4 = l3 + ip4_header_bytes (ip4);
+      icmp_proto = IP_PROTOCOL_ICMP;
+    }
+  if (p5tuple->l4.proto == icmp_proto)
+    {
+      *trace_bitmap |= is_ip6 ? 0x00000002 : 0x00000001;
+      /* type */
+      p5tuple->l4.port[0] = l4[0];
+      /* code */
+      p5tuple->l4.port[1] = l4[1];
+    }
+  else
+    {
+      /* assume TCP/UDP */
+      p5tuple->l4.port[0] = clib_net_to_host_u16 (*(u16 *) l4);
+      p5tuple->l4.port[1] = clib_net_to_host_u16 (*(u16 *) (l4 + 2));
+      /* UDP gets ability to check on an oddball data byte as a bonus */
+      p5tuple->l4.tcp_flags = l4[13];
+    }
+  p5tuple->l4.l4_valid = 1;
+}
+
+/*
+ * Non-first fragments carry no L4 header, neither does the part after
+ * the IPv6 fragment header as seen by acl_fill_5tuple_l3. Take the
+ * ports which virtual reassembly learned from the first fragment of
+ * the datagram. The info is only valid on the input arcs.
+ */
+always_inline void
+acl_fill_5tuple_reass (vlib_buffer_t * b0, int is_ip6,
+		       acl_5tuple_t * p5tuple)
+{
+  u8 proto = vnet_buffer (b0)->ip.reass.ip_proto;
+
+  if (!(b0->flags & VNET_BUFFER_L4_INFO_VALID))
+    return;
+  if (!vnet_buffer (b0)->ip.reass.is_non_first_fragment &&
+      !(is_ip6 && p5tuple->l4.proto == IP_PROTOCOL_IPV6_FRAGMENTATION))
+    return;
+  if (proto != IP_PROTOCOL_TCP && proto != IP_PROTOCOL_UDP)
+    return;
+
+  p5tuple->l4.proto = proto;
+  p5tuple->l4.port[0] =
+    clib_net_to_host_u16 (vnet_buffer (b0)->ip.reass.l4_src_port);
+  p5tuple->l4.port[1] =
+    clib_net_to_host_u16 (vnet_buffer (b0)->ip.reass.l4_dst_port);
+  p5tuple->l4.tcp_flags = 0;
+  p5tuple->l4.l4_valid = 1;
+}
+
+void acl_fa_enable_disable (u32 sw_if_index, int is_input,
+			    int enable_disable);
+
+#endif /* included_acl_fa_node_h */
+
+/*
+ * fd.io coding-style-patch-verification: ON
+ *
+ * Local Variables:
+ * eval: (c-set-style "gnu")
+ * End:
+ */
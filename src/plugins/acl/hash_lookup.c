@@ -0,0 +1,273 @@
+/*
+ *------------------------------------------------------------------
+ * hash_lookup.c - tuple-space search lookup for the ACL plugin
+ *
+ * Copyright (c) 2017 Cisco and/or its affiliates.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *------------------------------------------------------------------
+ */
+
+#include <vnet/vnet.h>
+#include <acl/acl.h>
+#include <acl/hash_lookup.h>
+
+static void
+hash_acl_make_address_mask (ip46_address_t * mask, int is_ip6, int prefixlen)
+{
+  memset (mask, 0, sizeof (*mask));
+  if (is_ip6)
+    {
+      if (prefixlen > 64)
+	{
+	  mask->as_u64[0] = ~0ULL;
+	  mask->as_u64[1] =
+	    clib_host_to_net_u64 (~0ULL << (128 - prefixlen));
+	}
+      else if (prefixlen > 0)
+	{
+	  mask->as_u64[0] = clib_host_to_net_u64 (~0ULL << (64 - prefixlen));
+	}
+    }
+  else
+    {
+      if (prefixlen > 0)
+	mask->ip4.as_u32 =
+	  clib_host_to_net_u32 (0xffffffff << (32 - prefixlen));
+    }
+}
+
+/*
+ * The mask type of a rule: addresses are masked by the prefix lengths,
+ * the protocol and the ports are either matched exactly or wildcarded.
+ * A port range is wildcarded here and checked on a hash hit.
+ */
+static void
+hash_acl_make_rule_mask (acl_rule_t * r, acl_5tuple_t * mask)
+{
+  memset (mask, 0, sizeof (*mask));
+  hash_acl_make_address_mask (&mask->addr[0], r->is_ipv6, r->src_prefixlen);
+  hash_acl_make_address_mask (&mask->addr[1], r->is_ipv6, r->dst_prefixlen);
+  mask->l4.is_ip6 = 0xff;
+  if (r->proto)
+    {
+      mask->l4.proto = 0xff;
+      if (r->src_port_or_type_first == r->src_port_or_type_last)
+	mask->l4.port[0] = 0xffff;
+      if (r->dst_port_or_code_first == r->dst_port_or_code_last)
+	mask->l4.port[1] = 0xffff;
+    }
+}
+
+static void
+hash_acl_make_rule_key (acl_rule_t * r, acl_5tuple_t * mask,
+			u32 mask_type_index, clib_bihash_kv_48_8_t * kv)
+{
+  acl_5tuple_t *key = (acl_5tuple_t *) & kv->key;
+  int i;
+
+  memset (key, 0, sizeof (*key));
+  key->addr[0] = r->src;
+  key->addr[1] = r->dst;
+  key->l4.proto = r->proto;
+  key->l4.is_ip6 = r->is_ipv6;
+  key->l4.port[0] = r->src_port_or_type_first;
+  key->l4.port[1] = r->dst_port_or_code_first;
+  for (i = 0; i < ARRAY_LEN (key->as_u64); i++)
+    key->as_u64[i] &= mask->as_u64[i];
+  key->pkt.mask_type_index = mask_type_index;
+}
+
+static u32
+hash_acl_find_or_add_mask_type (acl_hash_t * ha, acl_5tuple_t * mask,
+				u32 rule_index)
+{
+  acl_mask_type_t *mt;
+
+  vec_foreach (mt, ha->mask_types)
+  {
+    if (0 == memcmp (&mt->mask, mask, sizeof (*mask)))
+      {
+	mt->refcount++;
+	return mt - ha->mask_types;
+      }
+  }
+  /*
+   * The rules are walked in order, so the mask types are created
+   * already sorted by the index of the first rule using them.
+   */
+  vec_add2 (ha->mask_types, mt, 1);
+  mt->mask = *mask;
+  mt->first_rule_index = rule_index;
+  mt->refcount = 1;
+  return mt - ha->mask_types;
+}
+
+acl_hash_t *
+hash_acl_build (u32 acl_index, acl_rule_t * rules, u32 count)
+{
+  acl_hash_t *ha;
+  clib_bihash_kv_48_8_t kv, result;
+  acl_5tuple_t mask;
+  u32 mask_type_index;
+  u32 nbuckets;
+  uword memory_size;
+  u8 *name;
+  int i;
+
+  ha = clib_mem_alloc (sizeof (*ha));
+  if (!ha)
+    return 0;
+  memset (ha, 0, sizeof (*ha));
+
+  nbuckets = clib_max (64, count);
+  memory_size = (1 << 20) + (uword) count *1024;
+  name = format (0, "acl %d lookup%c", acl_index, 0);
+  clib_bihash_init_48_8 (&ha->hash, (char *) name, nbuckets, memory_size);
+
+  for (i = 0; i < count; i++)
+    {
+      acl_rule_t *r = &rules[i];
+
+      hash_acl_make_rule_mask (r, &mask);
+      mask_type_index = hash_acl_find_or_add_mask_type (ha, &mask, i);
+      hash_acl_make_rule_key (r, &mask, mask_type_index, &kv);
+
+      if (0 == clib_bihash_search_48_8 (&ha->hash, &kv, &result))
+	{
+	  /* same masked key as an earlier rule, chain it behind */
+	  vec_add1 (ha->entry_rules[result.value], i);
+	}
+      else
+	{
+	  kv.value = vec_len (ha->entry_rules);
+	  vec_validate (ha->entry_rules, kv.value);
+	  vec_add1 (ha->entry_rules[kv.value], i);
+	  clib_bihash_add_del_48_8 (&ha->hash, &kv, 1 /* is_add */ );
+	}
+    }
+  return ha;
+}
+
+void
+hash_acl_free (acl_hash_t * ha)
+{
+  u32 **entry;
+  u8 *name;
+
+  if (!ha)
+    return;
+
+  vec_foreach (entry, ha->entry_rules) vec_free (*entry);
+  vec_free (ha->entry_rules);
+  vec_free (ha->mask_types);
+  name = ha->hash.name;
+  clib_bihash_free_48_8 (&ha->hash);
+  vec_free (name);
+  clib_mem_free (ha);
+}
+
+/*
+ * The key matched, so the addresses, protocol and exact ports did.
+ * What is left are the port ranges and, for TCP rules only, the flags:
+ * a non-TCP rule ignores whatever tcp_flags_mask it was given.
+ */
+always_inline int
+hash_acl_rule_l4_match (acl_rule_t * r, acl_5tuple_t * pkt_5tuple)
+{
+  u16 sport = pkt_5tuple->l4.port[0];
+  u16 dport = pkt_5tuple->l4.port[1];
+
+  if (!r->proto)
+    return 1;
+  if (sport < r->src_port_or_type_first || sport > r->src_port_or_type_last)
+    return 0;
+  if (dport < r->dst_port_or_code_first || dport > r->dst_port_or_code_last)
+    return 0;
+  if (r->proto != IP_PROTOCOL_TCP)
+    return 1;
+  return ((pkt_5tuple->l4.tcp_flags & r->tcp_flags_mask) ==
+	  r->tcp_flags_value);
+}
+
+int
+hash_acl_match_5tuple (acl_hash_t * ha, acl_rule_t * rules,
+		       acl_5tuple_t * pkt_5tuple, u32 * r_rule_index)
+{
+  clib_bihash_kv_48_8_t kv, result;
+  acl_5tuple_t *key = (acl_5tuple_t *) & kv.key;
+  acl_mask_type_t *mt;
+  u32 best_rule_index = ~0;
+  u32 *rule_index;
+  int i;
+
+  vec_foreach (mt, ha->mask_types)
+  {
+    /* sorted: no rule behind this point can beat what we have */
+    if (mt->first_rule_index >= best_rule_index)
+      break;
+
+    for (i = 0; i < ARRAY_LEN (key->as_u64); i++)
+      kv.key[i] = pkt_5tuple->as_u64[i] & mt->mask.as_u64[i];
+    key->pkt.mask_type_index = mt - ha->mask_types;
+
+    if (clib_bihash_search_48_8 (&ha->hash, &kv, &result))
+      continue;
+
+    vec_foreach (rule_index, ha->entry_rules[result.value])
+    {
+      if (*rule_index >= best_rule_index)
+	break;
+      if (hash_acl_rule_l4_match (&rules[*rule_index], pkt_5tuple))
+	{
+	  best_rule_index = *rule_index;
+	  break;
+	}
+    }
+  }
+
+  if (~0 == best_rule_index)
+    return 0;
+
+  *r_rule_index = best_rule_index;
+  return 1;
+}
+
+u8 *
+format_acl_hash (u8 * s, va_list * args)
+{
+  acl_hash_t *ha = va_arg (*args, acl_hash_t *);
+  acl_mask_type_t *mt;
+
+  if (!ha)
+    return format (s, "linear lookup");
+
+  s = format (s, "tuple-space lookup: %d mask types, %d hash entries",
+	      vec_len (ha->mask_types), vec_len (ha->entry_rules));
+  vec_foreach (mt, ha->mask_types)
+  {
+    s = format (s, "\n  mask type %d: first rule %d, %d rules, "
+		"mask %016llx %016llx %016llx %016llx %016llx",
+		mt - ha->mask_types, mt->first_rule_index, mt->refcount,
+		mt->mask.as_u64[0], mt->mask.as_u64[1], mt->mask.as_u64[2],
+		mt->mask.as_u64[3], mt->mask.as_u64[4]);
+  }
+  return s;
+}
+
+/*
+ * fd.io coding-style-patch-verification: ON
+ *
+ * Local Variables:
+ * eval: (c-set-style "gnu")
+ * End:
+ */
@@ -0,0 +1,45 @@
+/*
+ * Copyright (c) 2017 Cisco and/or its affiliates.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef included_acl_hash_lookup_h
+#define included_acl_hash_lookup_h
+
+#include <acl/acl.h>
+
+/*
+ * Build the tuple-space search structure for a set of rules.
+ * Returns 0 if the structure could not be built, in which case
+ * the ACL keeps being evaluated by the linear walk.
+ */
+acl_hash_t *hash_acl_build (u32 acl_index, acl_rule_t * rules, u32 count);
+void hash_acl_free (acl_hash_t * ha);
+
+/*
+ * Return 1 and the index of the first matching rule if any rule
+ * of the ACL matches the packet 5-tuple, 0 otherwise.
+ */
+int hash_acl_match_5tuple (acl_hash_t * ha, acl_rule_t * rules,
+			   acl_5tuple_t * pkt_5tuple, u32 * r_rule_index);
+
+format_function_t format_acl_hash;
+
+#endif /* included_acl_hash_lookup_h */
+
+/*
+ * fd.io coding-style-patch-verification: ON
+ *
+ * Local Variables:
+ * eval: (c-set-style "gnu")
+ * End:
+ */
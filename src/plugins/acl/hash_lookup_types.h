@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) 2017 Cisco and/or its affiliates.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef included_acl_hash_lookup_types_h
+#define included_acl_hash_lookup_types_h
+
+#include <vppinfra/bihash_48_8.h>
+
+/*
+ * Tuple-space search over the rules of a single ACL.
+ *
+ * Each rule is reduced to a "mask type": the set of 5-tuple bits that
+ * the rule really looks at (prefix lengths, whether the protocol and the
+ * ports are exact values or wildcards). The rule is then inserted into a
+ * bihash under its masked 5-tuple, tagged with the mask type index.
+ *
+ * A lookup costs one hash probe per distinct mask type instead of one
+ * comparison per rule. Port ranges and TCP flags can not be expressed
+ * as masks, so rules using them are hashed with the ports wildcarded and
+ * checked in full on a hit.
+ */
+
+typedef union
+{
+  u64 as_u64[6];
+  struct
+  {
+    ip46_address_t addr[2];
+    union
+    {
+      struct
+      {
+	u16 port[2];
+	u8 proto;
+	u8 is_ip6;
+	u8 tcp_flags;
+	u8 l4_valid;
+      };
+      u64 as_u64;
+    } l4;
+    union
+    {
+      struct
+      {
+	u32 mask_type_index;
+	/* only set in the session table keys */
+	u32 sw_if_index;
+      };
+      u64 as_u64;
+    } pkt;
+  };
+} acl_5tuple_t;
+
+typedef struct
+{
+  /* which bits of the packet 5-tuple this mask type looks at */
+  acl_5tuple_t mask;
+  /* lowest rule index using this mask type, used to prune the search */
+  u32 first_rule_index;
+  /* number of rules using this mask type */
+  u32 refcount;
+} acl_mask_type_t;
+
+typedef struct
+{
+  /* sorted by ascending first_rule_index */
+  acl_mask_type_t *mask_types;
+  /* per hash entry: ascending vector of rule indices sharing the key */
+  u32 **entry_rules;
+  clib_bihash_48_8_t hash;
+} acl_hash_t;
+
+#endif /* included_acl_hash_lookup_types_h */
+
+/*
+ * fd.io coding-style-patch-verification: ON
+ *
+ * Local Variables:
+ * eval: (c-set-style "gnu")
+ * End:
+ */
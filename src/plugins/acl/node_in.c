@@ -63,79 +63,124 @@ static char *acl_in_error_strings[] = {
 #undef _
 };
 
+static_always_inline void
+acl_in_add_trace (vlib_main_t * vm, vlib_node_runtime_t * node,
+		   vlib_buffer_t * b0, u32 next0, u32 acl_match0,
+		   u32 rule_match0, u32 trace_bitmap0)
+{
+  acl_in_trace_t *t = vlib_add_trace (vm, node, b0, sizeof (*t));
+  t->sw_if_index = vnet_buffer (b0)->sw_if_index[VLIB_RX];
+  t->next_index = next0;
+  t->match_acl_index = acl_match0;
+  t->match_rule_index = rule_match0;
+  t->trace_bitmap = trace_bitmap0;
+}
+
 static uword
 acl_in_node_fn (vlib_main_t * vm,
 		vlib_node_runtime_t * node, vlib_frame_t * frame)
 {
   u32 n_left_from, *from, *to_next;
   acl_in_next_t next_index;
-  u32 pkts_acl_checked = 0;
-  u32 feature_bitmap0;
-  u32 trace_bitmap = 0;
-  u32 *input_feat_next_node_index =
-    acl_main.acl_in_node_feat_next_node_index;
+  u32 nexts[VLIB_FRAME_SIZE];
+  u32 acl_match[VLIB_FRAME_SIZE];
+  u32 rule_match[VLIB_FRAME_SIZE];
+  u32 trace_bitmap[VLIB_FRAME_SIZE];
+  u32 *next;
+  int is_traced = node->flags & VLIB_NODE_FLAG_TRACE;
 
   from = vlib_frame_vector_args (frame);
   n_left_from = frame->n_vectors;
   next_index = node->cached_next_index;
 
+  /* Classify the whole frame up front, then just enqueue */
+  acl_packet_match_batch (vm, from, n_left_from, 1 /* is_input */ , nexts,
+			  acl_match, rule_match, trace_bitmap);
+  next = nexts;
+
   while (n_left_from > 0)
     {
       u32 n_left_to_next;
 
       vlib_get_next_frame (vm, node, next_index, to_next, n_left_to_next);
 
-      while (n_left_from > 0 && n_left_to_next > 0)
+      while (n_left_from >= 4 && n_left_to_next >= 4)
 	{
-	  u32 bi0;
-	  vlib_buffer_t *b0;
-	  u32 next0 = ~0;
-	  u32 sw_if_index0;
-	  u32 next = ~0;
-	  u32 match_acl_index = ~0;
-	  u32 match_rule_index = ~0;
+	  u32 bi0, bi1, bi2, bi3;
+	  u32 next0, next1, next2, next3;
+
+	  /* speculatively enqueue b0..b3 to the current next frame */
+	  to_next[0] = bi0 = from[0];
+	  to_next[1] = bi1 = from[1];
+	  to_next[2] = bi2 = from[2];
+	  to_next[3] = bi3 = from[3];
+	  next0 = next[0];
+	  next1 = next[1];
+	  next2 = next[2];
+	  next3 = next[3];
+	  next0 = next0 < node->n_next_nodes ? next0 : 0;
+	  next1 = next1 < node->n_next_nodes ? next1 : 0;
+	  next2 = next2 < node->n_next_nodes ? next2 : 0;
+	  next3 = next3 < node->n_next_nodes ? next3 : 0;
 
-	  /* speculatively enqueue b0 to the current next frame */
-	  bi0 = from[0];
-	  to_next[0] = bi0;
-	  from += 1;
-	  to_next += 1;
-	  n_left_from -= 1;
-	  n_left_to_next -= 1;
+	  if (PREDICT_FALSE (is_traced))
+	    {
+	      /* trace the next nodes actually enqueued to */
+	      u32 next4[4] = { next0, next1, next2, next3 };
+	      vlib_buffer_t *b;
+	      u32 j;
+
+	      for (j = 0; j < 4; j++)
+		{
+		  b = vlib_get_buffer (vm, from[j]);
+		  if (b->flags & VLIB_BUFFER_IS_TRACED)
+		    {
+		      u32 k = next - nexts + j;
+		      acl_in_add_trace (vm, node, b, next4[j], acl_match[k],
+					rule_match[k], trace_bitmap[k]);
+		    }
+		}
+	    }
 
-	  b0 = vlib_get_buffer (vm, bi0);
+	  from += 4;
+	  to_next += 4;
+	  next += 4;
+	  n_left_from -= 4;
+	  n_left_to_next -= 4;
 
+	  /* verify speculative enqueues, maybe switch current next frame */
+	  vlib_validate_buffer_enqueue_x4 (vm, node, next_index,
+					   to_next, n_left_to_next,
+					   bi0, bi1, bi2, bi3,
+					   next0, next1, next2, next3);
+	}
 
-	  sw_if_index0 = vnet_buffer (b0)->sw_if_index[VLIB_RX];
-	  feature_bitmap0 = vnet_buffer (b0)->l2.feature_bitmap;
+      while (n_left_from > 0 && n_left_to_next > 0)
+	{
+	  u32 bi0;
+	  u32 next0;
 
-	  input_acl_packet_match (sw_if_index0, b0, &next, &match_acl_index,
-				  &match_rule_index, &trace_bitmap);
-	  if (next != ~0)
-	    {
-	      next0 = next;
-	    }
-	  if (next0 == ~0)
-	    {
-	      next0 =
-		feat_bitmap_get_next_node_index (input_feat_next_node_index,
-						 feature_bitmap0);
-	    }
+	  /* speculatively enqueue b0 to the current next frame */
+	  to_next[0] = bi0 = from[0];
+	  next0 = next[0];
+	  next0 = next0 < node->n_next_nodes ? next0 : 0;
 
-	  if (PREDICT_FALSE ((node->flags & VLIB_NODE_FLAG_TRACE)
-			     && (b0->flags & VLIB_BUFFER_IS_TRACED)))
+	  if (PREDICT_FALSE (is_traced))
 	    {
-	      acl_in_trace_t *t = vlib_add_trace (vm, node, b0, sizeof (*t));
-	      t->sw_if_index = sw_if_index0;
-	      t->next_index = next0;
-	      t->match_acl_index = match_acl_index;
-	      t->match_rule_index = match_rule_index;
-	      t->trace_bitmap = trace_bitmap;
+	      vlib_buffer_t *b0 = vlib_get_buffer (vm, bi0);
+	      if (b0->flags & VLIB_BUFFER_IS_TRACED)
+		{
+		  u32 k = next - nexts;
+		  acl_in_add_trace (vm, node, b0, next0, acl_match[k],
+				    rule_match[k], trace_bitmap[k]);
+		}
 	    }
 
-	  next0 = next0 < node->n_next_nodes ? next0 : 0;
-
-	  pkts_acl_checked += 1;
+	  from += 1;
+	  to_next += 1;
+	  next += 1;
+	  n_left_from -= 1;
+	  n_left_to_next -= 1;
 
 	  /* verify speculative enqueue, maybe switch current next frame */
 	  vlib_validate_buffer_enqueue_x1 (vm, node, next_index,
@@ -147,7 +192,7 @@ acl_in_node_fn (vlib_main_t * vm,
     }
 
   vlib_node_increment_counter (vm, acl_in_node.index,
-			       ACL_IN_ERROR_ACL_CHECK, pkts_acl_checked);
+			       ACL_IN_ERROR_ACL_CHECK, frame->n_vectors);
   return frame->n_vectors;
 }
 
@@ -20,6 +20,8 @@
 
 #include <vnet/ethernet/ethernet.h>
 #include <dpdk/device/dpdk.h>
+#include <rte_ip.h>
+#include <rte_tcp.h>
 
 #include <dpdk/device/dpdk_priv.h>
 #include <vppinfra/error.h>
@@ -197,6 +199,48 @@ dpdk_validate_rte_mbuf (vlib_main_t * vm, vlib_buffer_t * b,
     }
 }
 
+/*
+ * Ask the nic to segment GSO packets. Everything else is sent without
+ * offloads, mbufs may still carry flags from a previous use.
+ */
+static_always_inline void
+dpdk_buffer_tx_offload (dpdk_device_t * xd, vlib_buffer_t * b,
+			struct rte_mbuf *mb)
+{
+  u8 *l3;
+  struct tcp_hdr *th;
+
+  if (PREDICT_TRUE (!(b->flags & VNET_BUFFER_GSO)))
+    {
+      mb->ol_flags = 0;
+      return;
+    }
+
+  mb->l2_len = vnet_buffer (b)->ip.save_rewrite_length;
+  mb->l4_len = vnet_buffer2 (b)->gso_l4_hdr_sz;
+  mb->tso_segsz = vnet_buffer2 (b)->gso_size;
+  l3 = vlib_buffer_get_current (b) + mb->l2_len;
+
+  if ((l3[0] & 0xF0) == 0x40)
+    {
+      struct ipv4_hdr *ip4 = (struct ipv4_hdr *) l3;
+      mb->l3_len = (ip4->version_ihl & IPV4_HDR_IHL_MASK)
+	* IPV4_IHL_MULTIPLIER;
+      mb->ol_flags = PKT_TX_TCP_SEG | PKT_TX_IPV4 | PKT_TX_IP_CKSUM;
+      ip4->hdr_checksum = 0;
+      th = (struct tcp_hdr *) (l3 + mb->l3_len);
+      th->cksum = rte_ipv4_phdr_cksum (ip4, mb->ol_flags);
+    }
+  else
+    {
+      struct ipv6_hdr *ip6 = (struct ipv6_hdr *) l3;
+      mb->l3_len = sizeof (struct ipv6_hdr);
+      mb->ol_flags = PKT_TX_TCP_SEG | PKT_TX_IPV6;
+      th = (struct tcp_hdr *) (l3 + mb->l3_len);
+      th->cksum = rte_ipv6_phdr_cksum (ip6, mb->ol_flags);
+    }
+}
+
 /*
  * This function calls the dpdk's tx_burst function to transmit the packets
  * on the tx_vector. It manages a lock per-device if the device does not
@@ -471,6 +515,14 @@ dpdk_interface_tx (vlib_main_t * vm,
       mb2 = rte_mbuf_from_vlib_buffer (b2);
       mb3 = rte_mbuf_from_vlib_buffer (b3);
 
+      if (PREDICT_FALSE (xd->flags & DPDK_DEVICE_FLAG_TX_OFFLOAD))
+	{
+	  dpdk_buffer_tx_offload (xd, b0, mb0);
+	  dpdk_buffer_tx_offload (xd, b1, mb1);
+	  dpdk_buffer_tx_offload (xd, b2, mb2);
+	  dpdk_buffer_tx_offload (xd, b3, mb3);
+	}
+
       if (PREDICT_FALSE (or_flags & VLIB_BUFFER_RECYCLE))
 	{
 	  dpdk_buffer_recycle (vm, node, b0, bi0, &mb0);
@@ -537,6 +589,8 @@ dpdk_interface_tx (vlib_main_t * vm,
       dpdk_validate_rte_mbuf (vm, b0, 1);
 
       mb0 = rte_mbuf_from_vlib_buffer (b0);
+      if (PREDICT_FALSE (xd->flags & DPDK_DEVICE_FLAG_TX_OFFLOAD))
+	dpdk_buffer_tx_offload (xd, b0, mb0);
       dpdk_buffer_recycle (vm, node, b0, bi0, &mb0);
 
       if (PREDICT_FALSE (node->flags & VLIB_NODE_FLAG_TRACE))
@@ -178,6 +178,7 @@ typedef struct
 #define DPDK_DEVICE_FLAG_MAYBE_MULTISEG     (1 << 4)
 #define DPDK_DEVICE_FLAG_HAVE_SUBIF         (1 << 5)
 #define DPDK_DEVICE_FLAG_HQOS               (1 << 6)
+#define DPDK_DEVICE_FLAG_TX_OFFLOAD         (1 << 7)
 
   u16 nb_tx_desc;
     CLIB_CACHE_LINE_ALIGN_MARK (cacheline1);
@@ -284,6 +285,10 @@ typedef struct
 #define DPDK_DEVICE_VLAN_STRIP_DEFAULT 0
 #define DPDK_DEVICE_VLAN_STRIP_OFF 1
 #define DPDK_DEVICE_VLAN_STRIP_ON  2
+  u8 tso;
+#define DPDK_DEVICE_TSO_DEFAULT 0
+#define DPDK_DEVICE_TSO_OFF 1
+#define DPDK_DEVICE_TSO_ON  2
 
 #define _(x) uword x;
     foreach_dpdk_device_config_item
@@ -1036,6 +1036,21 @@ dpdk_lib_init (dpdk_main_t * dm)
       vec_validate_aligned (xd->d_trace_buffers, tm->n_vlib_mains,
 			    CLIB_CACHE_LINE_BYTES);
 
+      /* TCP segmentation offload, needs multi-segment tx for the large
+         buffer chains handed over by the stack. The tx queues are set up
+         with these flags, so decide before dpdk_port_setup */
+      if (devconf->tso == DPDK_DEVICE_TSO_ON)
+	{
+	  if ((dev_info.tx_offload_capa & DEV_TX_OFFLOAD_TCP_TSO)
+	      && !(xd->tx_conf.txq_flags & ETH_TXQ_FLAGS_NOMULTSEGS))
+	    {
+	      xd->tx_conf.txq_flags &= ~ETH_TXQ_FLAGS_NOOFFLOADS;
+	      xd->flags |= DPDK_DEVICE_FLAG_TX_OFFLOAD;
+	    }
+	  else
+	    clib_warning ("TSO cannot be supported by interface\n");
+	}
+
       rv = dpdk_port_setup (dm, xd);
 
       if (rv)
@@ -1093,6 +1108,9 @@ dpdk_lib_init (dpdk_main_t * dm)
 	    clib_warning ("VLAN strip cannot be supported by interface\n");
 	}
 
+      if (xd->flags & DPDK_DEVICE_FLAG_TX_OFFLOAD)
+	hi->flags |= VNET_HW_INTERFACE_FLAG_SUPPORTS_GSO;
+
       hi->max_l3_packet_bytes[VLIB_RX] = hi->max_l3_packet_bytes[VLIB_TX] =
 	xd->port_conf.rxmode.max_rx_pkt_len - sizeof (ethernet_header_t);
 
@@ -1242,6 +1260,10 @@ dpdk_device_config (dpdk_config_main_t * conf, vlib_pci_addr_t pci_addr,
 	devconf->vlan_strip_offload = DPDK_DEVICE_VLAN_STRIP_OFF;
       else if (unformat (input, "vlan-strip-offload on"))
 	devconf->vlan_strip_offload = DPDK_DEVICE_VLAN_STRIP_ON;
+      else if (unformat (input, "tso off"))
+	devconf->tso = DPDK_DEVICE_TSO_OFF;
+      else if (unformat (input, "tso on"))
+	devconf->tso = DPDK_DEVICE_TSO_ON;
       else
 	if (unformat
 	    (input, "hqos %U", unformat_vlib_cli_sub_input, &sub_input))
@@ -32,6 +32,7 @@ memif_create_command_fn (vlib_main_t * vm, unformat_input_t * input,
   unformat_input_t _line_input, *line_input = &_line_input;
   int r;
   u32 ring_size = MEMIF_DEFAULT_RING_SIZE;
+  u32 rx_queues = 1, tx_queues = 1;
   memif_create_if_args_t args = { 0 };
   args.buffer_size = MEMIF_DEFAULT_BUFFER_SIZE;
 
@@ -49,10 +50,16 @@ memif_create_command_fn (vlib_main_t * vm, unformat_input_t * input,
 	;
       else if (unformat (line_input, "buffer-size %u", &args.buffer_size))
 	;
+      else if (unformat (line_input, "rx-queues %u", &rx_queues))
+	;
+      else if (unformat (line_input, "tx-queues %u", &tx_queues))
+	;
       else if (unformat (line_input, "master"))
 	args.is_master = 1;
       else if (unformat (line_input, "slave"))
 	args.is_master = 0;
+      else if (unformat (line_input, "zero-copy"))
+	args.zero_copy = 1;
       else if (unformat (line_input, "hw-addr %U",
 			 unformat_ethernet_address, args.hw_addr))
 	args.hw_addr_set = 1;
@@ -67,6 +74,15 @@ memif_create_command_fn (vlib_main_t * vm, unformat_input_t * input,
 
   args.log2_ring_size = min_log2 (ring_size);
 
+  if (rx_queues < 1 || rx_queues > 255 || tx_queues < 1 || tx_queues > 255)
+    return clib_error_return (0, "number of queues must be 1 - 255");
+
+  if (args.is_master && (rx_queues != 1 || tx_queues != 1))
+    return clib_error_return (0, "the number of queues is set by the slave");
+
+  args.rx_queues = rx_queues;
+  args.tx_queues = tx_queues;
+
   r = memif_create_if (vm, &args);
 
   if (r <= VNET_API_ERROR_SYSCALL_ERROR_1
@@ -79,6 +95,13 @@ memif_create_command_fn (vlib_main_t * vm, unformat_input_t * input,
   if (r == VNET_API_ERROR_SUBIF_ALREADY_EXISTS)
     return clib_error_return (0, "Interface already exists");
 
+  if (r == VNET_API_ERROR_INVALID_ARGUMENT)
+    return clib_error_return (0, "zero-copy is only supported on master");
+
+  if (r == VNET_API_ERROR_UNIMPLEMENTED)
+    return clib_error_return (0, "zero-copy needs fake dma pages "
+			      "(no dpdk, physmem no-huge)");
+
   return 0;
 }
 
@@ -87,7 +110,7 @@ VLIB_CLI_COMMAND (memif_create_command, static) = {
   .path = "create memif",
   .short_help = "create memif [key <key>] [socket <path>] "
                 "[ring-size <size>] [buffer-size <size>] [hw-addr <mac-address>] "
-		"<master|slave>",
+		"<master [zero-copy]|slave [rx-queues <n>] [tx-queues <n>]>",
   .function = memif_create_command_fn,
 };
 /* *INDENT-ON* */
@@ -130,6 +153,50 @@ VLIB_CLI_COMMAND (memif_delete_command, static) = {
 };
 /* *INDENT-ON* */
 
+static u8 *
+format_memif_rx_mode (u8 * s, va_list * args)
+{
+  memif_rx_mode_t mode = va_arg (*args, int);
+  char *t = 0;
+
+  switch (mode)
+    {
+#define _(v,f,str) case MEMIF_RX_MODE_##f: t = str; break;
+      foreach_memif_rx_mode
+#undef _
+    default:
+      return format (s, "unknown");
+    }
+  return format (s, "%s", t);
+}
+
+static uword
+unformat_memif_rx_mode (unformat_input_t * input, va_list * args)
+{
+  memif_rx_mode_t *mode = va_arg (*args, memif_rx_mode_t *);
+
+  if (0);
+#define _(v,f,str) else if (unformat (input, str)) *mode = MEMIF_RX_MODE_##f;
+  foreach_memif_rx_mode
+#undef _
+  else
+    return 0;
+  return 1;
+}
+
+static u8 *
+format_memif_rx_placement (u8 * s, va_list * args)
+{
+  memif_if_t *mif = va_arg (*args, memif_if_t *);
+  memif_ring_type_t type = va_arg (*args, int);
+  int i = va_arg (*args, int);
+
+  if (type != memif_rx_ring_type (mif) || i >= vec_len (mif->rx_queue_cpu))
+    return s;
+
+  return format (s, " rx on thread %u", mif->rx_queue_cpu[i]);
+}
+
 static clib_error_t *
 memif_show_command_fn (vlib_main_t * vm, unformat_input_t * input,
 		       vlib_cli_command_t * cmd)
@@ -153,12 +220,19 @@ memif_show_command_fn (vlib_main_t * vm, unformat_input_t * input,
 			mif->num_s2m_rings,
 			mif->num_m2s_rings,
 			mif->buffer_size);
+       vlib_cli_output (vm, "  rx-mode %U", format_memif_rx_mode,
+			mif->rx_mode);
+       if (vec_len (mif->regions) > MEMIF_BUFFER_REGION)
+	 vlib_cli_output (vm, "  zero-copy buffer region %U",
+			  format_memory_size, mif->buffer_region_size);
        for (i=0; i < mif->num_s2m_rings; i++)
          {
 	   memif_ring_t * ring = memif_get_ring (mif, MEMIF_RING_S2M, i);
 	   if (ring)
 	     {
-	       vlib_cli_output (vm, "  slave-to-master ring %u:", i);
+	       vlib_cli_output (vm, "  slave-to-master ring %u:%U", i,
+				format_memif_rx_placement, mif,
+				MEMIF_RING_S2M, i);
 	       vlib_cli_output (vm, "    head %u tail %u", ring->head, ring->tail);
 	     }
 	 }
@@ -167,7 +241,9 @@ memif_show_command_fn (vlib_main_t * vm, unformat_input_t * input,
 	   memif_ring_t * ring = memif_get_ring (mif, MEMIF_RING_M2S, i);
 	   if (ring)
 	     {
-	       vlib_cli_output (vm, "  master-to-slave ring %u:", i);
+	       vlib_cli_output (vm, "  master-to-slave ring %u:%U", i,
+				format_memif_rx_placement, mif,
+				MEMIF_RING_M2S, i);
 	       vlib_cli_output (vm, "    head %u tail %u", ring->head, ring->tail);
 	     }
 	 }
@@ -185,6 +261,164 @@ VLIB_CLI_COMMAND (memif_show_command, static) = {
 };
 /* *INDENT-ON* */
 
+static clib_error_t *
+memif_set_placement_command_fn (vlib_main_t * vm, unformat_input_t * input,
+				vlib_cli_command_t * cmd)
+{
+  unformat_input_t _line_input, *line_input = &_line_input;
+  memif_main_t *mm = &memif_main;
+  vnet_main_t *vnm = vnet_get_main ();
+  vnet_hw_interface_t *hw;
+  u32 hw_if_index = ~0;
+  u32 queue = 0;
+  u32 cpu = ~0;
+  clib_error_t *error = 0;
+  int r;
+
+  if (!unformat_user (input, unformat_line_input, line_input))
+    return 0;
+
+  while (unformat_check_input (line_input) != UNFORMAT_END_OF_INPUT)
+    {
+      if (unformat (line_input, "%U", unformat_vnet_hw_interface, vnm,
+		    &hw_if_index))
+	;
+      else if (unformat (line_input, "queue %u", &queue))
+	;
+      else if (unformat (line_input, "thread %u", &cpu))
+	;
+      else
+	{
+	  error = clib_error_return (0, "unknown input `%U'",
+				     format_unformat_error, line_input);
+	  goto done;
+	}
+    }
+
+  if (hw_if_index == ~0)
+    {
+      error = clib_error_return (0, "please specify valid interface name");
+      goto done;
+    }
+
+  hw = vnet_get_hw_interface (vnm, hw_if_index);
+  if (hw->dev_class_index != memif_device_class.index)
+    {
+      error = clib_error_return (0, "not a memif interface");
+      goto done;
+    }
+
+  r = memif_set_rx_placement (vm, pool_elt_at_index (mm->interfaces,
+						       hw->dev_instance),
+			      queue, cpu);
+
+  if (r == VNET_API_ERROR_INVALID_VALUE)
+    error = clib_error_return (0, "unknown queue %u", queue);
+  else if (r == VNET_API_ERROR_INVALID_WORKER)
+    error = clib_error_return (0, "please specify valid thread id");
+
+done:
+  unformat_free (line_input);
+  return error;
+}
+
+/*?
+ * Assign a receive queue of a memif interface to a thread. Queues are
+ * spread over the input threads when the interface connects; the
+ * assignment is kept across reconnects. The queue defaults to 0.
+ *
+ * @cliexpar
+ * Example of how to move queue 1 of memif0 to thread 2:
+ * @cliexcmd{set memif placement memif0 queue 1 thread 2}
+?*/
+/* *INDENT-OFF* */
+VLIB_CLI_COMMAND (memif_set_placement_command, static) = {
+  .path = "set memif placement",
+  .short_help = "set memif placement <interface> [queue <n>] thread <n>",
+  .function = memif_set_placement_command_fn,
+};
+/* *INDENT-ON* */
+
+static clib_error_t *
+memif_set_rx_mode_command_fn (vlib_main_t * vm, unformat_input_t * input,
+			      vlib_cli_command_t * cmd)
+{
+  unformat_input_t _line_input, *line_input = &_line_input;
+  memif_main_t *mm = &memif_main;
+  vnet_main_t *vnm = vnet_get_main ();
+  vnet_hw_interface_t *hw;
+  memif_rx_mode_t mode = ~0;
+  u32 hw_if_index = ~0;
+  clib_error_t *error = 0;
+
+  if (!unformat_user (input, unformat_line_input, line_input))
+    return 0;
+
+  while (unformat_check_input (line_input) != UNFORMAT_END_OF_INPUT)
+    {
+      if (unformat (line_input, "%U", unformat_vnet_hw_interface, vnm,
+		    &hw_if_index))
+	;
+      else if (unformat (line_input, "%U", unformat_memif_rx_mode, &mode))
+	;
+      else
+	{
+	  error = clib_error_return (0, "unknown input `%U'",
+				     format_unformat_error, line_input);
+	  goto done;
+	}
+    }
+
+  if (hw_if_index == ~0)
+    {
+      error = clib_error_return (0, "please specify valid interface name");
+      goto done;
+    }
+
+  hw = vnet_get_hw_interface (vnm, hw_if_index);
+  if (hw->dev_class_index != memif_device_class.index)
+    {
+      error = clib_error_return (0, "not a memif interface");
+      goto done;
+    }
+
+  if (mode == ~0)
+    {
+      error = clib_error_return (0, "please specify rx mode");
+      goto done;
+    }
+
+  memif_set_rx_mode (vm, pool_elt_at_index (mm->interfaces, hw->dev_instance),
+		     mode);
+
+done:
+  unformat_free (line_input);
+  return error;
+}
+
+/*?
+ * Select how a memif interface receives packets. In '<em>polling</em>'
+ * mode the rings are polled continuously and the peer does not signal
+ * the interrupt line. In '<em>interrupt</em>' mode a ring is only read
+ * after the peer has signalled it. In '<em>adaptive</em>' mode, the
+ * default, the main thread sleeps until signalled and switches to
+ * polling, with signalling turned off, while the vector rate is high.
+ * Worker threads poll rings in adaptive mode. A worker whose rings are
+ * all in interrupt mode only checks a flag raised by the main thread,
+ * and reads its rings once the peer has signalled one of them.
+ *
+ * @cliexpar
+ * Example of how to put memif0 into interrupt mode:
+ * @cliexcmd{set memif rx-mode memif0 interrupt}
+?*/
+/* *INDENT-OFF* */
+VLIB_CLI_COMMAND (memif_set_rx_mode_command, static) = {
+  .path = "set memif rx-mode",
+  .short_help = "set memif rx-mode <interface> <polling|interrupt|adaptive>",
+  .function = memif_set_rx_mode_command_fn,
+};
+/* *INDENT-ON* */
+
 clib_error_t *
 memif_cli_init (vlib_main_t * vm)
 {
@@ -29,6 +29,8 @@
 
 #define foreach_memif_tx_func_error	       \
 _(NO_FREE_SLOTS, "no free tx slots")           \
+_(NO_FREE_BUFFERS, "no free zero-copy buffers") \
+_(NOT_CONNECTED, "interface not connected")    \
 _(PENDING_MSGS, "pending msgs in tx ring")
 
 typedef enum
@@ -79,20 +81,20 @@ format_memif_tx_trace (u8 * s, va_list * args)
 }
 
 static_always_inline void
-memif_interface_lock (memif_if_t * mif)
+memif_ring_lock (memif_if_t * mif, memif_ring_data_t * rd)
 {
-  if (PREDICT_FALSE (mif->lockp != 0))
+  if (PREDICT_FALSE (mif->flags & MEMIF_IF_FLAG_TX_LOCK))
     {
-      while (__sync_lock_test_and_set (mif->lockp, 1))
+      while (__sync_lock_test_and_set (&rd->lock, 1))
 	;
     }
 }
 
 static_always_inline void
-memif_interface_unlock (memif_if_t * mif)
+memif_ring_unlock (memif_if_t * mif, memif_ring_data_t * rd)
 {
-  if (PREDICT_FALSE (mif->lockp != 0))
-    *mif->lockp = 0;
+  if (PREDICT_FALSE (mif->flags & MEMIF_IF_FLAG_TX_LOCK))
+    __sync_lock_release (&rd->lock);
 }
 
 static_always_inline void
@@ -106,10 +108,10 @@ memif_prefetch_buffer_and_data (vlib_main_t * vm, u32 bi)
 static_always_inline uword
 memif_interface_tx_inline (vlib_main_t * vm, vlib_node_runtime_t * node,
 			   vlib_frame_t * frame, memif_if_t * mif,
-			   memif_ring_type_t type)
+			   memif_ring_type_t type, u16 rid)
 {
-  u8 rid = 0;
   memif_ring_t *ring = memif_get_ring (mif, type, rid);
+  memif_ring_data_t *rd = memif_get_ring_data (mif, type, rid);
   u32 *buffers = vlib_frame_args (frame);
   u32 n_left = frame->n_vectors;
   u16 ring_size = 1 << mif->log2_ring_size;
@@ -117,7 +119,7 @@ memif_interface_tx_inline (vlib_main_t * vm, vlib_node_runtime_t * node,
   u16 head, tail;
   u16 free_slots;
 
-  memif_interface_lock (mif);
+  memif_ring_lock (mif, rd);
 
   /* free consumed buffers */
 
@@ -210,7 +212,124 @@ memif_interface_tx_inline (vlib_main_t * vm, vlib_node_runtime_t * node,
   CLIB_MEMORY_STORE_BARRIER ();
   ring->head = head;
 
-  memif_interface_unlock (mif);
+  memif_ring_unlock (mif, rd);
+
+  if (n_left)
+    vlib_error_count (vm, node->node_index, MEMIF_TX_ERROR_NO_FREE_SLOTS,
+		      n_left);
+
+  vlib_buffer_free (vm, vlib_frame_args (frame), frame->n_vectors);
+  /* pairs with the barrier in memif_ring_mask_interrupts () */
+  CLIB_MEMORY_BARRIER ();
+  if ((ring->flags & MEMIF_RING_FLAG_MASK_INT) == 0 &&
+      mif->interrupt_line.fd > 0)
+    {
+      u8 b = rid;
+      CLIB_UNUSED (int r) = write (mif->interrupt_line.fd, &b, sizeof (b));
+    }
+
+  return frame->n_vectors;
+}
+
+/*
+ * Zero-copy master tx: descriptors point at the vlib buffers themselves,
+ * which stay in the ring until the slave has consumed them. Only buffers
+ * of the region shared with the slave can be posted, others are copied
+ * into one first.
+ */
+static_always_inline uword
+memif_interface_tx_zc_inline (vlib_main_t * vm, vlib_node_runtime_t * node,
+			      vlib_frame_t * frame, memif_if_t * mif,
+			      memif_ring_type_t type, u16 rid)
+{
+  memif_ring_t *ring = memif_get_ring (mif, type, rid);
+  memif_ring_data_t *rd = memif_get_ring_data (mif, type, rid);
+  u32 *buffers = vlib_frame_args (frame);
+  u32 n_left = frame->n_vectors;
+  u16 ring_size = 1 << mif->log2_ring_size;
+  u16 mask = ring_size - 1;
+  u16 head, tail, n_free;
+  u16 free_slots;
+  u32 copies[VLIB_FRAME_SIZE];
+  u32 n_copies = 0, n_used = 0, n_dropped = 0;
+  u32 bi0;
+
+  memif_ring_lock (mif, rd);
+
+  /* free consumed buffers */
+  head = ring->head;
+  tail = ring->tail;
+
+  while (rd->last_tail != tail)
+    {
+      n_free = (tail > rd->last_tail ? tail : ring_size) - rd->last_tail;
+      vlib_buffer_free (vm, rd->buffers + rd->last_tail, n_free);
+      memset (rd->buffers + rd->last_tail, 0xff, n_free * sizeof (u32));
+      rd->last_tail = (rd->last_tail + n_free) & mask;
+    }
+
+  /* keep one slot open so that a full ring is not seen as empty */
+  free_slots = ring_size - 1 - ((head - tail) & mask);
+
+  while (n_left && free_slots)
+    {
+      vlib_buffer_t *b0 = vlib_get_buffer (vm, buffers[0]);
+      memif_desc_t *d0 = &ring->desc[head];
+
+      if (n_left > 2)
+	vlib_prefetch_buffer_header (vlib_get_buffer (vm, buffers[2]), LOAD);
+
+      bi0 = buffers[0];
+      if (PREDICT_FALSE (!memif_buffer_in_region (mif, b0)))
+	{
+	  vlib_buffer_t *c0;
+
+	  if (n_used == n_copies)
+	    {
+	      n_copies = memif_buffer_alloc (vm, mif, copies,
+					     clib_min (n_left, free_slots));
+	      n_used = 0;
+	    }
+	  if (n_used == n_copies)
+	    {
+	      vlib_buffer_free_one (vm, bi0);
+	      n_dropped++;
+	      buffers++;
+	      n_left--;
+	      continue;
+	    }
+	  bi0 = copies[n_used++];
+	  c0 = vlib_get_buffer (vm, bi0);
+	  clib_memcpy (c0->data, vlib_buffer_get_current (b0),
+		       b0->current_length);
+	  c0->current_data = 0;
+	  c0->current_length = b0->current_length;
+	  vlib_buffer_free_one (vm, buffers[0]);
+	  b0 = c0;
+	}
+
+      d0->region = MEMIF_BUFFER_REGION;
+      d0->offset = memif_buffer_offset (mif, vlib_buffer_get_current (b0));
+      d0->length = d0->buffer_length = b0->current_length;
+      rd->buffers[head] = bi0;
+      head = (head + 1) & mask;
+
+      buffers++;
+      n_left--;
+      free_slots--;
+    }
+
+  CLIB_MEMORY_STORE_BARRIER ();
+  ring->head = head;
+
+  memif_ring_unlock (mif, rd);
+
+  if (n_used < n_copies)
+    vlib_buffer_free (vm, copies + n_used, n_copies - n_used);
+
+  if (n_dropped)
+    vlib_error_count (vm, node->node_index, MEMIF_TX_ERROR_NO_FREE_BUFFERS,
+		      n_dropped);
 
   if (n_left)
     {
@@ -219,8 +338,10 @@ memif_interface_tx_inline (vlib_main_t * vm, vlib_node_runtime_t * node,
       vlib_buffer_free (vm, buffers, n_left);
     }
 
-  vlib_buffer_free (vm, vlib_frame_args (frame), frame->n_vectors);
-  if (mif->interrupt_line.fd > 0)
+  /* pairs with the barrier in memif_ring_mask_interrupts () */
+  CLIB_MEMORY_BARRIER ();
+  if ((ring->flags & MEMIF_RING_FLAG_MASK_INT) == 0 &&
+      mif->interrupt_line.fd > 0)
     {
       u8 b = rid;
       CLIB_UNUSED (int r) = write (mif->interrupt_line.fd, &b, sizeof (b));
@@ -237,10 +358,24 @@ memif_interface_tx (vlib_main_t * vm,
   vnet_interface_output_runtime_t *rund = (void *) node->runtime_data;
   memif_if_t *mif = pool_elt_at_index (nm->interfaces, rund->dev_instance);
 
-  if (mif->flags & MEMIF_IF_FLAG_IS_SLAVE)
-    return memif_interface_tx_inline (vm, node, frame, mif, MEMIF_RING_S2M);
+  memif_ring_type_t type = memif_tx_ring_type (mif);
+  u16 rid;
+
+  if (PREDICT_FALSE ((mif->flags & MEMIF_IF_FLAG_CONNECTED) == 0))
+    {
+      vlib_error_count (vm, node->node_index, MEMIF_TX_ERROR_NOT_CONNECTED,
+			frame->n_vectors);
+      vlib_buffer_free (vm, vlib_frame_args (frame), frame->n_vectors);
+      return frame->n_vectors;
+    }
+
+  /* one ring per thread, shared under a lock if there are too few */
+  rid = os_get_cpu_number () % memif_num_rings (mif, type);
+
+  if (type == MEMIF_RING_M2S && (mif->flags & MEMIF_IF_FLAG_ZERO_COPY))
+    return memif_interface_tx_zc_inline (vm, node, frame, mif, type, rid);
   else
-    return memif_interface_tx_inline (vm, node, frame, mif, MEMIF_RING_M2S);
+    return memif_interface_tx_inline (vm, node, frame, mif, type, rid);
 }
 
 static void
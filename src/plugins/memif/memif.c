@@ -67,31 +67,323 @@ memif_remove_pending_conn (
   pool_put (mm->pending_conns, pending_conn);
 }
 
+/*
+ * The main thread is woken up by the interrupt line; it polls memif-input
+ * only when it serves a ring in polling mode, otherwise vlib switches the
+ * node between interrupt and polling mode by vector rate. Workers cannot
+ * be sent node interrupts from the main thread, so memif-input keeps
+ * running on a worker which serves rx rings. If none of them is polled,
+ * it returns after one load of a per-thread flag, which the main thread
+ * raises when the interrupt line fires for one of the worker's rings.
+ */
+static void
+memif_update_input_node_state (void)
+{
+  memif_main_t *mm = &memif_main;
+  vlib_thread_main_t *tm = vlib_get_thread_main ();
+  vlib_node_runtime_t *rt;
+  vlib_main_t *this_vm;
+  memif_if_t *mif;
+  uword *polling = 0, *serving = 0;
+  u32 *cpu;
+  int i, run;
+
+  clib_bitmap_alloc (polling, tm->n_vlib_mains);
+  clib_bitmap_alloc (serving, tm->n_vlib_mains);
+
+  /* *INDENT-OFF* */
+  pool_foreach (mif, mm->interfaces,
+    ({
+      if (mif->flags & MEMIF_IF_FLAG_CONNECTED)
+	vec_foreach (cpu, mif->rx_queue_cpu)
+	  {
+	    serving = clib_bitmap_set (serving, cpu[0], 1);
+	    /* workers cannot switch modes, adaptive rings are polled */
+	    if (mif->rx_mode == MEMIF_RX_MODE_POLLING ||
+		(cpu[0] != 0 && mif->rx_mode == MEMIF_RX_MODE_ADAPTIVE))
+	      polling = clib_bitmap_set (polling, cpu[0], 1);
+	  }
+    }));
+  /* *INDENT-ON* */
+
+  for (i = 0; i < tm->n_vlib_mains; i++)
+    {
+      this_vm = i ? vlib_mains[i] : &vlib_global_main;
+      mm->per_thread[i].polling = clib_bitmap_get (polling, i);
+      run = clib_bitmap_get (i ? serving : polling, i);
+      vlib_node_set_state (this_vm, memif_input_node.index,
+			   run ? VLIB_NODE_STATE_POLLING :
+			   VLIB_NODE_STATE_INTERRUPT);
+      /* start over with vlib adaptive mode */
+      rt = vlib_node_get_runtime (this_vm, memif_input_node.index);
+      rt->flags &= ~(VLIB_NODE_FLAG_SWITCH_FROM_INTERRUPT_TO_POLLING_MODE |
+		     VLIB_NODE_FLAG_SWITCH_FROM_POLLING_TO_INTERRUPT_MODE);
+    }
+
+  clib_bitmap_free (polling);
+  clib_bitmap_free (serving);
+}
+
+static void
+memif_init_rx_rings (memif_if_t * mif)
+{
+  memif_ring_type_t type = memif_rx_ring_type (mif);
+  int i;
+
+  for (i = 0; i < memif_num_rings (mif, type); i++)
+    {
+      memif_get_ring_data (mif, type, i)->int_pending = 0;
+      memif_ring_mask_interrupts (memif_get_ring (mif, type, i),
+				  mif->rx_mode == MEMIF_RX_MODE_POLLING);
+    }
+}
+
+int
+memif_set_rx_mode (vlib_main_t * vm, memif_if_t * mif, memif_rx_mode_t mode)
+{
+  mif->rx_mode = mode;
+  if (mif->flags & MEMIF_IF_FLAG_CONNECTED)
+    memif_init_rx_rings (mif);
+  memif_update_input_node_state ();
+  return 0;
+}
+
+int
+memif_set_rx_placement (vlib_main_t * vm, memif_if_t * mif, u32 qid,
+			u32 cpu_index)
+{
+  memif_main_t *mm = &memif_main;
+
+  if (qid >= vec_len (mif->rx_queue_cpu))
+    return VNET_API_ERROR_INVALID_VALUE;
+
+  if (cpu_index < mm->input_cpu_first_index ||
+      cpu_index >= mm->input_cpu_first_index + mm->input_cpu_count)
+    return VNET_API_ERROR_INVALID_WORKER;
+
+  mif->rx_queue_cpu[qid] = cpu_index;
+  memif_update_input_node_state ();
+  return 0;
+}
+
 static void
 memif_connect (vlib_main_t * vm, memif_if_t * mif)
 {
+  memif_main_t *mm = &memif_main;
+  vlib_thread_main_t *tm = vlib_get_thread_main ();
   vnet_main_t *vnm = vnet_get_main ();
   int num_rings = mif->num_s2m_rings + mif->num_m2s_rings;
+  memif_ring_type_t rx_type = memif_rx_ring_type (mif);
+  memif_ring_type_t tx_type = memif_tx_ring_type (mif);
+  u8 num_rx_rings = memif_num_rings (mif, rx_type);
   memif_ring_data_t *rd = NULL;
+  u32 *cpu;
 
   vec_validate_aligned (mif->ring_data, num_rings - 1, CLIB_CACHE_LINE_BYTES);
   vec_foreach (rd, mif->ring_data)
   {
     rd->last_head = 0;
+    rd->last_tail = 0;
+    rd->lock = 0;
+  }
+  memif_init_rx_rings (mif);
+
+  /* each thread gets its own tx ring if there are enough of them */
+  if (memif_num_rings (mif, tx_type) < tm->n_vlib_mains)
+    mif->flags |= MEMIF_IF_FLAG_TX_LOCK;
+  else
+    mif->flags &= ~MEMIF_IF_FLAG_TX_LOCK;
+
+  /* spread rx rings over input threads, keeping earlier placement */
+  vec_validate_init_empty (mif->rx_queue_cpu, num_rx_rings - 1, ~0);
+  _vec_len (mif->rx_queue_cpu) = num_rx_rings;
+  vec_foreach (cpu, mif->rx_queue_cpu)
+  {
+    if (cpu[0] == ~0)
+      cpu[0] = mm->input_cpu_first_index +
+	(mif->if_index + (cpu - mif->rx_queue_cpu)) % mm->input_cpu_count;
   }
 
   mif->flags &= ~MEMIF_IF_FLAG_CONNECTING;
   mif->flags |= MEMIF_IF_FLAG_CONNECTED;
+  memif_update_input_node_state ();
   vnet_hw_interface_set_flags (vnm, mif->hw_if_index,
 			       VNET_HW_INTERFACE_FLAG_LINK_UP);
 }
 
+/*
+ * Set aside the buffers shared with a zero-copy slave: a page aligned
+ * chunk of physmem is remapped onto a memfd, carved into vlib buffers and
+ * given a free list of its own. Only that memfd is handed to the slave.
+ */
+static int
+memif_buffer_region_init (vlib_main_t * vm, memif_if_t * mif, u32 n_buffers)
+{
+  uword page_size = clib_mem_get_page_size ();
+  vlib_buffer_free_list_t *fl;
+  vlib_buffer_t *b;
+  u32 buffer_bytes, i;
+  void *region;
+  uword size;
+  int fd;
+
+  if (mif->buffer_region)
+    return n_buffers <= mif->n_region_buffers ? 0 : -1;
+
+  buffer_bytes = sizeof (vlib_buffer_t) +
+    vlib_buffer_round_size (VLIB_BUFFER_DATA_SIZE);
+  size = round_pow2 ((uword) n_buffers * buffer_bytes, page_size);
+
+  if ((fd = memfd_create ("memif buffers", 0)) < 0)
+    {
+      DEBUG_UNIX_LOG ("memfd_create");
+      return -1;
+    }
+
+  if (ftruncate (fd, size) < 0)
+    {
+      DEBUG_UNIX_LOG ("ftruncate");
+      close (fd);
+      return -1;
+    }
+
+  region = vm->os_physmem_alloc_aligned (&vm->physmem_main, size, page_size);
+  if (region == 0)
+    {
+      DEBUG_LOG ("Failed to allocate %U of buffer memory",
+		 format_memory_size, size);
+      close (fd);
+      return -1;
+    }
+
+  if (mmap (region, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED,
+	    fd, 0) == MAP_FAILED)
+    {
+      DEBUG_UNIX_LOG ("mmap buffer memory");
+      vm->os_physmem_free (region);
+      close (fd);
+      return -1;
+    }
+
+  /* new free lists must be seen by all threads */
+  vlib_worker_thread_barrier_sync (vm);
+  mif->buffer_free_list_index =
+    vlib_buffer_create_free_list (vm, VLIB_BUFFER_DATA_SIZE,
+				  "memif%u zero-copy", mif->if_index);
+  vlib_worker_thread_barrier_release (vm);
+
+  fl = vlib_buffer_get_free_list (vm, mif->buffer_free_list_index);
+  for (i = 0; i < n_buffers; i++)
+    {
+      b = region + i * buffer_bytes;
+      vlib_buffer_init_for_free_list (b, fl);
+      vec_add1 (mif->region_buffers, vlib_get_buffer_index (vm, b));
+    }
+
+  mif->buffer_region = region;
+  mif->buffer_region_size = size;
+  mif->buffer_region_fd = fd;
+  mif->n_region_buffers = n_buffers;
+  return 0;
+}
+
+static void
+memif_buffer_region_free (vlib_main_t * vm, memif_if_t * mif)
+{
+  int i;
+
+  if (mif->buffer_region == 0)
+    return;
+
+  vlib_worker_thread_barrier_sync (vm);
+
+  for (i = 0; i < vec_len (vlib_mains); i++)
+    memif_buffer_collect (vlib_mains[i], mif);
+
+  /* buffers still queued somewhere would come back to a freed list */
+  if (vec_len (mif->region_buffers) != mif->n_region_buffers)
+    {
+      clib_warning ("memif%u: %u zero-copy buffers still in use, "
+		    "keeping their memory", mif->if_index,
+		    mif->n_region_buffers - vec_len (mif->region_buffers));
+      vlib_worker_thread_barrier_release (vm);
+      return;
+    }
+
+  vlib_buffer_delete_free_list (vm, mif->buffer_free_list_index);
+  vlib_worker_thread_barrier_release (vm);
+
+  /* give the physmem heap back private memory */
+  mmap (mif->buffer_region, mif->buffer_region_size, PROT_READ | PROT_WRITE,
+	MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
+  vm->os_physmem_free (mif->buffer_region);
+  close (mif->buffer_region_fd);
+  vec_free (mif->region_buffers);
+  mif->buffer_region = 0;
+  mif->buffer_region_size = 0;
+  mif->buffer_region_fd = -1;
+  mif->n_region_buffers = 0;
+}
+
+static int
+memif_zero_copy_init (vlib_main_t * vm, memif_if_t * mif)
+{
+  int num_rings = mif->num_s2m_rings + mif->num_m2s_rings;
+  u16 ring_size = 1 << mif->log2_ring_size;
+  memif_ring_data_t *rd;
+  memif_ring_t *ring;
+  vlib_buffer_t *b;
+  int i, j;
+
+  vec_validate_aligned (mif->ring_data, num_rings - 1, CLIB_CACHE_LINE_BYTES);
+  vec_foreach (rd, mif->ring_data)
+  {
+    vec_validate_init_empty (rd->buffers, ring_size - 1, ~0);
+    rd->last_tail = 0;
+  }
+
+  /* post empty buffers for the slave to fill */
+  for (i = 0; i < mif->num_s2m_rings; i++)
+    {
+      ring = memif_get_ring (mif, MEMIF_RING_S2M, i);
+      rd = vec_elt_at_index (mif->ring_data, i);
+      if (memif_buffer_alloc (vm, mif, rd->buffers, ring_size) != ring_size)
+	return -1;
+      for (j = 0; j < ring_size; j++)
+	{
+	  b = vlib_get_buffer (vm, rd->buffers[j]);
+	  ring->desc[j].region = MEMIF_BUFFER_REGION;
+	  ring->desc[j].offset = memif_buffer_offset (mif, b->data);
+	  ring->desc[j].buffer_length = memif_buffer_posted_length (mif);
+	}
+    }
+
+  /* master-to-slave descriptors are pointed at vlib buffers on tx */
+  return 0;
+}
+
+static void
+memif_zero_copy_free (vlib_main_t * vm, memif_if_t * mif)
+{
+  memif_ring_data_t *rd;
+  int i;
+
+  vec_foreach (rd, mif->ring_data)
+  {
+    for (i = 0; i < vec_len (rd->buffers); i++)
+      if (rd->buffers[i] != ~0)
+	vlib_buffer_free_one (vm, rd->buffers[i]);
+    vec_free (rd->buffers);
+  }
+}
+
 static void
 memif_disconnect (vlib_main_t * vm, memif_if_t * mif)
 {
   vnet_main_t *vnm = vnet_get_main ();
 
   mif->flags &= ~(MEMIF_IF_FLAG_CONNECTED | MEMIF_IF_FLAG_CONNECTING);
+  memif_update_input_node_state ();
   if (mif->hw_if_index != ~0)
     vnet_hw_interface_set_flags (vnm, mif->hw_if_index, 0);
 
@@ -110,6 +402,12 @@ memif_disconnect (vlib_main_t * vm, memif_if_t * mif)
       mif->connection.fd = -1;		/* closed in unix_file_del */
     }
 
+  memif_zero_copy_free (vm, mif);
+
+  if ((mif->flags & MEMIF_IF_FLAG_IS_SLAVE) &&
+      vec_len (mif->regions) > MEMIF_BUFFER_REGION)
+    munmap (mif->regions[MEMIF_BUFFER_REGION], mif->buffer_region_size);
+
   // TODO: properly munmap + close memif-owned shared memory segments
   vec_free (mif->regions);
 }
@@ -126,6 +424,10 @@ memif_process_connect_req (memif_pending_conn_t * pending_conn,
   memif_if_t *mif = 0;
   memif_msg_t resp = { 0 };
   unix_file_t template = { 0 };
+  struct msghdr mh = { 0 };
+  struct iovec iov[1];
+  struct cmsghdr *cmsg;
+  char ctl[CMSG_SPACE (sizeof (int))] = { 0 };
   void *shm;
   uword *p;
   u8 retval = 0;
@@ -229,7 +531,33 @@ memif_process_connect_req (memif_pending_conn_t * pending_conn,
   mif->buffer_size = req->buffer_size;
   mif->remote_pid = slave_cr->pid;
   mif->remote_uid = slave_cr->uid;
+
+  /* rings live in the slave's segment, so register it before posting
+     buffers in them */
   vec_add1 (mif->regions, shm);
+  if (mif->flags & MEMIF_IF_FLAG_ZERO_COPY)
+    {
+      /* posted buffers, those in flight and a frame of refills per ring */
+      u32 n_buffers =
+	((mif->num_s2m_rings + mif->num_m2s_rings) << mif->log2_ring_size) +
+	mif->num_s2m_rings * VLIB_FRAME_SIZE;
+      int rv = memif_buffer_region_init (vm, mif, n_buffers);
+
+      if (rv == 0)
+	{
+	  vec_add1 (mif->regions, mif->buffer_region);
+	  rv = memif_zero_copy_init (vm, mif);
+	}
+      if (rv)
+	{
+	  DEBUG_LOG ("Failed to allocate zero-copy buffers");
+	  memif_zero_copy_free (vm, mif);
+	  munmap (shm, req->shared_mem_size);
+	  vec_free (mif->regions);
+	  retval = 12;
+	  goto response;
+	}
+    }
 
   /* register interrupt line */
   mif->interrupt_line.fd = int_fd;
@@ -251,32 +579,80 @@ response:
   resp.version = MEMIF_VERSION;
   resp.type = MEMIF_MSG_TYPE_CONNECT_RESP;
   resp.retval = retval;
-  send (fd, &resp, sizeof (resp), 0);
+  iov[0].iov_base = (void *) &resp;
+  iov[0].iov_len = sizeof (memif_msg_t);
+  mh.msg_iov = iov;
+  mh.msg_iovlen = 1;
+
+  /* hand over vlib buffer memory */
+  if (retval == 0 && (mif->flags & MEMIF_IF_FLAG_ZERO_COPY))
+    {
+      int region_fd = mif->buffer_region_fd;
+      resp.flags |= MEMIF_MSG_FLAG_ZERO_COPY;
+      resp.buffer_region_size = mif->buffer_region_size;
+      mh.msg_control = ctl;
+      mh.msg_controllen = sizeof (ctl);
+      cmsg = CMSG_FIRSTHDR (&mh);
+      cmsg->cmsg_len = CMSG_LEN (sizeof (region_fd));
+      cmsg->cmsg_level = SOL_SOCKET;
+      cmsg->cmsg_type = SCM_RIGHTS;
+      clib_memcpy (CMSG_DATA (cmsg), &region_fd, sizeof (region_fd));
+    }
+  sendmsg (fd, &mh, 0);
   return error;
 }
 
 static clib_error_t *
-memif_process_connect_resp (memif_if_t * mif, memif_msg_t * resp)
+memif_process_connect_resp (memif_if_t * mif, memif_msg_t * resp,
+			    int region_fd)
 {
   vlib_main_t *vm = vlib_get_main ();
+  void *region;
 
   if ((mif->flags & MEMIF_IF_FLAG_IS_SLAVE) == 0)
     {
       DEBUG_LOG ("Memif master does not accept connection responses");
-      return 0;
+      goto done;
     }
 
   if ((mif->flags & MEMIF_IF_FLAG_CONNECTING) == 0)
     {
       DEBUG_LOG ("Unexpected connection response");
-      return 0;
+      goto done;
     }
 
-  if (resp->retval == 0)
-    memif_connect (vm, mif);
-  else
-    memif_disconnect (vm, mif);
+  if (resp->retval != 0)
+    {
+      memif_disconnect (vm, mif);
+      goto done;
+    }
 
+  if (resp->flags & MEMIF_MSG_FLAG_ZERO_COPY)
+    {
+      if (region_fd == -1)
+	{
+	  DEBUG_LOG ("Zero-copy response is missing buffer memory");
+	  memif_disconnect (vm, mif);
+	  goto done;
+	}
+      if ((region = mmap (NULL, resp->buffer_region_size,
+			  PROT_READ | PROT_WRITE, MAP_SHARED, region_fd,
+			  0)) == MAP_FAILED)
+	{
+	  DEBUG_UNIX_LOG ("Failed to map buffer memory of memif master");
+	  memif_disconnect (vm, mif);
+	  goto done;
+	}
+      ASSERT (vec_len (mif->regions) == MEMIF_BUFFER_REGION);
+      vec_add1 (mif->regions, region);
+      mif->buffer_region_size = resp->buffer_region_size;
+    }
+
+  memif_connect (vm, mif);
+
+done:
+  if (region_fd != -1)
+    close (region_fd);
   return 0;
 }
 
@@ -333,6 +709,25 @@ memif_conn_fd_read_ready (unix_file_t * uf)
       goto disconnect;
     }
 
+  /* Read anciliary data */
+  cmsg = CMSG_FIRSTHDR (&mh);
+  while (cmsg)
+    {
+      if (cmsg->cmsg_level == SOL_SOCKET
+	  && cmsg->cmsg_type == SCM_CREDENTIALS)
+	{
+	  cr = (struct ucred *) CMSG_DATA (cmsg);
+	}
+      else if (cmsg->cmsg_level == SOL_SOCKET
+	       && cmsg->cmsg_type == SCM_RIGHTS)
+	{
+	  clib_memcpy (fd_array, CMSG_DATA (cmsg),
+		       clib_min (sizeof (fd_array),
+				 cmsg->cmsg_len - CMSG_LEN (0)));
+	}
+      cmsg = CMSG_NXTHDR (&mh, cmsg);
+    }
+
   /* process the message based on its type */
   switch (msg.type)
     {
@@ -343,23 +738,6 @@ memif_conn_fd_read_ready (unix_file_t * uf)
 	  return 0;
 	}
 
-      /* Read anciliary data */
-      cmsg = CMSG_FIRSTHDR (&mh);
-      while (cmsg)
-	{
-	  if (cmsg->cmsg_level == SOL_SOCKET
-	      && cmsg->cmsg_type == SCM_CREDENTIALS)
-	    {
-	      cr = (struct ucred *) CMSG_DATA (cmsg);
-	    }
-	  else if (cmsg->cmsg_level == SOL_SOCKET
-		   && cmsg->cmsg_type == SCM_RIGHTS)
-	    {
-	      clib_memcpy (fd_array, CMSG_DATA (cmsg), sizeof (fd_array));
-	    }
-	  cmsg = CMSG_NXTHDR (&mh, cmsg);
-	}
-
       return memif_process_connect_req (pending_conn, &msg, cr,
 					fd_array[0], fd_array[1]);
 
@@ -369,7 +747,7 @@ memif_conn_fd_read_ready (unix_file_t * uf)
 	  DEBUG_LOG ("Received unexpected connection response");
 	  return 0;
 	}
-      return memif_process_connect_resp (mif, &msg);
+      return memif_process_connect_resp (mif, &msg, fd_array[0]);
 
     case MEMIF_MSG_TYPE_DISCONNECT:
       goto disconnect;
@@ -395,10 +773,12 @@ memif_int_fd_read_ready (unix_file_t * uf)
   memif_main_t *mm = &memif_main;
   vlib_main_t *vm = vlib_get_main ();
   memif_if_t *mif = vec_elt_at_index (mm->interfaces, uf->private_data);
-  u8 b;
+  u8 b[64];
   ssize_t size;
+  int i, main_pending = 0;
+  u32 cpu;
 
-  size = read (uf->file_descriptor, &b, sizeof (b));
+  size = read (uf->file_descriptor, b, sizeof (b));
   if (0 == size)
     {
       /* interrupt line was disconnected */
@@ -407,7 +787,29 @@ memif_int_fd_read_ready (unix_file_t * uf)
       mif->interrupt_line.index = ~0;
       mif->interrupt_line.fd = -1;
     }
-  vlib_node_set_interrupt_pending (vm, memif_input_node.index);
+
+  /* each byte carries the number of the ring the peer enqueued to */
+  if ((mif->flags & MEMIF_IF_FLAG_CONNECTED) == 0)
+    return 0;
+  for (i = 0; i < size; i++)
+    {
+      if (b[i] >= vec_len (mif->rx_queue_cpu))
+	continue;
+      memif_get_ring_data (mif, memif_rx_ring_type (mif),
+			   b[i])->int_pending = 1;
+      cpu = mif->rx_queue_cpu[b[i]];
+      if (cpu == 0)
+	main_pending = 1;
+      else
+	{
+	  /* pairs with the barrier in memif_input_fn () */
+	  CLIB_MEMORY_BARRIER ();
+	  vec_elt (mm->per_thread, cpu).int_pending = 1;
+	}
+    }
+
+  if (main_pending)
+    vlib_node_set_interrupt_pending (vm, memif_input_node.index);
   return 0;
 }
 
@@ -694,6 +1096,7 @@ memif_close_if (memif_main_t * mm, memif_if_t * mif)
   memif_pending_conn_t *pending_conn = 0;
 
   memif_disconnect (vm, mif);
+  memif_buffer_region_free (vm, mif);
 
   if (mif->listener_index != (uword)~0)
     {
@@ -719,15 +1122,10 @@ memif_close_if (memif_main_t * mm, memif_if_t * mif)
 	}
     }
 
-  if (mif->lockp != 0)
-    {
-      clib_mem_free ((void *) mif->lockp);
-      mif->lockp = 0;
-    }
-
   mhash_unset (&mm->if_index_by_key, &mif->key, &mif->if_index);
   vec_free (mif->socket_filename);
   vec_free (mif->ring_data);
+  vec_free (mif->rx_queue_cpu);
 
   memset (mif, 0, sizeof (*mif));
   pool_put (mm->interfaces, mif);
@@ -764,7 +1162,6 @@ int
 memif_create_if (vlib_main_t * vm, memif_create_if_args_t * args)
 {
   memif_main_t *mm = &memif_main;
-  vlib_thread_main_t *tm = vlib_get_thread_main ();
   vnet_main_t *vnm = vnet_get_main ();
   memif_if_t *mif = 0;
   vnet_sw_interface_t *sw;
@@ -776,6 +1173,21 @@ memif_create_if (vlib_main_t * vm, memif_create_if_args_t * args)
   if (p)
     return VNET_API_ERROR_SUBIF_ALREADY_EXISTS;
 
+  if (args->zero_copy)
+    {
+      /* only the master shares its buffer memory */
+      if (!args->is_master)
+	return VNET_API_ERROR_INVALID_ARGUMENT;
+
+      /* shared buffers are remapped over fake dma pages */
+      if (vm->buffer_main->extern_buffer_mgmt)
+	return VNET_API_ERROR_UNIMPLEMENTED;
+      if (vm->os_physmem_alloc_aligned == 0)
+	unix_physmem_init (vm, 0 /* fail_if_physical_memory_not_present */ );
+      if (!unix_physmem_is_fake (vm))
+	return VNET_API_ERROR_UNIMPLEMENTED;
+    }
+
   pool_get (mm->interfaces, mif);
   memset (mif, 0, sizeof (*mif));
   mif->key = args->key;
@@ -784,13 +1196,7 @@ memif_create_if (vlib_main_t * vm, memif_create_if_args_t * args)
   mif->listener_index = ~0;
   mif->connection.index = mif->interrupt_line.index = ~0;
   mif->connection.fd = mif->interrupt_line.fd = -1;
-
-  if (tm->n_vlib_mains > 1)
-    {
-      mif->lockp = clib_mem_alloc_aligned (CLIB_CACHE_LINE_BYTES,
-					   CLIB_CACHE_LINE_BYTES);
-      memset ((void *) mif->lockp, 0, CLIB_CACHE_LINE_BYTES);
-    }
+  mif->buffer_region_fd = -1;
 
   if (!args->hw_addr_set)
     {
@@ -821,10 +1227,13 @@ memif_create_if (vlib_main_t * vm, memif_create_if_args_t * args)
 
   mif->log2_ring_size = args->log2_ring_size;
   mif->buffer_size = args->buffer_size;
+  mif->rx_mode = MEMIF_RX_MODE_ADAPTIVE;
+  if (args->zero_copy)
+    mif->flags |= MEMIF_IF_FLAG_ZERO_COPY;
 
-  /* TODO: make configurable */
-  mif->num_s2m_rings = 1;
-  mif->num_m2s_rings = 1;
+  /* the slave picks the number of rings, the master follows */
+  mif->num_s2m_rings = clib_max (args->tx_queues, 1);
+  mif->num_m2s_rings = clib_max (args->rx_queues, 1);
 
   mhash_set_mem (&mm->if_index_by_key, &args->key, &mif->if_index, 0);
 
@@ -1019,6 +1428,8 @@ memif_init (vlib_main_t * vm)
 
   vec_validate_aligned (mm->rx_buffers, tm->n_vlib_mains - 1,
 			CLIB_CACHE_LINE_BYTES);
+  vec_validate_aligned (mm->per_thread, tm->n_vlib_mains - 1,
+			CLIB_CACHE_LINE_BYTES);
 
   /* set default socket filename */
   vec_validate (mm->default_socket_filename,
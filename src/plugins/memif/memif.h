@@ -19,7 +19,7 @@ typedef struct
 {
   u16 version;
 #define MEMIF_VERSION_MAJOR 0
-#define MEMIF_VERSION_MINOR 1
+#define MEMIF_VERSION_MINOR 3
 #define MEMIF_VERSION ((MEMIF_VERSION_MAJOR << 8) | MEMIF_VERSION_MINOR)
   u8 type;
 #define MEMIF_MSG_TYPE_CONNECT_REQ  0
@@ -38,6 +38,9 @@ typedef struct
 
   /* Connection-response parameters: */
   u8 retval;
+  u8 flags;
+#define MEMIF_MSG_FLAG_ZERO_COPY (1 << 0)
+  u64 buffer_region_size;
 } memif_msg_t;
 
 typedef struct __attribute__ ((packed))
@@ -54,10 +57,17 @@ typedef struct __attribute__ ((packed))
 
 STATIC_ASSERT_SIZEOF (memif_desc_t, 32);
 
+/* In zero-copy mode the master shares a pool of vlib buffers set aside
+   for the interface as region 1 and descriptors point straight into them */
+#define MEMIF_BUFFER_REGION 1
+
 typedef struct
 {
   u16 head __attribute__ ((aligned (128)));
   u16 tail __attribute__ ((aligned (128)));
+  /* written by the receiver, like the tail */
+  u16 flags;
+#define MEMIF_RING_FLAG_MASK_INT (1 << 0)
   memif_desc_t desc[0] __attribute__ ((aligned (128)));
 } memif_ring_t;
 
@@ -69,8 +79,18 @@ typedef struct
 
 typedef struct
 {
+  CLIB_CACHE_LINE_ALIGN_MARK (cacheline0);
   u16 last_head;
   u16 last_tail;
+
+  /* taken on tx when threads share the ring */
+  volatile u32 lock;
+
+  /* rx: peer has signalled the interrupt line */
+  volatile u8 int_pending;
+
+  /* zero-copy: vlib buffer posted in each slot, ~0 if none */
+  u32 *buffers;
 } memif_ring_data_t;
 
 typedef struct
@@ -95,16 +115,29 @@ typedef struct
   uword listener_index;
 } memif_pending_conn_t;
 
+#define foreach_memif_rx_mode		\
+  _(0, POLLING, "polling")		\
+  _(1, INTERRUPT, "interrupt")		\
+  _(2, ADAPTIVE, "adaptive")
+
+typedef enum
+{
+#define _(v,f,s) MEMIF_RX_MODE_##f = v,
+  foreach_memif_rx_mode
+#undef _
+} memif_rx_mode_t;
+
 typedef struct
 {
   CLIB_CACHE_LINE_ALIGN_MARK (cacheline0);
-  volatile u32 *lockp;
   u32 flags;
 #define MEMIF_IF_FLAG_ADMIN_UP   (1 << 0)
 #define MEMIF_IF_FLAG_IS_SLAVE   (1 << 1)
 #define MEMIF_IF_FLAG_CONNECTING (1 << 2)
 #define MEMIF_IF_FLAG_CONNECTED  (1 << 3)
 #define MEMIF_IF_FLAG_DELETING   (1 << 4)
+#define MEMIF_IF_FLAG_ZERO_COPY  (1 << 5)
+#define MEMIF_IF_FLAG_TX_LOCK    (1 << 6)
 
   u64 key;
   uword if_index;
@@ -119,6 +152,16 @@ typedef struct
   u8 *socket_filename;
 
   void **regions;
+  uword buffer_region_size;
+
+  /* zero-copy master: vlib buffers carved from a memfd shared with the
+     slave, returned by vlib to their own free list */
+  void *buffer_region;
+  int buffer_region_fd;
+  u32 buffer_free_list_index;
+  u32 n_region_buffers;
+  volatile u32 buffer_lock;
+  u32 *region_buffers;
 
   u8 log2_ring_size;
   u8 num_s2m_rings;
@@ -127,11 +170,24 @@ typedef struct
 
   memif_ring_data_t *ring_data;
 
+  /* thread polling each rx ring */
+  u32 *rx_queue_cpu;
+  memif_rx_mode_t rx_mode;
+
   /* remote info */
   pid_t remote_pid;
   uid_t remote_uid;
 } memif_if_t;
 
+typedef struct
+{
+  CLIB_CACHE_LINE_ALIGN_MARK (cacheline0);
+  /* the thread serves an rx ring which has to be polled */
+  u8 polling;
+  /* worker: the main thread took an interrupt for one of its rings */
+  volatile u8 int_pending;
+} memif_per_thread_t;
+
 typedef struct
 {
   CLIB_CACHE_LINE_ALIGN_MARK (cacheline0);
@@ -154,6 +210,8 @@ typedef struct
   /* rx buffer cache */
   u32 **rx_buffers;
 
+  memif_per_thread_t *per_thread;
+
   /* hash of all registered keys */
   mhash_t if_index_by_key;
 
@@ -187,6 +245,9 @@ typedef struct
   u16 buffer_size;
   u8 hw_addr_set;
   u8 hw_addr[6];
+  u8 zero_copy;
+  u8 rx_queues;
+  u8 tx_queues;
 
   /* return */
   u32 sw_if_index;
@@ -194,6 +255,10 @@ typedef struct
 
 int memif_create_if (vlib_main_t * vm, memif_create_if_args_t * args);
 int memif_delete_if (vlib_main_t * vm, u64 key);
+int memif_set_rx_placement (vlib_main_t * vm, memif_if_t * mif, u32 qid,
+			    u32 cpu_index);
+int memif_set_rx_mode (vlib_main_t * vm, memif_if_t * mif,
+		       memif_rx_mode_t mode);
 clib_error_t *memif_plugin_api_hookup (vlib_main_t * vm);
 
 #ifndef __NR_memfd_create
@@ -235,6 +300,48 @@ memif_get_ring (memif_if_t * mif, memif_ring_type_t type, u16 ring_num)
   return (memif_ring_t *) p;
 }
 
+static_always_inline memif_ring_data_t *
+memif_get_ring_data (memif_if_t * mif, memif_ring_type_t type, u16 ring_num)
+{
+  return vec_elt_at_index (mif->ring_data,
+			   ring_num + type * mif->num_s2m_rings);
+}
+
+static_always_inline memif_ring_type_t
+memif_rx_ring_type (memif_if_t * mif)
+{
+  return (mif->flags & MEMIF_IF_FLAG_IS_SLAVE) ? MEMIF_RING_M2S :
+    MEMIF_RING_S2M;
+}
+
+static_always_inline memif_ring_type_t
+memif_tx_ring_type (memif_if_t * mif)
+{
+  return (mif->flags & MEMIF_IF_FLAG_IS_SLAVE) ? MEMIF_RING_S2M :
+    MEMIF_RING_M2S;
+}
+
+static_always_inline u8
+memif_num_rings (memif_if_t * mif, memif_ring_type_t type)
+{
+  return type == MEMIF_RING_S2M ? mif->num_s2m_rings : mif->num_m2s_rings;
+}
+
+/* ask the peer to stop or resume writing to the interrupt line */
+static_always_inline void
+memif_ring_mask_interrupts (memif_ring_t * ring, int mask)
+{
+  if (mask && (ring->flags & MEMIF_RING_FLAG_MASK_INT) == 0)
+    ring->flags |= MEMIF_RING_FLAG_MASK_INT;
+  else if (!mask && (ring->flags & MEMIF_RING_FLAG_MASK_INT))
+    {
+      ring->flags &= ~MEMIF_RING_FLAG_MASK_INT;
+      /* pairs with the barrier in tx, so that a packet enqueued before
+         the peer saw the flag cleared is seen by the next rx check */
+      CLIB_MEMORY_BARRIER ();
+    }
+}
+
 static_always_inline void *
 memif_get_buffer (memif_if_t * mif, memif_ring_t * ring, u16 slot)
 {
@@ -242,6 +349,81 @@ memif_get_buffer (memif_if_t * mif, memif_ring_t * ring, u16 slot)
   return mif->regions[region] + ring->desc[slot].offset;
 }
 
+static_always_inline u64
+memif_buffer_offset (memif_if_t * mif, void *p)
+{
+  return p - mif->buffer_region;
+}
+
+/* room offered to the slave in a posted buffer, no more than it asked for */
+static_always_inline u32
+memif_buffer_posted_length (memif_if_t * mif)
+{
+  return clib_min (mif->buffer_size, VLIB_BUFFER_DATA_SIZE);
+}
+
+static_always_inline int
+memif_buffer_in_region (memif_if_t * mif, vlib_buffer_t * b)
+{
+  void *p = b;
+  return p >= mif->buffer_region &&
+    p < mif->buffer_region + mif->buffer_region_size;
+}
+
+/* move region buffers freed on the thread of vm off its free list */
+static_always_inline void
+memif_buffer_collect (vlib_main_t * vm, memif_if_t * mif)
+{
+  vlib_buffer_free_list_t *fl;
+  u32 i;
+
+  fl = vlib_buffer_get_free_list (vm, mif->buffer_free_list_index);
+
+  /* leave alone any buffer vlib itself allocated for this free list */
+  for (i = 0; i < vec_len (fl->buffers);)
+    {
+      if (memif_buffer_in_region (mif, vlib_get_buffer (vm, fl->buffers[i])))
+	{
+	  vec_add1 (mif->region_buffers, fl->buffers[i]);
+	  vec_del1 (fl->buffers, i);
+	}
+      else
+	i++;
+    }
+}
+
+/*
+ * Take up to n buffers of the zero-copy region. Region buffers freed on
+ * this thread sit on its copy of the region free list, so they are
+ * collected first; vlib never grows that free list on our behalf.
+ */
+static_always_inline u32
+memif_buffer_alloc (vlib_main_t * vm, memif_if_t * mif, u32 * buffers,
+		    u32 n_buffers)
+{
+  u32 i, n_free;
+
+  while (__sync_lock_test_and_set (&mif->buffer_lock, 1))
+    ;
+
+  memif_buffer_collect (vm, mif);
+
+  n_free = vec_len (mif->region_buffers);
+  n_buffers = clib_min (n_buffers, n_free);
+  clib_memcpy (buffers, mif->region_buffers + n_free - n_buffers,
+	       n_buffers * sizeof (u32));
+  _vec_len (mif->region_buffers) = n_free - n_buffers;
+
+  __sync_lock_release (&mif->buffer_lock);
+
+  if (CLIB_DEBUG > 0)
+    for (i = 0; i < n_buffers; i++)
+      vlib_buffer_set_known_state (vm, buffers[i],
+				   VLIB_BUFFER_KNOWN_ALLOCATED);
+
+  return n_buffers;
+}
+
 #ifndef F_LINUX_SPECIFIC_BASE
 #define F_LINUX_SPECIFIC_BASE 1024
 #endif
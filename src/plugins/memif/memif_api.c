@@ -142,6 +142,15 @@ void vl_api_memif_create_t_handler
       args.buffer_size = ntohs (mp->buffer_size);
     }
 
+  /* queues */
+  args.rx_queues = mp->rx_queues ? mp->rx_queues : 1;
+  args.tx_queues = mp->tx_queues ? mp->tx_queues : 1;
+  if (args.is_master && (args.rx_queues != 1 || args.tx_queues != 1))
+    {
+      rv = VNET_API_ERROR_INVALID_ARGUMENT;
+      goto reply;
+    }
+
   /* MAC address */
   if (memcmp (mp->hw_addr, empty_hw_addr, 6) != 0)
     {
@@ -29,7 +29,8 @@
 
 #include <memif/memif.h>
 
-#define foreach_memif_input_error
+#define foreach_memif_input_error \
+_(BAD_DESC_LENGTH, "descriptor longer than its buffer")
 
 typedef enum
 {
@@ -78,13 +79,11 @@ memif_prefetch (vlib_main_t * vm, u32 bi)
 static_always_inline uword
 memif_device_input_inline (vlib_main_t * vm, vlib_node_runtime_t * node,
 			   vlib_frame_t * frame, memif_if_t * mif,
-			   memif_ring_type_t type)
+			   memif_ring_type_t type, u16 rid)
 {
   vnet_main_t *vnm = vnet_get_main ();
-  u8 rid = 0;			/* Ring id */
   memif_ring_t *ring = memif_get_ring (mif, type, rid);
-  memif_ring_data_t *rd =
-    vec_elt_at_index (mif->ring_data, rid + type * mif->num_s2m_rings);
+  memif_ring_data_t *rd = memif_get_ring_data (mif, type, rid);
   u16 head;
 
   u32 next_index = VNET_DEVICE_INPUT_NEXT_ETHERNET_INPUT;
@@ -326,6 +325,142 @@ memif_device_input_inline (vlib_main_t * vm, vlib_node_runtime_t * node,
   return n_rx_packets;
 }
 
+/*
+ * Zero-copy master rx: the slave has written packets straight into the
+ * vlib buffers posted in the ring, so they are handed to the graph as they
+ * are and fresh buffers are posted in their place.
+ */
+static_always_inline uword
+memif_device_input_zc_inline (vlib_main_t * vm, vlib_node_runtime_t * node,
+			      vlib_frame_t * frame, memif_if_t * mif,
+			      memif_ring_type_t type, u16 rid)
+{
+  vnet_main_t *vnm = vnet_get_main ();
+  memif_ring_t *ring = memif_get_ring (mif, type, rid);
+  memif_ring_data_t *rd = memif_get_ring_data (mif, type, rid);
+  u16 head;
+
+  u32 next_index = VNET_DEVICE_INPUT_NEXT_ETHERNET_INPUT;
+  uword n_trace = vlib_get_trace_count (vm, node);
+  u32 n_rx_packets = 0;
+  u32 n_rx_bytes = 0;
+  u32 *to_next = 0;
+  u32 new_buffers[VLIB_FRAME_SIZE];
+  u32 n_new, i;
+  u32 cpu_index = os_get_cpu_number ();
+  u32 bi0, new_bi0;
+  vlib_buffer_t *b0, *new_b0;
+  memif_desc_t *d0;
+  u16 ring_size = 1 << mif->log2_ring_size;
+  u16 mask = ring_size - 1;
+  u16 num_slots;
+
+  if (mif->per_interface_next_index != ~0)
+    next_index = mif->per_interface_next_index;
+
+  head = ring->head;
+  if (head == rd->last_head)
+    return 0;
+
+  num_slots = (head - rd->last_head) & mask;
+
+  while (num_slots)
+    {
+      u32 n_left_to_next;
+      vlib_get_next_frame (vm, node, next_index, to_next, n_left_to_next);
+
+      /* leave slots in the ring which cannot be refilled */
+      n_new = memif_buffer_alloc (vm, mif, new_buffers,
+				  clib_min (num_slots, n_left_to_next));
+      if (n_new == 0)
+	{
+	  vlib_put_next_frame (vm, node, next_index, n_left_to_next);
+	  break;
+	}
+
+      for (i = 0; i < n_new && n_left_to_next; i++)
+	{
+	  u32 next0 = next_index;
+	  d0 = &ring->desc[rd->last_head];
+	  bi0 = rd->buffers[rd->last_head];
+
+	  /* take the buffer the slave wrote into */
+	  to_next[0] = bi0;
+	  to_next += 1;
+	  n_left_to_next--;
+
+	  b0 = vlib_get_buffer (vm, bi0);
+	  b0->current_data = 0;
+	  b0->current_length = d0->length;
+	  vnet_buffer (b0)->sw_if_index[VLIB_RX] = mif->sw_if_index;
+	  vnet_buffer (b0)->sw_if_index[VLIB_TX] = (u32) ~ 0;
+
+	  /* the slave claims more than the buffer we posted holds, it may
+	     have rewritten buffer_length too */
+	  if (PREDICT_FALSE (d0->length > d0->buffer_length
+			     || d0->length > memif_buffer_posted_length (mif)))
+	    {
+	      b0->current_length = 0;
+	      b0->error = node->errors[MEMIF_INPUT_ERROR_BAD_DESC_LENGTH];
+	      next0 = VNET_DEVICE_INPUT_NEXT_DROP;
+	    }
+
+	  /* post an empty one in its place */
+	  new_bi0 = new_buffers[i];
+	  new_b0 = vlib_get_buffer (vm, new_bi0);
+	  d0->region = MEMIF_BUFFER_REGION;
+	  d0->offset = memif_buffer_offset (mif, new_b0->data);
+	  d0->buffer_length = memif_buffer_posted_length (mif);
+	  rd->buffers[rd->last_head] = new_bi0;
+
+	  /* trace */
+	  VLIB_BUFFER_TRACE_TRAJECTORY_INIT (b0);
+
+	  if (PREDICT_FALSE (n_trace > 0))
+	    {
+	      memif_input_trace_t *tr;
+	      vlib_trace_buffer (vm, node, next0, b0, /* follow_chain */ 0);
+	      vlib_set_trace_count (vm, node, --n_trace);
+	      tr = vlib_add_trace (vm, node, b0, sizeof (*tr));
+	      tr->next_index = next0;
+	      tr->hw_if_index = mif->hw_if_index;
+	      tr->ring = rid;
+	    }
+
+	  /* redirect if feature path enabled */
+	  if (PREDICT_TRUE (next0 != VNET_DEVICE_INPUT_NEXT_DROP))
+	    {
+	      vnet_feature_start_device_input_x1 (mif->sw_if_index, &next0,
+						  b0);
+	      n_rx_packets++;
+	      n_rx_bytes += b0->current_length;
+	    }
+
+	  /* enqueue */
+	  vlib_validate_buffer_enqueue_x1 (vm, node, next_index, to_next,
+					   n_left_to_next, bi0, next0);
+
+	  /* next packet */
+	  rd->last_head = (rd->last_head + 1) & mask;
+	  num_slots--;
+	}
+      vlib_put_next_frame (vm, node, next_index, n_left_to_next);
+
+      /* a feature redirect may have left us in a fuller frame */
+      if (i < n_new)
+	vlib_buffer_free (vm, new_buffers + i, n_new - i);
+    }
+  CLIB_MEMORY_STORE_BARRIER ();
+  ring->tail = rd->last_head;
+
+  vlib_increment_combined_counter (vnm->interface_main.combined_sw_if_counters
+				   + VNET_INTERFACE_COUNTER_RX, cpu_index,
+				   mif->hw_if_index, n_rx_packets,
+				   n_rx_bytes);
+
+  return n_rx_packets;
+}
+
 static uword
 memif_input_fn (vlib_main_t * vm, vlib_node_runtime_t * node,
 		vlib_frame_t * frame)
@@ -333,28 +468,78 @@ memif_input_fn (vlib_main_t * vm, vlib_node_runtime_t * node,
   u32 n_rx_packets = 0;
   u32 cpu_index = os_get_cpu_number ();
   memif_main_t *nm = &memif_main;
+  memif_per_thread_t *pt = vec_elt_at_index (nm->per_thread, cpu_index);
+  memif_ring_type_t type;
+  memif_ring_data_t *rd;
+  memif_ring_t *ring;
   memif_if_t *mif;
+  u16 rid;
+  int polling, more = 0;
+
+  /* a worker with no ring to poll only runs when the main thread has
+     taken an interrupt for it, see memif_update_input_node_state () */
+  if (cpu_index != 0 && !pt->polling)
+    {
+      if (pt->int_pending == 0)
+	return 0;
+      pt->int_pending = 0;
+      /* pairs with the barrier in memif_int_fd_read_ready () */
+      CLIB_MEMORY_BARRIER ();
+    }
+
+  /* polling, and not about to hand over to interrupt mode */
+  polling = node->state == VLIB_NODE_STATE_POLLING &&
+    (node->flags & VLIB_NODE_FLAG_SWITCH_FROM_POLLING_TO_INTERRUPT_MODE) == 0;
 
   /* *INDENT-OFF* */
   pool_foreach (mif, nm->interfaces,
     ({
-      if (mif->flags & MEMIF_IF_FLAG_ADMIN_UP &&
-	  mif->flags & MEMIF_IF_FLAG_CONNECTED &&
-	  (mif->if_index % nm->input_cpu_count) ==
-	  (cpu_index - nm->input_cpu_first_index))
+      if ((mif->flags & MEMIF_IF_FLAG_ADMIN_UP) == 0 ||
+	  (mif->flags & MEMIF_IF_FLAG_CONNECTED) == 0)
+	continue;
+
+      /* slaves receive on master-to-slave rings and vice versa */
+      type = memif_rx_ring_type (mif);
+      for (rid = 0; rid < vec_len (mif->rx_queue_cpu); rid++)
 	{
-	  if (mif->flags & MEMIF_IF_FLAG_IS_SLAVE)
+	  if (mif->rx_queue_cpu[rid] != cpu_index)
+	    continue;
+
+	  rd = memif_get_ring_data (mif, type, rid);
+	  ring = memif_get_ring (mif, type, rid);
+	  if (mif->rx_mode == MEMIF_RX_MODE_INTERRUPT)
+	    {
+	      if (rd->int_pending == 0)
+		continue;
+	    }
+	  else if (mif->rx_mode == MEMIF_RX_MODE_ADAPTIVE)
+	    memif_ring_mask_interrupts (ring, polling);
+	  rd->int_pending = 0;
+	  if (type == MEMIF_RING_S2M && (mif->flags & MEMIF_IF_FLAG_ZERO_COPY))
 	    n_rx_packets +=
-	      memif_device_input_inline (vm, node, frame, mif,
-					 MEMIF_RING_M2S);
+	      memif_device_input_zc_inline (vm, node, frame, mif, type, rid);
 	  else
 	    n_rx_packets +=
-	      memif_device_input_inline (vm, node, frame, mif,
-					 MEMIF_RING_S2M);
+	      memif_device_input_inline (vm, node, frame, mif, type, rid);
+
+	  /* come back for what did not fit in this call */
+	  if (ring->head != rd->last_head)
+	    {
+	      rd->int_pending = 1;
+	      more = 1;
+	    }
 	}
     }));
   /* *INDENT-ON* */
 
+  if (more)
+    {
+      if (cpu_index != 0)
+	pt->int_pending = 1;
+      else if (node->state == VLIB_NODE_STATE_INTERRUPT)
+	vlib_node_set_interrupt_pending (vm, memif_input_node.index);
+    }
+
   return n_rx_packets;
 }
 
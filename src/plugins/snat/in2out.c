@@ -24,6 +24,7 @@
 #include <snat/snat.h>
 #include <snat/snat_ipfix_logging.h>
 #include <snat/snat_det.h>
+#include <snat/snat_ed.h>
 
 #include <vppinfra/hash.h>
 #include <vppinfra/error.h>
@@ -88,6 +89,7 @@ vlib_node_registration_t snat_in2out_slowpath_node;
 vlib_node_registration_t snat_in2out_fast_node;
 vlib_node_registration_t snat_in2out_worker_handoff_node;
 vlib_node_registration_t snat_det_in2out_node;
+vlib_node_registration_t snat_ed_in2out_node;
 
 #define foreach_snat_in2out_error                       \
 _(UNSUPPORTED_PROTOCOL, "Unsupported protocol")         \
@@ -140,6 +142,7 @@ snat_not_translate (snat_main_t * sm, snat_runtime_t * rt, u32 sw_if_index0,
   ip4_address_t * first_int_addr;
   udp_header_t * udp0 = ip4_next_header (ip0);
   snat_session_key_t key0, sm0;
+  snat_main_per_thread_data_t *tsm;
   clib_bihash_kv_8_8_t kv0, value0;
   fib_node_index_t fei = FIB_NODE_INDEX_INVALID;
   fib_prefix_t pfx = {
@@ -174,7 +177,8 @@ snat_not_translate (snat_main_t * sm, snat_runtime_t * rt, u32 sw_if_index0,
 
   /* NAT packet aimed at external address if */
   /* has active sessions */
-  if (clib_bihash_search_8_8 (&sm->out2in, &kv0, &value0))
+  tsm = snat_get_out2in_thread_data (sm, &key0);
+  if (!tsm || clib_bihash_search_8_8 (&tsm->out2in, &kv0, &value0))
     {
       /* or is static mappings */
       if (!snat_static_mapping_match(sm, key0, &sm0, 1))
@@ -243,7 +247,8 @@ static u32 slow_path (snat_main_t *sm, vlib_buffer_t *b0,
   kv0.key = user_key.as_u64;
   
   /* Ever heard of the "user" = src ip4 address before? */
-  if (clib_bihash_search_8_8 (&sm->user_hash, &kv0, &value0))
+  if (clib_bihash_search_8_8 (&sm->per_thread_data[cpu_index].user_hash,
+                              &kv0, &value0))
     {
       /* no, make a new one */
       pool_get (sm->per_thread_data[cpu_index].users, u);
@@ -262,7 +267,8 @@ static u32 slow_path (snat_main_t *sm, vlib_buffer_t *b0,
       kv0.value = u - sm->per_thread_data[cpu_index].users;
 
       /* add user */
-      clib_bihash_add_del_8_8 (&sm->user_hash, &kv0, 1 /* is_add */);
+      clib_bihash_add_del_8_8 (&sm->per_thread_data[cpu_index].user_hash,
+                               &kv0, 1 /* is_add */);
     }
   else
     {
@@ -300,10 +306,12 @@ static u32 slow_path (snat_main_t *sm, vlib_buffer_t *b0,
 
       /* Remove in2out, out2in keys */
       kv0.key = s->in2out.as_u64;
-      if (clib_bihash_add_del_8_8 (&sm->in2out, &kv0, 0 /* is_add */))
+      if (clib_bihash_add_del_8_8 (&sm->per_thread_data[cpu_index].in2out,
+                                   &kv0, 0 /* is_add */))
           clib_warning ("in2out key delete failed");
       kv0.key = s->out2in.as_u64;
-      if (clib_bihash_add_del_8_8 (&sm->out2in, &kv0, 0 /* is_add */))
+      if (clib_bihash_add_del_8_8 (&sm->per_thread_data[cpu_index].out2in,
+                                   &kv0, 0 /* is_add */))
           clib_warning ("out2in key delete failed");
 
       /* log NAT event */
@@ -318,6 +326,9 @@ static u32 slow_path (snat_main_t *sm, vlib_buffer_t *b0,
         (sm, &s->out2in, s->outside_address_index);
       s->outside_address_index = ~0;
 
+      /* Rearmed below for the new translation */
+      snat_session_timer_stop (sm, cpu_index, s);
+
       if (snat_alloc_outside_address_and_port (sm, rx_fib_index0, &key1,
                                                &address_index))
         {
@@ -386,16 +397,20 @@ static u32 slow_path (snat_main_t *sm, vlib_buffer_t *b0,
   s->out2in.fib_index = outside_fib_index;
   *sessionp = s;
 
+  snat_session_timer_start (sm, &sm->per_thread_data[cpu_index], s);
+
   /* Add to translation hashes */
   kv0.key = s->in2out.as_u64;
   kv0.value = s - sm->per_thread_data[cpu_index].sessions;
-  if (clib_bihash_add_del_8_8 (&sm->in2out, &kv0, 1 /* is_add */))
+  if (clib_bihash_add_del_8_8 (&sm->per_thread_data[cpu_index].in2out,
+                               &kv0, 1 /* is_add */))
       clib_warning ("in2out key add failed");
   
   kv0.key = s->out2in.as_u64;
   kv0.value = s - sm->per_thread_data[cpu_index].sessions;
   
-  if (clib_bihash_add_del_8_8 (&sm->out2in, &kv0, 1 /* is_add */))
+  if (clib_bihash_add_del_8_8 (&sm->per_thread_data[cpu_index].out2in,
+                               &kv0, 1 /* is_add */))
       clib_warning ("out2in key add failed");
 
   /* Add to translated packets worker lookup */
@@ -406,6 +421,8 @@ static u32 slow_path (snat_main_t *sm, vlib_buffer_t *b0,
   kv0.value = cpu_index;
   clib_bihash_add_del_8_8 (&sm->worker_by_out, &kv0, 1);
 
+  sm->per_thread_data[cpu_index].sessions_created++;
+
   /* log NAT event */
   snat_ipfix_logging_nat44_ses_create(s->in2out.addr.as_u32,
                                       s->out2in.addr.as_u32,
@@ -508,7 +525,8 @@ u32 icmp_match_in2out_slow(snat_main_t *sm, vlib_node_runtime_t *node,
 
   kv0.key = key0.as_u64;
 
-  if (clib_bihash_search_8_8 (&sm->in2out, &kv0, &value0))
+  if (clib_bihash_search_8_8 (&sm->per_thread_data[cpu_index].in2out,
+                              &kv0, &value0))
     {
       if (PREDICT_FALSE(snat_not_translate(sm, rt, sw_if_index0, ip0,
           IP_PROTOCOL_ICMP, rx_fib_index0)))
@@ -759,11 +777,11 @@ snat_hairpinning (snat_main_t *sm,
                   u32 proto0)
 {
   snat_session_key_t key0, sm0;
-  snat_worker_key_t k0;
+  snat_main_per_thread_data_t *tsm;
   snat_session_t * s0;
   clib_bihash_kv_8_8_t kv0, value0;
   ip_csum_t sum0;
-  u32 new_dst_addr0 = 0, old_dst_addr0, ti = 0, si;
+  u32 new_dst_addr0 = 0, old_dst_addr0;
   u16 new_dst_port0, old_dst_port0;
 
   key0.addr = ip0->dst_address;
@@ -772,8 +790,9 @@ snat_hairpinning (snat_main_t *sm,
   key0.fib_index = sm->outside_fib_index;
   kv0.key = key0.as_u64;
 
-  /* Check if destination is in active sessions */
-  if (clib_bihash_search_8_8 (&sm->out2in, &kv0, &value0))
+  /* Check if destination is in active sessions of its owning thread */
+  tsm = snat_get_out2in_thread_data (sm, &key0);
+  if (!tsm || clib_bihash_search_8_8 (&tsm->out2in, &kv0, &value0))
     {
       /* or static mappings */
       if (!snat_static_mapping_match(sm, key0, &sm0, 1))
@@ -785,22 +804,7 @@ snat_hairpinning (snat_main_t *sm,
     }
   else
     {
-      si = value0.value;
-      if (sm->num_workers > 1)
-        {
-          k0.addr = ip0->dst_address;
-          k0.port = udp0->dst_port;
-          k0.fib_index = sm->outside_fib_index;
-          kv0.key = k0.as_u64;
-          if (clib_bihash_search_8_8 (&sm->worker_by_out, &kv0, &value0))
-            ASSERT(0);
-          else
-            ti = value0.value;
-        }
-      else
-        ti = sm->num_workers;
-
-      s0 = pool_elt_at_index (sm->per_thread_data[ti].sessions, si);
+      s0 = pool_elt_at_index (tsm->sessions, value0.value);
       new_dst_addr0 = s0->in2out.addr.as_u32;
       new_dst_port0 = s0->in2out.port;
       vnet_buffer(b0)->sw_if_index[VLIB_TX] = s0->in2out.fib_index;
@@ -997,7 +1001,8 @@ snat_in2out_node_fn_inline (vlib_main_t * vm,
           
           kv0.key = key0.as_u64;
 
-          if (PREDICT_FALSE (clib_bihash_search_8_8 (&sm->in2out, &kv0, &value0) != 0))
+          if (PREDICT_FALSE (clib_bihash_search_8_8 (
+                &sm->per_thread_data[cpu_index].in2out, &kv0, &value0) != 0))
             {
               if (is_slow_path)
                 {
@@ -1045,6 +1050,7 @@ snat_in2out_node_fn_inline (vlib_main_t * vm,
                                      ip4_header_t /* cheat */,
                                      length /* changed member */);
               tcp0->checksum = ip_csum_fold(sum0);
+              snat_session_update_tcp_state (s0, tcp0);
             }
           else
             {
@@ -1137,7 +1143,8 @@ snat_in2out_node_fn_inline (vlib_main_t * vm,
           
           kv1.key = key1.as_u64;
 
-            if (PREDICT_FALSE(clib_bihash_search_8_8 (&sm->in2out, &kv1, &value1) != 0))
+            if (PREDICT_FALSE(clib_bihash_search_8_8 (
+                  &sm->per_thread_data[cpu_index].in2out, &kv1, &value1) != 0))
             {
               if (is_slow_path)
                 {
@@ -1185,6 +1192,7 @@ snat_in2out_node_fn_inline (vlib_main_t * vm,
                                      ip4_header_t /* cheat */,
                                      length /* changed member */);
               tcp1->checksum = ip_csum_fold(sum1);
+              snat_session_update_tcp_state (s1, tcp1);
             }
           else
             {
@@ -1312,7 +1320,8 @@ snat_in2out_node_fn_inline (vlib_main_t * vm,
           
           kv0.key = key0.as_u64;
 
-          if (clib_bihash_search_8_8 (&sm->in2out, &kv0, &value0))
+          if (clib_bihash_search_8_8 (&sm->per_thread_data[cpu_index].in2out,
+                                      &kv0, &value0))
             {
               if (is_slow_path)
                 {
@@ -1361,6 +1370,7 @@ snat_in2out_node_fn_inline (vlib_main_t * vm,
                                      ip4_header_t /* cheat */,
                                      length /* changed member */);
               tcp0->checksum = ip_csum_fold(sum0);
+              snat_session_update_tcp_state (s0, tcp0);
             }
           else
             {
@@ -1646,16 +1656,16 @@ snat_det_in2out_node_fn (vlib_main_t * vm,
           switch(ses0->state)
             {
             case SNAT_SESSION_UDP_ACTIVE:
-                ses0->expire = now + SNAT_UDP_TIMEOUT;
+                ses0->expire = now + sm->udp_timeout;
                 break;
             case SNAT_SESSION_TCP_SYN_SENT:
             case SNAT_SESSION_TCP_FIN_WAIT:
             case SNAT_SESSION_TCP_CLOSE_WAIT:
             case SNAT_SESSION_TCP_LAST_ACK:
-                ses0->expire = now + SNAT_TCP_TRANSITORY_TIMEOUT;
+                ses0->expire = now + sm->tcp_transitory_timeout;
                 break;
             case SNAT_SESSION_TCP_ESTABLISHED:
-                ses0->expire = now + SNAT_TCP_ESTABLISHED_TIMEOUT;
+                ses0->expire = now + sm->tcp_established_timeout;
                 break;
             }
 
@@ -1768,16 +1778,16 @@ snat_det_in2out_node_fn (vlib_main_t * vm,
           switch(ses1->state)
             {
             case SNAT_SESSION_UDP_ACTIVE:
-                ses1->expire = now + SNAT_UDP_TIMEOUT;
+                ses1->expire = now + sm->udp_timeout;
                 break;
             case SNAT_SESSION_TCP_SYN_SENT:
             case SNAT_SESSION_TCP_FIN_WAIT:
             case SNAT_SESSION_TCP_CLOSE_WAIT:
             case SNAT_SESSION_TCP_LAST_ACK:
-                ses1->expire = now + SNAT_TCP_TRANSITORY_TIMEOUT;
+                ses1->expire = now + sm->tcp_transitory_timeout;
                 break;
             case SNAT_SESSION_TCP_ESTABLISHED:
-                ses1->expire = now + SNAT_TCP_ESTABLISHED_TIMEOUT;
+                ses1->expire = now + sm->tcp_established_timeout;
                 break;
             }
 
@@ -1923,16 +1933,16 @@ snat_det_in2out_node_fn (vlib_main_t * vm,
           switch(ses0->state)
             {
             case SNAT_SESSION_UDP_ACTIVE:
-                ses0->expire = now + SNAT_UDP_TIMEOUT;
+                ses0->expire = now + sm->udp_timeout;
                 break;
             case SNAT_SESSION_TCP_SYN_SENT:
             case SNAT_SESSION_TCP_FIN_WAIT:
             case SNAT_SESSION_TCP_CLOSE_WAIT:
             case SNAT_SESSION_TCP_LAST_ACK:
-                ses0->expire = now + SNAT_TCP_TRANSITORY_TIMEOUT;
+                ses0->expire = now + sm->tcp_transitory_timeout;
                 break;
             case SNAT_SESSION_TCP_ESTABLISHED:
-                ses0->expire = now + SNAT_TCP_ESTABLISHED_TIMEOUT;
+                ses0->expire = now + sm->tcp_established_timeout;
                 break;
             }
 
@@ -1990,6 +2000,280 @@ VLIB_REGISTER_NODE (snat_det_in2out_node) = {
 
 VLIB_NODE_FUNCTION_MULTIARCH (snat_det_in2out_node, snat_det_in2out_node_fn);
 
+/******************************/
+/*** endpoint-dependent NAT ***/
+/******************************/
+
+/*
+ * Sessions are keyed by the inside endpoint and the remote endpoint, the
+ * outside port is only unique per remote endpoint. ICMP echo is keyed by
+ * the identifier, other ICMP messages are not translated.
+ */
+static uword
+snat_ed_in2out_node_fn (vlib_main_t * vm,
+                        vlib_node_runtime_t * node,
+                        vlib_frame_t * frame)
+{
+  u32 n_left_from, * from, * to_next;
+  snat_in2out_next_t next_index;
+  u32 pkts_processed = 0;
+  snat_main_t * sm = &snat_main;
+  snat_runtime_t * rt = (snat_runtime_t *)node->runtime_data;
+  f64 now = vlib_time_now (vm);
+  u32 cpu_index = os_get_cpu_number ();
+  snat_main_per_thread_data_t *tsm =
+    vec_elt_at_index (sm->per_thread_data, cpu_index);
+
+  from = vlib_frame_vector_args (frame);
+  n_left_from = frame->n_vectors;
+  next_index = node->cached_next_index;
+
+  while (n_left_from > 0)
+    {
+      u32 n_left_to_next;
+
+      vlib_get_next_frame (vm, node, next_index,
+			   to_next, n_left_to_next);
+
+      while (n_left_from > 0 && n_left_to_next > 0)
+	{
+          u32 bi0;
+	  vlib_buffer_t * b0;
+          u32 next0;
+          u32 sw_if_index0, rx_fib_index0;
+          ip4_header_t * ip0;
+          ip_csum_t sum0;
+          u32 new_addr0, old_addr0;
+          u16 old_port0, new_port0, l_port0, r_port0;
+          udp_header_t * udp0;
+          tcp_header_t * tcp0;
+          icmp46_header_t * icmp0;
+          icmp_echo_header_t * echo0;
+          u32 proto0;
+          snat_session_key_t key0, sm0;
+          snat_ed_session_key_t ed_key0;
+          clib_bihash_kv_16_8_t kv0, value0;
+          snat_session_t * s0 = 0;
+          u8 is_static0;
+
+          /* Prefetch next iteration. */
+          if (PREDICT_TRUE (n_left_from > 1))
+            {
+              vlib_buffer_t * p1;
+
+              p1 = vlib_get_buffer (vm, from[1]);
+              vlib_prefetch_buffer_header (p1, LOAD);
+              CLIB_PREFETCH (p1->data, CLIB_CACHE_LINE_BYTES, STORE);
+            }
+
+          /* speculatively enqueue b0 to the current next frame */
+	  bi0 = from[0];
+	  to_next[0] = bi0;
+	  from += 1;
+	  to_next += 1;
+	  n_left_from -= 1;
+	  n_left_to_next -= 1;
+
+	  b0 = vlib_get_buffer (vm, bi0);
+          next0 = SNAT_IN2OUT_NEXT_LOOKUP;
+
+          ip0 = vlib_buffer_get_current (b0);
+          udp0 = ip4_next_header (ip0);
+          tcp0 = (tcp_header_t *) udp0;
+          icmp0 = (icmp46_header_t *) udp0;
+          echo0 = (icmp_echo_header_t *) (icmp0 + 1);
+
+          sw_if_index0 = vnet_buffer(b0)->sw_if_index[VLIB_RX];
+	  rx_fib_index0 = vec_elt (sm->ip4_main->fib_index_by_sw_if_index,
+                                   sw_if_index0);
+
+          if (PREDICT_FALSE(ip0->ttl == 1))
+            {
+              vnet_buffer (b0)->sw_if_index[VLIB_TX] = (u32) ~ 0;
+              icmp4_error_set_vnet_buffer (b0, ICMP4_time_exceeded,
+                                           ICMP4_time_exceeded_ttl_exceeded_in_transit,
+                                           0);
+              next0 = SNAT_IN2OUT_NEXT_ICMP_ERROR;
+              goto trace0;
+            }
+
+          proto0 = ip_proto_to_snat_proto (ip0->protocol);
+
+          /* Next configured feature, probably ip4-lookup */
+          if (PREDICT_FALSE (proto0 == ~0))
+            goto trace0;
+
+          if (PREDICT_FALSE (proto0 == SNAT_PROTOCOL_ICMP))
+            {
+              if (icmp0->type != ICMP4_echo_request &&
+                  icmp0->type != ICMP4_echo_reply)
+                {
+                  b0->error = node->errors[SNAT_IN2OUT_ERROR_BAD_ICMP_TYPE];
+                  next0 = SNAT_IN2OUT_NEXT_DROP;
+                  goto trace0;
+                }
+              l_port0 = echo0->identifier;
+              r_port0 = 0;
+            }
+          else
+            {
+              l_port0 = udp0->src_port;
+              r_port0 = udp0->dst_port;
+            }
+
+          snat_ed_make_key (&ed_key0, ip0->src_address, l_port0,
+                            ip0->dst_address, r_port0, proto0, rx_fib_index0);
+          kv0.key[0] = ed_key0.as_u64[0];
+          kv0.key[1] = ed_key0.as_u64[1];
+
+          if (clib_bihash_search_16_8 (&tsm->in2out_ed, &kv0, &value0))
+            {
+              if (PREDICT_FALSE(snat_not_translate(sm, rt, sw_if_index0, ip0,
+                  proto0, rx_fib_index0)))
+                goto trace0;
+
+              if (PREDICT_FALSE (proto0 == SNAT_PROTOCOL_ICMP &&
+                                 icmp0->type != ICMP4_echo_request))
+                {
+                  b0->error = node->errors[SNAT_IN2OUT_ERROR_BAD_ICMP_TYPE];
+                  next0 = SNAT_IN2OUT_NEXT_DROP;
+                  goto trace0;
+                }
+
+              key0.addr = ip0->src_address;
+              key0.port = l_port0;
+              key0.protocol = proto0;
+              key0.fib_index = rx_fib_index0;
+
+              /* First try to match static mapping by local address and port */
+              is_static0 = !snat_static_mapping_match (sm, key0, &sm0, 0);
+
+              s0 = snat_ed_session_create (sm, cpu_index, &key0, &sm0,
+                                           &ip0->dst_address, r_port0,
+                                           is_static0);
+              if (PREDICT_FALSE (!s0))
+                {
+                  b0->error = node->errors[SNAT_IN2OUT_ERROR_OUT_OF_PORTS];
+                  next0 = SNAT_IN2OUT_NEXT_DROP;
+                  goto trace0;
+                }
+            }
+          else
+            s0 = pool_elt_at_index (tsm->sessions, value0.value);
+
+          old_addr0 = ip0->src_address.as_u32;
+          ip0->src_address = s0->out2in.addr;
+          new_addr0 = ip0->src_address.as_u32;
+          vnet_buffer(b0)->sw_if_index[VLIB_TX] = s0->out2in.fib_index;
+
+          sum0 = ip0->checksum;
+          sum0 = ip_csum_update (sum0, old_addr0, new_addr0,
+                                 ip4_header_t,
+                                 src_address /* changed member */);
+          ip0->checksum = ip_csum_fold (sum0);
+
+          if (PREDICT_TRUE(proto0 == SNAT_PROTOCOL_TCP))
+            {
+              old_port0 = tcp0->src_port;
+              tcp0->src_port = s0->out2in.port;
+              new_port0 = tcp0->src_port;
+
+              sum0 = tcp0->checksum;
+              sum0 = ip_csum_update (sum0, old_addr0, new_addr0,
+                                     ip4_header_t,
+                                     dst_address /* changed member */);
+              sum0 = ip_csum_update (sum0, old_port0, new_port0,
+                                     ip4_header_t /* cheat */,
+                                     length /* changed member */);
+              tcp0->checksum = ip_csum_fold(sum0);
+              snat_session_update_tcp_state (s0, tcp0);
+            }
+          else if (proto0 == SNAT_PROTOCOL_UDP)
+            {
+              udp0->src_port = s0->out2in.port;
+              udp0->checksum = 0;
+            }
+          else
+            {
+              old_port0 = echo0->identifier;
+              new_port0 = s0->out2in.port;
+              echo0->identifier = new_port0;
+
+              sum0 = icmp0->checksum;
+              sum0 = ip_csum_update (sum0, old_port0, new_port0,
+                                     icmp_echo_header_t,
+                                     identifier /* changed member */);
+              icmp0->checksum = ip_csum_fold (sum0);
+            }
+
+          /* Accounting */
+          s0->last_heard = now;
+          s0->total_pkts++;
+          s0->total_bytes += vlib_buffer_length_in_chain (vm, b0);
+          /* Per-user LRU list maintenance for dynamic translation */
+          if (!snat_is_session_static (s0))
+            {
+              clib_dlist_remove (tsm->list_pool, s0->per_user_index);
+              clib_dlist_addtail (tsm->list_pool, s0->per_user_list_head_index,
+                                  s0->per_user_index);
+            }
+
+        trace0:
+          if (PREDICT_FALSE((node->flags & VLIB_NODE_FLAG_TRACE)
+                            && (b0->flags & VLIB_BUFFER_IS_TRACED)))
+            {
+              snat_in2out_trace_t *t =
+                 vlib_add_trace (vm, node, b0, sizeof (*t));
+              t->is_slow_path = 0;
+              t->sw_if_index = sw_if_index0;
+              t->next_index = next0;
+              t->session_index = ~0;
+              if (s0)
+                t->session_index = s0 - tsm->sessions;
+            }
+
+          pkts_processed += next0 != SNAT_IN2OUT_NEXT_DROP;
+
+          /* verify speculative enqueue, maybe switch current next frame */
+	  vlib_validate_buffer_enqueue_x1 (vm, node, next_index,
+					   to_next, n_left_to_next,
+					   bi0, next0);
+	}
+
+      vlib_put_next_frame (vm, node, next_index, n_left_to_next);
+    }
+
+  vlib_node_increment_counter (vm, snat_ed_in2out_node.index,
+                               SNAT_IN2OUT_ERROR_IN2OUT_PACKETS,
+                               pkts_processed);
+  return frame->n_vectors;
+}
+
+VLIB_REGISTER_NODE (snat_ed_in2out_node) = {
+  .function = snat_ed_in2out_node_fn,
+  .name = "snat-ed-in2out",
+  .vector_size = sizeof (u32),
+  .format_trace = format_snat_in2out_trace,
+  .type = VLIB_NODE_TYPE_INTERNAL,
+
+  .n_errors = ARRAY_LEN(snat_in2out_error_strings),
+  .error_strings = snat_in2out_error_strings,
+
+  .runtime_data_bytes = sizeof (snat_runtime_t),
+
+  .n_next_nodes = SNAT_IN2OUT_N_NEXT,
+
+  /* edit / add dispositions here */
+  .next_nodes = {
+    [SNAT_IN2OUT_NEXT_DROP] = "error-drop",
+    [SNAT_IN2OUT_NEXT_LOOKUP] = "ip4-lookup",
+    [SNAT_IN2OUT_NEXT_SLOW_PATH] = "snat-ed-in2out",
+    [SNAT_IN2OUT_NEXT_ICMP_ERROR] = "ip4-icmp-error",
+  },
+};
+
+VLIB_NODE_FUNCTION_MULTIARCH (snat_ed_in2out_node, snat_ed_in2out_node_fn);
+
 /**********************/
 /*** worker handoff ***/
 /**********************/
@@ -23,6 +23,7 @@
 #include <snat/snat.h>
 #include <snat/snat_ipfix_logging.h>
 #include <snat/snat_det.h>
+#include <snat/snat_ed.h>
 #include <vnet/fib/fib_table.h>
 #include <vnet/fib/ip4_fib.h>
 
@@ -120,6 +121,16 @@ VNET_FEATURE_INIT (ip4_snat_det_out2in, static) = {
   .node_name = "snat-det-out2in",
   .runs_before = VNET_FEATURES ("ip4-lookup"),
 };
+VNET_FEATURE_INIT (ip4_snat_ed_in2out, static) = {
+  .arc_name = "ip4-unicast",
+  .node_name = "snat-ed-in2out",
+  .runs_before = VNET_FEATURES ("snat-ed-out2in"),
+};
+VNET_FEATURE_INIT (ip4_snat_ed_out2in, static) = {
+  .arc_name = "ip4-unicast",
+  .node_name = "snat-ed-out2in",
+  .runs_before = VNET_FEATURES ("ip4-lookup"),
+};
 VNET_FEATURE_INIT (ip4_snat_in2out_worker_handoff, static) = {
   .arc_name = "ip4-unicast",
   .node_name = "snat-in2out-worker-handoff",
@@ -567,13 +578,13 @@ int snat_add_static_mapping(ip4_address_t l_addr, ip4_address_t e_addr,
           u_key.addr = m->local_addr;
           u_key.fib_index = m->fib_index;
           kv.key = u_key.as_u64;
-          if (!clib_bihash_search_8_8 (&sm->user_hash, &kv, &value))
+          if (!clib_bihash_search_8_8 (&sm->worker_by_in, &kv, &value))
+            tsm = vec_elt_at_index (sm->per_thread_data, value.value);
+          else
+            tsm = vec_elt_at_index (sm->per_thread_data, sm->num_workers);
+          if (!clib_bihash_search_8_8 (&tsm->user_hash, &kv, &value))
             {
               user_index = value.value;
-              if (!clib_bihash_search_8_8 (&sm->worker_by_in, &kv, &value))
-                tsm = vec_elt_at_index (sm->per_thread_data, value.value);
-              else
-                tsm = vec_elt_at_index (sm->per_thread_data, sm->num_workers);
               u = pool_elt_at_index (tsm->users, user_index);
               if (u->nstaticsessions)
                 {
@@ -605,10 +616,17 @@ int snat_add_static_mapping(ip4_address_t l_addr, ip4_address_t e_addr,
                                                           s->out2in.port,
                                                           s->in2out.fib_index);
 
-                      value.key = s->in2out.as_u64;
-                      clib_bihash_add_del_8_8 (&sm->in2out, &value, 0);
-                      value.key = s->out2in.as_u64;
-                      clib_bihash_add_del_8_8 (&sm->out2in, &value, 0);
+                      if (snat_is_session_ed (s))
+                        snat_ed_session_del_keys (tsm, s);
+                      else
+                        {
+                          value.key = s->in2out.as_u64;
+                          clib_bihash_add_del_8_8 (&tsm->in2out, &value, 0);
+                          value.key = s->out2in.as_u64;
+                          clib_bihash_add_del_8_8 (&tsm->out2in, &value, 0);
+                        }
+                      snat_session_timer_stop (sm, tsm - sm->per_thread_data,
+                                               s);
                       pool_put (tsm->sessions, s);
 
                       clib_dlist_remove (tsm->list_pool, del_elt_index);
@@ -621,7 +639,7 @@ int snat_add_static_mapping(ip4_address_t l_addr, ip4_address_t e_addr,
                   if (addr_only)
                     {
                       pool_put (tsm->users, u);
-                      clib_bihash_add_del_8_8 (&sm->user_hash, &kv, 0);
+                      clib_bihash_add_del_8_8 (&tsm->user_hash, &kv, 0);
                     }
                 }
             }
@@ -693,8 +711,9 @@ int snat_del_address (snat_main_t *sm, ip4_address_t addr, u8 delete_sm)
         }
     }
 
-  /* Delete sessions using address */
-  if (a->busy_tcp_ports || a->busy_udp_ports || a->busy_icmp_ports)
+  /* Delete sessions using address, endpoint-dependent ones use no bitmaps */
+  if (a->busy_tcp_ports || a->busy_udp_ports || a->busy_icmp_ports ||
+      sm->endpoint_dependent)
     {
       vec_foreach (tsm, sm->per_thread_data)
         {
@@ -709,15 +728,22 @@ int snat_del_address (snat_main_t *sm, ip4_address_t addr, u8 delete_sm)
                                                     ses->out2in.port,
                                                     ses->in2out.fib_index);
                 vec_add1 (ses_to_be_removed, ses - tsm->sessions);
-                kv.key = ses->in2out.as_u64;
-                clib_bihash_add_del_8_8 (&sm->in2out, &kv, 0);
-                kv.key = ses->out2in.as_u64;
-                clib_bihash_add_del_8_8 (&sm->out2in, &kv, 0);
+                snat_session_timer_stop (sm, tsm - sm->per_thread_data,
+                                         ses);
+                if (snat_is_session_ed (ses))
+                  snat_ed_session_del_keys (tsm, ses);
+                else
+                  {
+                    kv.key = ses->in2out.as_u64;
+                    clib_bihash_add_del_8_8 (&tsm->in2out, &kv, 0);
+                    kv.key = ses->out2in.as_u64;
+                    clib_bihash_add_del_8_8 (&tsm->out2in, &kv, 0);
+                  }
                 clib_dlist_remove (tsm->list_pool, ses->per_user_index);
                 user_key.addr = ses->in2out.addr;
                 user_key.fib_index = ses->in2out.fib_index;
                 kv.key = user_key.as_u64;
-                if (!clib_bihash_search_8_8 (&sm->user_hash, &kv, &value))
+                if (!clib_bihash_search_8_8 (&tsm->user_hash, &kv, &value))
                   {
                     u = pool_elt_at_index (tsm->users, value.value);
                     u->nsessions--;
@@ -747,6 +773,8 @@ int snat_del_address (snat_main_t *sm, ip4_address_t addr, u8 delete_sm)
   return 0;
 }
 
+static void snat_session_expiry_enable (snat_main_t * sm);
+
 static int snat_interface_add_del (u32 sw_if_index, u8 is_inside, int is_del)
 {
   snat_main_t *sm = &snat_main;
@@ -764,6 +792,8 @@ static int snat_interface_add_del (u32 sw_if_index, u8 is_inside, int is_del)
         feature_name = is_inside ?  "snat-in2out-worker-handoff" : "snat-out2in-worker-handoff";
       else if (sm->deterministic)
         feature_name = is_inside ?  "snat-det-in2out" : "snat-det-out2in";
+      else if (sm->endpoint_dependent)
+        feature_name = is_inside ?  "snat-ed-in2out" : "snat-ed-out2in";
       else
         feature_name = is_inside ?  "snat-in2out" : "snat-out2in";
     }
@@ -771,6 +801,9 @@ static int snat_interface_add_del (u32 sw_if_index, u8 is_inside, int is_del)
   vnet_feature_enable_disable ("ip4-unicast", feature_name, sw_if_index,
 			       !is_del, 0, 0);
 
+  if (!is_del)
+    snat_session_expiry_enable (sm);
+
   if (sm->fq_in2out_index == ~0 && !sm->deterministic && sm->num_workers > 1)
     sm->fq_in2out_index = vlib_frame_queue_main_init (sm->in2out_node_index, 0);
 
@@ -1549,7 +1582,7 @@ vl_api_snat_user_session_dump_t_handler
     tsm = vec_elt_at_index (sm->per_thread_data, value.value);
   else
     tsm = vec_elt_at_index (sm->per_thread_data, sm->num_workers);
-  if (clib_bihash_search_8_8 (&sm->user_hash, &key, &value))
+  if (clib_bihash_search_8_8 (&tsm->user_hash, &key, &value))
     return;
   u = pool_elt_at_index (tsm->users, value.value);
   if (!u->nsessions && !u->nstaticsessions)
@@ -1738,8 +1771,10 @@ vl_api_snat_det_map_dump_t_handler
   if (q == 0)
     return;
 
-  vec_foreach(m, sm->det_maps)
+  pool_foreach (m, sm->det_maps,
+  ({
     sent_snat_det_map_details(m, q, mp->context);
+  }));
 }
 
 static void * vl_api_snat_det_map_dump_t_print
@@ -1856,6 +1891,10 @@ static clib_error_t * snat_init (vlib_main_t * vm)
   sm->workers = 0;
   sm->fq_in2out_index = ~0;
   sm->fq_out2in_index = ~0;
+  sm->udp_timeout = SNAT_UDP_TIMEOUT;
+  sm->tcp_established_timeout = SNAT_TCP_ESTABLISHED_TIMEOUT;
+  sm->tcp_transitory_timeout = SNAT_TCP_TRANSITORY_TIMEOUT;
+  sm->icmp_timeout = SNAT_ICMP_TIMEOUT;
 
   p = hash_get_mem (tm->thread_registrations_by_name, "workers");
   if (p)
@@ -1928,6 +1967,214 @@ void snat_free_outside_address_and_port (snat_main_t * sm,
     }
 }  
 
+/**
+ * @brief Delete SNAT session.
+ *
+ * Remove the session from the translation hashes and the per-user list,
+ * release its outside port and log the deletion. The user is freed
+ * together with its last session. The caller takes care of the timer.
+ *
+ * @param sm           SNAT main.
+ * @param thread_index Thread owning the session.
+ * @param s            SNAT session.
+ */
+void
+snat_delete_session (snat_main_t * sm, u32 thread_index, snat_session_t * s)
+{
+  snat_main_per_thread_data_t *tsm =
+    vec_elt_at_index (sm->per_thread_data, thread_index);
+  clib_bihash_kv_8_8_t kv, value;
+  snat_user_key_t u_key;
+  snat_worker_key_t w_key;
+  snat_session_key_t out2in_key;
+  snat_user_t *u;
+
+  /* log NAT event */
+  snat_ipfix_logging_nat44_ses_delete(s->in2out.addr.as_u32,
+                                      s->out2in.addr.as_u32,
+                                      s->in2out.protocol,
+                                      s->in2out.port,
+                                      s->out2in.port,
+                                      s->in2out.fib_index);
+
+  if (snat_is_session_ed (s))
+    snat_ed_session_del_keys (tsm, s);
+  else
+    {
+      kv.key = s->in2out.as_u64;
+      if (clib_bihash_add_del_8_8 (&tsm->in2out, &kv, 0 /* is_add */))
+        clib_warning ("in2out key delete failed");
+      kv.key = s->out2in.as_u64;
+      if (clib_bihash_add_del_8_8 (&tsm->out2in, &kv, 0 /* is_add */))
+        clib_warning ("out2in key delete failed");
+    }
+
+  clib_dlist_remove (tsm->list_pool, s->per_user_index);
+  pool_put_index (tsm->list_pool, s->per_user_index);
+
+  u_key.addr = s->in2out.addr;
+  u_key.fib_index = s->in2out.fib_index;
+  kv.key = u_key.as_u64;
+  if (!clib_bihash_search_8_8 (&tsm->user_hash, &kv, &value))
+    {
+      u = pool_elt_at_index (tsm->users, value.value);
+      if (snat_is_session_static (s))
+        u->nstaticsessions--;
+      else
+        u->nsessions--;
+
+      if (!u->nsessions && !u->nstaticsessions)
+        {
+          pool_put_index (tsm->list_pool, u->sessions_per_user_list_head_index);
+          pool_put (tsm->users, u);
+          clib_bihash_add_del_8_8 (&tsm->user_hash, &kv, 0 /* is_add */);
+        }
+    }
+
+  /*
+   * Endpoint-dependent outside ports are shared and never marked busy,
+   * their worker follows from the port.
+   */
+  if (!snat_is_session_static (s) && !snat_is_session_ed (s))
+    {
+      /* Static mappings keep their translated packets worker lookup */
+      if (sm->num_workers > 1)
+        {
+          w_key.addr = s->out2in.addr;
+          w_key.port = s->out2in.port;
+          w_key.fib_index = s->out2in.fib_index;
+          kv.key = w_key.as_u64;
+          clib_bihash_add_del_8_8 (&sm->worker_by_out, &kv, 0 /* is_add */);
+        }
+      out2in_key = s->out2in;
+      snat_free_outside_address_and_port (sm, &out2in_key,
+                                          s->outside_address_index);
+    }
+
+  pool_put (tsm->sessions, s);
+}
+
+/*
+ * The timer is not moved on every packet: when it fires, a session
+ * heard from in the meantime is rescheduled for the remaining time.
+ */
+static void
+snat_session_expired_timer_callback (u32 * expired_timers)
+{
+  snat_main_t *sm = &snat_main;
+  u32 thread_index = os_get_cpu_number ();
+  snat_main_per_thread_data_t *tsm =
+    vec_elt_at_index (sm->per_thread_data, thread_index);
+  snat_session_t *s;
+  u32 session_index;
+  f64 remaining;
+  int i;
+
+  for (i = 0; i < vec_len (expired_timers); i++)
+    {
+      session_index = expired_timers[i] & 0x7FFFFFFF;
+      if (pool_is_free_index (tsm->sessions, session_index))
+        continue;
+      s = pool_elt_at_index (tsm->sessions, session_index);
+      remaining = s->last_heard + snat_session_timeout (sm, s) - tsm->now;
+      if (remaining > 0)
+        {
+          s->timer_handle =
+            tw_timer_start_2t_1w_2048sl (&tsm->timer_wheel, session_index, 0,
+                                         snat_session_timer_ticks (remaining));
+          continue;
+        }
+      snat_delete_session (sm, thread_index, s);
+      tsm->sessions_expired++;
+    }
+}
+
+/*
+ * Idle sessions age out without any traffic, so the timer wheels are
+ * not run from the data path. The workers poll this input node, which
+ * only checks the time until the next tick is due. The main thread must
+ * not poll, snat-session-expire-walk runs its wheel instead.
+ */
+static uword
+snat_session_expire_fn (vlib_main_t * vm, vlib_node_runtime_t * rt,
+                        vlib_frame_t * f)
+{
+  snat_main_t *sm = &snat_main;
+  u32 thread_index = os_get_cpu_number ();
+  snat_main_per_thread_data_t *tsm =
+    vec_elt_at_index (sm->per_thread_data, thread_index);
+  f64 now = vlib_time_now (vm);
+
+  /* timers queued by the main thread are stopped before new sessions */
+  if (now >= tsm->timer_wheel.last_run_time + SNAT_TIMER_INTERVAL
+      || vec_len (tsm->timers_to_stop))
+    snat_expire_sessions (sm, thread_index, now);
+
+  return 0;
+}
+
+VLIB_REGISTER_NODE (snat_session_expire_node, static) = {
+  .function = snat_session_expire_fn,
+  .type = VLIB_NODE_TYPE_INPUT,
+  .name = "snat-session-expire",
+  .state = VLIB_NODE_STATE_DISABLED,
+};
+
+/**
+ * @brief The 'snat-session-expire-walk' process's main loop.
+ *
+ * Age out the idle sessions of the main thread, once SNAT is enabled
+ * on an interface.
+ */
+static uword
+snat_session_expire_walk_fn (vlib_main_t * vm, vlib_node_runtime_t * rt,
+                             vlib_frame_t * f)
+{
+  snat_main_t *sm = &snat_main;
+
+  vlib_process_wait_for_event (vm);
+  vlib_process_get_events (vm, NULL);
+
+  while (1)
+    {
+      vlib_process_wait_for_event_or_clock (vm, SNAT_TIMER_INTERVAL);
+      vlib_process_get_events (vm, NULL);
+      snat_expire_sessions (sm, os_get_cpu_number (), vlib_time_now (vm));
+    }
+
+  return 0;
+}
+
+VLIB_REGISTER_NODE (snat_session_expire_walk_node, static) = {
+  .function = snat_session_expire_walk_fn,
+  .type = VLIB_NODE_TYPE_PROCESS,
+  .name = "snat-session-expire-walk",
+};
+
+/* Start aging out the sessions of every thread */
+static void
+snat_session_expiry_enable (snat_main_t * sm)
+{
+  vlib_main_t *vm = vlib_get_main ();
+  int i;
+
+  if (sm->session_expiry_enabled || sm->deterministic ||
+      (sm->static_mapping_only && !(sm->static_mapping_connection_tracking)))
+    return;
+  sm->session_expiry_enabled = 1;
+
+  vlib_process_signal_event (vm, snat_session_expire_walk_node.index, 0, 0);
+
+  if (vec_len (vlib_mains) > 1)
+    {
+      vlib_worker_thread_barrier_sync (vm);
+      for (i = 1; i < vec_len (vlib_mains); i++)
+        vlib_node_set_state (vlib_mains[i], snat_session_expire_node.index,
+                             VLIB_NODE_STATE_POLLING);
+      vlib_worker_thread_barrier_release (vm);
+    }
+}
+
 /**
  * @brief Match SNAT static mapping.
  *
@@ -2592,8 +2839,11 @@ snat_config (vlib_main_t * vm, unformat_input_t * input)
   u8 static_mapping_only = 0;
   u8 static_mapping_connection_tracking = 0;
   vlib_thread_main_t *tm = vlib_get_thread_main ();
+  snat_main_per_thread_data_t *tsm;
+  u32 i;
 
   sm->deterministic = 0;
+  sm->endpoint_dependent = 0;
 
   while (unformat_check_input (input) != UNFORMAT_END_OF_INPUT)
     {
@@ -2623,11 +2873,27 @@ snat_config (vlib_main_t * vm, unformat_input_t * input)
         }
       else if (unformat (input, "deterministic"))
         sm->deterministic = 1;
+      else if (unformat (input, "endpoint-dependent"))
+        sm->endpoint_dependent = 1;
+      else if (unformat (input, "udp timeout %d", &sm->udp_timeout))
+        ;
+      else if (unformat (input, "tcp established timeout %d",
+                         &sm->tcp_established_timeout))
+        ;
+      else if (unformat (input, "tcp transitory timeout %d",
+                         &sm->tcp_transitory_timeout))
+        ;
+      else if (unformat (input, "icmp timeout %d", &sm->icmp_timeout))
+        ;
       else
 	return clib_error_return (0, "unknown input '%U'",
 				  format_unformat_error, input);
     }
 
+  if (sm->endpoint_dependent && (sm->deterministic || static_mapping_only))
+    return clib_error_return (0, "endpoint-dependent mode can't be combined "
+                              "with deterministic or static mapping only");
+
   /* for show commands, etc. */
   sm->translation_buckets = translation_buckets;
   sm->translation_memory_size = translation_memory_size;
@@ -2643,6 +2909,18 @@ snat_config (vlib_main_t * vm, unformat_input_t * input)
   sm->static_mapping_only = static_mapping_only;
   sm->static_mapping_connection_tracking = static_mapping_connection_tracking;
 
+  /* The in2out/out2in nodes of every mode run the timer wheel */
+  vec_validate_aligned (sm->per_thread_data, tm->n_vlib_mains - 1,
+                        CLIB_CACHE_LINE_BYTES);
+  vec_foreach (tsm, sm->per_thread_data)
+    {
+      tw_timer_wheel_init_2t_1w_2048sl (&tsm->timer_wheel,
+                                        snat_session_expired_timer_callback,
+                                        SNAT_TIMER_INTERVAL,
+                                        SNAT_MAX_EXPIRATIONS_PER_RUN);
+      tsm->timer_wheel.last_run_time = vlib_time_now (vm);
+    }
+
   if (sm->deterministic)
     {
       sm->in2out_node_index = snat_det_in2out_node.index;
@@ -2651,9 +2929,18 @@ snat_config (vlib_main_t * vm, unformat_input_t * input)
   else
     {
       sm->worker_in2out_cb = snat_get_worker_in2out_cb;
-      sm->worker_out2in_cb = snat_get_worker_out2in_cb;
-      sm->in2out_node_index = snat_in2out_node.index;
-      sm->out2in_node_index = snat_out2in_node.index;
+      if (sm->endpoint_dependent)
+        {
+          sm->worker_out2in_cb = snat_ed_get_worker_out2in_cb;
+          sm->in2out_node_index = snat_ed_in2out_node.index;
+          sm->out2in_node_index = snat_ed_out2in_node.index;
+        }
+      else
+        {
+          sm->worker_out2in_cb = snat_get_worker_out2in_cb;
+          sm->in2out_node_index = snat_in2out_node.index;
+          sm->out2in_node_index = snat_out2in_node.index;
+        }
       if (!static_mapping_only ||
           (static_mapping_only && static_mapping_connection_tracking))
         {
@@ -2666,16 +2953,45 @@ snat_config (vlib_main_t * vm, unformat_input_t * input)
           clib_bihash_init_8_8 (&sm->worker_by_out, "worker-by-out", user_buckets,
                                 user_memory_size);
 
-          vec_validate (sm->per_thread_data, tm->n_vlib_mains - 1);
+          vec_validate_aligned (sm->per_thread_data, tm->n_vlib_mains - 1,
+                                CLIB_CACHE_LINE_BYTES);
 
-          clib_bihash_init_8_8 (&sm->in2out, "in2out", translation_buckets,
-                                translation_memory_size);
+          /* Each thread owns its tables, no writer lock contention */
+          vec_foreach (tsm, sm->per_thread_data)
+            {
+              i = tsm - sm->per_thread_data;
 
-          clib_bihash_init_8_8 (&sm->out2in, "out2in", translation_buckets,
-                                translation_memory_size);
+              clib_bihash_init_8_8 (&tsm->in2out,
+                                    (char *) format (0, "in2out-%d%c", i, 0),
+                                    translation_buckets,
+                                    translation_memory_size);
 
-          clib_bihash_init_8_8 (&sm->user_hash, "users", user_buckets,
-                                user_memory_size);
+              clib_bihash_init_8_8 (&tsm->out2in,
+                                    (char *) format (0, "out2in-%d%c", i, 0),
+                                    translation_buckets,
+                                    translation_memory_size);
+
+              clib_bihash_init_8_8 (&tsm->user_hash,
+                                    (char *) format (0, "users-%d%c", i, 0),
+                                    user_buckets, user_memory_size);
+
+              if (sm->endpoint_dependent)
+                {
+                  clib_bihash_init_16_8 (&tsm->in2out_ed,
+                                         (char *) format (0, "in2out-ed-%d%c",
+                                                          i, 0),
+                                         translation_buckets,
+                                         translation_memory_size);
+
+                  clib_bihash_init_16_8 (&tsm->out2in_ed,
+                                         (char *) format (0, "out2in-ed-%d%c",
+                                                          i, 0),
+                                         translation_buckets,
+                                         translation_memory_size);
+
+                  tsm->random_seed = random_default_seed () + i;
+                }
+            }
         }
       else
         {
@@ -2736,9 +3052,16 @@ u8 * format_snat_session (u8 * s, va_list * args)
 {
   snat_main_t * sm __attribute__((unused)) = va_arg (*args, snat_main_t *);
   snat_session_t * sess = va_arg (*args, snat_session_t *);
+  ip4_address_t ext_host_addr;
 
   s = format (s, "  i2o %U\n", format_snat_key, &sess->in2out);
   s = format (s, "    o2i %U\n", format_snat_key, &sess->out2in);
+  if (snat_is_session_ed (sess))
+    {
+      ext_host_addr = sess->ext_host_addr;
+      s = format (s, "       external host %U:%d\n", format_ip4_address,
+                  &ext_host_addr, clib_net_to_host_u16 (sess->ext_host_port));
+    }
   s = format (s, "       last heard %.2f\n", sess->last_heard);
   s = format (s, "       total pkts %d, total bytes %lld\n",
               sess->total_pkts, sess->total_bytes);
@@ -2896,11 +3219,21 @@ show_snat_command_fn (vlib_main_t * vm,
     {
       vlib_cli_output (vm, "SNAT mode: deterministic mapping");
     }
+  else if (sm->endpoint_dependent)
+    {
+      vlib_cli_output (vm, "SNAT mode: endpoint-dependent translations "
+                       "enabled");
+    }
   else
     {
       vlib_cli_output (vm, "SNAT mode: dynamic translations enabled");
     }
 
+  vlib_cli_output (vm, "Session timeouts: udp %d, tcp established %d, "
+                   "tcp transitory %d, icmp %d", sm->udp_timeout,
+                   sm->tcp_established_timeout, sm->tcp_transitory_timeout,
+                   sm->icmp_timeout);
+
   if (verbose > 0)
     {
       pool_foreach (i, sm->interfaces,
@@ -3010,10 +3343,6 @@ show_snat_command_fn (vlib_main_t * vm,
 
           if (verbose > 0)
             {
-              vlib_cli_output (vm, "%U", format_bihash_8_8, &sm->in2out,
-                               verbose - 1);
-              vlib_cli_output (vm, "%U", format_bihash_8_8, &sm->out2in,
-                               verbose - 1);
               vlib_cli_output (vm, "%U", format_bihash_8_8, &sm->worker_by_in,
                                verbose - 1);
               vlib_cli_output (vm, "%U", format_bihash_8_8, &sm->worker_by_out,
@@ -3030,6 +3359,17 @@ show_snat_command_fn (vlib_main_t * vm,
                                    w->lcore_id);
                   vlib_cli_output (vm, "  %d list pool elements",
                                    pool_elts (tsm->list_pool));
+                  vlib_cli_output (vm, "  %U", format_bihash_8_8, &tsm->in2out,
+                                   verbose - 1);
+                  vlib_cli_output (vm, "  %U", format_bihash_8_8, &tsm->out2in,
+                                   verbose - 1);
+                  if (sm->endpoint_dependent)
+                    {
+                      vlib_cli_output (vm, "  %U", format_bihash_16_8,
+                                       &tsm->in2out_ed, verbose - 1);
+                      vlib_cli_output (vm, "  %U", format_bihash_16_8,
+                                       &tsm->out2in_ed, verbose - 1);
+                    }
 
                   pool_foreach (u, tsm->users,
                   ({
@@ -3064,6 +3404,138 @@ VLIB_CLI_COMMAND (show_snat_command, static) = {
     .function = show_snat_command_fn,
 };
 
+static clib_error_t *
+show_snat_session_rate_command_fn (vlib_main_t * vm,
+                                   unformat_input_t * input,
+                                   vlib_cli_command_t * cmd)
+{
+  snat_main_t * sm = &snat_main;
+  snat_main_per_thread_data_t *tsm;
+  f64 now = vlib_time_now (vm);
+  u64 created, total = 0;
+  f64 rate, total_rate = 0;
+  uword j;
+
+  if (sm->deterministic || (sm->static_mapping_only &&
+                            !(sm->static_mapping_connection_tracking)))
+    return clib_error_return (0, "no dynamic sessions in this SNAT mode");
+
+  /*
+   * The rate is the number of sessions created since the previous
+   * invocation of the command (or since start) over the elapsed time.
+   */
+  vec_foreach_index (j, sm->per_thread_data)
+    {
+      vlib_worker_thread_t *w = vlib_worker_threads + j;
+
+      tsm = vec_elt_at_index (sm->per_thread_data, j);
+      created = tsm->sessions_created;
+      if (now > tsm->last_sample_time)
+        rate = (created - tsm->last_sessions_created) /
+          (now - tsm->last_sample_time);
+      else
+        rate = 0;
+      tsm->last_sessions_created = created;
+      tsm->last_sample_time = now;
+
+      total += created;
+      total_rate += rate;
+      vlib_cli_output (vm, "Thread %d (%s): %llu sessions created, "
+                       "%.2f sessions/s, %llu expired, %d active", j, w->name,
+                       created, rate, tsm->sessions_expired,
+                       pool_elts (tsm->sessions));
+    }
+  vlib_cli_output (vm, "Total: %llu sessions created, %.2f sessions/s",
+                   total, total_rate);
+
+  return 0;
+}
+
+/*?
+ * @cliexpar
+ * @cliexstart{show snat session-rate}
+ * Show the number of SNAT sessions created by each thread and the
+ * session creation rate since the previous invocation of the command.
+ *  vpp# show snat session-rate
+ *  Thread 0 (vpp_main): 0 sessions created, 0.00 sessions/s, 0 expired, 0 active
+ *  Thread 1 (vpp_wk_0): 51200 sessions created, 10240.00 sessions/s, 0 expired, 51200 active
+ *  Total: 51200 sessions created, 10240.00 sessions/s
+ * @cliexend
+?*/
+VLIB_CLI_COMMAND (show_snat_session_rate_command, static) = {
+    .path = "show snat session-rate",
+    .short_help = "show snat session-rate",
+    .function = show_snat_session_rate_command_fn,
+};
+
+static clib_error_t *
+set_snat_timeout_command_fn (vlib_main_t * vm,
+                             unformat_input_t * input,
+                             vlib_cli_command_t * cmd)
+{
+  snat_main_t * sm = &snat_main;
+  unformat_input_t _line_input, *line_input = &_line_input;
+  u32 udp = sm->udp_timeout;
+  u32 tcp_established = sm->tcp_established_timeout;
+  u32 tcp_transitory = sm->tcp_transitory_timeout;
+  u32 icmp = sm->icmp_timeout;
+  clib_error_t *error = 0;
+
+  /* Get a line of input. */
+  if (!unformat_user (input, unformat_line_input, line_input))
+    return 0;
+
+  while (unformat_check_input (line_input) != UNFORMAT_END_OF_INPUT)
+    {
+      if (unformat (line_input, "udp %u", &udp))
+        ;
+      else if (unformat (line_input, "tcp-established %u", &tcp_established))
+        ;
+      else if (unformat (line_input, "tcp-transitory %u", &tcp_transitory))
+        ;
+      else if (unformat (line_input, "icmp %u", &icmp))
+        ;
+      else
+        {
+          error = clib_error_return (0, "unknown input '%U'",
+            format_unformat_error, line_input);
+          goto done;
+        }
+    }
+
+  if (!udp || !tcp_established || !tcp_transitory || !icmp)
+    {
+      error = clib_error_return (0, "timeout must be non-zero");
+      goto done;
+    }
+
+  /* Running timers pick the new values up when they fire */
+  sm->udp_timeout = udp;
+  sm->tcp_established_timeout = tcp_established;
+  sm->tcp_transitory_timeout = tcp_transitory;
+  sm->icmp_timeout = icmp;
+
+done:
+  unformat_free (line_input);
+
+  return error;
+}
+
+/*?
+ * @cliexpar
+ * @cliexstart{set snat timeout}
+ * Set the idle timeouts of dynamic SNAT sessions, in seconds. Idle
+ * sessions are aged out by a timer wheel on the thread owning them.
+ *  vpp# set snat timeout udp 120 tcp-established 3600
+ * @cliexend
+?*/
+VLIB_CLI_COMMAND (set_snat_timeout_command, static) = {
+    .path = "set snat timeout",
+    .short_help = "set snat timeout [udp <sec>] [tcp-established <sec>] "
+                  "[tcp-transitory <sec>] [icmp <sec>]",
+    .function = set_snat_timeout_command_fn,
+};
+
 
 static void
 snat_ip4_add_del_interface_address_cb (ip4_main_t * im,
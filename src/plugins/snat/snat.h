@@ -24,7 +24,9 @@
 #include <vnet/ip/icmp46_packet.h>
 #include <vnet/api_errno.h>
 #include <vppinfra/bihash_8_8.h>
+#include <vppinfra/bihash_16_8.h>
 #include <vppinfra/dlist.h>
+#include <vppinfra/tw_timer_2t_1w_2048sl.h>
 #include <vppinfra/error.h>
 #include <vlibapi/api.h>
 
@@ -32,6 +34,12 @@
 #define SNAT_UDP_TIMEOUT 300
 #define SNAT_TCP_TRANSITORY_TIMEOUT 240
 #define SNAT_TCP_ESTABLISHED_TIMEOUT 7440
+#define SNAT_ICMP_TIMEOUT 60
+
+/* Session aging timer wheel: one second ticks, a single ring */
+#define SNAT_TIMER_INTERVAL 1.0
+#define SNAT_TIMER_MAX_TICKS 2047
+#define SNAT_MAX_EXPIRATIONS_PER_RUN 256
 
 /* Key */
 typedef struct {
@@ -61,6 +69,23 @@ typedef struct {
   };
 } snat_det_out_key_t;
 
+/* Endpoint-dependent session key, local and remote endpoint */
+typedef struct {
+  union
+  {
+    struct
+    {
+      ip4_address_t l_addr;
+      ip4_address_t r_addr;
+      u32 proto:8,
+        fib_index:24;
+      u16 l_port;
+      u16 r_port;
+    };
+    u64 as_u64[2];
+  };
+} snat_ed_session_key_t;
+
 typedef struct {
   union
   {
@@ -116,6 +141,7 @@ typedef enum {
 
 
 #define SNAT_SESSION_FLAG_STATIC_MAPPING 1
+#define SNAT_SESSION_FLAG_ENDPOINT_DEPENDENT 2
 
 typedef CLIB_PACKED(struct {
   snat_session_key_t out2in;    /* 0-15 */
@@ -139,6 +165,16 @@ typedef CLIB_PACKED(struct {
   /* Outside address */
   u32 outside_address_index;    /* 64-67 */
 
+  /* Idle timer */
+  u32 timer_handle;             /* 68-71 */
+
+  /* snat_session_state_t, selects the idle timeout */
+  u8 state;                     /* 72 */
+
+  /* External host, endpoint-dependent sessions only */
+  ip4_address_t ext_host_addr;  /* 73-76 */
+  u16 ext_host_port;            /* 77-78 */
+
 }) snat_session_t;
 
 
@@ -148,6 +184,8 @@ typedef struct {
   u32 sessions_per_user_list_head_index;
   u32 nsessions;
   u32 nstaticsessions;
+  /* Outside port given out last, endpoint-dependent mode */
+  u16 ed_out_port;
 } snat_user_t;
 
 typedef struct {
@@ -175,8 +213,16 @@ typedef struct {
   u32 sharing_ratio;
   u16 ports_per_host;
   u32 ses_num;
+  /* log2 of sharing_ratio, both ranges are prefixes */
+  u8 sharing_shift;
+  /* inside host offset within its outside address, by outside port - 1024 */
+  u16 * host_by_port;
   /* vector of sessions */
   snat_det_session_t * sessions;
+  /* session lookup by inside address and port */
+  clib_bihash_8_8_t in_hash;
+  /* session lookup by inside address and outside key */
+  clib_bihash_16_8_t out_hash;
 } snat_det_map_t;
 
 typedef struct {
@@ -207,6 +253,25 @@ typedef struct {
 } snat_static_map_resolve_t;
 
 typedef struct {
+  CLIB_CACHE_LINE_ALIGN_MARK (cacheline0);
+
+  /*
+   * Main lookup tables. Worker handoff (worker_by_in / worker_by_out)
+   * sends every packet of a session to the thread which created it,
+   * so only that thread ever writes them.
+   */
+  clib_bihash_8_8_t out2in;
+  clib_bihash_8_8_t in2out;
+
+  /* Endpoint-dependent mode lookup tables, keyed by both endpoints */
+  clib_bihash_16_8_t in2out_ed;
+  clib_bihash_16_8_t out2in_ed;
+  /* Randomize endpoint-dependent port allocation order */
+  u32 random_seed;
+
+  /* Find-a-user => src address lookup */
+  clib_bihash_8_8_t user_hash;
+
   /* User pool */
   snat_user_t * users;
 
@@ -215,6 +280,21 @@ typedef struct {
 
   /* Pool of doubly-linked list elements */
   dlist_elt_t * list_pool;
+
+  /* Idle session aging */
+  tw_timer_wheel_2t_1w_2048sl_t timer_wheel;
+  /* Timers of sessions deleted by other threads, stopped by the owner */
+  u32 * timers_to_stop;
+  /* Time of the current timer wheel run, for the expiry callback */
+  f64 now;
+
+  /* Sessions created and aged out by this thread */
+  u64 sessions_created;
+  u64 sessions_expired;
+
+  /* Last sample taken by "show snat session-rate", main thread only */
+  u64 last_sessions_created;
+  f64 last_sample_time;
 } snat_main_per_thread_data_t;
 
 struct snat_main_s;
@@ -231,13 +311,6 @@ typedef u32 snat_icmp_match_function_t (struct snat_main_s *sm,
 typedef u32 (snat_get_worker_function_t) (ip4_header_t * ip, u32 rx_fib_index);
 
 typedef struct snat_main_s {
-  /* Main lookup tables */
-  clib_bihash_8_8_t out2in;
-  clib_bihash_8_8_t in2out;
-
-  /* Find-a-user => src address lookup */
-  clib_bihash_8_8_t user_hash;
-
   /* Non-translated packets worker lookup => src address + VRF */
   clib_bihash_8_8_t worker_by_in;
 
@@ -296,6 +369,7 @@ typedef struct snat_main_s {
   u8 static_mapping_only;
   u8 static_mapping_connection_tracking;
   u8 deterministic;
+  u8 endpoint_dependent;
   u32 translation_buckets;
   u32 translation_memory_size;
   u32 user_buckets;
@@ -306,6 +380,14 @@ typedef struct snat_main_s {
   u32 inside_vrf_id;
   u32 inside_fib_index;
 
+  /* Session idle timeouts in seconds */
+  u32 udp_timeout;
+  u32 tcp_established_timeout;
+  u32 tcp_transitory_timeout;
+  u32 icmp_timeout;
+  /* Sessions are aged out by snat-session-expire(-walk), once enabled */
+  u8 session_expiry_enabled;
+
   /* tenant VRF aware address pool activation flag */
   u8 vrf_mode;
 
@@ -329,6 +411,8 @@ extern vlib_node_registration_t snat_in2out_worker_handoff_node;
 extern vlib_node_registration_t snat_out2in_worker_handoff_node;
 extern vlib_node_registration_t snat_det_in2out_node;
 extern vlib_node_registration_t snat_det_out2in_node;
+extern vlib_node_registration_t snat_ed_in2out_node;
+extern vlib_node_registration_t snat_ed_out2in_node;
 
 void snat_free_outside_address_and_port (snat_main_t * sm, 
                                          snat_session_key_t * k, 
@@ -349,8 +433,35 @@ void snat_add_del_addr_to_fib (ip4_address_t * addr,
                                u32 sw_if_index,
                                int is_add);
 
+void snat_delete_session (snat_main_t * sm, u32 thread_index,
+                          snat_session_t * s);
+
 format_function_t format_snat_user;
 
+/** \brief Get the per-thread data of the thread owning an out2in session.
+    @param sm SNAT main
+    @param key out2in session key
+    @return per-thread data or 0 if no thread owns the address and port
+*/
+always_inline snat_main_per_thread_data_t *
+snat_get_out2in_thread_data (snat_main_t * sm, snat_session_key_t * key)
+{
+  snat_worker_key_t worker_key;
+  clib_bihash_kv_8_8_t kv, value;
+
+  if (sm->num_workers <= 1)
+    return vec_elt_at_index (sm->per_thread_data, sm->num_workers);
+
+  worker_key.addr = key->addr;
+  worker_key.port = key->port;
+  worker_key.fib_index = key->fib_index;
+  kv.key = worker_key.as_u64;
+  if (clib_bihash_search_8_8 (&sm->worker_by_out, &kv, &value))
+    return 0;
+
+  return vec_elt_at_index (sm->per_thread_data, value.value);
+}
+
 typedef struct {
   u32 cached_sw_if_index;
   u32 cached_ip4_address;
@@ -362,6 +473,12 @@ typedef struct {
 */
 #define snat_is_session_static(s) s->flags & SNAT_SESSION_FLAG_STATIC_MAPPING
 
+/** \brief Check if SNAT session is endpoint-dependent.
+    @param s SNAT session
+    @return 1 if SNAT session is keyed by both endpoints otherwise 0
+*/
+#define snat_is_session_ed(s) (s->flags & SNAT_SESSION_FLAG_ENDPOINT_DEPENDENT)
+
 /* 
  * Why is this here? Because we don't need to touch this layer to
  * simply reply to an icmp. We need to change id to a unique
@@ -438,4 +555,120 @@ icmp_is_error_message (icmp46_header_t * icmp)
   return 0;
 }
 
+/** \brief Get the idle timeout of a SNAT session.
+    @param sm SNAT main
+    @param s SNAT session
+    @return timeout in seconds
+*/
+always_inline u32
+snat_session_timeout (snat_main_t * sm, snat_session_t * s)
+{
+  switch (s->in2out.protocol)
+    {
+    case SNAT_PROTOCOL_TCP:
+      if (s->state == SNAT_SESSION_TCP_ESTABLISHED)
+        return sm->tcp_established_timeout;
+      return sm->tcp_transitory_timeout;
+    case SNAT_PROTOCOL_UDP:
+      return sm->udp_timeout;
+    default:
+      return sm->icmp_timeout;
+    }
+}
+
+always_inline u32
+snat_session_timer_ticks (f64 timeout)
+{
+  u32 ticks = (u32) (timeout / SNAT_TIMER_INTERVAL) + 1;
+
+  /* Longer timeouts are covered by rescheduling when the timer fires */
+  return clib_min (ticks, SNAT_TIMER_MAX_TICKS);
+}
+
+/** \brief Arm the idle timer of a newly created SNAT session.
+    @param sm SNAT main
+    @param tsm per-thread data of the thread owning the session
+    @param s SNAT session
+*/
+always_inline void
+snat_session_timer_start (snat_main_t * sm, snat_main_per_thread_data_t * tsm,
+                          snat_session_t * s)
+{
+  if (s->in2out.protocol == SNAT_PROTOCOL_TCP)
+    s->state = SNAT_SESSION_TCP_SYN_SENT;
+  else if (s->in2out.protocol == SNAT_PROTOCOL_UDP)
+    s->state = SNAT_SESSION_UDP_ACTIVE;
+  else
+    s->state = SNAT_SESSION_UNKNOWN;
+
+  s->timer_handle =
+    tw_timer_start_2t_1w_2048sl (&tsm->timer_wheel, s - tsm->sessions, 0,
+                                 snat_session_timer_ticks
+                                 (snat_session_timeout (sm, s)));
+}
+
+/** \brief Stop the idle timer of a SNAT session being deleted.
+    Only the owning thread touches its timer wheel. A session deleted
+    from another thread, with the workers held at the barrier, has its
+    timer queued and stopped by the owner in snat_expire_sessions().
+    @param sm SNAT main
+    @param thread_index thread owning the session
+    @param s SNAT session
+*/
+always_inline void
+snat_session_timer_stop (snat_main_t * sm, u32 thread_index,
+                         snat_session_t * s)
+{
+  snat_main_per_thread_data_t *tsm =
+    vec_elt_at_index (sm->per_thread_data, thread_index);
+
+  if (PREDICT_TRUE (thread_index == os_get_cpu_number ()))
+    tw_timer_stop_2t_1w_2048sl (&tsm->timer_wheel, s->timer_handle);
+  else
+    vec_add1 (tsm->timers_to_stop, s->timer_handle);
+}
+
+/** \brief Track the TCP state of a SNAT session, for the idle timeout.
+    @param s SNAT session
+    @param tcp TCP header of a packet of the session, either direction
+*/
+always_inline void
+snat_session_update_tcp_state (snat_session_t * s, tcp_header_t * tcp)
+{
+  if (tcp->flags & (TCP_FLAG_FIN | TCP_FLAG_RST))
+    s->state = SNAT_SESSION_TCP_FIN_WAIT;
+  else if (tcp->flags & TCP_FLAG_SYN)
+    s->state = SNAT_SESSION_TCP_SYN_SENT;
+  else if (tcp->flags & TCP_FLAG_ACK && s->state == SNAT_SESSION_TCP_SYN_SENT)
+    s->state = SNAT_SESSION_TCP_ESTABLISHED;
+}
+
+/** \brief Age out the idle sessions of a thread.
+    Sessions whose timer fired are removed in batches of at most
+    SNAT_MAX_EXPIRATIONS_PER_RUN per call. Called without traffic too:
+    by the snat-session-expire input node on the workers and by the
+    snat-session-expire-walk process on the main thread.
+    @param sm SNAT main
+    @param thread_index thread owning the sessions, the calling thread
+    @param now current time
+*/
+always_inline void
+snat_expire_sessions (snat_main_t * sm, u32 thread_index, f64 now)
+{
+  snat_main_per_thread_data_t *tsm =
+    vec_elt_at_index (sm->per_thread_data, thread_index);
+
+  u32 *handle;
+
+  if (PREDICT_FALSE (vec_len (tsm->timers_to_stop) != 0))
+    {
+      vec_foreach (handle, tsm->timers_to_stop)
+        tw_timer_stop_2t_1w_2048sl (&tsm->timer_wheel, handle[0]);
+      _vec_len (tsm->timers_to_stop) = 0;
+    }
+
+  tsm->now = now;
+  tw_timer_expire_timers_2t_1w_2048sl (&tsm->timer_wheel, now);
+}
+
 #endif /* __included_snat_h__ */
@@ -40,22 +40,75 @@ int
 snat_det_add_map (snat_main_t * sm, ip4_address_t * in_addr, u8 in_plen,
 		  ip4_address_t * out_addr, u8 out_plen, int is_add)
 {
-  snat_det_map_t *det_map;
+  snat_det_map_t *det_map = 0, *dm;
   static snat_det_session_t empty_snat_det_session = { 0 };
   snat_interface_t *i;
+  ip4_address_t in_cmp, out_cmp;
+  u32 n_users, port;
+  uword memory_size;
 
-  pool_get (sm->det_maps, det_map);
-  memset (det_map, 0, sizeof (*det_map));
-  det_map->in_addr.as_u32 = in_addr->as_u32 & ip4_main.fib_masks[in_plen];
-  det_map->in_plen = in_plen;
-  det_map->out_addr.as_u32 = out_addr->as_u32 & ip4_main.fib_masks[out_plen];
-  det_map->out_plen = out_plen;
-  det_map->sharing_ratio = (1 << (32 - in_plen)) / (1 << (32 - out_plen));
-  det_map->ports_per_host = (65535 - 1023) / det_map->sharing_ratio;
-
-  vec_validate_init_empty (det_map->sessions,
-			   SNAT_DET_SES_PER_USER * (1 << (32 - in_plen)) - 1,
-			   empty_snat_det_session);
+  in_cmp.as_u32 = in_addr->as_u32 & ip4_main.fib_masks[in_plen];
+  out_cmp.as_u32 = out_addr->as_u32 & ip4_main.fib_masks[out_plen];
+  /* *INDENT-OFF* */
+  pool_foreach (dm, sm->det_maps,
+  ({
+    if (dm->in_addr.as_u32 == in_cmp.as_u32 && dm->in_plen == in_plen &&
+        dm->out_addr.as_u32 == out_cmp.as_u32 && dm->out_plen == out_plen)
+      det_map = dm;
+  }));
+  /* *INDENT-ON* */
+
+  if (is_add)
+    {
+      if (det_map)
+	return VNET_API_ERROR_VALUE_EXIST;
+      if (out_plen < in_plen)
+	return VNET_API_ERROR_INVALID_VALUE;
+
+      pool_get (sm->det_maps, det_map);
+      memset (det_map, 0, sizeof (*det_map));
+      det_map->in_addr.as_u32 = in_cmp.as_u32;
+      det_map->in_plen = in_plen;
+      det_map->out_addr.as_u32 = out_cmp.as_u32;
+      det_map->out_plen = out_plen;
+      det_map->sharing_ratio = (1 << (32 - in_plen)) / (1 << (32 - out_plen));
+      det_map->sharing_shift = out_plen - in_plen;
+      det_map->ports_per_host = (65535 - 1023) / det_map->sharing_ratio;
+
+      /*
+       * Precompute the reverse mapping of every outside port, indexed by
+       * the port less 1024 wrapped to 16 bits. Ports below 1024 map past
+       * the inside range and never hit a session.
+       */
+      vec_validate (det_map->host_by_port, 0xffff);
+      for (port = 0; port <= 0xffff; port++)
+	det_map->host_by_port[port] = port / det_map->ports_per_host;
+
+      n_users = 1 << (32 - in_plen);
+      vec_validate_init_empty (det_map->sessions,
+			       SNAT_DET_SES_PER_USER * n_users - 1,
+			       empty_snat_det_session);
+
+      /* Both tables grow with the map, the 16_8 entries are half bigger */
+      memory_size = clib_max ((uword) n_users * SNAT_DET_HASH_MEMORY_PER_USER,
+			      SNAT_DET_HASH_MIN_MEMORY);
+      clib_bihash_init_8_8 (&det_map->in_hash, "snat-det-in",
+			    clib_max (n_users, 1024), memory_size);
+      clib_bihash_init_16_8 (&det_map->out_hash, "snat-det-out",
+			     clib_max (n_users, 1024),
+			     memory_size + memory_size / 2);
+    }
+  else
+    {
+      if (!det_map)
+	return VNET_API_ERROR_NO_SUCH_ENTRY;
+
+      clib_bihash_free_8_8 (&det_map->in_hash);
+      clib_bihash_free_16_8 (&det_map->out_hash);
+      vec_free (det_map->sessions);
+      vec_free (det_map->host_by_port);
+      pool_put (sm->det_maps, det_map);
+    }
 
   /* Add/del external address range to FIB */
   /* *INDENT-OFF* */
@@ -28,6 +28,25 @@
 
 #define SNAT_DET_SES_PER_USER 1000
 
+/* Session hash memory reserved per inside host, and the least per map */
+#define SNAT_DET_HASH_MEMORY_PER_USER (4 << 10)
+#define SNAT_DET_HASH_MIN_MEMORY (256 << 10)
+
+/* Session hash key, inside address and port */
+typedef struct
+{
+  union
+  {
+    struct
+    {
+      ip4_address_t in_addr;
+      u16 in_port;
+      u16 rsvd;
+    };
+    u64 as_u64;
+  };
+} snat_det_in_key_t;
+
 
 int snat_det_add_map (snat_main_t * sm, ip4_address_t * in_addr, u8 in_plen,
 		      ip4_address_t * out_addr, u8 out_plen, int is_add);
@@ -78,11 +97,12 @@ snat_det_forward (snat_det_map_t * dm, ip4_address_t * in_addr,
 
   in_offset = clib_net_to_host_u32 (in_addr->as_u32) -
     clib_net_to_host_u32 (dm->in_addr.as_u32);
-  out_offset = in_offset / dm->sharing_ratio;
+  out_offset = in_offset >> dm->sharing_shift;
   out_addr->as_u32 =
     clib_host_to_net_u32 (clib_net_to_host_u32 (dm->out_addr.as_u32) +
 			  out_offset);
-  *lo_port = 1024 + dm->ports_per_host * (in_offset % dm->sharing_ratio);
+  *lo_port = 1024 +
+    dm->ports_per_host * (in_offset & (dm->sharing_ratio - 1));
 }
 
 always_inline void
@@ -93,8 +113,8 @@ snat_det_reverse (snat_det_map_t * dm, ip4_address_t * out_addr, u16 out_port,
 
   out_offset = clib_net_to_host_u32 (out_addr->as_u32) -
     clib_net_to_host_u32 (dm->out_addr.as_u32);
-  in_offset1 = out_offset * dm->sharing_ratio;
-  in_offset2 = (out_port - 1024) / dm->ports_per_host;
+  in_offset1 = out_offset << dm->sharing_shift;
+  in_offset2 = dm->host_by_port[(u16) (out_port - 1024)];
   in_addr->as_u32 =
     clib_host_to_net_u32 (clib_net_to_host_u32 (dm->in_addr.as_u32) +
 			  in_offset1 + in_offset2);
@@ -107,63 +127,105 @@ snat_det_user_ses_offset (ip4_address_t * addr, u8 plen)
     SNAT_DET_SES_PER_USER;
 }
 
+always_inline void
+snat_det_ses_in_addr (snat_det_map_t * dm, snat_det_session_t * ses,
+		      ip4_address_t * in_addr)
+{
+  u32 user = (ses - dm->sessions) / SNAT_DET_SES_PER_USER;
+
+  in_addr->as_u32 =
+    clib_host_to_net_u32 (clib_net_to_host_u32 (dm->in_addr.as_u32) + user);
+}
+
+/*
+ * The hashes are only an index, a hit is checked against the session
+ * slot, which may have been closed and reused meanwhile.
+ */
 always_inline snat_det_session_t *
 snat_det_get_ses_by_out (snat_det_map_t * dm, ip4_address_t * in_addr,
 			 u64 out_key)
 {
-  u32 user_offset;
-  u16 i;
+  clib_bihash_kv_16_8_t kv, value;
+  snat_det_session_t *ses;
 
-  user_offset = snat_det_user_ses_offset (in_addr, dm->in_plen);
-  for (i = 0; i < SNAT_DET_SES_PER_USER; i++)
-    {
-      if (dm->sessions[i + user_offset].out.as_u64 == out_key)
-	return &dm->sessions[i + user_offset];
-    }
+  kv.key[0] = in_addr->as_u32;
+  kv.key[1] = out_key;
+  if (clib_bihash_search_16_8 (&dm->out_hash, &kv, &value))
+    return 0;
 
-  return 0;
+  ses = vec_elt_at_index (dm->sessions, value.value);
+  if (PREDICT_FALSE (!ses->in_port || ses->out.as_u64 != out_key))
+    return 0;
+
+  return ses;
 }
 
 always_inline snat_det_session_t *
 snat_det_find_ses_by_in (snat_det_map_t * dm,
 			 ip4_address_t * in_addr, u16 in_port)
 {
-  u32 user_offset;
-  u16 i;
+  snat_det_in_key_t key;
+  clib_bihash_kv_8_8_t kv, value;
+  snat_det_session_t *ses;
 
-  user_offset = snat_det_user_ses_offset (in_addr, dm->in_plen);
-  for (i = 0; i < SNAT_DET_SES_PER_USER; i++)
-    {
-      if (dm->sessions[i + user_offset].in_port == in_port)
-	return &dm->sessions[i + user_offset];
-    }
+  key.in_addr = *in_addr;
+  key.in_port = in_port;
+  key.rsvd = 0;
+  kv.key = key.as_u64;
+  if (clib_bihash_search_8_8 (&dm->in_hash, &kv, &value))
+    return 0;
 
-  return 0;
+  ses = vec_elt_at_index (dm->sessions, value.value);
+  if (PREDICT_FALSE (ses->in_port != in_port))
+    return 0;
+
+  return ses;
 }
 
 always_inline snat_det_session_t *
 snat_det_ses_create (snat_det_map_t * dm, ip4_address_t * in_addr,
 		     u16 in_port, snat_det_out_key_t * out)
 {
+  snat_det_session_t *ses;
+  snat_det_in_key_t key;
+  clib_bihash_kv_8_8_t kv;
+  clib_bihash_kv_16_8_t kv16;
   u32 user_offset;
-  u16 i;
+  u16 i, j;
 
   user_offset = snat_det_user_ses_offset (in_addr, dm->in_plen);
 
+  /* Start probing at a slot picked by the port, it is mostly free */
+  j = in_port % SNAT_DET_SES_PER_USER;
   for (i = 0; i < SNAT_DET_SES_PER_USER; i++)
     {
-      if (!dm->sessions[i + user_offset].in_port)
-	{
-	  if (__sync_bool_compare_and_swap
-	      (&dm->sessions[i + user_offset].in_port, 0, in_port))
-	    {
-	      dm->sessions[i + user_offset].out.as_u64 = out->as_u64;
-	      dm->sessions[i + user_offset].state = SNAT_SESSION_UNKNOWN;
-	      dm->sessions[i + user_offset].expire = 0;
-	      __sync_add_and_fetch (&dm->ses_num, 1);
-	      return &dm->sessions[i + user_offset];
-	    }
-	}
+      ses = &dm->sessions[user_offset + j];
+      if (++j == SNAT_DET_SES_PER_USER)
+	j = 0;
+
+      if (ses->in_port)
+	continue;
+      if (!__sync_bool_compare_and_swap (&ses->in_port, 0, in_port))
+	continue;
+
+      ses->out.as_u64 = out->as_u64;
+      ses->state = SNAT_SESSION_UNKNOWN;
+      ses->expire = 0;
+      __sync_add_and_fetch (&dm->ses_num, 1);
+
+      key.in_addr = *in_addr;
+      key.in_port = in_port;
+      key.rsvd = 0;
+      kv.key = key.as_u64;
+      kv.value = ses - dm->sessions;
+      clib_bihash_add_del_8_8 (&dm->in_hash, &kv, 1 /* is_add */ );
+
+      kv16.key[0] = in_addr->as_u32;
+      kv16.key[1] = out->as_u64;
+      kv16.value = ses - dm->sessions;
+      clib_bihash_add_del_16_8 (&dm->out_hash, &kv16, 1 /* is_add */ );
+
+      return ses;
     }
 
   return 0;
@@ -172,7 +234,26 @@ snat_det_ses_create (snat_det_map_t * dm, ip4_address_t * in_addr,
 always_inline void
 snat_det_ses_close (snat_det_map_t * dm, snat_det_session_t * ses)
 {
-  if (__sync_bool_compare_and_swap (&ses->in_port, ses->in_port, 0))
+  u16 in_port = ses->in_port;
+  snat_det_in_key_t key;
+  clib_bihash_kv_8_8_t kv;
+  clib_bihash_kv_16_8_t kv16;
+
+  if (!in_port)
+    return;
+
+  /* Unhash before the slot can be reused */
+  snat_det_ses_in_addr (dm, ses, &key.in_addr);
+  key.in_port = in_port;
+  key.rsvd = 0;
+  kv.key = key.as_u64;
+  clib_bihash_add_del_8_8 (&dm->in_hash, &kv, 0 /* is_add */ );
+
+  kv16.key[0] = key.in_addr.as_u32;
+  kv16.key[1] = ses->out.as_u64;
+  clib_bihash_add_del_16_8 (&dm->out_hash, &kv16, 0 /* is_add */ );
+
+  if (__sync_bool_compare_and_swap (&ses->in_port, in_port, 0))
     {
       ses->out.as_u64 = 0;
       __sync_add_and_fetch (&dm->ses_num, -1);
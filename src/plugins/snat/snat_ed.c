@@ -0,0 +1,493 @@
+/*
+ * snat_ed.c - endpoint-dependent NAT
+ *
+ * Copyright (c) 2017 Cisco and/or its affiliates.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/**
+ * @file
+ * @brief endpoint-dependent NAT
+ */
+
+#include <snat/snat_ed.h>
+#include <snat/snat_ipfix_logging.h>
+
+
+always_inline int
+snat_ed_port_is_static (snat_address_t * a, u8 proto, u32 port)
+{
+  switch (proto)
+    {
+#define _(N, i, n, s) \
+    case SNAT_PROTOCOL_##N: \
+      return clib_bitmap_get (a->busy_##n##_port_bitmap, port);
+      foreach_snat_protocol
+#undef _
+    default:
+      return 1;
+    }
+}
+
+/* Is the outside port usable for a new session towards the remote */
+always_inline int
+snat_ed_port_is_free (snat_main_t * sm, snat_main_per_thread_data_t * tsm,
+		      snat_address_t * a, snat_session_key_t * in2out,
+		      ip4_address_t * r_addr, u16 r_port, u32 port_lo,
+		      u32 n_ports, u32 portnum)
+{
+  snat_ed_session_key_t key;
+  clib_bihash_kv_16_8_t kv, value;
+
+  if (portnum < port_lo || portnum >= port_lo + n_ports)
+    return 0;
+  if (snat_ed_port_is_static (a, in2out->protocol, portnum))
+    return 0;
+
+  snat_ed_make_key (&key, a->addr, clib_host_to_net_u16 (portnum),
+		    *r_addr, r_port, in2out->protocol, sm->outside_fib_index);
+  kv.key[0] = key.as_u64[0];
+  kv.key[1] = key.as_u64[1];
+  return clib_bihash_search_16_8 (&tsm->out2in_ed, &kv, &value) != 0;
+}
+
+/**
+ * @brief Allocate outside address and port for endpoint-dependent session.
+ *
+ * The port only has to be unique towards the remote endpoint. All sessions
+ * of a user get the same outside address, the port of the previous session
+ * of the user and the inside port are tried before random ports of the
+ * thread's range, then the whole range is swept. Ports of static mappings
+ * are never handed out. If no port of the user's address is free, the
+ * allocation fails rather than giving the user a second address.
+ *
+ * @param sm            SNAT main.
+ * @param thread_index  Thread creating the session.
+ * @param u             User creating the session.
+ * @param in2out        Inside address and port.
+ * @param r_addr        Remote address.
+ * @param r_port        Remote port.
+ * @param out2in        Allocated outside address and port.
+ * @param address_indexp Index of the allocated outside address.
+ *
+ * @returns 0 on success, 1 if no port is available.
+ */
+static int
+snat_ed_alloc_outside_port (snat_main_t * sm, u32 thread_index,
+			    snat_user_t * u, snat_session_key_t * in2out,
+			    ip4_address_t * r_addr, u16 r_port,
+			    snat_session_key_t * out2in, u32 * address_indexp)
+{
+  snat_main_per_thread_data_t *tsm =
+    vec_elt_at_index (sm->per_thread_data, thread_index);
+  snat_address_t *a;
+  u32 port_lo, n_ports, portnum;
+  u32 n_addresses = vec_len (sm->addresses);
+  u32 i, j, attempt;
+
+  snat_ed_thread_port_range (sm, thread_index, &port_lo, &n_ports);
+
+  for (j = 0; j < n_addresses; j++)
+    {
+      /* Paired pooling: the first eligible address is the user's */
+      i = (clib_net_to_host_u32 (in2out->addr.as_u32) + j) % n_addresses;
+      a = sm->addresses + i;
+      if (sm->vrf_mode && a->fib_index != ~0
+	  && a->fib_index != in2out->fib_index)
+	continue;
+
+      for (attempt = 0; attempt < SNAT_ED_PORT_ALLOC_ATTEMPTS; attempt++)
+	{
+	  if (attempt == 0)
+	    portnum = u->ed_out_port;
+	  else if (attempt == 1)
+	    portnum = clib_net_to_host_u16 (in2out->port);
+	  else
+	    portnum = port_lo + random_u32 (&tsm->random_seed) % n_ports;
+
+	  if (snat_ed_port_is_free (sm, tsm, a, in2out, r_addr, r_port,
+				    port_lo, n_ports, portnum))
+	    goto found;
+	}
+
+      /* Random probing failed, sweep the range before giving up */
+      for (portnum = port_lo; portnum < port_lo + n_ports; portnum++)
+	if (snat_ed_port_is_free (sm, tsm, a, in2out, r_addr, r_port,
+				  port_lo, n_ports, portnum))
+	  goto found;
+
+      /* Keep the user on its address, don't move on to the next one */
+      break;
+    }
+
+  /* Totally out of translations to use... */
+  snat_ipfix_logging_addresses_exhausted (0);
+  return 1;
+
+found:
+  out2in->addr = a->addr;
+  out2in->port = clib_host_to_net_u16 (portnum);
+  *address_indexp = i;
+  u->ed_out_port = portnum;
+  return 0;
+}
+
+/* Delete the least recently used dynamic session of an over quota user */
+static void
+snat_ed_user_recycle_session (snat_main_t * sm, u32 thread_index,
+			      snat_user_t * u)
+{
+  snat_main_per_thread_data_t *tsm =
+    vec_elt_at_index (sm->per_thread_data, thread_index);
+  u32 head_index = u->sessions_per_user_list_head_index;
+  dlist_elt_t *elt;
+  u32 elt_index;
+  snat_session_t *s;
+
+  elt = pool_elt_at_index (tsm->list_pool, head_index);
+  elt_index = elt->next;
+  while (elt_index != head_index)
+    {
+      elt = pool_elt_at_index (tsm->list_pool, elt_index);
+      s = pool_elt_at_index (tsm->sessions, elt->value);
+      if (!snat_is_session_static (s))
+	{
+	  snat_session_timer_stop (sm, thread_index, s);
+	  snat_delete_session (sm, thread_index, s);
+	  return;
+	}
+      elt_index = elt->next;
+    }
+}
+
+/**
+ * @brief Create endpoint-dependent SNAT session.
+ *
+ * @param sm           SNAT main.
+ * @param thread_index Thread owning the session, the calling thread.
+ * @param in2out       Inside address, port, protocol and FIB index.
+ * @param out2in       Outside address and port of the static mapping if
+ *                     is_static, otherwise allocated here.
+ * @param r_addr       Remote address.
+ * @param r_port       Remote port, 0 for ICMP.
+ * @param is_static    Session is created from a static mapping.
+ *
+ * @returns session or 0 if out of ports.
+ */
+snat_session_t *
+snat_ed_session_create (snat_main_t * sm, u32 thread_index,
+			snat_session_key_t * in2out,
+			snat_session_key_t * out2in, ip4_address_t * r_addr,
+			u16 r_port, u8 is_static)
+{
+  snat_main_per_thread_data_t *tsm =
+    vec_elt_at_index (sm->per_thread_data, thread_index);
+  snat_user_key_t user_key;
+  clib_bihash_kv_8_8_t kv, value;
+  clib_bihash_kv_16_8_t in2out_kv, out2in_kv;
+  dlist_elt_t *elt;
+  snat_user_t *u = 0;
+  snat_session_t *s;
+  u32 address_index = ~0;
+
+  user_key.addr = in2out->addr;
+  user_key.fib_index = in2out->fib_index;
+  kv.key = user_key.as_u64;
+
+  if (!clib_bihash_search_8_8 (&tsm->user_hash, &kv, &value))
+    {
+      u = pool_elt_at_index (tsm->users, value.value);
+      /* Over quota? Recycle the least recently used dynamic session */
+      if (!is_static && u->nsessions >= sm->max_translations_per_user)
+	{
+	  snat_ed_user_recycle_session (sm, thread_index, u);
+	  /* The user is gone if that was its last session */
+	  u = 0;
+	  if (!clib_bihash_search_8_8 (&tsm->user_hash, &kv, &value))
+	    u = pool_elt_at_index (tsm->users, value.value);
+	}
+    }
+
+  if (!u)
+    {
+      pool_get (tsm->users, u);
+      memset (u, 0, sizeof (*u));
+      u->addr = in2out->addr;
+      u->fib_index = in2out->fib_index;
+
+      pool_get (tsm->list_pool, elt);
+      u->sessions_per_user_list_head_index = elt - tsm->list_pool;
+      clib_dlist_init (tsm->list_pool, u->sessions_per_user_list_head_index);
+
+      kv.value = u - tsm->users;
+      clib_bihash_add_del_8_8 (&tsm->user_hash, &kv, 1 /* is_add */ );
+    }
+
+  if (!is_static
+      && snat_ed_alloc_outside_port (sm, thread_index, u, in2out, r_addr,
+				     r_port, out2in, &address_index))
+    return 0;
+
+  pool_get (tsm->sessions, s);
+  memset (s, 0, sizeof (*s));
+
+  s->in2out = *in2out;
+  s->out2in = *out2in;
+  s->out2in.protocol = in2out->protocol;
+  s->out2in.fib_index = sm->outside_fib_index;
+  s->ext_host_addr = *r_addr;
+  s->ext_host_port = r_port;
+  s->outside_address_index = address_index;
+  s->flags = SNAT_SESSION_FLAG_ENDPOINT_DEPENDENT;
+  if (is_static)
+    {
+      s->flags |= SNAT_SESSION_FLAG_STATIC_MAPPING;
+      u->nstaticsessions++;
+    }
+  else
+    u->nsessions++;
+
+  /* Create list elts */
+  pool_get (tsm->list_pool, elt);
+  clib_dlist_init (tsm->list_pool, elt - tsm->list_pool);
+  elt->value = s - tsm->sessions;
+  s->per_user_index = elt - tsm->list_pool;
+  s->per_user_list_head_index = u->sessions_per_user_list_head_index;
+  clib_dlist_addtail (tsm->list_pool, s->per_user_list_head_index,
+		      s->per_user_index);
+
+  /* Add to translation hashes */
+  snat_ed_session_make_kvs (s, &in2out_kv, &out2in_kv);
+  in2out_kv.value = s - tsm->sessions;
+  if (clib_bihash_add_del_16_8 (&tsm->in2out_ed, &in2out_kv, 1 /* is_add */ ))
+    clib_warning ("in2out-ed key add failed");
+  out2in_kv.value = s - tsm->sessions;
+  if (clib_bihash_add_del_16_8 (&tsm->out2in_ed, &out2in_kv, 1 /* is_add */ ))
+    clib_warning ("out2in-ed key add failed");
+
+  snat_session_timer_start (sm, tsm, s);
+  tsm->sessions_created++;
+
+  /* log NAT event */
+  snat_ipfix_logging_nat44_ses_create (s->in2out.addr.as_u32,
+				       s->out2in.addr.as_u32,
+				       s->in2out.protocol,
+				       s->in2out.port,
+				       s->out2in.port, s->in2out.fib_index);
+  return s;
+}
+
+/**
+ * @brief Select the worker for a translated packet.
+ *
+ * Static mappings keep the worker of their local host, dynamic sessions
+ * are owned by the worker whose port range contains the outside port.
+ */
+u32
+snat_ed_get_worker_out2in_cb (ip4_header_t * ip0, u32 rx_fib_index0)
+{
+  snat_main_t *sm = &snat_main;
+  snat_worker_key_t key0;
+  clib_bihash_kv_8_8_t kv0, value0;
+  udp_header_t *udp0;
+  u32 port, ports_per_worker, i;
+
+  udp0 = ip4_next_header (ip0);
+
+  key0.addr = ip0->dst_address;
+  key0.port = udp0->dst_port;
+  key0.fib_index = rx_fib_index0;
+
+  if (PREDICT_FALSE (ip0->protocol == IP_PROTOCOL_ICMP))
+    {
+      icmp46_header_t *icmp0 = (icmp46_header_t *) udp0;
+      icmp_echo_header_t *echo0 = (icmp_echo_header_t *) (icmp0 + 1);
+      key0.port = echo0->identifier;
+    }
+  port = clib_net_to_host_u16 (key0.port);
+
+  kv0.key = key0.as_u64;
+  if (!clib_bihash_search_8_8 (&sm->worker_by_out, &kv0, &value0))
+    return value0.value;
+
+  /* Static mapping without port */
+  key0.port = 0;
+  kv0.key = key0.as_u64;
+  if (!clib_bihash_search_8_8 (&sm->worker_by_out, &kv0, &value0))
+    return value0.value;
+
+  if (port < SNAT_ED_PORT_LO)
+    return sm->first_worker_index + sm->workers[0];
+
+  ports_per_worker = SNAT_ED_N_PORTS / vec_len (sm->workers);
+  i = clib_min ((port - SNAT_ED_PORT_LO) / ports_per_worker,
+		vec_len (sm->workers) - 1);
+  return sm->first_worker_index + sm->workers[i];
+}
+
+static clib_error_t *
+snat_ed_bench_command_fn (vlib_main_t * vm, unformat_input_t * input,
+			  vlib_cli_command_t * cmd)
+{
+  snat_main_t *sm = &snat_main;
+  u32 thread_index = os_get_cpu_number ();
+  snat_main_per_thread_data_t *tsm;
+  unformat_input_t _line_input, *line_input = &_line_input;
+  u32 n_subscribers = 1000, n_sessions = 100, n_destinations = 10;
+  u32 *session_indices = 0, *si;
+  uword *ports = 0;
+  snat_session_key_t in2out, out2in;
+  ip4_address_t r_addr;
+  snat_session_t *s;
+  u32 i, j, n_created = 0, n_failed = 0;
+  u64 n_ports = 0;
+  f64 t0, t1, t2;
+  clib_error_t *error = 0;
+
+  if (!sm->endpoint_dependent)
+    return clib_error_return (0, "endpoint-dependent mode not enabled");
+  if (vec_len (sm->addresses) == 0)
+    return clib_error_return (0, "no SNAT pool addresses");
+
+  /* Get a line of input. */
+  if (unformat_user (input, unformat_line_input, line_input))
+    {
+      while (unformat_check_input (line_input) != UNFORMAT_END_OF_INPUT)
+	{
+	  if (unformat (line_input, "subscribers %u", &n_subscribers))
+	    ;
+	  else if (unformat (line_input, "sessions %u", &n_sessions))
+	    ;
+	  else if (unformat (line_input, "destinations %u", &n_destinations))
+	    ;
+	  else
+	    {
+	      error = clib_error_return (0, "unknown input '%U'",
+					 format_unformat_error, line_input);
+	      unformat_free (line_input);
+	      return error;
+	    }
+	}
+      unformat_free (line_input);
+    }
+
+  if (n_sessions == 0 || n_sessions > sm->max_translations_per_user)
+    {
+      return clib_error_return (0, "sessions must be 1 to %u",
+				sm->max_translations_per_user);
+    }
+  if (n_subscribers == 0 || n_destinations == 0 || n_sessions > 16384)
+    {
+      return clib_error_return (0, "subscribers and destinations must be "
+				"non zero, sessions at most 16384");
+    }
+
+  tsm = vec_elt_at_index (sm->per_thread_data, thread_index);
+  vec_validate (session_indices, n_subscribers * n_sessions - 1);
+
+  /*
+   * Subscribers 100.64.0.0/10 open sessions from consecutive ephemeral
+   * ports to https servers in 198.18.0.0/15, round robin.
+   */
+  memset (&in2out, 0, sizeof (in2out));
+  in2out.protocol = SNAT_PROTOCOL_TCP;
+  in2out.fib_index = sm->inside_fib_index;
+  memset (&out2in, 0, sizeof (out2in));
+
+  t0 = vlib_time_now (vm);
+  for (i = 0; i < n_subscribers; i++)
+    {
+      in2out.addr.as_u32 = clib_host_to_net_u32 (0x64400000 + i);
+      for (j = 0; j < n_sessions; j++)
+	{
+	  in2out.port = clib_host_to_net_u16 (49152 + j);
+	  r_addr.as_u32 = clib_host_to_net_u32 (0xc6120000 +
+						j % n_destinations);
+	  s = snat_ed_session_create (sm, thread_index, &in2out, &out2in,
+				      &r_addr, clib_host_to_net_u16 (443),
+				      0 /* is_static */ );
+	  session_indices[i * n_sessions + j] = s ? s - tsm->sessions : ~0;
+	  if (s)
+	    n_created++;
+	  else
+	    n_failed++;
+	}
+    }
+  t1 = vlib_time_now (vm);
+
+  for (i = 0; i < n_subscribers; i++)
+    {
+      for (j = 0; j < n_sessions; j++)
+	{
+	  si = vec_elt_at_index (session_indices, i * n_sessions + j);
+	  if (si[0] == ~0)
+	    continue;
+	  s = pool_elt_at_index (tsm->sessions, si[0]);
+	  ports = clib_bitmap_set (ports,
+				   clib_net_to_host_u16 (s->out2in.port), 1);
+	}
+      n_ports += clib_bitmap_count_set_bits (ports);
+      clib_bitmap_zero (ports);
+    }
+
+  t2 = vlib_time_now (vm);
+  vec_foreach (si, session_indices)
+  {
+    if (si[0] == ~0)
+      continue;
+    s = pool_elt_at_index (tsm->sessions, si[0]);
+    snat_session_timer_stop (sm, thread_index, s);
+    snat_delete_session (sm, thread_index, s);
+  }
+
+  vlib_cli_output (vm, "%u sessions created in %.6f seconds, %.0f sessions/s",
+		   n_created, t1 - t0, (f64) n_created / (t1 - t0));
+  vlib_cli_output (vm, "%u sessions deleted in %.6f seconds",
+		   n_created, vlib_time_now (vm) - t2);
+  if (n_failed)
+    vlib_cli_output (vm, "%u sessions failed, out of ports", n_failed);
+  vlib_cli_output (vm, "outside ports per subscriber: %.2f "
+		   "(%u without port overloading)",
+		   (f64) n_ports / n_subscribers, n_sessions);
+
+  vec_free (session_indices);
+  clib_bitmap_free (ports);
+  return 0;
+}
+
+/*?
+ * @cliexpar
+ * @cliexstart{test snat ed-bench}
+ * Create and delete endpoint-dependent sessions on the calling thread and
+ * report the session setup rate and the outside ports used per subscriber.
+ * Requires endpoint-dependent mode and at least one pool address:
+ *  vpp# test snat ed-bench subscribers 1000 sessions 100 destinations 10
+ * With 100 sessions spread over 10 destinations every subscriber needs
+ * about 10 outside ports, against 100 without port overloading.
+ * @cliexend
+?*/
+/* *INDENT-OFF* */
+VLIB_CLI_COMMAND (snat_ed_bench_command, static) = {
+  .path = "test snat ed-bench",
+  .short_help = "test snat ed-bench [subscribers <n>] [sessions <n>] "
+                "[destinations <n>]",
+  .function = snat_ed_bench_command_fn,
+};
+/* *INDENT-ON* */
+
+/*
+ * fd.io coding-style-patch-verification: ON
+ *
+ * Local Variables:
+ * eval: (c-set-style "gnu")
+ * End:
+ */
@@ -0,0 +1,143 @@
+/*
+ * snat_ed.h - endpoint-dependent NAT definitions
+ *
+ * Copyright (c) 2017 Cisco and/or its affiliates.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/**
+ * @file
+ * @brief endpoint-dependent NAT definitions
+ *
+ * Sessions are keyed by both the local and the remote endpoint, so one
+ * outside address and port can be shared by sessions towards different
+ * remote hosts (port overloading). With worker threads the outside port
+ * range is split between the workers, the port of a translated packet
+ * selects the worker owning the session.
+ */
+
+#ifndef __included_snat_ed_h__
+#define __included_snat_ed_h__
+
+#include <vnet/ip/ip.h>
+#include <snat/snat.h>
+
+
+#define SNAT_ED_PORT_ALLOC_ATTEMPTS 32
+
+/* Dynamic outside ports, 1024-65535 */
+#define SNAT_ED_PORT_LO 1024
+#define SNAT_ED_N_PORTS (65536 - SNAT_ED_PORT_LO)
+
+
+snat_session_t *snat_ed_session_create (snat_main_t * sm, u32 thread_index,
+					snat_session_key_t * in2out,
+					snat_session_key_t * out2in,
+					ip4_address_t * r_addr, u16 r_port,
+					u8 is_static);
+
+u32 snat_ed_get_worker_out2in_cb (ip4_header_t * ip0, u32 rx_fib_index0);
+
+always_inline void
+snat_ed_make_key (snat_ed_session_key_t * key, ip4_address_t l_addr,
+		  u16 l_port, ip4_address_t r_addr, u16 r_port, u8 proto,
+		  u32 fib_index)
+{
+  key->l_addr = l_addr;
+  key->r_addr = r_addr;
+  key->proto = proto;
+  key->fib_index = fib_index;
+  key->l_port = l_port;
+  key->r_port = r_port;
+}
+
+/** \brief Build the in2out and out2in keys of an endpoint-dependent session.
+    @param s SNAT session
+    @param in2out_kv in2out key
+    @param out2in_kv out2in key
+*/
+always_inline void
+snat_ed_session_make_kvs (snat_session_t * s,
+			  clib_bihash_kv_16_8_t * in2out_kv,
+			  clib_bihash_kv_16_8_t * out2in_kv)
+{
+  snat_ed_session_key_t key;
+
+  snat_ed_make_key (&key, s->in2out.addr, s->in2out.port, s->ext_host_addr,
+		    s->ext_host_port, s->in2out.protocol, s->in2out.fib_index);
+  in2out_kv->key[0] = key.as_u64[0];
+  in2out_kv->key[1] = key.as_u64[1];
+
+  snat_ed_make_key (&key, s->out2in.addr, s->out2in.port, s->ext_host_addr,
+		    s->ext_host_port, s->out2in.protocol, s->out2in.fib_index);
+  out2in_kv->key[0] = key.as_u64[0];
+  out2in_kv->key[1] = key.as_u64[1];
+}
+
+/** \brief Remove an endpoint-dependent session from the lookup tables.
+    @param tsm per-thread data of the thread owning the session
+    @param s SNAT session
+*/
+always_inline void
+snat_ed_session_del_keys (snat_main_per_thread_data_t * tsm,
+			  snat_session_t * s)
+{
+  clib_bihash_kv_16_8_t in2out_kv, out2in_kv;
+
+  snat_ed_session_make_kvs (s, &in2out_kv, &out2in_kv);
+  if (clib_bihash_add_del_16_8 (&tsm->in2out_ed, &in2out_kv, 0 /* is_add */ ))
+    clib_warning ("in2out-ed key delete failed");
+  if (clib_bihash_add_del_16_8 (&tsm->out2in_ed, &out2in_kv, 0 /* is_add */ ))
+    clib_warning ("out2in-ed key delete failed");
+}
+
+/** \brief Get the dynamic outside port range of a thread.
+    @param sm SNAT main
+    @param thread_index thread
+    @param port_lo first port of the range, host byte order
+    @param n_ports number of ports in the range
+*/
+always_inline void
+snat_ed_thread_port_range (snat_main_t * sm, u32 thread_index,
+			   u32 * port_lo, u32 * n_ports)
+{
+  u32 n_workers = vec_len (sm->workers);
+  u32 ports_per_worker, i;
+
+  *port_lo = SNAT_ED_PORT_LO;
+  *n_ports = SNAT_ED_N_PORTS;
+
+  /* Without worker handoff one thread owns all sessions */
+  if (n_workers <= 1)
+    return;
+
+  ports_per_worker = SNAT_ED_N_PORTS / n_workers;
+  for (i = 0; i < n_workers; i++)
+    {
+      if (sm->first_worker_index + sm->workers[i] == thread_index)
+	{
+	  *port_lo = SNAT_ED_PORT_LO + i * ports_per_worker;
+	  *n_ports = ports_per_worker;
+	  return;
+	}
+    }
+}
+
+#endif /* __included_snat_ed_h__ */
+
+/*
+ * fd.io coding-style-patch-verification: ON
+ *
+ * Local Variables:
+ * eval: (c-set-style "gnu")
+ * End:
+ */
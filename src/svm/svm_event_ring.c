@@ -0,0 +1,138 @@
+/*
+ * Copyright (c) 2017 Cisco and/or its affiliates.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stddef.h>
+#include <string.h>
+#include "svm_event_ring.h"
+
+/** create an event ring, in the current heap. Fails vs blow up the process */
+svm_event_ring_t *
+svm_event_ring_init (u32 nels, u32 elsize)
+{
+  svm_event_ring_t *r;
+  u32 slot_size, i;
+
+  nels = max_pow2 (nels);
+  slot_size = round_pow2 (sizeof (svm_event_ring_slot_t) + elsize,
+			  sizeof (u64));
+
+  r = clib_mem_alloc_aligned_or_null (sizeof (*r) + nels * slot_size,
+				      CLIB_CACHE_LINE_BYTES);
+  if (r == 0)
+    return 0;
+
+  memset (r, 0, sizeof (*r));
+  r->nitems = nels;
+  r->elsize = elsize;
+  r->slot_size = slot_size;
+
+  /* Slot i is free for the producer at position i */
+  for (i = 0; i < nels; i++)
+    svm_event_ring_slot (r, i)->seq = i;
+
+  return r;
+}
+
+void
+svm_event_ring_free (svm_event_ring_t * r)
+{
+  clib_mem_free (r);
+}
+
+static int
+svm_event_ring_doorbell_addr (svm_event_ring_t * r, struct sockaddr_un *sun)
+{
+  int len = strnlen (r->doorbell, sizeof (r->doorbell));
+
+  memset (sun, 0, sizeof (*sun));
+  sun->sun_family = AF_UNIX;
+  /* Abstract namespace, nothing to clean up on the file system */
+  clib_memcpy (sun->sun_path + 1, r->doorbell, len);
+  return offsetof (struct sockaddr_un, sun_path) + 1 + len;
+}
+
+/**
+ * Consumer: bind the doorbell producers ring when they find the consumer
+ * sleeping. Returns a non-blocking datagram socket to wait on, or -1.
+ */
+int
+svm_event_ring_doorbell_open (svm_event_ring_t * r, char *name)
+{
+  struct sockaddr_un sun;
+  int fd, len;
+
+  fd = socket (AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd < 0)
+    return -1;
+
+  memset (r->doorbell, 0, sizeof (r->doorbell));
+  strncpy (r->doorbell, name, sizeof (r->doorbell) - 1);
+  len = svm_event_ring_doorbell_addr (r, &sun);
+
+  if (bind (fd, (struct sockaddr *) &sun, len) < 0)
+    {
+      close (fd);
+      r->doorbell[0] = 0;
+      return -1;
+    }
+
+  return fd;
+}
+
+/**
+ * Producer: wake a sleeping consumer. One unbound socket per process
+ * serves all rings. A full doorbell already has a wakeup pending.
+ */
+void
+svm_event_ring_kick (svm_event_ring_t * r)
+{
+  static int kick_fd = -1;
+  struct sockaddr_un sun;
+  int fd, expected = -1, len;
+  u8 ding = 0;
+
+  if (r->doorbell[0] == 0)
+    return;
+
+  fd = __atomic_load_n (&kick_fd, __ATOMIC_ACQUIRE);
+  if (PREDICT_FALSE (fd < 0))
+    {
+      fd = socket (AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+      if (fd < 0)
+	return;
+      if (!__atomic_compare_exchange_n (&kick_fd, &expected, fd, 0,
+					__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+	{
+	  close (fd);
+	  fd = expected;
+	}
+    }
+
+  len = svm_event_ring_doorbell_addr (r, &sun);
+  (void) sendto (fd, &ding, sizeof (ding), MSG_DONTWAIT,
+		 (struct sockaddr *) &sun, len);
+}
+
+/*
+ * fd.io coding-style-patch-verification: ON
+ *
+ * Local Variables:
+ * eval: (c-set-style "gnu")
+ * End:
+ */
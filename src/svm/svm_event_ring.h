@@ -0,0 +1,192 @@
+/*
+ * Copyright (c) 2017 Cisco and/or its affiliates.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef __included_svm_event_ring_h__
+#define __included_svm_event_ring_h__
+
+#include <vppinfra/clib.h>
+#include <vppinfra/mem.h>
+#include <vppinfra/smp.h>
+
+/**
+ * Bounded event ring in shared memory, with many producers and a single
+ * consumer and no lock.
+ *
+ * Each slot carries a sequence number. A producer claims the slot at the
+ * tail by advancing the tail with a compare and swap, copies its element
+ * and publishes it by setting the slot sequence to its position + 1. The
+ * consumer takes published slots in order and hands them back to
+ * producers by setting their sequence to the position of the next lap.
+ *
+ * A consumer that stops polling announces it in consumer_sleeping. The
+ * producer that finds the flag set after publishing clears it and rings
+ * the doorbell, a datagram to the abstract unix socket the consumer waits
+ * on.
+ */
+typedef struct
+{
+  u32 seq;
+  u32 pad;
+  u8 data[0];
+} svm_event_ring_slot_t;
+
+#define SVM_EVENT_RING_DOORBELL_LEN 32
+
+typedef struct
+{
+  u32 nitems;			/**< Number of slots, a power of 2 */
+  u32 elsize;			/**< Element size */
+  u32 slot_size;		/**< Bytes per slot, sequence included */
+  volatile u32 consumer_sleeping; /**< Producers have to ring the doorbell */
+  char doorbell[SVM_EVENT_RING_DOORBELL_LEN];	/**< Abstract socket name,
+						   empty if none */
+    CLIB_CACHE_LINE_ALIGN_MARK (producer);
+  u32 tail;			/**< Next slot to claim, free running */
+    CLIB_CACHE_LINE_ALIGN_MARK (consumer);
+  u32 head;			/**< Next slot to read, free running */
+    CLIB_CACHE_LINE_ALIGN_MARK (data);
+} svm_event_ring_t;
+
+svm_event_ring_t *svm_event_ring_init (u32 nels, u32 elsize);
+void svm_event_ring_free (svm_event_ring_t * r);
+int svm_event_ring_doorbell_open (svm_event_ring_t * r, char *name);
+void svm_event_ring_kick (svm_event_ring_t * r);
+
+static inline svm_event_ring_slot_t *
+svm_event_ring_slot (svm_event_ring_t * r, u32 pos)
+{
+  return (svm_event_ring_slot_t *) (r->data + (pos & (r->nitems - 1))
+				    * r->slot_size);
+}
+
+/**
+ * Producer: add an element. Fails with -1 if the ring is full and nowait
+ * is set, spins until the consumer frees a slot otherwise.
+ */
+static inline int
+svm_event_ring_enqueue (svm_event_ring_t * r, u8 * elem, int nowait)
+{
+  svm_event_ring_slot_t *s;
+  u32 pos;
+  i32 diff;
+
+  pos = __atomic_load_n (&r->tail, __ATOMIC_RELAXED);
+  while (1)
+    {
+      s = svm_event_ring_slot (r, pos);
+      diff = (i32) (__atomic_load_n (&s->seq, __ATOMIC_ACQUIRE) - pos);
+      if (diff == 0)
+	{
+	  /* A failed swap reloads pos */
+	  if (__atomic_compare_exchange_n (&r->tail, &pos, pos + 1,
+					   1 /* weak */ , __ATOMIC_RELAXED,
+					   __ATOMIC_RELAXED))
+	    break;
+	}
+      else if (diff < 0)
+	{
+	  /* The consumer has not released the slot from the last lap */
+	  if (nowait)
+	    return -1;
+	  os_sched_yield ();
+	  pos = __atomic_load_n (&r->tail, __ATOMIC_RELAXED);
+	}
+      else
+	pos = __atomic_load_n (&r->tail, __ATOMIC_RELAXED);
+    }
+
+  clib_memcpy (s->data, elem, r->elsize);
+  __atomic_store_n (&s->seq, pos + 1, __ATOMIC_SEQ_CST);
+
+  if (PREDICT_FALSE (__atomic_load_n (&r->consumer_sleeping,
+				      __ATOMIC_SEQ_CST))
+      && __atomic_exchange_n (&r->consumer_sleeping, 0, __ATOMIC_SEQ_CST))
+    svm_event_ring_kick (r);
+
+  return 0;
+}
+
+/**
+ * Consumer: move up to max_elts published elements to elems, in order.
+ * Returns the number moved.
+ */
+static inline u32
+svm_event_ring_dequeue_batch (svm_event_ring_t * r, u8 * elems, u32 max_elts)
+{
+  svm_event_ring_slot_t *s;
+  u32 pos = r->head, n;
+
+  for (n = 0; n < max_elts; n++)
+    {
+      s = svm_event_ring_slot (r, pos + n);
+      if (__atomic_load_n (&s->seq, __ATOMIC_ACQUIRE) != pos + n + 1)
+	break;
+      clib_memcpy (elems + n * r->elsize, s->data, r->elsize);
+      __atomic_store_n (&s->seq, pos + n + r->nitems, __ATOMIC_RELEASE);
+    }
+
+  r->head = pos + n;
+  return n;
+}
+
+/**
+ * Consumer: elements claimed by producers, an upper bound of what the
+ * next dequeue returns since some may not be published yet.
+ */
+static inline u32
+svm_event_ring_max_dequeue (svm_event_ring_t * r)
+{
+  return __atomic_load_n (&r->tail, __ATOMIC_ACQUIRE) - r->head;
+}
+
+/** Consumer: the next element is not published */
+static inline int
+svm_event_ring_is_empty (svm_event_ring_t * r)
+{
+  svm_event_ring_slot_t *s = svm_event_ring_slot (r, r->head);
+  return __atomic_load_n (&s->seq, __ATOMIC_SEQ_CST) != r->head + 1;
+}
+
+/**
+ * Consumer: stop polling and have producers ring the doorbell. Fails
+ * with -1, consumer still awake, if elements arrived meanwhile.
+ */
+static inline int
+svm_event_ring_consumer_sleep (svm_event_ring_t * r)
+{
+  __atomic_store_n (&r->consumer_sleeping, 1, __ATOMIC_SEQ_CST);
+  if (!svm_event_ring_is_empty (r))
+    {
+      __atomic_store_n (&r->consumer_sleeping, 0, __ATOMIC_SEQ_CST);
+      return -1;
+    }
+  return 0;
+}
+
+/** Consumer: poll again, producers stop ringing the doorbell */
+static inline void
+svm_event_ring_consumer_wake (svm_event_ring_t * r)
+{
+  __atomic_store_n (&r->consumer_sleeping, 0, __ATOMIC_SEQ_CST);
+}
+
+#endif /* __included_svm_event_ring_h__ */
+
+/*
+ * fd.io coding-style-patch-verification: ON
+ *
+ * Local Variables:
+ * eval: (c-set-style "gnu")
+ * End:
+ */
@@ -14,6 +14,7 @@
  */
 
 #include "svm_fifo.h"
+#include <vppinfra/time.h>
 
 /** create an svm fifo, in the current heap. Fails vs blow up the process */
 svm_fifo_t *
@@ -31,6 +32,8 @@ svm_fifo_create (u32 data_size_in_bytes)
   memset (f, 0, sizeof (*f) + data_size_in_bytes);
   f->nitems = data_size_in_bytes;
   f->ooos_list_head = OOO_SEGMENT_INVALID_INDEX;
+  f->ooos_root = OOO_SEGMENT_INVALID_INDEX;
+  f->ooos_seed = clib_cpu_time_now ();
 
   memset (&attr, 0, sizeof (attr));
   memset (&cattr, 0, sizeof (cattr));
@@ -55,17 +58,176 @@ svm_fifo_create (u32 data_size_in_bytes)
   return (f);
 }
 
-always_inline ooo_segment_t *
-ooo_segment_new (svm_fifo_t * f, u32 start, u32 length)
+/*
+ * Out-of-order segment lookup treap. Segments are ordered by start, i.e.,
+ * their position in the byte stream, priorities are random so the
+ * expected depth is O(log n).
+ */
+
+static void
+ooo_treap_rotate_left (svm_fifo_t * f, u32 * rootp)
 {
-  ooo_segment_t *s;
+  ooo_segment_t *root, *pivot;
+  u32 pivot_index;
+
+  root = pool_elt_at_index (f->ooo_segments, *rootp);
+  pivot_index = root->right;
+  pivot = pool_elt_at_index (f->ooo_segments, pivot_index);
+  root->right = pivot->left;
+  pivot->left = *rootp;
+  *rootp = pivot_index;
+}
+
+static void
+ooo_treap_rotate_right (svm_fifo_t * f, u32 * rootp)
+{
+  ooo_segment_t *root, *pivot;
+  u32 pivot_index;
+
+  root = pool_elt_at_index (f->ooo_segments, *rootp);
+  pivot_index = root->left;
+  pivot = pool_elt_at_index (f->ooo_segments, pivot_index);
+  root->left = pivot->right;
+  pivot->right = *rootp;
+  *rootp = pivot_index;
+}
+
+static void
+ooo_treap_insert (svm_fifo_t * f, u32 * rootp, u32 index)
+{
+  ooo_segment_t *root, *s, *child;
+
+  if (*rootp == OOO_SEGMENT_INVALID_INDEX)
+    {
+      *rootp = index;
+      return;
+    }
+
+  root = pool_elt_at_index (f->ooo_segments, *rootp);
+  s = pool_elt_at_index (f->ooo_segments, index);
+  if (ooo_start_lt (s->start, root->start))
+    {
+      ooo_treap_insert (f, &root->left, index);
+      child = pool_elt_at_index (f->ooo_segments, root->left);
+      if (child->prio > root->prio)
+	ooo_treap_rotate_right (f, rootp);
+    }
+  else
+    {
+      ooo_treap_insert (f, &root->right, index);
+      child = pool_elt_at_index (f->ooo_segments, root->right);
+      if (child->prio > root->prio)
+	ooo_treap_rotate_left (f, rootp);
+    }
+}
+
+static void
+ooo_treap_remove (svm_fifo_t * f, u32 * rootp, u32 index)
+{
+  ooo_segment_t *root, *s, *left, *right;
+
+  ASSERT (*rootp != OOO_SEGMENT_INVALID_INDEX);
+  root = pool_elt_at_index (f->ooo_segments, *rootp);
+
+  if (*rootp != index)
+    {
+      s = pool_elt_at_index (f->ooo_segments, index);
+      if (ooo_start_lt (s->start, root->start))
+	ooo_treap_remove (f, &root->left, index);
+      else
+	ooo_treap_remove (f, &root->right, index);
+      return;
+    }
+
+  /* Rotate the segment down until it has at most one child */
+  if (root->left == OOO_SEGMENT_INVALID_INDEX)
+    {
+      *rootp = root->right;
+      return;
+    }
+  if (root->right == OOO_SEGMENT_INVALID_INDEX)
+    {
+      *rootp = root->left;
+      return;
+    }
+
+  left = pool_elt_at_index (f->ooo_segments, root->left);
+  right = pool_elt_at_index (f->ooo_segments, root->right);
+  if (left->prio > right->prio)
+    {
+      ooo_treap_rotate_right (f, rootp);
+      root = pool_elt_at_index (f->ooo_segments, *rootp);
+      ooo_treap_remove (f, &root->right, index);
+    }
+  else
+    {
+      ooo_treap_rotate_left (f, rootp);
+      root = pool_elt_at_index (f->ooo_segments, *rootp);
+      ooo_treap_remove (f, &root->left, index);
+    }
+}
+
+/**
+ * Find the last segment that starts at or before @a start
+ */
+static ooo_segment_t *
+ooo_segment_lookup (svm_fifo_t * f, u32 start)
+{
+  ooo_segment_t *s, *result = 0;
+  u32 index = f->ooos_root;
+
+  while (index != OOO_SEGMENT_INVALID_INDEX)
+    {
+      s = pool_elt_at_index (f->ooo_segments, index);
+      if (!ooo_start_lt (start, s->start))
+	{
+	  result = s;
+	  index = s->right;
+	}
+      else
+	index = s->left;
+    }
+  return result;
+}
+
+/**
+ * Allocate a segment and link it into the list after @a prev_index, or
+ * at the head if that's invalid, and into the lookup treap.
+ */
+static ooo_segment_t *
+ooo_segment_new (svm_fifo_t * f, u32 prev_index, u32 offset, u32 length)
+{
+  ooo_segment_t *s, *prev, *next;
+  u32 index;
 
   pool_get (f->ooo_segments, s);
+  index = s - f->ooo_segments;
 
-  s->fifo_position = start;
+  s->fifo_position = (f->tail + offset) % f->nitems;
   s->length = length;
+  s->start = f->n_enqueued + offset;
+  s->prio = random_u32 (&f->ooos_seed);
+  s->left = s->right = OOO_SEGMENT_INVALID_INDEX;
+
+  s->prev = prev_index;
+  if (prev_index != OOO_SEGMENT_INVALID_INDEX)
+    {
+      prev = pool_elt_at_index (f->ooo_segments, prev_index);
+      s->next = prev->next;
+      prev->next = index;
+    }
+  else
+    {
+      s->next = f->ooos_list_head;
+      f->ooos_list_head = index;
+    }
+  if (s->next != OOO_SEGMENT_INVALID_INDEX)
+    {
+      next = pool_elt_at_index (f->ooo_segments, s->next);
+      next->prev = index;
+    }
 
-  s->prev = s->next = OOO_SEGMENT_INVALID_INDEX;
+  ooo_treap_insert (f, &f->ooos_root, index);
 
   return s;
 }
@@ -76,6 +238,8 @@ ooo_segment_del (svm_fifo_t * f, u32 index)
   ooo_segment_t *cur, *prev = 0, *next = 0;
   cur = pool_elt_at_index (f->ooo_segments, index);
 
+  ooo_treap_remove (f, &f->ooos_root, index);
+
   if (cur->next != OOO_SEGMENT_INVALID_INDEX)
     {
       next = pool_elt_at_index (f->ooo_segments, cur->next);
@@ -97,202 +261,92 @@ ooo_segment_del (svm_fifo_t * f, u32 index)
 
 /**
  * Add segment to fifo's out-of-order segment list. Takes care of merging
- * adjacent segments and removing overlapping ones.
+ * adjacent segments and removing overlapping ones. Segments in the list
+ * are disjoint and not adjacent.
+ *
+ * @return 0 on success, -1 if a new segment is needed and the fifo
+ *         already tracks SVM_FIFO_MAX_OOO_SEGMENTS
  */
-static void
+static int
 ooo_segment_add (svm_fifo_t * f, u32 offset, u32 length)
 {
-  ooo_segment_t *s, *new_s, *prev, *next, *it;
-  u32 new_index, position, end_offset, s_sof, s_eof, s_index;
+  ooo_segment_t *s, *next;
+  u32 start, end, s_end, next_end, s_index;
 
-  position = (f->tail + offset) % f->nitems;
-  end_offset = offset + length;
+  start = f->n_enqueued + offset;
+  end = start + length;
 
-  if (f->ooos_list_head == OOO_SEGMENT_INVALID_INDEX)
+  /* Merge with the last segment that starts at or before the new one */
+  s = ooo_segment_lookup (f, start);
+  if (s && !ooo_start_lt (s->start + s->length, start))
     {
-      s = ooo_segment_new (f, position, length);
-      f->ooos_list_head = s - f->ooo_segments;
-      f->ooos_newest = f->ooos_list_head;
-      return;
+      s_end = s->start + s->length;
+      if (ooo_start_lt (s_end, end))
+	s->length = end - s->start;
     }
-
-  /* Find first segment that starts after new segment */
-  s = pool_elt_at_index (f->ooo_segments, f->ooos_list_head);
-  while (s->next != OOO_SEGMENT_INVALID_INDEX
-	 && ooo_segment_offset (f, s) <= offset)
-    s = pool_elt_at_index (f->ooo_segments, s->next);
-
-  s_index = s - f->ooo_segments;
-  s_sof = ooo_segment_offset (f, s);
-  s_eof = ooo_segment_end_offset (f, s);
-
-  /* No overlap, add before current segment */
-  if (end_offset < s_sof)
+  else
     {
-      new_s = ooo_segment_new (f, position, length);
-      new_index = new_s - f->ooo_segments;
-
-      /* Pool might've moved, get segment again */
-      s = pool_elt_at_index (f->ooo_segments, s_index);
-
-      if (s->prev != OOO_SEGMENT_INVALID_INDEX)
-	{
-	  new_s->prev = s->prev;
-
-	  prev = pool_elt_at_index (f->ooo_segments, new_s->prev);
-	  prev->next = new_index;
-	}
-      else
-	{
-	  /* New head */
-	  f->ooos_list_head = new_index;
-	}
-
-      new_s->next = s - f->ooo_segments;
-      s->prev = new_index;
-      f->ooos_newest = new_index;
-      return;
+      if (pool_elts (f->ooo_segments) >= SVM_FIFO_MAX_OOO_SEGMENTS)
+	return -1;
+      s_index = s ? s - f->ooo_segments : OOO_SEGMENT_INVALID_INDEX;
+      s = ooo_segment_new (f, s_index, offset, length);
     }
-  /* No overlap, add after current segment */
-  else if (s_eof < offset)
-    {
-      new_s = ooo_segment_new (f, position, length);
-      new_index = new_s - f->ooo_segments;
 
-      /* Pool might've moved, get segment again */
-      s = pool_elt_at_index (f->ooo_segments, s_index);
-
-      if (s->next != OOO_SEGMENT_INVALID_INDEX)
-	{
-	  new_s->next = s->next;
-
-	  next = pool_elt_at_index (f->ooo_segments, new_s->next);
-	  next->prev = new_index;
-	}
-
-      new_s->prev = s - f->ooo_segments;
-      s->next = new_index;
-      f->ooos_newest = new_index;
-
-      return;
-    }
-
-  /*
-   * Merge needed
-   */
-
-  /* Merge at head */
-  if (offset <= s_sof)
-    {
-      /* If we have a previous, check if we overlap */
-      if (s->prev != OOO_SEGMENT_INVALID_INDEX)
-	{
-	  prev = pool_elt_at_index (f->ooo_segments, s->prev);
-
-	  /* New segment merges prev and current. Remove previous and
-	   * update position of current. */
-	  if (ooo_segment_end_offset (f, prev) >= offset)
-	    {
-	      s->fifo_position = prev->fifo_position;
-	      s->length = s_eof - ooo_segment_offset (f, prev);
-	      ooo_segment_del (f, s->prev);
-	    }
-	}
-      else
-	{
-	  s->fifo_position = position;
-	  s->length = s_eof - ooo_segment_offset (f, s);
-	}
-
-      /* The new segment's tail may cover multiple smaller ones */
-      if (s_eof < end_offset)
-	{
-	  /* Remove segments completely covered */
-	  it = (s->next != OOO_SEGMENT_INVALID_INDEX) ?
-	    pool_elt_at_index (f->ooo_segments, s->next) : 0;
-	  while (it && ooo_segment_end_offset (f, it) < end_offset)
-	    {
-	      next = (it->next != OOO_SEGMENT_INVALID_INDEX) ?
-		pool_elt_at_index (f->ooo_segments, it->next) : 0;
-	      ooo_segment_del (f, it - f->ooo_segments);
-	      it = next;
-	    }
-
-	  /* Update length. Segment's start might have changed. */
-	  s->length = end_offset - ooo_segment_offset (f, s);
-
-	  /* If partial overlap with last, merge */
-	  if (it && ooo_segment_offset (f, it) < end_offset)
-	    {
-	      s->length +=
-		it->length - (ooo_segment_offset (f, it) - end_offset);
-	      ooo_segment_del (f, it - f->ooo_segments);
-	    }
-	}
-    }
-  /* Last but overlapping previous */
-  else if (s_eof <= end_offset)
-    {
-      s->length = end_offset - ooo_segment_offset (f, s);
-    }
-  /* New segment completely covered by current one */
-  else
+  /* Swallow the segments the new data reaches */
+  s_index = s - f->ooo_segments;
+  while (s->next != OOO_SEGMENT_INVALID_INDEX)
     {
-      /* Do Nothing */
+      next = pool_elt_at_index (f->ooo_segments, s->next);
+      s_end = s->start + s->length;
+      if (ooo_start_lt (s_end, next->start))
+	break;
+      next_end = next->start + next->length;
+      if (ooo_start_lt (s_end, next_end))
+	s->length = next_end - s->start;
+      ooo_segment_del (f, s->next);
+      s = pool_elt_at_index (f->ooo_segments, s_index);
     }
 
   /* Most recently updated segment */
-  f->ooos_newest = s - f->ooo_segments;
+  f->ooos_newest = s_index;
+  return 0;
 }
 
+
 /**
  * Removes segments that can now be enqueued because the fifo's tail has
- * advanced. Returns the number of bytes added to tail.
+ * advanced. Returns the number of bytes added to tail, at most n_free.
  */
 static int
-ooo_segment_try_collect (svm_fifo_t * f, u32 n_bytes_enqueued)
+ooo_segment_try_collect (svm_fifo_t * f, u32 n_bytes_enqueued, u32 n_free)
 {
   ooo_segment_t *s;
-  u32 index, bytes = 0, diff;
+  u32 tail, s_end, bytes = 0;
 
-  s = pool_elt_at_index (f->ooo_segments, f->ooos_list_head);
+  /* Stream position of the tail, the producer has not published it yet */
+  tail = f->n_enqueued + n_bytes_enqueued;
 
-  /* If last tail update overlaps one/multiple ooo segments, remove them */
-  diff = (f->nitems + f->tail - s->fifo_position) % f->nitems;
-  while (0 < diff && diff < n_bytes_enqueued)
+  while (f->ooos_list_head != OOO_SEGMENT_INVALID_INDEX)
     {
-      /* Segment end is beyond the tail. Advance tail and be done */
-      if (diff < s->length)
-	{
-	  f->tail += s->length - diff;
-	  f->tail %= f->nitems;
-	  break;
-	}
-      /* If we have next go on */
-      else if (s->next != OOO_SEGMENT_INVALID_INDEX)
-	{
-	  index = s - f->ooo_segments;
-	  s = pool_elt_at_index (f->ooo_segments, s->next);
-	  diff = (f->nitems + f->tail - s->fifo_position) % f->nitems;
-	  ooo_segment_del (f, index);
-	}
-      /* End of search */
-      else
+      s = pool_elt_at_index (f->ooo_segments, f->ooos_list_head);
+
+      /* Still a hole before the first segment */
+      if (ooo_start_lt (tail, s->start))
+	break;
+
+      /* Tail reaches into or up to the segment, 'consume' it. The next
+       * one starts after a hole. */
+      s_end = s->start + s->length;
+      if (ooo_start_lt (tail, s_end))
 	{
+	  bytes = clib_min (s_end - tail, n_free);
+	  f->tail = (f->tail + bytes) % f->nitems;
+	  ooo_segment_del (f, f->ooos_list_head);
 	  break;
 	}
-    }
-
-  /* If tail is adjacent to an ooo segment, 'consume' it */
-  if (diff == 0)
-    {
-      bytes = ((f->nitems - f->cursize) >= s->length) ? s->length :
-	f->nitems - f->cursize;
 
-      f->tail += bytes;
-      f->tail %= f->nitems;
-
-      ooo_segment_del (f, s - f->ooo_segments);
+      /* In-order data covered the whole segment */
+      ooo_segment_del (f, f->ooos_list_head);
     }
 
   return bytes;
@@ -305,13 +359,13 @@ svm_fifo_enqueue_internal (svm_fifo_t * f,
   u32 total_copy_bytes, first_copy_bytes, second_copy_bytes;
   u32 cursize, nitems;
 
-  if (PREDICT_FALSE (f->cursize == f->nitems))
-    return -2;			/* fifo stuffed */
-
   /* read cursize, which can only decrease while we're working */
-  cursize = f->cursize;
+  cursize = svm_fifo_max_dequeue (f);
   nitems = f->nitems;
 
+  if (PREDICT_FALSE (cursize == nitems))
+    return -2;			/* fifo stuffed */
+
   /* Number of bytes we're going to copy */
   total_copy_bytes = (nitems - cursize) < max_bytes ?
     (nitems - cursize) : max_bytes;
@@ -347,10 +401,12 @@ svm_fifo_enqueue_internal (svm_fifo_t * f,
 
   /* Any out-of-order segments to collect? */
   if (PREDICT_FALSE (f->ooos_list_head != OOO_SEGMENT_INVALID_INDEX))
-    total_copy_bytes += ooo_segment_try_collect (f, total_copy_bytes);
+    total_copy_bytes += ooo_segment_try_collect (f, total_copy_bytes,
+						 nitems - cursize -
+						 total_copy_bytes);
 
-  /* Atomically increase the queue length */
-  __sync_fetch_and_add (&f->cursize, total_copy_bytes);
+  /* Hand the data over to the consumer */
+  svm_fifo_produced (f, total_copy_bytes);
 
   return (total_copy_bytes);
 }
@@ -382,14 +438,15 @@ svm_fifo_enqueue_with_offset_internal2 (svm_fifo_t * f,
   ASSERT (offset > 0);
 
   /* read cursize, which can only decrease while we're working */
-  cursize = f->cursize;
+  cursize = svm_fifo_max_dequeue (f);
   nitems = f->nitems;
 
   /* Will this request fit? */
   if ((required_bytes + offset) > (nitems - cursize))
     return -1;
 
-  ooo_segment_add (f, offset, required_bytes);
+  if (ooo_segment_add (f, offset, required_bytes))
+    return -1;
 
   /* Number of bytes we're going to copy */
   total_copy_bytes = required_bytes;
@@ -436,13 +493,13 @@ svm_fifo_dequeue_internal2 (svm_fifo_t * f,
   u32 total_copy_bytes, first_copy_bytes, second_copy_bytes;
   u32 cursize, nitems;
 
-  if (PREDICT_FALSE (f->cursize == 0))
-    return -2;			/* nothing in the fifo */
-
   /* read cursize, which can only increase while we're working */
-  cursize = f->cursize;
+  cursize = svm_fifo_max_dequeue (f);
   nitems = f->nitems;
 
+  if (PREDICT_FALSE (cursize == 0))
+    return -2;			/* nothing in the fifo */
+
   /* Number of bytes we're going to copy */
   total_copy_bytes = (cursize < max_bytes) ? cursize : max_bytes;
 
@@ -471,11 +528,11 @@ svm_fifo_dequeue_internal2 (svm_fifo_t * f,
       ASSERT (max_bytes <= cursize);
       f->head += max_bytes;
       f->head = f->head % nitems;
-      cursize -= max_bytes;
       total_copy_bytes = max_bytes;
     }
 
-  __sync_fetch_and_sub (&f->cursize, total_copy_bytes);
+  /* Give the space back to the producer */
+  svm_fifo_consumed (f, total_copy_bytes);
 
   return (total_copy_bytes);
 }
@@ -494,13 +551,13 @@ svm_fifo_peek (svm_fifo_t * f, int pid, u32 offset, u32 max_bytes,
   u32 total_copy_bytes, first_copy_bytes, second_copy_bytes;
   u32 cursize, nitems;
 
-  if (PREDICT_FALSE (f->cursize == 0))
-    return -2;			/* nothing in the fifo */
-
   /* read cursize, which can only increase while we're working */
-  cursize = f->cursize;
+  cursize = svm_fifo_max_dequeue (f);
   nitems = f->nitems;
 
+  if (PREDICT_FALSE (cursize == 0))
+    return -2;			/* nothing in the fifo */
+
   /* Number of bytes we're going to copy */
   total_copy_bytes = (cursize < max_bytes) ? cursize : max_bytes;
 
@@ -529,13 +586,13 @@ svm_fifo_dequeue_drop (svm_fifo_t * f, int pid, u32 max_bytes)
   u32 total_drop_bytes, first_drop_bytes, second_drop_bytes;
   u32 cursize, nitems;
 
-  if (PREDICT_FALSE (f->cursize == 0))
-    return -2;			/* nothing in the fifo */
-
   /* read cursize, which can only increase while we're working */
-  cursize = f->cursize;
+  cursize = svm_fifo_max_dequeue (f);
   nitems = f->nitems;
 
+  if (PREDICT_FALSE (cursize == 0))
+    return -2;			/* nothing in the fifo */
+
   /* Number of bytes we're going to drop */
   total_drop_bytes = (cursize < max_bytes) ? cursize : max_bytes;
 
@@ -554,7 +611,7 @@ svm_fifo_dequeue_drop (svm_fifo_t * f, int pid, u32 max_bytes)
       f->head = (f->head == nitems) ? 0 : f->head;
     }
 
-  __sync_fetch_and_sub (&f->cursize, total_drop_bytes);
+  svm_fifo_consumed (f, total_drop_bytes);
 
   return total_drop_bytes;
 }
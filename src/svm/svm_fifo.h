@@ -21,6 +21,7 @@
 #include <vppinfra/heap.h>
 #include <vppinfra/pool.h>
 #include <vppinfra/format.h>
+#include <vppinfra/random.h>
 #include <pthread.h>
 
 typedef enum
@@ -38,18 +39,29 @@ typedef struct
 
   u32 fifo_position;	/**< Start of segment, normalized*/
   u32 length;		/**< Length of segment */
+
+  u32 start;	/**< Start of segment in the byte stream, lookup key */
+  u32 left;	/**< Lookup treap child with lower start */
+  u32 right;	/**< Lookup treap child with higher start */
+  u32 prio;	/**< Lookup treap priority */
 } ooo_segment_t;
 
 #define OOO_SEGMENT_INVALID_INDEX ((u32)~0)
 
+/** Bound on out-of-order segments per fifo, further holes are refused */
+#define SVM_FIFO_MAX_OOO_SEGMENTS 4096
+
+/** Compare stream positions, which are free running and wrap */
+#define ooo_start_lt(_s1, _s2) ((i32)((_s1)-(_s2)) < 0)
+
 typedef struct
 {
   pthread_mutex_t mutex;	/* 8 bytes */
   pthread_cond_t condvar;	/* 8 bytes */
   u32 owner_pid;
   svm_lock_tag_t tag;
-  volatile u32 cursize;
   u32 nitems;
+  u8 has_event;			/**< An event for the fifo is pending */
 
   /* Backpointers */
   u32 server_session_index;
@@ -57,15 +69,21 @@ typedef struct
   u8 server_thread_index;
   u8 client_thread_index;
     CLIB_CACHE_LINE_ALIGN_MARK (end_shared);
+
+  /* consumer */
   u32 head;
+  u32 n_dequeued;		/**< Bytes dequeued, free running */
     CLIB_CACHE_LINE_ALIGN_MARK (end_consumer);
 
   /* producer */
   u32 tail;
+  u32 n_enqueued;		/**< Bytes enqueued, free running */
 
   ooo_segment_t *ooo_segments;	/**< Pool of ooo segments */
   u32 ooos_list_head;		/**< Head of out-of-order linked-list */
   u32 ooos_newest;		/**< Last segment to have been updated */
+  u32 ooos_root;		/**< Root of out-of-order lookup treap */
+  u32 ooos_seed;		/**< Seed for lookup treap priorities */
 
     CLIB_CACHE_LINE_ALIGN_MARK (data);
 } svm_fifo_t;
@@ -94,16 +112,80 @@ svm_fifo_unlock (svm_fifo_t * f)
   pthread_mutex_unlock (&f->mutex);
 }
 
+/**
+ * Number of bytes in the fifo
+ *
+ * Fifos have a single producer and a single consumer, each of which owns
+ * its index and publishes the number of bytes it has moved. Neither side
+ * writes to the other's cache line. The count is exact for the side that
+ * asks about its own work. It never overstates data for the consumer nor
+ * space for the producer.
+ */
 static inline u32
 svm_fifo_max_dequeue (svm_fifo_t * f)
 {
-  return f->cursize;
+  return __atomic_load_n (&f->n_enqueued, __ATOMIC_ACQUIRE)
+    - __atomic_load_n (&f->n_dequeued, __ATOMIC_ACQUIRE);
 }
 
 static inline u32
 svm_fifo_max_enqueue (svm_fifo_t * f)
 {
-  return f->nitems - f->cursize;
+  return f->nitems - svm_fifo_max_dequeue (f);
+}
+
+/** Producer: publish bytes written at the tail */
+static inline void
+svm_fifo_produced (svm_fifo_t * f, u32 n_bytes)
+{
+  __atomic_store_n (&f->n_enqueued, f->n_enqueued + n_bytes,
+		    __ATOMIC_RELEASE);
+}
+
+/** Consumer: release bytes read at the head */
+static inline void
+svm_fifo_consumed (svm_fifo_t * f, u32 n_bytes)
+{
+  __atomic_store_n (&f->n_dequeued, f->n_dequeued + n_bytes,
+		    __ATOMIC_RELEASE);
+}
+
+/**
+ * Data at the head, for consumers that read it in place and release it
+ * with svm_fifo_dequeue_drop(). At most svm_fifo_max_dequeue_contiguous()
+ * bytes are contiguous.
+ */
+static inline u8 *
+svm_fifo_head (svm_fifo_t * f)
+{
+  return &f->data[f->head];
+}
+
+static inline u32
+svm_fifo_max_dequeue_contiguous (svm_fifo_t * f)
+{
+  return clib_min (svm_fifo_max_dequeue (f), f->nitems - f->head);
+}
+
+/**
+ * Claim the fifo's pending event. Returns 1 if the caller did and has to
+ * send the event, 0 if one is already on its way. Events are thereby
+ * coalesced to one per fifo.
+ */
+static inline u8
+svm_fifo_set_event (svm_fifo_t * f)
+{
+  return __atomic_exchange_n (&f->has_event, 1, __ATOMIC_SEQ_CST) == 0;
+}
+
+/**
+ * Consumer: release the pending event before reading the fifo, data
+ * enqueued from then on comes with a new event.
+ */
+static inline void
+svm_fifo_unset_event (svm_fifo_t * f)
+{
+  __atomic_store_n (&f->has_event, 0, __ATOMIC_SEQ_CST);
 }
 
 static inline u8
@@ -0,0 +1,244 @@
+/*
+ * Copyright (c) 2017 Cisco and/or its affiliates.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#define _GNU_SOURCE
+
+#include <sys/socket.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "svm_event_ring.h"
+#include <vppinfra/format.h>
+#include <vppinfra/error.h>
+#include <vppinfra/time.h>
+
+typedef struct
+{
+  u32 producer;
+  u32 seq;
+} ring_test_elt_t;
+
+typedef struct
+{
+  svm_event_ring_t *r;
+  u32 producer;
+  u32 n_elts;
+} ring_test_producer_t;
+
+static void *
+ring_test_producer (void *arg)
+{
+  ring_test_producer_t *p = arg;
+  ring_test_elt_t e;
+  u32 i;
+
+  e.producer = p->producer;
+  for (i = 0; i < p->n_elts; i++)
+    {
+      e.seq = i;
+      svm_event_ring_enqueue (p->r, (u8 *) & e, 0 /* wait */ );
+    }
+  return 0;
+}
+
+/** Producers on their own threads, every element arrives once and in
+ *  the order its producer sent it */
+static clib_error_t *
+mpsc (int verbose, u32 ring_size, u32 n_producers, u32 n_elts, u32 batch)
+{
+  ring_test_producer_t *producers = 0, *p;
+  pthread_t *threads = 0;
+  ring_test_elt_t *elts = 0;
+  u32 *next_seq = 0, n_rcvd = 0, n, i;
+  svm_event_ring_t *r;
+  clib_error_t *error = 0;
+  f64 before, delta;
+
+  r = svm_event_ring_init (ring_size, sizeof (ring_test_elt_t));
+  if (r == 0)
+    return clib_error_return (0, "svm_event_ring_init failed");
+
+  vec_validate (producers, n_producers - 1);
+  vec_validate (threads, n_producers - 1);
+  vec_validate (next_seq, n_producers - 1);
+  vec_validate (elts, batch - 1);
+
+  before = unix_time_now ();
+
+  vec_foreach (p, producers)
+  {
+    p->r = r;
+    p->producer = p - producers;
+    p->n_elts = n_elts;
+    if (pthread_create (&threads[p - producers], 0, ring_test_producer, p))
+      return clib_error_return_unix (0, "pthread_create");
+  }
+
+  while (n_rcvd < n_producers * n_elts)
+    {
+      n = svm_event_ring_dequeue_batch (r, (u8 *) elts, batch);
+
+      /* Let a producer that claimed the next slot publish it */
+      if (n == 0)
+	os_sched_yield ();
+
+      for (i = 0; i < n; i++)
+	{
+	  if (elts[i].producer >= n_producers
+	      || elts[i].seq != next_seq[elts[i].producer])
+	    {
+	      error = clib_error_return (0, "producer %u: got %u expected %u",
+					 elts[i].producer, elts[i].seq,
+					 next_seq[elts[i].producer]);
+	      goto done;
+	    }
+	  next_seq[elts[i].producer]++;
+	}
+      n_rcvd += n;
+    }
+
+  if (!svm_event_ring_is_empty (r) || svm_event_ring_max_dequeue (r))
+    error = clib_error_return (0, "ring not empty after %u elements",
+			       n_rcvd);
+
+done:
+  for (i = 0; i < n_producers; i++)
+    pthread_join (threads[i], 0);
+
+  delta = unix_time_now () - before;
+  if (verbose && !error)
+    fformat (stdout, "%u elements from %u producers in %.3f s, %.2f Mops\n",
+	     n_rcvd, n_producers, delta, (f64) n_rcvd / delta / 1e6);
+
+  vec_free (producers);
+  vec_free (threads);
+  vec_free (next_seq);
+  vec_free (elts);
+  svm_event_ring_free (r);
+  return error;
+}
+
+/** A sleeping consumer is woken once, by the first element */
+static clib_error_t *
+doorbell (int verbose)
+{
+  ring_test_elt_t e = { 0 };
+  svm_event_ring_t *r;
+  clib_error_t *error = 0;
+  char name[SVM_EVENT_RING_DOORBELL_LEN];
+  u8 ding;
+  int fd;
+
+  r = svm_event_ring_init (16, sizeof (e));
+  if (r == 0)
+    return clib_error_return (0, "svm_event_ring_init failed");
+
+  snprintf (name, sizeof (name), "test-svm-event-ring-%d", getpid ());
+  fd = svm_event_ring_doorbell_open (r, name);
+  if (fd < 0)
+    {
+      error = clib_error_return_unix (0, "svm_event_ring_doorbell_open");
+      goto done;
+    }
+
+  if (svm_event_ring_consumer_sleep (r))
+    {
+      error = clib_error_return (0, "empty ring refused to sleep");
+      goto done;
+    }
+
+  svm_event_ring_enqueue (r, (u8 *) & e, 1 /* nowait */ );
+  svm_event_ring_enqueue (r, (u8 *) & e, 1 /* nowait */ );
+
+  if (recv (fd, &ding, sizeof (ding), 0) != sizeof (ding))
+    error = clib_error_return_unix (0, "no doorbell");
+  else if (recv (fd, &ding, sizeof (ding), MSG_DONTWAIT) >= 0)
+    error = clib_error_return (0, "doorbell rang twice");
+  else if (r->consumer_sleeping)
+    error = clib_error_return (0, "consumer still sleeping");
+  else if (svm_event_ring_consumer_sleep (r) == 0)
+    error = clib_error_return (0, "slept over pending elements");
+
+  if (verbose && !error)
+    fformat (stdout, "doorbell %s rang once\n", name);
+
+done:
+  if (fd >= 0)
+    close (fd);
+  svm_event_ring_free (r);
+  return error;
+}
+
+static int
+test_svm_event_ring (unformat_input_t * input)
+{
+  clib_error_t *error = 0;
+  int verbose = 0;
+  u32 ring_size = 2048, n_producers = 4, n_elts = 1 << 20, batch = 256;
+
+  while (unformat_check_input (input) != UNFORMAT_END_OF_INPUT)
+    {
+      if (unformat (input, "verbose %d", &verbose))
+	;
+      else if (unformat (input, "verbose"))
+	verbose = 1;
+      else if (unformat (input, "size %d", &ring_size))
+	;
+      else if (unformat (input, "producers %d", &n_producers))
+	;
+      else if (unformat (input, "elements %d", &n_elts))
+	;
+      else if (unformat (input, "batch %d", &batch))
+	;
+      else
+	{
+	  error = clib_error_create ("unknown input `%U'\n",
+				     format_unformat_error, input);
+	  goto out;
+	}
+    }
+
+  error = mpsc (verbose, ring_size, n_producers, n_elts, batch);
+  if (error == 0)
+    error = doorbell (verbose);
+
+out:
+  if (error)
+    {
+      clib_error_report (error);
+      return 1;
+    }
+  return 0;
+}
+
+int
+main (int argc, char *argv[])
+{
+  unformat_input_t i;
+  int r;
+
+  clib_mem_init (0, 64 << 20);
+
+  unformat_init_command_line (&i, argv);
+  r = test_svm_event_ring (&i);
+  unformat_free (&i);
+  return r;
+}
+
+/*
+ * fd.io coding-style-patch-verification: ON
+ *
+ * Local Variables:
+ * eval: (c-set-style "gnu")
+ * End:
+ */
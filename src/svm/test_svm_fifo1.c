@@ -12,8 +12,10 @@
  * See the License for the specific language governing permissions and
  * limitations under the License.
  */
+#define _GNU_SOURCE
 
 #include "svm_fifo_segment.h"
+#include <vppinfra/time.h>
 
 clib_error_t *
 hello_world (int verbose)
@@ -273,12 +275,351 @@ slave (int verbose)
 }
 
 
+typedef struct
+{
+  svm_fifo_t *f;
+  u8 *buf;
+  u32 chunk_size;
+  u64 n_bytes;
+  u64 n_ops;
+  int cpu;
+  int verify;
+  int error;
+} perf_thread_args_t;
+
+static void
+perf_pin_thread (int cpu)
+{
+  cpu_set_t cpuset;
+  int rv;
+
+  if (cpu < 0)
+    return;
+
+  CPU_ZERO (&cpuset);
+  CPU_SET (cpu, &cpuset);
+  rv = pthread_setaffinity_np (pthread_self (), sizeof (cpuset), &cpuset);
+  if (rv)
+    clib_warning ("pthread_setaffinity_np cpu %d returned %d", cpu, rv);
+}
+
+/* Stream byte n is n & 0xff, the buffer holds that pattern twice over */
+static void *
+perf_producer (void *arg)
+{
+  perf_thread_args_t *a = arg;
+  u64 sent = 0;
+  int rv;
+
+  perf_pin_thread (a->cpu);
+
+  while (sent < a->n_bytes)
+    {
+      rv = svm_fifo_enqueue_nowait (a->f, 0,
+				    clib_min (a->chunk_size,
+					      a->n_bytes - sent),
+				    a->buf + (sent & 0xff));
+      if (rv > 0)
+	{
+	  sent += rv;
+	  a->n_ops++;
+	}
+    }
+  return 0;
+}
+
+static void *
+perf_consumer (void *arg)
+{
+  perf_thread_args_t *a = arg;
+  u64 rcvd = 0;
+  int i, rv;
+
+  perf_pin_thread (a->cpu);
+
+  while (rcvd < a->n_bytes)
+    {
+      rv = svm_fifo_dequeue_nowait (a->f, 0, a->chunk_size, a->buf);
+      if (rv <= 0)
+	continue;
+
+      if (a->verify)
+	for (i = 0; i < rv; i++)
+	  if (a->buf[i] != (u8) (rcvd + i))
+	    a->error = 1;
+
+      rcvd += rv;
+      a->n_ops++;
+    }
+  return 0;
+}
+
+/** Stream data through a fifo from one core to another */
+clib_error_t *
+perf (int verbose, u32 fifo_size, u32 chunk_size, u64 n_bytes,
+      int producer_cpu, int consumer_cpu, int verify)
+{
+  svm_fifo_segment_create_args_t _a, *a = &_a;
+  perf_thread_args_t producer, consumer;
+  svm_fifo_segment_private_t *sp;
+  pthread_t producer_thread, consumer_thread;
+  svm_fifo_t *f;
+  f64 before, delta;
+  int i, rv;
+
+  memset (a, 0, sizeof (*a));
+
+  a->segment_name = "fifo-test1";
+  a->segment_size = fifo_size + (256 << 10);
+
+  rv = svm_fifo_segment_create (a);
+
+  if (rv)
+    return clib_error_return (0, "svm_fifo_segment_create returned %d", rv);
+
+  sp = svm_fifo_get_segment (a->new_segment_index);
+
+  f = svm_fifo_segment_alloc_fifo (sp, fifo_size);
+
+  if (f == 0)
+    return clib_error_return (0, "svm_fifo_segment_alloc_fifo failed");
+
+  memset (&producer, 0, sizeof (producer));
+  producer.f = f;
+  producer.chunk_size = chunk_size;
+  producer.n_bytes = n_bytes;
+  producer.cpu = producer_cpu;
+  consumer = producer;
+  consumer.cpu = consumer_cpu;
+  consumer.verify = verify;
+
+  /* Threads don't allocate, the heap isn't thread safe */
+  vec_validate (producer.buf, chunk_size + 255);
+  for (i = 0; i < vec_len (producer.buf); i++)
+    producer.buf[i] = i;
+  vec_validate (consumer.buf, chunk_size - 1);
+
+  before = unix_time_now ();
+  if (pthread_create (&consumer_thread, 0, perf_consumer, &consumer)
+      || pthread_create (&producer_thread, 0, perf_producer, &producer))
+    return clib_error_return_unix (0, "pthread_create");
+  pthread_join (producer_thread, 0);
+  pthread_join (consumer_thread, 0);
+  delta = unix_time_now () - before;
+
+  vec_free (producer.buf);
+  vec_free (consumer.buf);
+  svm_fifo_segment_free_fifo (sp, f);
+
+  if (consumer.error)
+    return clib_error_return (0, "perf test FAILED, data corrupted");
+
+  fformat (stdout, "%lld bytes, fifo %d chunk %d, cpus %d -> %d: %.3f sec\n",
+	   n_bytes, fifo_size, chunk_size, producer_cpu, consumer_cpu, delta);
+  fformat (stdout, "  enqueue %.2f Mops/s, dequeue %.2f Mops/s, %.2f Gbit/s\n",
+	   producer.n_ops / delta / 1e6, consumer.n_ops / delta / 1e6,
+	   n_bytes * 8 / delta / 1e9);
+
+  return clib_error_return (0, "perf test OK");
+}
+
+/* Byte at a position in the ooo test stream */
+static inline u8
+ooo_stream_byte (u32 pos)
+{
+  return (pos * 0x9E3779B1) >> 24;
+}
+
+static void
+ooo_stream_fill (u8 * buf, u32 pos, u32 len)
+{
+  u32 i;
+  for (i = 0; i < len; i++)
+    buf[i] = ooo_stream_byte (pos + i);
+}
+
+/**
+ * Check the fifo's out-of-order segments against the bytes known to have
+ * been received past the tail
+ */
+static clib_error_t *
+ooo_check (svm_fifo_t * f, u8 * rcvd, u32 tail_pos, u32 * n_segments)
+{
+  ooo_segment_t *s;
+  u32 index, pos, offset, end = 0, n = 0, size = vec_len (rcvd);
+
+  index = f->ooos_list_head;
+  while (index != OOO_SEGMENT_INVALID_INDEX)
+    {
+      s = pool_elt_at_index (f->ooo_segments, index);
+      offset = s->start - tail_pos;
+
+      if (offset <= end || offset + s->length > size)
+	return clib_error_return (0, "segment %d at offset %d length %d "
+				  "overlaps, touches or is out of the window",
+				  index, offset, s->length);
+      if (offset != ooo_segment_offset (f, s))
+	return clib_error_return (0, "segment %d offset %d, fifo position "
+				  "says %d", index, offset,
+				  ooo_segment_offset (f, s));
+
+      /* Gap before the segment, then the segment */
+      for (pos = end; pos < offset; pos++)
+	if (rcvd[(tail_pos + pos) % size])
+	  return clib_error_return (0, "offset %d received, no segment", pos);
+      for (pos = offset; pos < offset + s->length; pos++)
+	if (!rcvd[(tail_pos + pos) % size])
+	  return clib_error_return (0, "offset %d in segment %d, not "
+				    "received", pos, index);
+
+      end = offset + s->length;
+      index = s->next;
+      n++;
+    }
+
+  for (pos = end; pos < size; pos++)
+    if (rcvd[(tail_pos + pos) % size])
+      return clib_error_return (0, "offset %d received, no segment", pos);
+
+  if (n != pool_elts (f->ooo_segments))
+    return clib_error_return (0, "%d segments in list, %d allocated", n,
+			      pool_elts (f->ooo_segments));
+
+  *n_segments = n;
+  return 0;
+}
+
+/** Out-of-order enqueues at random offsets, checked against a shadow map */
+clib_error_t *
+ooo_stress (int verbose, u32 fifo_size, u32 max_seg_size,
+	    u32 n_iterations, u32 seed)
+{
+  svm_fifo_segment_create_args_t _a, *a = &_a;
+  svm_fifo_segment_private_t *sp;
+  clib_error_t *error = 0;
+  svm_fifo_t *f;
+  u8 *buf = 0, *rcvd = 0;
+  u32 i, pos, offset, len, window, n_segments = 0, max_segments = 0;
+  u32 tail_pos = 0, head_pos = 0, n_ooo = 0, n_in_order = 0, n_refused = 0;
+  f64 before, delta = 0;
+  int rv;
+
+  memset (a, 0, sizeof (*a));
+
+  a->segment_name = "fifo-test1";
+  a->segment_size = fifo_size + (1 << 20);
+
+  rv = svm_fifo_segment_create (a);
+
+  if (rv)
+    return clib_error_return (0, "svm_fifo_segment_create returned %d", rv);
+
+  sp = svm_fifo_get_segment (a->new_segment_index);
+
+  f = svm_fifo_segment_alloc_fifo (sp, fifo_size);
+
+  if (f == 0)
+    return clib_error_return (0, "svm_fifo_segment_alloc_fifo failed");
+
+  vec_validate (buf, clib_max (max_seg_size, fifo_size) - 1);
+  vec_validate (rcvd, fifo_size - 1);
+
+  before = unix_time_now ();
+  for (i = 0; i < n_iterations; i++)
+    {
+      window = svm_fifo_max_enqueue (f);
+      if (window)
+	{
+	  offset = random_u32 (&seed) % window;
+	  len = 1 + random_u32 (&seed) % clib_min (max_seg_size,
+						   window - offset);
+
+	  /* Mostly out of order, now and then fill the first hole */
+	  if (offset == 0 || (random_u32 (&seed) & 15) == 0)
+	    {
+	      ooo_stream_fill (buf, tail_pos, len);
+	      rv = svm_fifo_enqueue_nowait (f, 0, len, buf);
+	      if (rv < (int) len)
+		{
+		  error = clib_error_return (0, "in-order enqueue of %d "
+					     "returned %d", len, rv);
+		  break;
+		}
+	      for (pos = 0; pos < rv; pos++)
+		rcvd[(tail_pos + pos) % fifo_size] = 0;
+	      tail_pos += rv;
+	      n_in_order++;
+	    }
+	  else
+	    {
+	      ooo_stream_fill (buf, tail_pos + offset, len);
+	      if (svm_fifo_enqueue_with_offset (f, 0, offset, len, buf))
+		n_refused++;
+	      else
+		{
+		  for (pos = offset; pos < offset + len; pos++)
+		    rcvd[(tail_pos + pos) % fifo_size] = 1;
+		  n_ooo++;
+		}
+	    }
+	}
+
+      /* Drain some of the in-order data */
+      if ((random_u32 (&seed) & 3) == 0 && svm_fifo_max_dequeue (f))
+	{
+	  len = 1 + random_u32 (&seed) % svm_fifo_max_dequeue (f);
+	  rv = svm_fifo_dequeue_nowait (f, 0, len, buf);
+	  for (pos = 0; pos < rv; pos++)
+	    if (buf[pos] != ooo_stream_byte (head_pos + pos))
+	      {
+		error = clib_error_return (0, "stream offset %u corrupted",
+					   head_pos + pos);
+		goto done;
+	      }
+	  head_pos += rv;
+	}
+
+      if ((i & 255) == 0 || verbose > 1)
+	{
+	  error = ooo_check (f, rcvd, tail_pos, &n_segments);
+	  if (error)
+	    break;
+	  max_segments = clib_max (max_segments, n_segments);
+	}
+    }
+  delta = unix_time_now () - before;
+
+done:
+  vec_free (buf);
+  vec_free (rcvd);
+  svm_fifo_segment_free_fifo (sp, f);
+
+  if (error)
+    {
+      clib_warning ("iteration %d: %U", i, format_clib_error, error);
+      clib_error_free (error);
+      return clib_error_return (0, "ooo test FAILED");
+    }
+
+  fformat (stdout, "%d iterations, %d ooo enqueues, %d refused, %d in "
+	   "order, max %d segments\n", n_iterations, n_ooo, n_refused,
+	   n_in_order, max_segments);
+  if (verbose)
+    fformat (stdout, "  %u bytes streamed in %.3f sec\n", head_pos, delta);
+
+  return clib_error_return (0, "ooo test OK");
+}
+
 int
 test_ssvm_fifo1 (unformat_input_t * input)
 {
   clib_error_t *error = 0;
   int verbose = 0;
   int test_id = 0;
+  uword fifo_size = 64 << 10, n_bytes = 1ULL << 32;
+  u32 chunk_size = 1460;
+  int producer_cpu = 0, consumer_cpu = 1, verify = 0;
+  u32 n_iterations = 1 << 20, seed = 0xdeadbeef;
 
   svm_fifo_segment_init (0x200000000ULL, 20);
 
@@ -296,6 +637,25 @@ test_ssvm_fifo1 (unformat_input_t * input)
 	test_id = 3;
       else if (unformat (input, "offset"))
 	test_id = 4;
+      else if (unformat (input, "perf"))
+	test_id = 5;
+      else if (unformat (input, "ooo"))
+	test_id = 6;
+      else if (unformat (input, "iterations %d", &n_iterations))
+	;
+      else if (unformat (input, "seed %d", &seed))
+	;
+      else if (unformat (input, "fifo-size %U", unformat_memory_size,
+			 &fifo_size))
+	;
+      else if (unformat (input, "chunk %d", &chunk_size))
+	;
+      else if (unformat (input, "bytes %U", unformat_memory_size, &n_bytes))
+	;
+      else if (unformat (input, "cpus %d %d", &producer_cpu, &consumer_cpu))
+	;
+      else if (unformat (input, "verify"))
+	verify = 1;
       else
 	{
 	  error = clib_error_create ("unknown input `%U'\n",
@@ -326,6 +686,16 @@ test_ssvm_fifo1 (unformat_input_t * input)
       error = offset (verbose);
       break;
 
+    case 5:
+      error = perf (verbose, fifo_size, chunk_size, n_bytes, producer_cpu,
+		    consumer_cpu, verify);
+      break;
+
+    case 6:
+      error = ooo_stress (verbose, fifo_size, chunk_size, n_iterations,
+			  seed);
+      break;
+
     default:
       error = clib_error_return (0, "test id %d unknown", test_id);
       break;
@@ -89,11 +89,15 @@ typedef struct
   /* drop all packets */
   int drop_packets;
 
+  /* share the listener with other servers, SO_REUSEPORT style */
+  int reuseport;
+  u64 listen_thread_mask;
+
   /* Our event queue */
   unix_shared_memory_queue_t *our_event_queue;
 
   /* $$$ single thread only for the moment */
-  unix_shared_memory_queue_t *vpp_event_queue;
+  svm_event_ring_t *vpp_event_queue;
 
   pid_t my_pid;
 
@@ -441,7 +445,7 @@ vl_api_connect_uri_reply_t_handler (vl_api_connect_uri_reply_t * mp)
   utm->our_event_queue = (unix_shared_memory_queue_t *)
     mp->client_event_queue_address;
 
-  utm->vpp_event_queue = (unix_shared_memory_queue_t *)
+  utm->vpp_event_queue = (svm_event_ring_t *)
     mp->vpp_event_queue_address;
 
   /*
@@ -515,16 +519,18 @@ client_send_data (uri_tcp_test_main_t * utm)
 	      buffer_offset += rv;
 	      bytes_sent += rv;
 
-	      /* Fabricate TX event, send to vpp */
-	      evt.fifo = tx_fifo;
-	      evt.event_type = FIFO_EVENT_SERVER_TX;
-	      /* $$$$ for event logging */
-	      evt.enqueue_length = rv;
-	      evt.event_id = serial_number++;
-
-	      unix_shared_memory_queue_add (utm->vpp_event_queue,
-					    (u8 *) & evt,
-					    0 /* do wait for mutex */ );
+	      /* Fabricate TX event, send to vpp, unless one is pending */
+	      if (svm_fifo_set_event (tx_fifo))
+		{
+		  evt.fifo = tx_fifo;
+		  evt.event_type = FIFO_EVENT_SERVER_TX;
+		  /* $$$$ for event logging */
+		  evt.enqueue_length = rv;
+		  evt.event_id = serial_number++;
+
+		  svm_event_ring_enqueue (utm->vpp_event_queue,
+					  (u8 *) & evt, 0 /* wait */ );
+		}
 	    }
 	}
     }
@@ -666,7 +672,7 @@ vl_api_accept_session_t_handler (vl_api_accept_session_t * mp)
   if (start_time == 0.0)
     start_time = clib_time_now (&utm->clib_time);
 
-  utm->vpp_event_queue = (unix_shared_memory_queue_t *)
+  utm->vpp_event_queue = (svm_event_ring_t *)
     mp->vpp_event_queue_address;
 
   /* Allocate local session and set it up */
@@ -716,7 +722,6 @@ server_handle_fifo_event_rx (uri_tcp_test_main_t * utm,
   int n_read;
 
   session_fifo_event_t evt;
-  unix_shared_memory_queue_t *q;
   int rv, bytes;
 
   rx_fifo = e->fifo;
@@ -737,15 +742,17 @@ server_handle_fifo_event_rx (uri_tcp_test_main_t * utm,
 	    }
 	  while (rv == -2 && !utm->time_to_stop);
 
-	  /* Fabricate TX event, send to vpp */
-	  evt.fifo = tx_fifo;
-	  evt.event_type = FIFO_EVENT_SERVER_TX;
-	  /* $$$$ for event logging */
-	  evt.enqueue_length = n_read;
-	  evt.event_id = e->event_id;
-	  q = utm->vpp_event_queue;
-	  unix_shared_memory_queue_add (q, (u8 *) & evt,
-					0 /* do wait for mutex */ );
+	  /* Fabricate TX event, send to vpp, unless one is pending */
+	  if (svm_fifo_set_event (tx_fifo))
+	    {
+	      evt.fifo = tx_fifo;
+	      evt.event_type = FIFO_EVENT_SERVER_TX;
+	      /* $$$$ for event logging */
+	      evt.enqueue_length = n_read;
+	      evt.event_id = e->event_id;
+	      svm_event_ring_enqueue (utm->vpp_event_queue, (u8 *) & evt,
+				      0 /* wait */ );
+	    }
 	}
 
       if (n_read > 0)
@@ -803,6 +810,11 @@ server_bind (uri_tcp_test_main_t * utm)
   bmp->options[SESSION_OPTIONS_RX_FIFO_SIZE] = fifo_size;
   bmp->options[SESSION_OPTIONS_TX_FIFO_SIZE] = fifo_size;
   bmp->options[SESSION_OPTIONS_ADD_SEGMENT_SIZE] = 128 << 20;
+  if (utm->reuseport)
+    {
+      bmp->options[SESSION_OPTIONS_FLAGS] |= SESSION_OPTIONS_FLAGS_REUSEPORT;
+      bmp->options[SESSION_OPTIONS_LISTEN_THREADS] = utm->listen_thread_mask;
+    }
   memcpy (bmp->uri, utm->uri, vec_len (utm->uri));
   vl_msg_api_send_shmem (utm->vl_input_queue, (u8 *) & bmp);
 }
@@ -934,6 +946,10 @@ main (int argc, char **argv)
 	drop_packets = 1;
       else if (unformat (a, "test"))
 	test_return_packets = 1;
+      else if (unformat (a, "reuseport"))
+	utm->reuseport = 1;
+      else if (unformat (a, "threads %llx", &utm->listen_thread_mask))
+	utm->reuseport = 1;
       else
 	{
 	  fformat (stderr, "%s: usage [master|slave]\n");
@@ -96,7 +96,7 @@ typedef struct
   unix_shared_memory_queue_t *our_event_queue;
 
   /* $$$ single thread only for the moment */
-  unix_shared_memory_queue_t *vpp_event_queue;
+  svm_event_ring_t *vpp_event_queue;
 
   /* $$$$ hack: cut-through session index */
   volatile u32 cut_through_session_index;
@@ -526,7 +526,7 @@ vl_api_accept_session_t_handler (vl_api_accept_session_t * mp)
   if (start_time == 0.0)
     start_time = clib_time_now (&utm->clib_time);
 
-  utm->vpp_event_queue = (unix_shared_memory_queue_t *)
+  utm->vpp_event_queue = (svm_event_ring_t *)
     mp->vpp_event_queue_address;
 
   pool_get (utm->sessions, session);
@@ -721,7 +721,6 @@ server_handle_fifo_event_rx (uri_udp_test_main_t * utm,
   int nbytes;
 
   session_fifo_event_t evt;
-  unix_shared_memory_queue_t *q;
   int rv;
 
   rx_fifo = e->fifo;
@@ -739,14 +738,17 @@ server_handle_fifo_event_rx (uri_udp_test_main_t * utm,
     }
   while (rv == -2);
 
-  /* Fabricate TX event, send to vpp */
-  evt.fifo = tx_fifo;
-  evt.event_type = FIFO_EVENT_SERVER_TX;
-  /* $$$$ for event logging */
-  evt.enqueue_length = nbytes;
-  evt.event_id = e->event_id;
-  q = utm->vpp_event_queue;
-  unix_shared_memory_queue_add (q, (u8 *) & evt, 0 /* do wait for mutex */ );
+  /* Fabricate TX event, send to vpp, unless one is pending */
+  if (svm_fifo_set_event (tx_fifo))
+    {
+      evt.fifo = tx_fifo;
+      evt.event_type = FIFO_EVENT_SERVER_TX;
+      /* $$$$ for event logging */
+      evt.enqueue_length = nbytes;
+      evt.event_id = e->event_id;
+      svm_event_ring_enqueue (utm->vpp_event_queue, (u8 *) & evt,
+			      0 /* wait */ );
+    }
 }
 
 void
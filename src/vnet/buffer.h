@@ -70,6 +70,16 @@
 #define LOG2_VNET_BUFFER_SPAN_CLONE LOG2_VLIB_BUFFER_FLAG_USER(8)
 #define VNET_BUFFER_SPAN_CLONE (1 << LOG2_VNET_BUFFER_SPAN_CLONE)
 
+/* Payload larger than the MTU, to be cut in segments of
+   vnet_buffer2(b)->gso_size bytes by the NIC or at interface-output */
+#define LOG2_VNET_BUFFER_GSO LOG2_VLIB_BUFFER_FLAG_USER(9)
+#define VNET_BUFFER_GSO (1 << LOG2_VNET_BUFFER_GSO)
+
+/* vnet_buffer(b)->ip.reass holds the L4 info of the datagram, set by
+   virtual reassembly and valid on the unicast arc up to the lookup */
+#define LOG2_VNET_BUFFER_L4_INFO_VALID LOG2_VLIB_BUFFER_FLAG_USER(10)
+#define VNET_BUFFER_L4_INFO_VALID (1 << LOG2_VNET_BUFFER_L4_INFO_VALID)
+
 #define foreach_buffer_opaque_union_subtype     \
 _(ethernet)                                     \
 _(ip)                                           \
@@ -142,6 +152,26 @@ typedef struct
 
 	/* IP header offset from vlib_buffer.data - saved by ip*_local nodes */
 	i32 start_of_ip_header;
+
+	/* IP reassembly, see ip_reassembly.h */
+	union
+	{
+	  /* full reassembly: fragment held in a reassembly context */
+	  struct
+	  {
+	    u32 next_range_bi;
+	    u16 range_first;
+	    u16 range_last;
+	  };
+	  /* virtual reassembly: L4 info of the (fragmented) datagram */
+	  struct
+	  {
+	    u16 l4_src_port;
+	    u16 l4_dst_port;
+	    u8 ip_proto;
+	    u8 is_non_first_fragment;
+	  };
+	} reass;
       };
 
     } ip;
@@ -296,9 +326,22 @@ typedef struct
 {
   union
   {
+    /* Generic segmentation offload, valid with VNET_BUFFER_GSO */
+    struct
+    {
+      u16 gso_size;		/**< L4 payload bytes per segment */
+      u16 gso_l4_hdr_sz;	/**< L4 header and options bytes */
+    };
+
+    u32 unused[14];
   };
 } vnet_buffer_opaque2_t;
 
+STATIC_ASSERT (sizeof (vnet_buffer_opaque2_t) <=
+	       STRUCT_SIZE_OF (vlib_buffer_t, opaque2),
+	       "VNET buffer opaque2 meta-data too large for vlib_buffer");
+
+#define vnet_buffer2(b) ((vnet_buffer_opaque2_t *) (b)->opaque2)
 
 
 #endif /* included_vnet_buffer_h */
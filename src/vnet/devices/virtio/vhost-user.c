@@ -196,10 +196,15 @@ vhost_user_name_renumber (vnet_hw_interface_t * hi, u32 new_dev_instance)
   return 0;
 }
 
+/*
+ * Regions are sorted by guest address and do not overlap, see
+ * vhost_user_sort_mem_regions(). Past the hint, a binary search finds
+ * the last region starting at or below addr.
+ */
 static_always_inline void *
 map_guest_mem (vhost_user_intf_t * vui, uword addr, u32 * hint)
 {
-  int i = *hint;
+  int i = *hint, lo, hi, mid;
   if (PREDICT_TRUE ((vui->regions[i].guest_phys_addr <= addr) &&
 		    ((vui->regions[i].guest_phys_addr +
 		      vui->regions[i].memory_size) > addr)))
@@ -207,59 +212,26 @@ map_guest_mem (vhost_user_intf_t * vui, uword addr, u32 * hint)
       return (void *) (vui->region_mmap_addr[i] + addr -
 		       vui->regions[i].guest_phys_addr);
     }
-#if __SSE4_2__
-  __m128i rl, rh, al, ah, r;
-  al = _mm_set1_epi64x (addr + 1);
-  ah = _mm_set1_epi64x (addr);
-
-  rl = _mm_loadu_si128 ((__m128i *) & vui->region_guest_addr_lo[0]);
-  rl = _mm_cmpgt_epi64 (al, rl);
-  rh = _mm_loadu_si128 ((__m128i *) & vui->region_guest_addr_hi[0]);
-  rh = _mm_cmpgt_epi64 (rh, ah);
-  r = _mm_and_si128 (rl, rh);
-
-  rl = _mm_loadu_si128 ((__m128i *) & vui->region_guest_addr_lo[2]);
-  rl = _mm_cmpgt_epi64 (al, rl);
-  rh = _mm_loadu_si128 ((__m128i *) & vui->region_guest_addr_hi[2]);
-  rh = _mm_cmpgt_epi64 (rh, ah);
-  r = _mm_blend_epi16 (r, _mm_and_si128 (rl, rh), 0x22);
-
-  rl = _mm_loadu_si128 ((__m128i *) & vui->region_guest_addr_lo[4]);
-  rl = _mm_cmpgt_epi64 (al, rl);
-  rh = _mm_loadu_si128 ((__m128i *) & vui->region_guest_addr_hi[4]);
-  rh = _mm_cmpgt_epi64 (rh, ah);
-  r = _mm_blend_epi16 (r, _mm_and_si128 (rl, rh), 0x44);
-
-  rl = _mm_loadu_si128 ((__m128i *) & vui->region_guest_addr_lo[6]);
-  rl = _mm_cmpgt_epi64 (al, rl);
-  rh = _mm_loadu_si128 ((__m128i *) & vui->region_guest_addr_hi[6]);
-  rh = _mm_cmpgt_epi64 (rh, ah);
-  r = _mm_blend_epi16 (r, _mm_and_si128 (rl, rh), 0x88);
-
-  r = _mm_shuffle_epi8 (r, _mm_set_epi64x (0, 0x0e060c040a020800));
-  i = __builtin_ctzll (_mm_movemask_epi8 (r) |
-		       (1 << VHOST_MEMORY_MAX_NREGIONS));
-
-  if (i < vui->nregions)
-    {
-      *hint = i;
-      return (void *) (vui->region_mmap_addr[i] + addr -
-		       vui->regions[i].guest_phys_addr);
+
+  lo = 0;
+  hi = vui->nregions - 1;
+  while (lo < hi)
+    {
+      mid = (lo + hi + 1) / 2;
+      if (vui->region_guest_addr_lo[mid] <= addr)
+	lo = mid;
+      else
+	hi = mid - 1;
     }
 
-#else
-  for (i = 0; i < vui->nregions; i++)
+  if (PREDICT_TRUE (vui->nregions && vui->region_guest_addr_lo[lo] <= addr
+		    && vui->region_guest_addr_hi[lo] > addr))
     {
-      if ((vui->regions[i].guest_phys_addr <= addr) &&
-	  ((vui->regions[i].guest_phys_addr + vui->regions[i].memory_size) >
-	   addr))
-	{
-	  *hint = i;
-	  return (void *) (vui->region_mmap_addr[i] + addr -
-			   vui->regions[i].guest_phys_addr);
-	}
+      *hint = lo;
+      return (void *) (vui->region_mmap_addr[lo] + addr -
+		       vui->regions[lo].guest_phys_addr);
     }
-#endif
+
   DBG_VQ ("failed to map guest mem addr %llx", addr);
   *hint = 0;
   return 0;
@@ -282,6 +254,39 @@ map_user_mem (vhost_user_intf_t * vui, uword addr)
   return 0;
 }
 
+/*
+ * Order the regions of a memory table by guest address, their fds along.
+ * Fails if two regions overlap.
+ */
+static int
+vhost_user_sort_mem_regions (vhost_user_memory_region_t * regions, int *fds,
+			     u32 n_regions)
+{
+  vhost_user_memory_region_t r;
+  int i, j, fd;
+
+  for (i = 1; i < n_regions; i++)
+    {
+      r = regions[i];
+      fd = fds[i];
+      for (j = i; j > 0 && regions[j - 1].guest_phys_addr > r.guest_phys_addr;
+	   j--)
+	{
+	  regions[j] = regions[j - 1];
+	  fds[j] = fds[j - 1];
+	}
+      regions[j] = r;
+      fds[j] = fd;
+    }
+
+  for (i = 1; i < n_regions; i++)
+    if (regions[i - 1].guest_phys_addr + regions[i - 1].memory_size >
+	regions[i].guest_phys_addr)
+      return -1;
+
+  return 0;
+}
+
 static long
 get_huge_page_size (int fd)
 {
@@ -758,7 +763,8 @@ vhost_user_socket_read (unix_file_t * uf)
 	(1ULL << FEAT_VIRTIO_NET_F_GUEST_ANNOUNCE) |
 	(1ULL << FEAT_VIRTIO_NET_F_MQ) |
 	(1ULL << FEAT_VHOST_USER_F_PROTOCOL_FEATURES) |
-	(1ULL << FEAT_VIRTIO_F_VERSION_1);
+	(1ULL << FEAT_VIRTIO_F_VERSION_1) |
+	(1ULL << FEAT_VIRTIO_F_IN_ORDER);
       msg.u64 &= vui->feature_mask;
       msg.size = sizeof (msg.u64);
       DBG_SOCK ("if %d msg VHOST_USER_GET_FEATURES - reply 0x%016llx",
@@ -780,6 +786,8 @@ vhost_user_socket_read (unix_file_t * uf)
 
       vui->is_any_layout =
 	(vui->features & (1 << FEAT_VIRTIO_F_ANY_LAYOUT)) ? 1 : 0;
+      vui->is_in_order =
+	(vui->features & (1ULL << FEAT_VIRTIO_F_IN_ORDER)) ? 1 : 0;
 
       ASSERT (vui->virtio_net_hdr_sz < VLIB_BUFFER_PRE_DATA_SIZE);
       vnet_hw_interface_set_flags (vnm, vui->hw_if_index, 0);
@@ -809,6 +817,12 @@ vhost_user_socket_read (unix_file_t * uf)
 	  DBG_SOCK ("each memory region must have FD");
 	  goto close_socket;
 	}
+      if (vhost_user_sort_mem_regions (msg.memory.regions, fds,
+				       msg.memory.nregions))
+	{
+	  DBG_SOCK ("memory regions must not overlap");
+	  goto close_socket;
+	}
       unmap_all_mem_regions (vui);
       for (i = 0; i < msg.memory.nregions; i++)
 	{
@@ -1356,47 +1370,74 @@ vhost_user_send_call (vlib_main_t * vm, vhost_user_vring_t * vq)
   vq->int_deadline = vlib_time_now (vm) + vum->coalesce_time;
 }
 
-static_always_inline u32
-vhost_user_input_copy (vhost_user_intf_t * vui, vhost_copy_t * cpy,
-		       u16 copy_len, u32 * map_hint)
+static_always_inline void *
+map_guest_mem_range (vhost_user_intf_t * vui, uword addr, u32 len,
+		     u32 * hint)
 {
-  void *src0, *src1, *src2, *src3;
-  if (PREDICT_TRUE (copy_len >= 4))
-    {
-      if (PREDICT_FALSE (!(src2 = map_guest_mem (vui, cpy[0].src, map_hint))))
-	return 1;
-      if (PREDICT_FALSE (!(src3 = map_guest_mem (vui, cpy[1].src, map_hint))))
-	return 1;
-
-      while (PREDICT_TRUE (copy_len >= 4))
-	{
-	  src0 = src2;
-	  src1 = src3;
+  void *ptr = map_guest_mem (vui, addr, hint);
 
-	  if (PREDICT_FALSE
-	      (!(src2 = map_guest_mem (vui, cpy[2].src, map_hint))))
-	    return 1;
-	  if (PREDICT_FALSE
-	      (!(src3 = map_guest_mem (vui, cpy[3].src, map_hint))))
-	    return 1;
+  /* The whole buffer must lie within the region it starts in */
+  if (PREDICT_FALSE (ptr && addr + len > vui->region_guest_addr_hi[*hint]))
+    return 0;
+  return ptr;
+}
 
-	  CLIB_PREFETCH (src2, 64, LOAD);
-	  CLIB_PREFETCH (src3, 64, LOAD);
+/*
+ * Run a batch of copy orders whose addresses were all resolved to
+ * host pointers. Nothing but prefetch and memcpy is left in the loop.
+ */
+static_always_inline void
+vhost_user_do_copies (vhost_copy_t * cpy, u16 copy_len)
+{
+  while (PREDICT_TRUE (copy_len >= 4))
+    {
+      CLIB_PREFETCH ((void *) cpy[2].src, 64, LOAD);
+      CLIB_PREFETCH ((void *) cpy[3].src, 64, LOAD);
+      CLIB_PREFETCH ((void *) cpy[2].dst, 64, STORE);
+      CLIB_PREFETCH ((void *) cpy[3].dst, 64, STORE);
 
-	  clib_memcpy ((void *) cpy[0].dst, src0, cpy[0].len);
-	  clib_memcpy ((void *) cpy[1].dst, src1, cpy[1].len);
-	  copy_len -= 2;
-	  cpy += 2;
-	}
+      clib_memcpy ((void *) cpy[0].dst, (void *) cpy[0].src, cpy[0].len);
+      clib_memcpy ((void *) cpy[1].dst, (void *) cpy[1].src, cpy[1].len);
+      copy_len -= 2;
+      cpy += 2;
     }
   while (copy_len)
     {
-      if (PREDICT_FALSE (!(src0 = map_guest_mem (vui, cpy->src, map_hint))))
-	return 1;
-      clib_memcpy ((void *) cpy->dst, src0, cpy->len);
+      clib_memcpy ((void *) cpy->dst, (void *) cpy->src, cpy->len);
       copy_len -= 1;
       cpy += 1;
     }
+}
+
+/*
+ * Guest tx data is always copied, there is no zero-copy dequeue. A vlib
+ * buffer keeps its data inline, right after its header, so it cannot
+ * point into guest memory. Placing headers in guest memory instead would
+ * overwrite what the guest keeps in front of its packets.
+ */
+static_always_inline u32
+vhost_user_input_copy (vhost_user_intf_t * vui, vhost_copy_t * cpy,
+		       u16 copy_len, u32 * map_hint)
+{
+  vhost_copy_t *c = cpy;
+  u16 n_left = copy_len;
+  void *src;
+
+  /*
+   * Resolve the guest addresses of the whole batch first, so that a
+   * bad descriptor is caught before any data is moved.
+   */
+  while (n_left)
+    {
+      if (PREDICT_FALSE
+	  (!(src = map_guest_mem_range (vui, c->src, c->len, map_hint))))
+	return 1;
+      c->src = (uword) src;
+      n_left -= 1;
+      c += 1;
+    }
+
+  vhost_user_do_copies (cpy, copy_len);
   return 0;
 }
 
@@ -1440,6 +1481,26 @@ out:
   return discarded_packets;
 }
 
+/*
+ * With VIRTIO_F_IN_ORDER, chains are used in the order they were made
+ * available and a single used entry, for the last chain of a batch,
+ * returns the whole batch to the driver.
+ */
+static_always_inline void
+vhost_user_used_in_order (vhost_user_intf_t * vui, vhost_user_vring_t * vq,
+			  u32 * last_head)
+{
+  u16 slot = (vq->last_used_idx - 1) & (vq->qsz - 1);
+
+  if (*last_head == ~0)
+    return;
+
+  vq->used->ring[slot].id = *last_head;
+  vq->used->ring[slot].len = 0;
+  vhost_user_log_dirty_ring (vui, vq, ring[slot]);
+  *last_head = ~0;
+}
+
 /*
  * In case of overflow, we need to rewind the array of allocated buffers.
  */
@@ -1478,6 +1539,7 @@ vhost_user_if_input (vlib_main_t * vm,
   u32 map_hint = 0;
   u16 cpu_index = os_get_cpu_number ();
   u16 copy_len = 0;
+  u32 in_order_head = ~0;
 
   {
     /* do we have pending interrupts ? */
@@ -1576,7 +1638,7 @@ vhost_user_if_input (vlib_main_t * vm,
 	{
 	  vlib_buffer_t *b_head, *b_current;
 	  u32 bi_current;
-	  u16 desc_current;
+	  u16 desc_current, desc_head;
 	  u32 desc_data_offset;
 	  vring_desc_t *desc_table = txvq->desc;
 
@@ -1590,7 +1652,8 @@ vhost_user_if_input (vlib_main_t * vm,
 	      break;
 	    }
 
-	  desc_current = txvq->avail->ring[txvq->last_avail_idx & qsz_mask];
+	  desc_head = desc_current =
+	    txvq->avail->ring[txvq->last_avail_idx & qsz_mask];
 	  vum->cpus[cpu_index].rx_buffers_len--;
 	  bi_current = (vum->cpus[cpu_index].rx_buffers)
 	    [vum->cpus[cpu_index].rx_buffers_len];
@@ -1605,10 +1668,14 @@ vhost_user_if_input (vlib_main_t * vm,
 					    rx_buffers_len - 1], LOAD);
 
 	  /* Just preset the used descriptor id and length for later */
-	  txvq->used->ring[txvq->last_used_idx & qsz_mask].id = desc_current;
-	  txvq->used->ring[txvq->last_used_idx & qsz_mask].len = 0;
-	  vhost_user_log_dirty_ring (vui, txvq,
-				     ring[txvq->last_used_idx & qsz_mask]);
+	  if (PREDICT_TRUE (!vui->is_in_order))
+	    {
+	      txvq->used->ring[txvq->last_used_idx & qsz_mask].id =
+		desc_current;
+	      txvq->used->ring[txvq->last_used_idx & qsz_mask].len = 0;
+	      vhost_user_log_dirty_ring (vui, txvq,
+					 ring[txvq->last_used_idx & qsz_mask]);
+	    }
 
 	  /* The buffer should already be initialized */
 	  b_head->total_length_not_including_first_buffer = 0;
@@ -1734,6 +1801,7 @@ vhost_user_if_input (vlib_main_t * vm,
 	  /* consume the descriptor and return it as used */
 	  txvq->last_avail_idx++;
 	  txvq->last_used_idx++;
+	  in_order_head = desc_head;
 
 	  VLIB_BUFFER_TRACE_TRAJECTORY_INIT (b_head);
 
@@ -1778,6 +1846,7 @@ vhost_user_if_input (vlib_main_t * vm,
 	      copy_len = 0;
 
 	      /* give buffers back to driver */
+	      vhost_user_used_in_order (vui, txvq, &in_order_head);
 	      CLIB_MEMORY_BARRIER ();
 	      txvq->used->idx = txvq->last_used_idx;
 	      vhost_user_log_dirty_ring (vui, txvq, idx);
@@ -1799,6 +1868,7 @@ vhost_user_if_input (vlib_main_t * vm,
     }
 
   /* give buffers back to driver */
+  vhost_user_used_in_order (vui, txvq, &in_order_head);
   CLIB_MEMORY_BARRIER ();
   txvq->used->idx = txvq->last_used_idx;
   vhost_user_log_dirty_ring (vui, txvq, idx);
@@ -1904,46 +1974,38 @@ static_always_inline u32
 vhost_user_tx_copy (vhost_user_intf_t * vui, vhost_copy_t * cpy,
 		    u16 copy_len, u32 * map_hint)
 {
-  void *dst0, *dst1, *dst2, *dst3;
-  if (PREDICT_TRUE (copy_len >= 4))
+  vhost_copy_t *c = cpy;
+  u16 n_left = copy_len;
+  void *dst;
+
+  if (PREDICT_FALSE (vui->log_base_addr &&
+		     (vui->features & (1 << FEAT_VHOST_F_LOG_ALL))))
     {
-      if (PREDICT_FALSE (!(dst2 = map_guest_mem (vui, cpy[0].dst, map_hint))))
-	return 1;
-      if (PREDICT_FALSE (!(dst3 = map_guest_mem (vui, cpy[1].dst, map_hint))))
-	return 1;
-      while (PREDICT_TRUE (copy_len >= 4))
+      /* Pages are logged once written, using the guest address */
+      while (n_left)
 	{
-	  dst0 = dst2;
-	  dst1 = dst3;
-
-	  if (PREDICT_FALSE
-	      (!(dst2 = map_guest_mem (vui, cpy[2].dst, map_hint))))
-	    return 1;
 	  if (PREDICT_FALSE
-	      (!(dst3 = map_guest_mem (vui, cpy[3].dst, map_hint))))
+	      (!(dst = map_guest_mem_range (vui, c->dst, c->len, map_hint))))
 	    return 1;
-
-	  CLIB_PREFETCH ((void *) cpy[2].src, 64, LOAD);
-	  CLIB_PREFETCH ((void *) cpy[3].src, 64, LOAD);
-
-	  clib_memcpy (dst0, (void *) cpy[0].src, cpy[0].len);
-	  clib_memcpy (dst1, (void *) cpy[1].src, cpy[1].len);
-
-	  vhost_user_log_dirty_pages_2 (vui, cpy[0].dst, cpy[0].len, 1);
-	  vhost_user_log_dirty_pages_2 (vui, cpy[1].dst, cpy[1].len, 1);
-	  copy_len -= 2;
-	  cpy += 2;
+	  clib_memcpy (dst, (void *) c->src, c->len);
+	  vhost_user_log_dirty_pages_2 (vui, c->dst, c->len, 1);
+	  n_left -= 1;
+	  c += 1;
 	}
+      return 0;
     }
-  while (copy_len)
+
+  while (n_left)
     {
-      if (PREDICT_FALSE (!(dst0 = map_guest_mem (vui, cpy->dst, map_hint))))
+      if (PREDICT_FALSE
+	  (!(dst = map_guest_mem_range (vui, c->dst, c->len, map_hint))))
 	return 1;
-      clib_memcpy (dst0, (void *) cpy->src, cpy->len);
-      vhost_user_log_dirty_pages_2 (vui, cpy->dst, cpy->len, 1);
-      copy_len -= 1;
-      cpy += 1;
+      c->dst = (uword) dst;
+      n_left -= 1;
+      c += 1;
     }
+
+  vhost_user_do_copies (cpy, copy_len);
   return 0;
 }
 
@@ -2026,6 +2088,12 @@ retry:
       desc_head = desc_index =
 	rxvq->avail->ring[rxvq->last_avail_idx & qsz_mask];
 
+      /* Prefetch the head descriptor of the next packet */
+      if (PREDICT_TRUE ((u16) (rxvq->last_avail_idx + 1) != rxvq->avail->idx))
+	CLIB_PREFETCH (&rxvq->desc[rxvq->avail->ring[(rxvq->last_avail_idx + 1)
+						     & qsz_mask]],
+		       sizeof (vring_desc_t), LOAD);
+
       /* Go deeper in case of indirect descriptor
        * I don't know of any driver providing indirect for RX. */
       if (PREDICT_FALSE (rxvq->desc[desc_head].flags & VIRTQ_DESC_F_INDIRECT))
@@ -2160,8 +2228,6 @@ retry:
 	    buffer_len -= cpy->len;
 	    buffer_map_addr += cpy->len;
 	    desc_len += cpy->len;
-
-	    CLIB_PREFETCH (&rxvq->desc, CLIB_CACHE_LINE_BYTES, LOAD);
 	  }
 
 	  // Check if vlib buffer has more data. If not, get more or break.
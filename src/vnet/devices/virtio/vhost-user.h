@@ -53,7 +53,8 @@
  _ (VIRTIO_F_ANY_LAYOUT, 27)            \
  _ (VIRTIO_F_INDIRECT_DESC, 28)         \
  _ (VHOST_USER_F_PROTOCOL_FEATURES, 30) \
- _ (VIRTIO_F_VERSION_1, 32)
+ _ (VIRTIO_F_VERSION_1, 32)            \
+ _ (VIRTIO_F_IN_ORDER, 35)
 
 
 typedef enum
@@ -246,6 +247,7 @@ typedef struct
 
   int virtio_net_hdr_sz;
   int is_any_layout;
+  int is_in_order;
 
   void *log_base_addr;
   u64 log_size;
@@ -184,6 +184,7 @@ ip4_fib_table_destroy (ip4_fib_t *fib)
     {
 	hash_unset (ip4_main.fib_index_by_table_id, fib_table->ft_table_id);
     }
+    ip4_mtrie_free(&fib->mtrie);
     pool_put(ip4_main.fibs, fib_table);
 }
 
@@ -378,6 +379,51 @@ ip4_fib_table_fwding_dpo_remove (ip4_fib_t *fib,
     ip4_fib_mtrie_add_del_route(fib, *addr, len, dpo->dpoi_index, 1); // DELETE
 }
 
+void
+ip4_fib_table_set_mtrie_16_8_8 (ip4_fib_t *fib,
+				int enable)
+{
+    ip4_fib_mtrie_t old;
+    hash_pair_t * p;
+    int len;
+
+    if (!enable == !fib->mtrie.root_ply_16)
+	return;
+
+    /*
+     * rebuild the mtrie with the new layout from the prefix hashes,
+     * the workers must not walk it meanwhile.
+     */
+    vlib_worker_thread_barrier_sync(vlib_get_main());
+
+    old = fib->mtrie;
+    ip4_mtrie_init_with_layout(&fib->mtrie, enable);
+
+    for (len = 0; len < ARRAY_LEN (fib->fib_entry_by_dst_address); len++)
+    {
+	uword * hash = fib->fib_entry_by_dst_address[len];
+
+	if (NULL == hash)
+	    continue;
+
+	hash_foreach_pair (p, hash,
+	({
+	    ip4_address_t addr = {
+		.data_u32 = p->key,
+	    };
+	    index_t lbi;
+
+	    lbi = fib_entry_contribute_ip_forwarding(p->value[0])->dpoi_index;
+	    if (INDEX_INVALID != lbi)
+		ip4_fib_mtrie_add_del_route(fib, addr, len, lbi, 0);
+	}));
+    }
+
+    vlib_worker_thread_barrier_release(vlib_get_main());
+
+    ip4_mtrie_free(&old);
+}
+
 void
 ip4_fib_table_walk (ip4_fib_t *fib,
                     fib_table_walk_fn_t fn,
@@ -512,6 +558,10 @@ ip4_show_fib (vlib_main_t * vm,
 	/* Show summary? */
 	if (! verbose)
 	{
+	    vlib_cli_output (vm, "mtrie: %s layout, memory usage %U",
+			     fib->mtrie.root_ply_16 ? "16-8-8" : "8-8-8-8",
+			     format_memory_size,
+			     ip4_fib_mtrie_memory_usage(&fib->mtrie));
 	    vlib_cli_output (vm, "%=20s%=16s", "Prefix length", "Count");
 	    for (i = 0; i < ARRAY_LEN (fib->fib_entry_by_dst_address); i++)
 	    {
@@ -690,3 +740,287 @@ VLIB_CLI_COMMAND (ip4_show_fib_command, static) = {
     .function = ip4_show_fib,
 };
 /* *INDENT-ON* */
+
+static clib_error_t *
+ip4_fib_set_mtrie (vlib_main_t * vm,
+		   unformat_input_t * input,
+		   vlib_cli_command_t * cmd)
+{
+    u32 table_id = 0, fib_index;
+    int use_16_8_8 = -1;
+
+    while (unformat_check_input (input) != UNFORMAT_END_OF_INPUT)
+    {
+	if (unformat (input, "table %d", &table_id))
+	    ;
+	else if (unformat (input, "16-8-8"))
+	    use_16_8_8 = 1;
+	else if (unformat (input, "8-8-8-8"))
+	    use_16_8_8 = 0;
+	else
+	    return clib_error_return (0, "unknown input `%U'",
+				      format_unformat_error, input);
+    }
+
+    if (-1 == use_16_8_8)
+	return clib_error_return (0, "specify 16-8-8 or 8-8-8-8");
+
+    fib_index = ip4_fib_index_from_table_id(table_id);
+    if (~0 == fib_index)
+	return clib_error_return (0, "no such table %d", table_id);
+
+    ip4_fib_table_set_mtrie_16_8_8(ip4_fib_get(fib_index), use_16_8_8);
+
+    return (NULL);
+}
+
+/*?
+ * This command selects the stride layout of the mtrie used for the
+ * forwarding lookups of an IPv4 table. The default '<em>8-8-8-8</em>'
+ * layout walks up to four 256 entry plies. The '<em>16-8-8</em>' layout
+ * replaces the first two with a flat 65536 entry root, so prefixes up
+ * to /16 resolve in one memory access and up to /24 in two, for about
+ * 320KB more per table. The mtrie is rebuilt from the table's prefixes
+ * while the workers are held at the barrier.
+ *
+ * @cliexpar
+ * Example of how to use the 16-8-8 layout in table 0:
+ * @cliexcmd{set ip fib mtrie table 0 16-8-8}
+?*/
+/* *INDENT-OFF* */
+VLIB_CLI_COMMAND (ip4_fib_set_mtrie_command, static) = {
+    .path = "set ip fib mtrie",
+    .short_help = "set ip fib mtrie [table <table-id>] 16-8-8|8-8-8-8",
+    .function = ip4_fib_set_mtrie,
+};
+/* *INDENT-ON* */
+
+/*
+ * Prefix length mix used to populate the benchmark table, shaped like
+ * the public IPv4 routing table: more than half /24s, then /22, /23,
+ * /21, /20 and /19 and a tail of shorter prefixes.
+ */
+static const struct {
+    u8 len;
+    u8 weight;
+} ip4_fib_bench_lengths[] = {
+    {24, 57}, {22, 10}, {23, 10}, {21, 5}, {20, 4}, {19, 3}, {16, 2},
+    {18, 2}, {17, 1}, {15, 1}, {14, 1}, {13, 1}, {12, 1}, {32, 1}, {28, 1},
+};
+
+/* scratch table of the mtrie bench, unless told otherwise */
+#define IP4_FIB_BENCH_TABLE_ID 0x7ffffffe
+
+static u32
+ip4_fib_bench_random_len (u32 *seed)
+{
+    u32 i, total = 0, r;
+
+    for (i = 0; i < ARRAY_LEN(ip4_fib_bench_lengths); i++)
+	total += ip4_fib_bench_lengths[i].weight;
+
+    r = random_u32(seed) % total;
+
+    for (i = 0; i < ARRAY_LEN(ip4_fib_bench_lengths); i++)
+    {
+	if (r < ip4_fib_bench_lengths[i].weight)
+	    break;
+	r -= ip4_fib_bench_lengths[i].weight;
+    }
+    return (ip4_fib_bench_lengths[i].len);
+}
+
+static f64
+ip4_fib_bench_run (u32 fib_index,
+		   const ip4_address_t *dsts,
+		   u32 *results)
+{
+    u64 t0, t1;
+    u32 i;
+
+    t0 = clib_cpu_time_now();
+    for (i = 0; i < vec_len(dsts); i++)
+	results[i] = ip4_fib_forwarding_lookup(fib_index, &dsts[i]);
+    t1 = clib_cpu_time_now();
+
+    return ((f64) (t1 - t0) / (f64) vec_len(dsts));
+}
+
+/*
+ * Delete every other remaining prefix with the mtrie in one layout, then
+ * compare its lookups with a fresh build of the other layout from the
+ * table's prefixes. Lookups of the deleted prefixes must fall back to
+ * their covering route.
+ */
+static u32
+ip4_fib_bench_delete_verify (u32 fib_index,
+			     fib_prefix_t *pfxs,
+			     u32 first,
+			     int use_16_8_8,
+			     const ip4_address_t *dsts,
+			     u32 **results)
+{
+    ip4_fib_t *fib = ip4_fib_get(fib_index);
+    u32 i, n_errors = 0;
+
+    ip4_fib_table_set_mtrie_16_8_8(fib, use_16_8_8);
+    for (i = first; i < vec_len(pfxs); i += 2)
+	fib_table_entry_special_remove(fib_index, &pfxs[i], FIB_SOURCE_CLI);
+    ip4_fib_bench_run(fib_index, dsts, results[use_16_8_8]);
+
+    ip4_fib_table_set_mtrie_16_8_8(fib, !use_16_8_8);
+    ip4_fib_bench_run(fib_index, dsts, results[!use_16_8_8]);
+
+    for (i = 0; i < vec_len(dsts); i++)
+	if (results[0][i] != results[1][i])
+	    n_errors++;
+
+    return (n_errors);
+}
+
+static clib_error_t *
+ip4_fib_mtrie_bench (vlib_main_t * vm,
+		     unformat_input_t * input,
+		     vlib_cli_command_t * cmd)
+{
+    u32 table_id = IP4_FIB_BENCH_TABLE_ID, n_routes = 600000;
+    u32 n_lookups = 1000000, fib_index, seed = 0xdeaddabe, i, n_errors = 0;
+    u32 *results[2] = { 0 };
+    ip4_main_t *im = &ip4_main;
+    fib_prefix_t *pfxs = NULL, *pfx;
+    ip4_address_t *dsts = NULL;
+    f64 clocks[2];
+    uword memory[2];
+    ip4_fib_t *fib;
+    int layout;
+
+    while (unformat_check_input (input) != UNFORMAT_END_OF_INPUT)
+    {
+	if (unformat (input, "table %d", &table_id))
+	    ;
+	else if (unformat (input, "routes %d", &n_routes))
+	    ;
+	else if (unformat (input, "lookups %d", &n_lookups))
+	    ;
+	else if (unformat (input, "seed %d", &seed))
+	    ;
+	else
+	    return clib_error_return (0, "unknown input `%U'",
+				      format_unformat_error, input);
+    }
+
+    /*
+     * the bench adds and deletes DROP routes, never do that in a table
+     * which forwards traffic: run in a scratch table, created here and
+     * destroyed at the end
+     */
+    if (~0 != ip4_fib_index_from_table_id(table_id))
+	return clib_error_return (0, "table %d exists, the bench needs an "
+				  "unused table-id", table_id);
+    if (0 == n_routes || 0 == n_lookups)
+	return clib_error_return (0, "routes and lookups must be non-zero");
+
+    fib_index = fib_table_find_or_create_and_lock(FIB_PROTOCOL_IP4,
+						  table_id);
+    fib = ip4_fib_get(fib_index);
+
+    for (i = 0; i < n_routes; i++)
+    {
+	fib_prefix_t p = {
+	    .fp_proto = FIB_PROTOCOL_IP4,
+	    .fp_len = ip4_fib_bench_random_len(&seed),
+	};
+	u32 a;
+
+	/* unicast space only */
+	a = 0x01000000 + random_u32(&seed) % (0xe0000000 - 0x01000000);
+	p.fp_addr.ip4.as_u32 =
+	    clib_host_to_net_u32(a) & im->fib_masks[p.fp_len];
+
+	if (FIB_NODE_INDEX_INVALID !=
+	    fib_table_lookup_exact_match(fib_index, &p))
+	    continue;
+
+	fib_table_entry_special_add(fib_index, &p, FIB_SOURCE_CLI,
+				    FIB_ENTRY_FLAG_DROP, ADJ_INDEX_INVALID);
+	vec_add1(pfxs, p);
+    }
+
+    /* half the lookups hit an added route, the rest are random */
+    vec_validate(dsts, n_lookups - 1);
+    for (i = 0; i < n_lookups; i++)
+    {
+	dsts[i].as_u32 = random_u32(&seed);
+
+	if ((i & 1) && vec_len(pfxs))
+	{
+	    pfx = &pfxs[random_u32(&seed) % vec_len(pfxs)];
+	    dsts[i].as_u32 &= ~im->fib_masks[pfx->fp_len];
+	    dsts[i].as_u32 |= pfx->fp_addr.ip4.as_u32;
+	}
+    }
+
+    for (layout = 0; layout < 2; layout++)
+    {
+	vec_validate(results[layout], n_lookups - 1);
+	ip4_fib_table_set_mtrie_16_8_8(fib, layout);
+	memory[layout] = ip4_fib_mtrie_memory_usage(&fib->mtrie);
+	clocks[layout] = ip4_fib_bench_run(fib_index, dsts, results[layout]);
+    }
+
+    for (i = 0; i < n_lookups; i++)
+	if (results[0][i] != results[1][i])
+	    n_errors++;
+
+    vlib_cli_output(vm, "%d routes added, %d lookups",
+		    vec_len(pfxs), n_lookups);
+    for (layout = 0; layout < 2; layout++)
+	vlib_cli_output(vm, "  %-8s memory %U, %.2f clocks/lookup, "
+			"%.2f Mlookups/s",
+			layout ? "16-8-8" : "8-8-8-8",
+			format_memory_size, memory[layout], clocks[layout],
+			vm->clib_time.clocks_per_second / clocks[layout] / 1e6);
+    vlib_cli_output(vm, "  %d mismatches after add", n_errors);
+
+    /*
+     * delete half of the routes with each layout, so that both delete
+     * paths, and the 16-8-8 root leaf unset, are checked
+     */
+    n_errors = ip4_fib_bench_delete_verify(fib_index, pfxs, 0, 1,
+					   dsts, results);
+    vlib_cli_output(vm, "  %d mismatches after 16-8-8 delete", n_errors);
+    n_errors = ip4_fib_bench_delete_verify(fib_index, pfxs, 1, 0,
+					   dsts, results);
+    vlib_cli_output(vm, "  %d mismatches after 8-8-8-8 delete", n_errors);
+
+    ip4_fib_table_set_mtrie_16_8_8(fib, 0);
+    fib_table_unlock(fib_index, FIB_PROTOCOL_IP4);
+
+    vec_free(pfxs);
+    vec_free(dsts);
+    vec_free(results[0]);
+    vec_free(results[1]);
+
+    return (NULL);
+}
+
+/*?
+ * This command compares the memory footprint and the lookup rate of the
+ * 8-8-8-8 and 16-8-8 mtrie layouts. It runs in a scratch table, created
+ * for the run with an unused table-id and deleted at the end, filled
+ * with random routes whose prefix length mix resembles a full Internet
+ * table. It checks that both layouts return the same load-balance for
+ * every address after the adds, and after deleting half of the routes
+ * with each layout, where lookups must fall back to the covering routes.
+ *
+ * @cliexpar
+ * Example of how to run:
+ * @cliexcmd{test ip mtrie-bench routes 600000 lookups 1000000}
+?*/
+/* *INDENT-OFF* */
+VLIB_CLI_COMMAND (ip4_fib_mtrie_bench_command, static) = {
+    .path = "test ip mtrie-bench",
+    .short_help = "test ip mtrie-bench [table <unused-table-id>] [routes <n>] [lookups <n>] [seed <n>]",
+    .function = ip4_fib_mtrie_bench,
+};
+/* *INDENT-ON* */
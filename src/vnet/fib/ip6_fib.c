@@ -188,6 +188,7 @@ ip6_fib_table_destroy (u32 fib_index)
     {
 	hash_unset (ip6_main.fib_index_by_table_id, fib_table->ft_table_id);
     }
+    ip6_fib_table_set_mtrie(fib_index, 0);
     pool_put(ip6_main.fibs, fib_table);
 }
 
@@ -337,10 +338,9 @@ ip6_fib_table_entry_insert (u32 fib_index,
     compute_prefix_lengths_in_search_order (table);
 }
 
-u32 
-ip6_fib_table_fwding_lookup (ip6_main_t * im,
-                             u32 fib_index,
-                             const ip6_address_t * dst)
+static u32
+ip6_fib_table_fwding_lookup_hash (u32 fib_index,
+                                  const ip6_address_t * dst)
 {
     const ip6_fib_table_instance_t *table;
     int i, len;
@@ -376,6 +376,22 @@ ip6_fib_table_fwding_lookup (ip6_main_t * im,
     return 0;
 }
 
+u32 
+ip6_fib_table_fwding_lookup (ip6_main_t * im,
+                             u32 fib_index,
+                             const ip6_address_t * dst)
+{
+    const ip6_fib_mtrie_t *mtrie;
+
+    mtrie = pool_elt_at_index(im->fibs, fib_index)->v6.mtrie;
+
+    if (NULL != mtrie)
+    {
+        return (ip6_fib_mtrie_lookup(mtrie, dst));
+    }
+    return (ip6_fib_table_fwding_lookup_hash(fib_index, dst));
+}
+
 u32 ip6_fib_table_fwding_lookup_with_if_index (ip6_main_t * im,
 					       u32 sw_if_index,
 					       const ip6_address_t * dst)
@@ -404,6 +420,55 @@ ip6_fib_table_get_index_for_sw_if_index (u32 sw_if_index)
     return (ip6_main.fib_index_by_sw_if_index[sw_if_index]);
 }
 
+/**
+ * @brief Removing a prefix from the mtrie leaves its range empty.
+ * Find the next less specific prefix in the forwarding hash and
+ * re-add it to fill the hole.
+ */
+static void
+ip6_fib_mtrie_add_cover (ip6_fib_mtrie_t *mtrie,
+                         u32 fib_index,
+                         const ip6_address_t *addr,
+                         u32 len)
+{
+    const ip6_fib_table_instance_t *table;
+    BVT(clib_bihash_kv) kv, value;
+    int i, n_p;
+    u64 fib;
+
+    table = &ip6_main.ip6_table[IP6_FIB_TABLE_FWDING];
+    n_p = vec_len (table->prefix_lengths_in_search_order);
+    fib = ((u64)((fib_index))<<32);
+
+    for (i = 0; i < n_p; i++)
+    {
+	int cover_len = table->prefix_lengths_in_search_order[i];
+	ip6_address_t * mask = &ip6_main.fib_masks[cover_len];
+
+	/* the default route lives in the default leaf, never removed */
+	if (cover_len >= len || 0 == cover_len)
+	    continue;
+
+	kv.key[0] = addr->as_u64[0] & mask->as_u64[0];
+	kv.key[1] = addr->as_u64[1] & mask->as_u64[1];
+	kv.key[2] = fib | cover_len;
+
+	if (0 == BV(clib_bihash_search_inline_2)(&table->ip6_hash, &kv, &value))
+	{
+	    ip6_address_t cover = {
+		.as_u64 = {
+		    [0] = kv.key[0],
+		    [1] = kv.key[1],
+		},
+	    };
+
+	    ip6_fib_mtrie_add_del_route(mtrie, &cover, cover_len,
+					value.value, 0);
+	    return;
+	}
+    }
+}
+
 void
 ip6_fib_table_fwding_dpo_update (u32 fib_index,
 				 const ip6_address_t *addr,
@@ -412,6 +477,7 @@ ip6_fib_table_fwding_dpo_update (u32 fib_index,
 {
     ip6_fib_table_instance_t *table;
     BVT(clib_bihash_kv) kv;
+    ip6_fib_mtrie_t *mtrie;
     ip6_address_t *mask;
     u64 fib;
 
@@ -432,6 +498,12 @@ ip6_fib_table_fwding_dpo_update (u32 fib_index,
         clib_bitmap_set (table->non_empty_dst_address_length_bitmap, 
 			 128 - len, 1);
     compute_prefix_lengths_in_search_order (table);
+
+    mtrie = ip6_fib_get(fib_index)->mtrie;
+    if (NULL != mtrie)
+    {
+        ip6_fib_mtrie_add_del_route(mtrie, addr, len, dpo->dpoi_index, 0);
+    }
 }
 
 void
@@ -442,6 +514,7 @@ ip6_fib_table_fwding_dpo_remove (u32 fib_index,
 {
     ip6_fib_table_instance_t *table;
     BVT(clib_bihash_kv) kv;
+    ip6_fib_mtrie_t *mtrie;
     ip6_address_t *mask;
     u64 fib;
 
@@ -465,6 +538,87 @@ ip6_fib_table_fwding_dpo_remove (u32 fib_index,
                              128 - len, 0);
 	compute_prefix_lengths_in_search_order (table);
     }
+
+    mtrie = ip6_fib_get(fib_index)->mtrie;
+    if (NULL != mtrie)
+    {
+        ip6_fib_mtrie_add_del_route(mtrie, addr, len, dpo->dpoi_index, 1);
+        ip6_fib_mtrie_add_cover(mtrie, fib_index, addr, len);
+    }
+}
+
+typedef struct ip6_fib_mtrie_build_ctx_t_
+{
+    u32 fib_index;
+    ip6_fib_mtrie_t *mtrie;
+} ip6_fib_mtrie_build_ctx_t;
+
+static void
+ip6_fib_mtrie_build_cb (BVT(clib_bihash_kv) * kvp,
+                        void *arg)
+{
+    ip6_fib_mtrie_build_ctx_t *ctx = arg;
+    ip6_address_t addr;
+
+    if ((kvp->key[2] >> 32) != ctx->fib_index)
+        return;
+
+    addr.as_u64[0] = kvp->key[0];
+    addr.as_u64[1] = kvp->key[1];
+
+    ip6_fib_mtrie_add_del_route(ctx->mtrie, &addr,
+                                kvp->key[2] & 0xFF,
+                                kvp->value, 0);
+}
+
+void
+ip6_fib_table_set_mtrie (u32 fib_index,
+                         int enable)
+{
+    ip6_fib_t *fib = ip6_fib_get(fib_index);
+    ip6_fib_mtrie_t *mtrie;
+
+    if (enable)
+    {
+        if (NULL != fib->mtrie)
+            return;
+
+        /*
+         * build the mtrie from the forwarding hash before publishing it,
+         * the workers see either no mtrie or a complete one.
+         */
+        ip6_fib_mtrie_build_ctx_t ctx = {
+            .fib_index = fib_index,
+            .mtrie = clib_mem_alloc(sizeof(*mtrie)),
+        };
+
+        ip6_fib_mtrie_init(ctx.mtrie);
+        BV(clib_bihash_foreach_key_value_pair)(
+            &ip6_main.ip6_table[IP6_FIB_TABLE_FWDING].ip6_hash,
+            ip6_fib_mtrie_build_cb,
+            &ctx);
+
+        CLIB_MEMORY_BARRIER();
+        fib->mtrie = ctx.mtrie;
+    }
+    else
+    {
+        mtrie = fib->mtrie;
+
+        if (NULL == mtrie)
+            return;
+
+        fib->mtrie = NULL;
+
+        /*
+         * wait for the workers to drop any reference before freeing
+         */
+        vlib_worker_thread_barrier_sync(vlib_get_main());
+        vlib_worker_thread_barrier_release(vlib_get_main());
+
+        ip6_fib_mtrie_free(mtrie);
+        clib_mem_free(mtrie);
+    }
 }
 
 /**
@@ -636,6 +790,10 @@ ip6_show_fib (vlib_main_t * vm,
 	    BVT(clib_bihash) * h = &im6->ip6_table[IP6_FIB_TABLE_NON_FWDING].ip6_hash;
 	    int len;
 
+	    if (NULL != fib->mtrie)
+		vlib_cli_output (vm, "mtrie: %U",
+				 format_ip6_fib_mtrie, fib->mtrie);
+
 	    vlib_cli_output (vm, "%=20s%=16s", "Prefix length", "Count");
 
 	    memset (ca, 0, sizeof(*ca));
@@ -767,3 +925,303 @@ VLIB_CLI_COMMAND (ip6_show_fib_command, static) = {
     .function = ip6_show_fib,
 };
 /* *INDENT-ON* */
+
+static clib_error_t *
+ip6_fib_set_lookup (vlib_main_t * vm,
+		    unformat_input_t * input,
+		    vlib_cli_command_t * cmd)
+{
+    u32 table_id = 0, fib_index;
+    int enable = -1;
+
+    while (unformat_check_input (input) != UNFORMAT_END_OF_INPUT)
+    {
+	if (unformat (input, "table %d", &table_id))
+	    ;
+	else if (unformat (input, "mtrie"))
+	    enable = 1;
+	else if (unformat (input, "hash"))
+	    enable = 0;
+	else
+	    return clib_error_return (0, "unknown input `%U'",
+				      format_unformat_error, input);
+    }
+
+    if (-1 == enable)
+	return clib_error_return (0, "specify mtrie or hash");
+
+    fib_index = ip6_fib_index_from_table_id(table_id);
+    if (~0 == fib_index)
+	return clib_error_return (0, "no such table %d", table_id);
+
+    ip6_fib_table_set_mtrie(fib_index, enable);
+
+    return (NULL);
+}
+
+/*?
+ * This command selects the structure used for the forwarding lookups of
+ * an IPv6 table. By default all tables share one hash, probed once per
+ * distinct prefix length present, longest first. With '<em>mtrie</em>'
+ * the table gets its own 8-bit stride multi-bit trie, built from the
+ * hash and kept in sync with it; a lookup then costs one memory access
+ * per address byte up to the matching prefix. The mtrie uses more memory,
+ * see '<em>show ip6 fib summary</em>'.
+ *
+ * @cliexpar
+ * Example of how to use an mtrie for the lookups in table 0:
+ * @cliexcmd{set ip6 fib lookup table 0 mtrie}
+?*/
+/* *INDENT-OFF* */
+VLIB_CLI_COMMAND (ip6_fib_set_lookup_command, static) = {
+    .path = "set ip6 fib lookup",
+    .short_help = "set ip6 fib lookup [table <table-id>] mtrie|hash",
+    .function = ip6_fib_set_lookup,
+};
+/* *INDENT-ON* */
+
+/*
+ * Prefix length mix used to populate the benchmark table, shaped like
+ * the public IPv6 routing table: mostly /48s and /32s, then /44, /40,
+ * /36 and /29 allocations and a tail of odd lengths.
+ */
+static const struct {
+    u8 len;
+    u8 weight;
+} ip6_fib_bench_lengths[] = {
+    { 48, 50 },
+    { 32, 14 },
+    { 44, 8 },
+    { 40, 7 },
+    { 36, 4 },
+    { 46, 3 },
+    { 29, 3 },
+    { 47, 2 },
+    { 45, 2 },
+    { 42, 2 },
+    { 28, 1 },
+    { 33, 1 },
+    { 34, 1 },
+    { 56, 1 },
+    { 64, 1 },
+};
+
+static void
+ip6_fib_bench_random_addr (ip6_address_t *a,
+			   u32 *seed)
+{
+    a->as_u32[0] = random_u32(seed);
+    a->as_u32[1] = random_u32(seed);
+    a->as_u32[2] = random_u32(seed);
+    a->as_u32[3] = random_u32(seed);
+
+    /* global unicast, 2000::/3 */
+    a->as_u8[0] = 0x20 | (a->as_u8[0] & 0x1f);
+}
+
+static u32
+ip6_fib_bench_random_len (u32 *seed)
+{
+    u32 i, total = 0, r;
+
+    for (i = 0; i < ARRAY_LEN(ip6_fib_bench_lengths); i++)
+	total += ip6_fib_bench_lengths[i].weight;
+
+    r = random_u32(seed) % total;
+
+    for (i = 0; i < ARRAY_LEN(ip6_fib_bench_lengths); i++)
+    {
+	if (r < ip6_fib_bench_lengths[i].weight)
+	    break;
+	r -= ip6_fib_bench_lengths[i].weight;
+    }
+    return (ip6_fib_bench_lengths[i].len);
+}
+
+static f64
+ip6_fib_bench_run (ip6_main_t * im,
+		   u32 fib_index,
+		   const ip6_address_t *dsts,
+		   u32 *results)
+{
+    u64 t0, t1;
+    u32 i;
+
+    t0 = clib_cpu_time_now();
+    for (i = 0; i < vec_len(dsts); i++)
+	results[i] = ip6_fib_table_fwding_lookup(im, fib_index, &dsts[i]);
+    t1 = clib_cpu_time_now();
+
+    return ((f64)(t1 - t0) / (f64)vec_len(dsts));
+}
+
+static u32
+ip6_fib_bench_verify (u32 fib_index,
+		      const ip6_address_t *dsts,
+		      const u32 *results)
+{
+    u32 i, n_errors = 0;
+
+    for (i = 0; i < vec_len(dsts); i++)
+	if (results[i] != ip6_fib_table_fwding_lookup_hash(fib_index, &dsts[i]))
+	    n_errors++;
+
+    return (n_errors);
+}
+
+/* scratch table of the lookup bench, unless told otherwise */
+#define IP6_FIB_BENCH_TABLE_ID 0x7ffffffe
+
+static clib_error_t *
+ip6_fib_lookup_bench (vlib_main_t * vm,
+		      unformat_input_t * input,
+		      vlib_cli_command_t * cmd)
+{
+    u32 table_id = IP6_FIB_BENCH_TABLE_ID, n_prefixes = 100000;
+    u32 n_lookups = 1000000;
+    u32 fib_index, seed = 0xdeadbeef, i, n_errors;
+    f64 hash_clocks, mtrie_clocks, clocks_per_sec;
+    ip6_main_t *im = &ip6_main;
+    fib_prefix_t *pfxs = NULL, *pfx;
+    ip6_address_t *dsts = NULL;
+    u32 *results = NULL;
+
+    while (unformat_check_input (input) != UNFORMAT_END_OF_INPUT)
+    {
+	if (unformat (input, "table %d", &table_id))
+	    ;
+	else if (unformat (input, "prefixes %d", &n_prefixes))
+	    ;
+	else if (unformat (input, "lookups %d", &n_lookups))
+	    ;
+	else if (unformat (input, "seed %d", &seed))
+	    ;
+	else
+	    return clib_error_return (0, "unknown input `%U'",
+				      format_unformat_error, input);
+    }
+
+    /*
+     * the bench adds and deletes DROP routes, never do that in a table
+     * which forwards traffic: run in a scratch table, created here and
+     * destroyed at the end
+     */
+    if (~0 != ip6_fib_index_from_table_id(table_id))
+	return clib_error_return (0, "table %d exists, the bench needs an "
+				  "unused table-id", table_id);
+    if (0 == n_prefixes || 0 == n_lookups)
+	return clib_error_return (0, "prefixes and lookups must be non-zero");
+
+    fib_index = fib_table_find_or_create_and_lock(FIB_PROTOCOL_IP6,
+						  table_id);
+
+    /*
+     * populate the table with random prefixes
+     */
+    for (i = 0; i < n_prefixes; i++)
+    {
+	fib_prefix_t p = {
+	    .fp_proto = FIB_PROTOCOL_IP6,
+	    .fp_len = ip6_fib_bench_random_len(&seed),
+	};
+	ip6_address_t addr;
+
+	ip6_fib_bench_random_addr(&addr, &seed);
+	ip6_address_mask(&addr, &im->fib_masks[p.fp_len]);
+	p.fp_addr.ip6 = addr;
+
+	if (FIB_NODE_INDEX_INVALID != fib_table_lookup_exact_match(fib_index, &p))
+	    continue;
+
+	fib_table_entry_special_add(fib_index, &p,
+				    FIB_SOURCE_CLI,
+				    FIB_ENTRY_FLAG_DROP,
+				    ADJ_INDEX_INVALID);
+	vec_add1(pfxs, p);
+    }
+
+    /*
+     * half the destinations hit a random added prefix, the rest are
+     * random global unicast addresses which mostly hit the default route
+     */
+    vec_validate(dsts, n_lookups - 1);
+    vec_validate(results, n_lookups - 1);
+    for (i = 0; i < n_lookups; i++)
+    {
+	ip6_fib_bench_random_addr(&dsts[i], &seed);
+
+	if ((i & 1) && vec_len(pfxs))
+	{
+	    ip6_address_t *host = &dsts[i];
+
+	    pfx = &pfxs[random_u32(&seed) % vec_len(pfxs)];
+	    host->as_u64[0] &= ~im->fib_masks[pfx->fp_len].as_u64[0];
+	    host->as_u64[1] &= ~im->fib_masks[pfx->fp_len].as_u64[1];
+	    host->as_u64[0] |= pfx->fp_addr.ip6.as_u64[0];
+	    host->as_u64[1] |= pfx->fp_addr.ip6.as_u64[1];
+	}
+    }
+
+    ip6_fib_table_set_mtrie(fib_index, 0);
+    hash_clocks = ip6_fib_bench_run(im, fib_index, dsts, results);
+
+    ip6_fib_table_set_mtrie(fib_index, 1);
+    mtrie_clocks = ip6_fib_bench_run(im, fib_index, dsts, results);
+    n_errors = ip6_fib_bench_verify(fib_index, dsts, results);
+
+    clocks_per_sec = vm->clib_time.clocks_per_second;
+    vlib_cli_output(vm, "%d prefixes added, %d lookups",
+		    vec_len(pfxs), n_lookups);
+    vlib_cli_output(vm, "  hash:  %.2f clocks/lookup, %.2f Mlookups/s, "
+		    "%d prefix lengths to probe",
+		    hash_clocks, clocks_per_sec / hash_clocks / 1e6,
+		    vec_len(im->ip6_table[IP6_FIB_TABLE_FWDING].prefix_lengths_in_search_order));
+    vlib_cli_output(vm, "  mtrie: %.2f clocks/lookup, %.2f Mlookups/s, %U",
+		    mtrie_clocks, clocks_per_sec / mtrie_clocks / 1e6,
+		    format_ip6_fib_mtrie, ip6_fib_get(fib_index)->mtrie);
+    vlib_cli_output(vm, "  %d mismatches after add", n_errors);
+
+    /*
+     * remove every other prefix; the mtrie must restore the covers
+     */
+    for (i = 0; i < vec_len(pfxs); i += 2)
+	fib_table_entry_special_remove(fib_index, &pfxs[i], FIB_SOURCE_CLI);
+
+    ip6_fib_bench_run(im, fib_index, dsts, results);
+    n_errors = ip6_fib_bench_verify(fib_index, dsts, results);
+    vlib_cli_output(vm, "  %d mismatches after delete", n_errors);
+
+    for (i = 1; i < vec_len(pfxs); i += 2)
+	fib_table_entry_special_remove(fib_index, &pfxs[i], FIB_SOURCE_CLI);
+
+    ip6_fib_table_set_mtrie(fib_index, 0);
+    fib_table_unlock(fib_index, FIB_PROTOCOL_IP6);
+
+    vec_free(pfxs);
+    vec_free(dsts);
+    vec_free(results);
+
+    return (NULL);
+}
+
+/*?
+ * This command compares the forwarding lookup cost of the hash and of
+ * the mtrie in a scratch IPv6 table, created for the run with an unused
+ * table-id and deleted at the end, so that forwarding tables are never
+ * touched. It adds random prefixes with a prefix
+ * length mix resembling the public IPv6 routing table, times the same
+ * set of lookups with each structure, checks that both return the same
+ * load-balance for every address, both after the adds and after deleting
+ * half of the prefixes, then removes the table. Results
+ * depend on the CPU and on the table contents.
+ *
+ * @cliexpar
+ * @cliexcmd{test ip6 fib lookup-bench prefixes 60000 lookups 1000000}
+?*/
+/* *INDENT-OFF* */
+VLIB_CLI_COMMAND (ip6_fib_lookup_bench_command, static) = {
+    .path = "test ip6 fib lookup-bench",
+    .short_help = "test ip6 fib lookup-bench [table <unused-table-id>] [prefixes <n>] [lookups <n>] [seed <n>]",
+    .function = ip6_fib_lookup_bench,
+};
+/* *INDENT-ON* */
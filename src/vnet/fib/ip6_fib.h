@@ -50,6 +50,13 @@ extern void ip6_fib_table_fwding_dpo_remove(u32 fib_index,
 					    u32 len,
 					    const dpo_id_t *dpo);
 
+/**
+ * @brief Switch the table's forwarding lookups between the shared
+ * per prefix length hash and a per-table mtrie
+ */
+extern void ip6_fib_table_set_mtrie(u32 fib_index,
+                                    int enable);
+
 u32 ip6_fib_table_fwding_lookup_with_if_index(ip6_main_t * im,
 					      u32 sw_if_index,
 					      const ip6_address_t * dst);
@@ -0,0 +1,187 @@
+/*
+ * Copyright (c) 2017 Cisco and/or its affiliates.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <vnet/gso/gso.h>
+#include <vnet/ip/ip.h>
+#include <vnet/tcp/tcp_packet.h>
+
+/**
+ * Copy @a n_bytes of payload, walking the chain from (@a cb, @a offset)
+ */
+always_inline void
+gso_copy_payload (vlib_main_t * vm, u8 * dst, vlib_buffer_t ** cb,
+		  u32 * offset, u32 n_bytes)
+{
+  u32 n_copy;
+
+  while (n_bytes)
+    {
+      if (*offset == (*cb)->current_length)
+	{
+	  ASSERT ((*cb)->flags & VLIB_BUFFER_NEXT_PRESENT);
+	  *cb = vlib_get_buffer (vm, (*cb)->next_buffer);
+	  *offset = 0;
+	  continue;
+	}
+      n_copy = clib_min (n_bytes, (*cb)->current_length - *offset);
+      clib_memcpy (dst, vlib_buffer_get_current (*cb) + *offset, n_copy);
+      dst += n_copy;
+      *offset += n_copy;
+      n_bytes -= n_copy;
+    }
+}
+
+/**
+ * Cut a GSO packet in segments
+ *
+ * The packet starts with an L2 header of @a l2_hdr_sz bytes, followed by
+ * an ip4 or ip6 and a TCP header. Each segment gets a copy of the headers
+ * with lengths, ip4 id, sequence number, flags and checksums fixed up, and
+ * at most gso_size bytes of payload. FIN and PSH are only kept on the last
+ * segment.
+ *
+ * @param vm vlib main
+ * @param bi GSO packet, freed if segmented
+ * @param l2_hdr_sz length of the L2 header
+ * @param segs vector the segment buffer indices are appended to
+ * @return number of segments, 0 if the packet could not be segmented
+ */
+u32
+vnet_gso_segment_buffer (vlib_main_t * vm, u32 bi, u32 l2_hdr_sz,
+			 u32 ** segs)
+{
+  vlib_buffer_t *b, *sb, *cb;
+  ip4_header_t *ip4 = 0;
+  ip6_header_t *ip6 = 0;
+  tcp_header_t *th;
+  u32 gso_size, l3_hdr_sz, hdr_sz, n_left, n_segs, first, offset, len;
+  u32 seq, i;
+  u16 ip4_id = 0;
+  u8 *hdr, *l3, is_ip4, tcp_flags;
+  int bogus;
+
+  b = vlib_get_buffer (vm, bi);
+  hdr = vlib_buffer_get_current (b);
+  gso_size = vnet_buffer2 (b)->gso_size;
+
+  if (b->current_length < l2_hdr_sz + sizeof (ip6_header_t))
+    return 0;
+
+  l3 = hdr + l2_hdr_sz;
+  is_ip4 = (l3[0] & 0xF0) == 0x40;
+  if (is_ip4)
+    {
+      ip4 = (ip4_header_t *) l3;
+      if (ip4->protocol != IP_PROTOCOL_TCP)
+	return 0;
+      l3_hdr_sz = ip4_header_bytes (ip4);
+      ip4_id = clib_net_to_host_u16 (ip4->fragment_id);
+    }
+  else
+    {
+      ip6 = (ip6_header_t *) l3;
+      if ((l3[0] & 0xF0) != 0x60 || ip6->protocol != IP_PROTOCOL_TCP)
+	return 0;
+      l3_hdr_sz = sizeof (ip6_header_t);
+    }
+
+  /* Headers must be in the first buffer, segments in one buffer each */
+  hdr_sz = l2_hdr_sz + l3_hdr_sz + vnet_buffer2 (b)->gso_l4_hdr_sz;
+  if (gso_size == 0 || b->current_length < hdr_sz
+      || hdr_sz + gso_size > VLIB_BUFFER_DATA_SIZE)
+    return 0;
+
+  th = (tcp_header_t *) (l3 + l3_hdr_sz);
+  seq = clib_net_to_host_u32 (th->seq_number);
+  tcp_flags = th->flags;
+
+  n_left = vlib_buffer_length_in_chain (vm, b) - hdr_sz;
+  n_segs = (n_left + gso_size - 1) / gso_size;
+  if (n_segs == 0)
+    return 0;
+
+  first = vec_len (*segs);
+  vec_validate (*segs, first + n_segs - 1);
+  len = vlib_buffer_alloc (vm, *segs + first, n_segs);
+  if (len != n_segs)
+    {
+      vlib_buffer_free_no_next (vm, *segs + first, len);
+      _vec_len (*segs) = first;
+      return 0;
+    }
+
+  cb = b;
+  offset = hdr_sz;
+  for (i = 0; i < n_segs; i++)
+    {
+      sb = vlib_get_buffer (vm, (*segs)[first + i]);
+      len = clib_min (gso_size, n_left);
+
+      clib_memcpy (sb->opaque, b->opaque, sizeof (b->opaque));
+      sb->flags = b->flags & ~(VNET_BUFFER_GSO | VLIB_BUFFER_NEXT_PRESENT
+			       | VLIB_BUFFER_TOTAL_LENGTH_VALID
+			       | VLIB_BUFFER_EXT_HDR_VALID
+			       | VLIB_BUFFER_IS_TRACED
+			       | IP_BUFFER_L4_CHECKSUM_COMPUTED
+			       | IP_BUFFER_L4_CHECKSUM_CORRECT);
+      sb->error = b->error;
+      sb->current_data = 0;
+      sb->current_length = hdr_sz + len;
+
+      clib_memcpy (vlib_buffer_get_current (sb), hdr, hdr_sz);
+      gso_copy_payload (vm, vlib_buffer_get_current (sb) + hdr_sz, &cb,
+			&offset, len);
+
+      l3 = vlib_buffer_get_current (sb) + l2_hdr_sz;
+      th = (tcp_header_t *) (l3 + l3_hdr_sz);
+      th->seq_number = clib_host_to_net_u32 (seq + i * gso_size);
+      if (i != n_segs - 1)
+	th->flags = tcp_flags & ~(TCP_FLAG_FIN | TCP_FLAG_PSH);
+      th->checksum = 0;
+
+      /* Checksums are computed from the L3 header */
+      vlib_buffer_advance (sb, l2_hdr_sz);
+      if (is_ip4)
+	{
+	  ip4 = (ip4_header_t *) l3;
+	  ip4->length = clib_host_to_net_u16 (sb->current_length);
+	  ip4->fragment_id = clib_host_to_net_u16 (ip4_id + i);
+	  ip4->checksum = ip4_header_checksum (ip4);
+	  th->checksum = ip4_tcp_udp_compute_checksum (vm, sb, ip4);
+	}
+      else
+	{
+	  ip6 = (ip6_header_t *) l3;
+	  ip6->payload_length =
+	    clib_host_to_net_u16 (sb->current_length - l3_hdr_sz);
+	  th->checksum = ip6_tcp_udp_icmp_compute_checksum (vm, sb, ip6,
+							    &bogus);
+	}
+      vlib_buffer_advance (sb, -(word) l2_hdr_sz);
+
+      n_left -= len;
+    }
+
+  vlib_buffer_free_one (vm, bi);
+  return n_segs;
+}
+
+/*
+ * fd.io coding-style-patch-verification: ON
+ *
+ * Local Variables:
+ * eval: (c-set-style "gnu")
+ * End:
+ */
@@ -0,0 +1,55 @@
+/*
+ * Copyright (c) 2017 Cisco and/or its affiliates.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/*
+ * gso/gso.h: generic segmentation offload
+ *
+ * Locally originated TCP traffic may be handed to ip4/ip6 as buffer
+ * chains of up to 64K, flagged VNET_BUFFER_GSO. Interfaces that can
+ * segment in hardware (VNET_HW_INTERFACE_FLAG_SUPPORTS_GSO) get the
+ * chains as they are, for all others interface-output cuts them in MSS
+ * sized segments in software, just before the tx function.
+ */
+
+#ifndef included_vnet_gso_h
+#define included_vnet_gso_h
+
+#include <vnet/vnet.h>
+#include <vnet/buffer.h>
+
+/**
+ * Length of an IP packet, from its L3 header, to check against the MTU.
+ * GSO packets are checked with the length of their largest segment.
+ */
+always_inline u32
+vnet_gso_l3_mtu_len (vlib_main_t * vm, vlib_buffer_t * b, u32 l3_hdr_sz)
+{
+  if (PREDICT_FALSE (b->flags & VNET_BUFFER_GSO))
+    return l3_hdr_sz + vnet_buffer2 (b)->gso_l4_hdr_sz
+      + vnet_buffer2 (b)->gso_size;
+  return vlib_buffer_length_in_chain (vm, b);
+}
+
+u32 vnet_gso_segment_buffer (vlib_main_t * vm, u32 bi, u32 l2_hdr_sz,
+			     u32 ** segs);
+
+#endif /* included_vnet_gso_h */
+
+/*
+ * fd.io coding-style-patch-verification: ON
+ *
+ * Local Variables:
+ * eval: (c-set-style "gnu")
+ * End:
+ */
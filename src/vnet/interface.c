@@ -824,6 +824,7 @@ vnet_register_interface (vnet_main_t * vnm,
 	static char *e[] = {
 	  "interface is down",
 	  "interface is deleted",
+	  "segmentation offload failed",
 	};
 
 	r.n_errors = ARRAY_LEN (e);
@@ -405,6 +405,9 @@ typedef struct vnet_hw_interface_t
 #define VNET_HW_INTERFACE_FLAG_L2OUTPUT_SHIFT	9
 #define VNET_HW_INTERFACE_FLAG_L2OUTPUT_MAPPED	(1 << 9)
 
+  /* Hardware segments VNET_BUFFER_GSO packets (TCP segmentation offload) */
+#define VNET_HW_INTERFACE_FLAG_SUPPORTS_GSO	(1 << 10)
+
   /* Hardware address as vector.  Zero (e.g. zero-length vector) if no
      address for this class (e.g. PPP). */
   u8 *hw_address;
@@ -631,6 +634,9 @@ typedef struct
 
   /* feature_arc_index */
   u8 output_feature_arc_index;
+
+  /* Per-thread scratch vectors for software segmented GSO packets */
+  u32 **gso_segs_by_thread;
 } vnet_interface_main_t;
 
 static inline void
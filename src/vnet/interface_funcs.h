@@ -327,6 +327,7 @@ typedef enum
 {
   VNET_INTERFACE_OUTPUT_ERROR_INTERFACE_DOWN,
   VNET_INTERFACE_OUTPUT_ERROR_INTERFACE_DELETED,
+  VNET_INTERFACE_OUTPUT_ERROR_GSO_FAILED,
 } vnet_interface_output_error_t;
 
 /* Format for interface output traces. */
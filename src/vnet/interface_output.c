@@ -39,6 +39,7 @@
 
 #include <vnet/vnet.h>
 #include <vnet/feature/feature.h>
+#include <vnet/gso/gso.h>
 
 typedef struct
 {
@@ -417,6 +418,84 @@ vnet_interface_output_node_flatten (vlib_main_t * vm,
 VLIB_NODE_FUNCTION_MULTIARCH_CLONE (vnet_interface_output_node_flatten);
 CLIB_MULTIARCH_SELECT_FN (vnet_interface_output_node_flatten);
 
+/**
+ * Segment a GSO packet in software and enqueue the segments to the tx
+ * frame, getting new frames as they fill up. Packets that cannot be
+ * segmented are dropped.
+ *
+ * @return slots left in the current tx frame
+ */
+static_always_inline u32
+interface_output_segment_and_enqueue (vlib_main_t * vm,
+				      vlib_node_runtime_t * node,
+				      vnet_interface_output_runtime_t * rt,
+				      u32 bi0, u32 next_index,
+				      u32 current_config_index, u32 ** to_txp,
+				      u32 n_left_to_tx, u32 * n_packets,
+				      u32 * n_bytes)
+{
+  vnet_main_t *vnm = vnet_get_main ();
+  vnet_interface_main_t *im = &vnm->interface_main;
+  u32 cpu_index = vm->cpu_index;
+  u32 *segs, *to_tx = *to_txp;
+  u32 n_segs, i, tx_swif0, n_bytes_b0;
+  vlib_buffer_t *b0;
+
+  b0 = vlib_get_buffer (vm, bi0);
+  tx_swif0 = vnet_buffer (b0)->sw_if_index[VLIB_TX];
+
+  vec_validate (im->gso_segs_by_thread, cpu_index);
+  segs = im->gso_segs_by_thread[cpu_index];
+  vec_reset_length (segs);
+  n_segs = vnet_gso_segment_buffer (vm, bi0,
+				    vnet_buffer (b0)->ip.save_rewrite_length,
+				    &segs);
+  im->gso_segs_by_thread[cpu_index] = segs;
+
+  if (PREDICT_FALSE (n_segs == 0))
+    {
+      vlib_error_drop_buffers (vm, node, &bi0, /* buffer stride */ 1,
+			       /* n_buffers */ 1,
+			       VNET_INTERFACE_OUTPUT_NEXT_DROP,
+			       node->node_index,
+			       VNET_INTERFACE_OUTPUT_ERROR_GSO_FAILED);
+      return n_left_to_tx;
+    }
+
+  for (i = 0; i < n_segs; i++)
+    {
+      if (PREDICT_FALSE (n_left_to_tx == 0))
+	{
+	  vlib_put_next_frame (vm, node, next_index, 0);
+	  vlib_get_new_next_frame (vm, node, next_index, to_tx,
+				   n_left_to_tx);
+	}
+
+      b0 = vlib_get_buffer (vm, segs[i]);
+      to_tx[0] = segs[i];
+      to_tx += 1;
+      n_left_to_tx -= 1;
+
+      if (PREDICT_FALSE (current_config_index != ~0))
+	{
+	  b0->feature_arc_index = im->output_feature_arc_index;
+	  b0->current_config_index = current_config_index;
+	}
+
+      n_bytes_b0 = b0->current_length;
+      *n_bytes += n_bytes_b0;
+      *n_packets += 1;
+
+      if (PREDICT_FALSE (tx_swif0 != rt->sw_if_index))
+	vlib_increment_combined_counter (im->combined_sw_if_counters +
+					 VNET_INTERFACE_COUNTER_TX,
+					 cpu_index, tx_swif0, 1, n_bytes_b0);
+    }
+
+  *to_txp = to_tx;
+  return n_left_to_tx;
+}
+
 uword
 vnet_interface_output_node (vlib_main_t * vm,
 			    vlib_node_runtime_t * node, vlib_frame_t * frame)
@@ -433,6 +512,7 @@ vnet_interface_output_node (vlib_main_t * vm,
   u32 next_index = VNET_INTERFACE_OUTPUT_NEXT_TX;
   u32 current_config_index = ~0;
   u8 arc = im->output_feature_arc_index;
+  u8 do_segmentation;
 
   n_buffers = frame->n_vectors;
 
@@ -475,6 +555,9 @@ vnet_interface_output_node (vlib_main_t * vm,
   n_bytes = 0;
   n_packets = 0;
 
+  /* GSO packets are segmented here unless the hardware does it */
+  do_segmentation = !(hi->flags & VNET_HW_INTERFACE_FLAG_SUPPORTS_GSO);
+
   /* interface-output feature arc handling */
   if (PREDICT_FALSE (vnet_have_features (arc, rt->sw_if_index)))
     {
@@ -521,6 +604,17 @@ vnet_interface_output_node (vlib_main_t * vm,
 	  b2 = vlib_get_buffer (vm, bi2);
 	  b3 = vlib_get_buffer (vm, bi3);
 
+	  /* Leave GSO packets to the single loop */
+	  if (PREDICT_FALSE (do_segmentation
+			     && ((b0->flags | b1->flags | b2->flags
+				  | b3->flags) & VNET_BUFFER_GSO)))
+	    {
+	      from -= 4;
+	      to_tx -= 4;
+	      n_left_to_tx += 4;
+	      break;
+	    }
+
 	  /* Be grumpy about zero length buffers for benefit of
 	     driver tx function. */
 	  ASSERT (b0->current_length > 0);
@@ -596,13 +690,23 @@ vnet_interface_output_node (vlib_main_t * vm,
 	  u32 tx_swif0;
 
 	  bi0 = from[0];
-	  to_tx[0] = bi0;
 	  from += 1;
-	  to_tx += 1;
-	  n_left_to_tx -= 1;
 
 	  b0 = vlib_get_buffer (vm, bi0);
 
+	  if (PREDICT_FALSE (do_segmentation
+			     && (b0->flags & VNET_BUFFER_GSO)))
+	    {
+	      n_left_to_tx = interface_output_segment_and_enqueue
+		(vm, node, rt, bi0, next_index, current_config_index,
+		 &to_tx, n_left_to_tx, &n_packets, &n_bytes);
+	      continue;
+	    }
+
+	  to_tx[0] = bi0;
+	  to_tx += 1;
+	  n_left_to_tx -= 1;
+
 	  /* Be grumpy about zero length buffers for benefit of
 	     driver tx function. */
 	  ASSERT (b0->current_length > 0);
@@ -140,18 +140,24 @@ ip4_fib_free (ip4_fib_mtrie_t * m)
   ply_free (m, root_ply);
 }
 
+void
+ip4_mtrie_free (ip4_fib_mtrie_t * m)
+{
+  /* every ply but the 16 bit root is in the pool */
+  pool_free (m->ply_pool);
+  if (m->root_ply_16)
+    clib_mem_free (m->root_ply_16);
+  m->root_ply_16 = 0;
+  m->default_leaf = IP4_FIB_MTRIE_LEAF_EMPTY;
+}
+
 u32
 ip4_mtrie_lookup_address (ip4_fib_mtrie_t * m, ip4_address_t dst)
 {
-  ip4_fib_mtrie_ply_t *p = pool_elt_at_index (m->ply_pool, 0);
+  ip4_fib_mtrie_ply_t *p;
   ip4_fib_mtrie_leaf_t l;
 
-  l = p->leaves[dst.as_u8[0]];
-  if (ip4_fib_mtrie_leaf_is_terminal (l))
-    return ip4_fib_mtrie_leaf_get_adj_index (l);
-
-  p = get_next_ply_for_leaf (m, l);
-  l = p->leaves[dst.as_u8[1]];
+  l = ip4_fib_mtrie_lookup_step_one (m, &dst);
   if (ip4_fib_mtrie_leaf_is_terminal (l))
     return ip4_fib_mtrie_leaf_get_adj_index (l);
 
@@ -372,6 +378,126 @@ unset_leaf (ip4_fib_mtrie_t * m,
   return 0;
 }
 
+static void
+set_root_16_leaf (ip4_fib_mtrie_t * m,
+		  ip4_fib_mtrie_set_unset_leaf_args_t * a)
+{
+  ip4_fib_mtrie_16_ply_t *old_ply = m->root_ply_16;
+  ip4_fib_mtrie_leaf_t old_leaf, new_leaf;
+  ip4_fib_mtrie_ply_t *new_ply;
+  i32 n_dst_bits_next_plies;
+  u16 slot;
+
+  ASSERT (a->dst_address_length > 0 && a->dst_address_length <= 32);
+
+  n_dst_bits_next_plies = a->dst_address_length - BITS (u16);
+
+  /* Number of bits next plies <= 0 => insert leaves this ply. */
+  if (n_dst_bits_next_plies <= 0)
+    {
+      uword i, dst_16, n_dst_bits_this_ply, old_leaf_is_terminal;
+
+      n_dst_bits_this_ply = -n_dst_bits_next_plies;
+      dst_16 = clib_net_to_host_u16 (a->dst_address.as_u16[0]);
+      ASSERT ((dst_16 & pow2_mask (n_dst_bits_this_ply)) == 0);
+
+      for (i = dst_16; i < dst_16 + (1 << n_dst_bits_this_ply); i++)
+	{
+	  /* the root is indexed by the address in network order */
+	  slot = clib_host_to_net_u16 (i);
+
+	  old_leaf = old_ply->leaves[slot];
+	  old_leaf_is_terminal = ip4_fib_mtrie_leaf_is_terminal (old_leaf);
+
+	  /* Is leaf to be inserted more specific? */
+	  if (a->dst_address_length >= old_ply->dst_address_bits_of_leaves[slot])
+	    {
+	      new_leaf = ip4_fib_mtrie_leaf_set_adj_index (a->adj_index);
+
+	      if (old_leaf_is_terminal)
+		{
+		  old_ply->dst_address_bits_of_leaves[slot] =
+		    a->dst_address_length;
+		  __sync_val_compare_and_swap (&old_ply->leaves[slot],
+					       old_leaf, new_leaf);
+		  ASSERT (old_ply->leaves[slot] == new_leaf);
+		}
+	      else
+		{
+		  new_ply = get_next_ply_for_leaf (m, old_leaf);
+		  set_ply_with_more_specific_leaf (m, new_ply, new_leaf,
+						   a->dst_address_length);
+		}
+	    }
+	  else if (!old_leaf_is_terminal)
+	    {
+	      new_ply = get_next_ply_for_leaf (m, old_leaf);
+	      set_leaf (m, a, new_ply - m->ply_pool, 2);
+	    }
+	}
+    }
+  else
+    {
+      slot = a->dst_address.as_u16[0];
+      old_leaf = old_ply->leaves[slot];
+
+      if (ip4_fib_mtrie_leaf_is_terminal (old_leaf))
+	{
+	  new_leaf =
+	    ply_create (m, old_leaf,
+			old_ply->dst_address_bits_of_leaves[slot]);
+	  new_ply = get_next_ply_for_leaf (m, new_leaf);
+
+	  __sync_val_compare_and_swap (&old_ply->leaves[slot], old_leaf,
+				       new_leaf);
+	  ASSERT (old_ply->leaves[slot] == new_leaf);
+	  old_ply->dst_address_bits_of_leaves[slot] = 0;
+	}
+      else
+	new_ply = get_next_ply_for_leaf (m, old_leaf);
+
+      set_leaf (m, a, new_ply - m->ply_pool, 2);
+    }
+}
+
+static void
+unset_root_16_leaf (ip4_fib_mtrie_t * m,
+		    ip4_fib_mtrie_set_unset_leaf_args_t * a)
+{
+  ip4_fib_mtrie_16_ply_t *old_ply = m->root_ply_16;
+  ip4_fib_mtrie_leaf_t old_leaf, del_leaf;
+  i32 n_dst_bits_next_plies;
+  uword i, dst_16, n_dst_bits_this_ply;
+  u16 slot;
+
+  ASSERT (a->dst_address_length > 0 && a->dst_address_length <= 32);
+
+  n_dst_bits_next_plies = a->dst_address_length - BITS (u16);
+
+  dst_16 = clib_net_to_host_u16 (a->dst_address.as_u16[0]);
+  if (n_dst_bits_next_plies < 0)
+    dst_16 &= ~pow2_mask (-n_dst_bits_next_plies);
+
+  n_dst_bits_this_ply =
+    n_dst_bits_next_plies <= 0 ? -n_dst_bits_next_plies : 0;
+
+  del_leaf = ip4_fib_mtrie_leaf_set_adj_index (a->adj_index);
+
+  for (i = dst_16; i < dst_16 + (1 << n_dst_bits_this_ply); i++)
+    {
+      slot = clib_host_to_net_u16 (i);
+      old_leaf = old_ply->leaves[slot];
+
+      if (old_leaf == del_leaf
+	  || (!ip4_fib_mtrie_leaf_is_terminal (old_leaf)
+	      && unset_leaf (m, a, get_next_ply_for_leaf (m, old_leaf), 2)))
+	{
+	  old_ply->leaves[slot] = IP4_FIB_MTRIE_LEAF_EMPTY;
+	  old_ply->dst_address_bits_of_leaves[slot] = 0;
+	}
+    }
+}
+
 void
 ip4_mtrie_init (ip4_fib_mtrie_t * m)
 {
@@ -383,6 +509,25 @@ ip4_mtrie_init (ip4_fib_mtrie_t * m)
   ASSERT (ip4_fib_mtrie_leaf_get_next_ply_index (root) == 0);
 }
 
+void
+ip4_mtrie_init_with_layout (ip4_fib_mtrie_t * m, int use_16_8_8)
+{
+  ip4_fib_mtrie_16_ply_t *p;
+  uword i;
+
+  ip4_mtrie_init (m);
+
+  if (!use_16_8_8)
+    return;
+
+  p = clib_mem_alloc_aligned (sizeof (*p), CLIB_CACHE_LINE_BYTES);
+  for (i = 0; i < ARRAY_LEN (p->leaves); i++)
+    p->leaves[i] = IP4_FIB_MTRIE_LEAF_EMPTY;
+  memset (p->dst_address_bits_of_leaves, 0,
+	  sizeof (p->dst_address_bits_of_leaves));
+  m->root_ply_16 = p;
+}
+
 void
 ip4_fib_mtrie_add_del_route (ip4_fib_t * fib,
 			     ip4_address_t dst_address,
@@ -408,6 +553,8 @@ ip4_fib_mtrie_add_del_route (ip4_fib_t * fib,
     {
       if (dst_address_length == 0)
 	m->default_leaf = ip4_fib_mtrie_leaf_set_adj_index (adj_index);
+      else if (m->root_ply_16)
+	set_root_16_leaf (m, &a);
       else
 	set_leaf (m, &a, /* ply_index */ 0, /* dst_address_byte_index */ 0);
     }
@@ -421,7 +568,10 @@ ip4_fib_mtrie_add_del_route (ip4_fib_t * fib,
 	  ip4_main_t *im = &ip4_main;
 	  uword i;
 
-	  unset_leaf (m, &a, root_ply, 0);
+	  if (m->root_ply_16)
+	    unset_root_16_leaf (m, &a);
+	  else
+	    unset_leaf (m, &a, root_ply, 0);
 
 	  /* Find next less specific route and insert into mtrie. */
 	  for (i = dst_address_length - 1; i >= 1; i--)
@@ -445,8 +595,11 @@ ip4_fib_mtrie_add_del_route (ip4_fib_t * fib,
 		  a.adj_index = lbi;
 		  a.dst_address_length = i;
 
-		  set_leaf (m, &a, /* ply_index */ 0,
-			    /* dst_address_byte_index */ 0);
+		  if (m->root_ply_16)
+		    set_root_16_leaf (m, &a);
+		  else
+		    set_leaf (m, &a, /* ply_index */ 0,
+			      /* dst_address_byte_index */ 0);
 		  break;
 		}
 	    }
@@ -465,6 +618,19 @@ mtrie_memory_usage (ip4_fib_mtrie_t * m, ip4_fib_mtrie_ply_t * p)
       if (pool_is_free_index (m->ply_pool, 0))
 	return 0;
       p = pool_elt_at_index (m->ply_pool, 0);
+
+      if (m->root_ply_16)
+	{
+	  /* the unused 8 bit root ply is still allocated */
+	  bytes = sizeof (p[0]) + sizeof (m->root_ply_16[0]);
+	  for (i = 0; i < ARRAY_LEN (m->root_ply_16->leaves); i++)
+	    {
+	      ip4_fib_mtrie_leaf_t l = m->root_ply_16->leaves[i];
+	      if (ip4_fib_mtrie_leaf_is_next_ply (l))
+		bytes += mtrie_memory_usage (m, get_next_ply_for_leaf (m, l));
+	    }
+	  return bytes;
+	}
     }
 
   bytes = sizeof (p[0]);
@@ -478,6 +644,12 @@ mtrie_memory_usage (ip4_fib_mtrie_t * m, ip4_fib_mtrie_ply_t * p)
   return bytes;
 }
 
+uword
+ip4_fib_mtrie_memory_usage (ip4_fib_mtrie_t * m)
+{
+  return mtrie_memory_usage (m, 0);
+}
+
 static u8 *
 format_ip4_fib_mtrie_leaf (u8 * s, va_list * va)
 {
@@ -539,16 +711,60 @@ format_ip4_fib_mtrie_ply (u8 * s, va_list * va)
   return s;
 }
 
+static u8 *
+format_ip4_fib_mtrie_16_ply (u8 * s, va_list * va)
+{
+  ip4_fib_mtrie_t *m = va_arg (*va, ip4_fib_mtrie_t *);
+  ip4_fib_mtrie_16_ply_t *p = m->root_ply_16;
+  uword i, indent;
+
+  indent = format_get_indent (s);
+  s = format (s, "16 bit root ply");
+  for (i = 0; i < ARRAY_LEN (p->leaves); i++)
+    {
+      u16 slot = clib_host_to_net_u16 (i);
+      ip4_fib_mtrie_leaf_t l = p->leaves[slot];
+
+      if (!ip4_fib_mtrie_leaf_is_empty (l))
+	{
+	  u32 a, ia_length;
+	  ip4_address_t ia;
+
+	  a = i << 16;
+	  ia.as_u32 = clib_host_to_net_u32 (a);
+	  if (ip4_fib_mtrie_leaf_is_terminal (l))
+	    ia_length = p->dst_address_bits_of_leaves[slot];
+	  else
+	    ia_length = 16;
+	  s = format (s, "\n%U%20U %U",
+		      format_white_space, indent + 2,
+		      format_ip4_address_and_length, &ia, ia_length,
+		      format_ip4_fib_mtrie_leaf, l);
+
+	  if (ip4_fib_mtrie_leaf_is_next_ply (l))
+	    s = format (s, "\n%U%U",
+			format_white_space, indent + 2,
+			format_ip4_fib_mtrie_ply, m, a,
+			ip4_fib_mtrie_leaf_get_next_ply_index (l), 2);
+	}
+    }
+
+  return s;
+}
+
 u8 *
 format_ip4_fib_mtrie (u8 * s, va_list * va)
 {
   ip4_fib_mtrie_t *m = va_arg (*va, ip4_fib_mtrie_t *);
 
-  s = format (s, "%d plies, memory usage %U",
+  s = format (s, "%s layout, %d plies, memory usage %U",
+	      m->root_ply_16 ? "16-8-8" : "8-8-8-8",
 	      pool_elts (m->ply_pool),
 	      format_memory_size, mtrie_memory_usage (m, 0));
 
-  if (pool_elts (m->ply_pool) > 0)
+  if (m->root_ply_16)
+    s = format (s, "\n  %U", format_ip4_fib_mtrie_16_ply, m);
+  else if (pool_elts (m->ply_pool) > 0)
     {
       ip4_address_t base_address;
       base_address.as_u32 = 0;
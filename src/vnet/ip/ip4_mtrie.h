@@ -45,7 +45,7 @@
 #include <vnet/ip/lookup.h>
 #include <vnet/ip/ip4_packet.h>	/* for ip4_address_t */
 
-/* ip4 fib leafs: 4 ply 8-8-8-8 mtrie.
+/* ip4 fib leafs: 4 ply 8-8-8-8 mtrie, or 3 ply 16-8-8 mtrie.
    1 + 2*adj_index for terminal leaves.
    0 + 2*next_ply_index for non-terminals.
    1 => empty (adjacency index of zero is special miss adjacency). */
@@ -136,17 +136,41 @@ ip4_fib_mtrie_ply_t;
 STATIC_ASSERT (0 == sizeof (ip4_fib_mtrie_ply_t) % CLIB_CACHE_LINE_BYTES,
 	       "IP4 Mtrie ply cache line");
 
+#define IP4_FIB_MTRIE_PLY_16_N_LEAVES (1 << 16)
+
+/* Root ply of the 16-8-8 mtrie fib, indexed by the first 16 bits of the
+   address as they are in the packet (network byte order). */
+typedef struct
+{
+  ip4_fib_mtrie_leaf_t leaves[IP4_FIB_MTRIE_PLY_16_N_LEAVES];
+
+  /* Prefix length for terminal leaves. */
+  u8 dst_address_bits_of_leaves[IP4_FIB_MTRIE_PLY_16_N_LEAVES];
+} ip4_fib_mtrie_16_ply_t;
+
 typedef struct
 {
   /* Pool of plies.  Index zero is root ply. */
   ip4_fib_mtrie_ply_t *ply_pool;
 
+  /* Flat root ply replacing the first two 8 bit plies; non-zero
+     selects the 16-8-8 layout.  Ply zero is then unused. */
+  ip4_fib_mtrie_16_ply_t *root_ply_16;
+
   /* Special case leaf for default route 0.0.0.0/0. */
   ip4_fib_mtrie_leaf_t default_leaf;
 } ip4_fib_mtrie_t;
 
 void ip4_fib_mtrie_init (ip4_fib_mtrie_t * m);
 
+/* Initialize with the 16-8-8 layout when use_16_8_8 is set. */
+void ip4_mtrie_init_with_layout (ip4_fib_mtrie_t * m, int use_16_8_8);
+
+/* Free all plies. */
+void ip4_mtrie_free (ip4_fib_mtrie_t * m);
+
+uword ip4_fib_mtrie_memory_usage (ip4_fib_mtrie_t * m);
+
 struct ip4_fib_t;
 
 void ip4_fib_mtrie_add_del_route (struct ip4_fib_t *f,
@@ -177,6 +201,22 @@ ip4_fib_mtrie_lookup_step (ip4_fib_mtrie_t * m,
   return next_leaf;
 }
 
+/* Lookup step for the first 2 bytes of the address: a single load from
+   the flat root with the 16-8-8 layout, two plies otherwise.
+   Continue with ip4_fib_mtrie_lookup_step() for bytes 2 and 3. */
+always_inline ip4_fib_mtrie_leaf_t
+ip4_fib_mtrie_lookup_step_one (ip4_fib_mtrie_t * m,
+			       const ip4_address_t * dst_address)
+{
+  ip4_fib_mtrie_leaf_t next_leaf;
+
+  if (m->root_ply_16)
+    return m->root_ply_16->leaves[dst_address->as_u16[0]];
+
+  next_leaf = m->ply_pool[0].leaves[dst_address->as_u8[0]];
+  return ip4_fib_mtrie_lookup_step (m, next_leaf, dst_address, 1);
+}
+
 #endif /* included_ip_ip4_fib_h */
 
 /*
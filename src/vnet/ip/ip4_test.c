@@ -14,6 +14,8 @@
  */
 #include <vnet/ip/ip.h>
 #include <vnet/ethernet/ethernet.h>
+#include <vnet/fib/ip4_fib.h>
+#include <vnet/fib/fib_table.h>
 
 /**
  * @file
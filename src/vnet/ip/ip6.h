@@ -46,6 +46,7 @@
 #include <vnet/ip/ip6_packet.h>
 #include <vnet/ip/ip6_hop_by_hop_packet.h>
 #include <vnet/ip/lookup.h>
+#include <vnet/ip/ip6_mtrie.h>
 #include <stdbool.h>
 #include <vppinfra/bihash_24_8.h>
 #include <vppinfra/bihash_template.h>
@@ -74,6 +75,10 @@ typedef struct
 
   /* flow hash configuration */
   flow_hash_config_t flow_hash_config;
+
+  /* Forwarding lookups use this mtrie when set, else the shared
+     per prefix length hash. */
+  ip6_fib_mtrie_t *mtrie;
 } ip6_fib_t;
 
 typedef struct ip6_mfib_t
@@ -45,6 +45,7 @@
 #include <vnet/fib/fib_urpf_list.h>	/* for FIB uRPF check */
 #include <vnet/fib/ip6_fib.h>
 #include <vnet/mfib/ip6_mfib.h>
+#include <vnet/gso/gso.h>
 #include <vnet/dpo/load_balance.h>
 #include <vnet/dpo/classify_dpo.h>
 
@@ -2033,12 +2034,12 @@ ip6_rewrite_inline (vlib_main_t * vm,
 
 	  /* Check MTU of outgoing interface. */
 	  error0 =
-	    (vlib_buffer_length_in_chain (vm, p0) >
+	    (vnet_gso_l3_mtu_len (vm, p0, sizeof (ip6_header_t)) >
 	     adj0[0].
 	     rewrite_header.max_l3_packet_bytes ? IP6_ERROR_MTU_EXCEEDED :
 	     error0);
 	  error1 =
-	    (vlib_buffer_length_in_chain (vm, p1) >
+	    (vnet_gso_l3_mtu_len (vm, p1, sizeof (ip6_header_t)) >
 	     adj1[0].
 	     rewrite_header.max_l3_packet_bytes ? IP6_ERROR_MTU_EXCEEDED :
 	     error1);
@@ -2165,7 +2166,7 @@ ip6_rewrite_inline (vlib_main_t * vm,
 
 	  /* Check MTU of outgoing interface. */
 	  error0 =
-	    (vlib_buffer_length_in_chain (vm, p0) >
+	    (vnet_gso_l3_mtu_len (vm, p0, sizeof (ip6_header_t)) >
 	     adj0[0].
 	     rewrite_header.max_l3_packet_bytes ? IP6_ERROR_MTU_EXCEEDED :
 	     error0);
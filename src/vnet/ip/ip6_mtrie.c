@@ -0,0 +1,346 @@
+/*
+ * Copyright (c) 2017 Cisco and/or its affiliates.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/*
+ * ip/ip6_mtrie.c: ip6 mtrie fib
+ *
+ * Same algorithm as the ip4 mtrie, with 16 plies.
+ */
+
+#include <vnet/ip/ip.h>
+#include <vnet/ip/ip6_mtrie.h>
+
+static void
+ply_init (ip6_fib_mtrie_ply_t * p, ip6_fib_mtrie_leaf_t init,
+	  uword prefix_len)
+{
+  u32 *l;
+
+  p->n_non_empty_leafs =
+    ip6_fib_mtrie_leaf_is_empty (init) ? 0 : ARRAY_LEN (p->leaves);
+  memset (p->dst_address_bits_of_leaves, prefix_len,
+	  sizeof (p->dst_address_bits_of_leaves));
+
+  for (l = p->leaves; l < p->leaves + ARRAY_LEN (p->leaves); l += 4)
+    {
+      l[0] = init;
+      l[1] = init;
+      l[2] = init;
+      l[3] = init;
+    }
+}
+
+static ip6_fib_mtrie_leaf_t
+ply_create (ip6_fib_mtrie_t * m, ip6_fib_mtrie_leaf_t init_leaf,
+	    uword prefix_len)
+{
+  ip6_fib_mtrie_ply_t *p;
+
+  /* Get cache aligned ply. */
+  pool_get_aligned (m->ply_pool, p, sizeof (p[0]));
+
+  ply_init (p, init_leaf, prefix_len);
+  return ip6_fib_mtrie_leaf_set_next_ply_index (p - m->ply_pool);
+}
+
+always_inline ip6_fib_mtrie_ply_t *
+get_next_ply_for_leaf (ip6_fib_mtrie_t * m, ip6_fib_mtrie_leaf_t l)
+{
+  uword n = ip6_fib_mtrie_leaf_get_next_ply_index (l);
+  /* It better not be the root ply. */
+  ASSERT (n != 0);
+  return pool_elt_at_index (m->ply_pool, n);
+}
+
+typedef struct
+{
+  ip6_address_t dst_address;
+  u32 dst_address_length;
+  u32 lb_index;
+} ip6_fib_mtrie_set_unset_leaf_args_t;
+
+static void
+set_ply_with_more_specific_leaf (ip6_fib_mtrie_t * m,
+				 ip6_fib_mtrie_ply_t * ply,
+				 ip6_fib_mtrie_leaf_t new_leaf,
+				 uword new_leaf_dst_address_bits)
+{
+  ip6_fib_mtrie_leaf_t old_leaf;
+  uword i;
+
+  ASSERT (ip6_fib_mtrie_leaf_is_terminal (new_leaf));
+  ASSERT (!ip6_fib_mtrie_leaf_is_empty (new_leaf));
+
+  for (i = 0; i < ARRAY_LEN (ply->leaves); i++)
+    {
+      old_leaf = ply->leaves[i];
+
+      /* Recurse into sub plies. */
+      if (!ip6_fib_mtrie_leaf_is_terminal (old_leaf))
+	{
+	  ip6_fib_mtrie_ply_t *sub_ply = get_next_ply_for_leaf (m, old_leaf);
+	  set_ply_with_more_specific_leaf (m, sub_ply, new_leaf,
+					   new_leaf_dst_address_bits);
+	}
+
+      /* Replace less specific terminal leaves with new leaf. */
+      else if (new_leaf_dst_address_bits >=
+	       ply->dst_address_bits_of_leaves[i])
+	{
+	  __sync_val_compare_and_swap (&ply->leaves[i], old_leaf, new_leaf);
+	  ASSERT (ply->leaves[i] == new_leaf);
+	  ply->dst_address_bits_of_leaves[i] = new_leaf_dst_address_bits;
+	  ply->n_non_empty_leafs += ip6_fib_mtrie_leaf_is_empty (old_leaf);
+	}
+    }
+}
+
+static void
+set_leaf (ip6_fib_mtrie_t * m,
+	  ip6_fib_mtrie_set_unset_leaf_args_t * a,
+	  u32 old_ply_index, u32 dst_address_byte_index)
+{
+  ip6_fib_mtrie_leaf_t old_leaf, new_leaf;
+  i32 n_dst_bits_next_plies;
+  u8 dst_byte;
+
+  ASSERT (a->dst_address_length > 0 && a->dst_address_length <= 128);
+  ASSERT (dst_address_byte_index < ARRAY_LEN (a->dst_address.as_u8));
+
+  n_dst_bits_next_plies =
+    a->dst_address_length - BITS (u8) * (dst_address_byte_index + 1);
+
+  dst_byte = a->dst_address.as_u8[dst_address_byte_index];
+
+  /* Number of bits next plies <= 0 => insert leaves this ply. */
+  if (n_dst_bits_next_plies <= 0)
+    {
+      uword i, n_dst_bits_this_ply, old_leaf_is_terminal;
+
+      n_dst_bits_this_ply = -n_dst_bits_next_plies;
+      ASSERT ((a->dst_address.as_u8[dst_address_byte_index] &
+	       pow2_mask (n_dst_bits_this_ply)) == 0);
+
+      for (i = dst_byte; i < dst_byte + (1 << n_dst_bits_this_ply); i++)
+	{
+	  ip6_fib_mtrie_ply_t *old_ply, *new_ply;
+
+	  old_ply = pool_elt_at_index (m->ply_pool, old_ply_index);
+
+	  old_leaf = old_ply->leaves[i];
+	  old_leaf_is_terminal = ip6_fib_mtrie_leaf_is_terminal (old_leaf);
+
+	  /* Is leaf to be inserted more specific? */
+	  if (a->dst_address_length >= old_ply->dst_address_bits_of_leaves[i])
+	    {
+	      new_leaf = ip6_fib_mtrie_leaf_set_lb_index (a->lb_index);
+
+	      if (old_leaf_is_terminal)
+		{
+		  old_ply->dst_address_bits_of_leaves[i] =
+		    a->dst_address_length;
+		  __sync_val_compare_and_swap (&old_ply->leaves[i], old_leaf,
+					       new_leaf);
+		  ASSERT (old_ply->leaves[i] == new_leaf);
+		  old_ply->n_non_empty_leafs +=
+		    ip6_fib_mtrie_leaf_is_empty (old_leaf);
+		  ASSERT (old_ply->n_non_empty_leafs <=
+			  ARRAY_LEN (old_ply->leaves));
+		}
+	      else
+		{
+		  /* Existing leaf points to another ply.  We need to place
+		     new_leaf into all more specific slots. */
+		  new_ply = get_next_ply_for_leaf (m, old_leaf);
+		  set_ply_with_more_specific_leaf (m, new_ply, new_leaf,
+						   a->dst_address_length);
+		}
+	    }
+
+	  else if (!old_leaf_is_terminal)
+	    {
+	      new_ply = get_next_ply_for_leaf (m, old_leaf);
+	      set_leaf (m, a, new_ply - m->ply_pool,
+			dst_address_byte_index + 1);
+	    }
+	}
+    }
+  else
+    {
+      ip6_fib_mtrie_ply_t *old_ply, *new_ply;
+
+      old_ply = pool_elt_at_index (m->ply_pool, old_ply_index);
+      old_leaf = old_ply->leaves[dst_byte];
+      if (ip6_fib_mtrie_leaf_is_terminal (old_leaf))
+	{
+	  new_leaf =
+	    ply_create (m, old_leaf,
+			old_ply->dst_address_bits_of_leaves[dst_byte]);
+	  new_ply = get_next_ply_for_leaf (m, new_leaf);
+
+	  /* Refetch since ply_create may move pool. */
+	  old_ply = pool_elt_at_index (m->ply_pool, old_ply_index);
+
+	  __sync_val_compare_and_swap (&old_ply->leaves[dst_byte], old_leaf,
+				       new_leaf);
+	  ASSERT (old_ply->leaves[dst_byte] == new_leaf);
+	  old_ply->dst_address_bits_of_leaves[dst_byte] = 0;
+
+	  old_ply->n_non_empty_leafs -= !ip6_fib_mtrie_leaf_is_empty (old_leaf);
+	  ASSERT (old_ply->n_non_empty_leafs >= 0);
+
+	  /* Account for the ply we just created. */
+	  old_ply->n_non_empty_leafs += 1;
+	}
+      else
+	new_ply = get_next_ply_for_leaf (m, old_leaf);
+
+      set_leaf (m, a, new_ply - m->ply_pool, dst_address_byte_index + 1);
+    }
+}
+
+static uword
+unset_leaf (ip6_fib_mtrie_t * m,
+	    ip6_fib_mtrie_set_unset_leaf_args_t * a,
+	    ip6_fib_mtrie_ply_t * old_ply, u32 dst_address_byte_index)
+{
+  ip6_fib_mtrie_leaf_t old_leaf, del_leaf;
+  i32 n_dst_bits_next_plies;
+  i32 i, n_dst_bits_this_ply, old_leaf_is_terminal;
+  u8 dst_byte;
+
+  ASSERT (a->dst_address_length > 0 && a->dst_address_length <= 128);
+  ASSERT (dst_address_byte_index < ARRAY_LEN (a->dst_address.as_u8));
+
+  n_dst_bits_next_plies =
+    a->dst_address_length - BITS (u8) * (dst_address_byte_index + 1);
+
+  dst_byte = a->dst_address.as_u8[dst_address_byte_index];
+  if (n_dst_bits_next_plies < 0)
+    dst_byte &= ~pow2_mask (-n_dst_bits_next_plies);
+
+  n_dst_bits_this_ply =
+    n_dst_bits_next_plies <= 0 ? -n_dst_bits_next_plies : 0;
+  n_dst_bits_this_ply = clib_min (8, n_dst_bits_this_ply);
+
+  del_leaf = ip6_fib_mtrie_leaf_set_lb_index (a->lb_index);
+
+  for (i = dst_byte; i < dst_byte + (1 << n_dst_bits_this_ply); i++)
+    {
+      old_leaf = old_ply->leaves[i];
+      old_leaf_is_terminal = ip6_fib_mtrie_leaf_is_terminal (old_leaf);
+
+      if (old_leaf == del_leaf
+	  || (!old_leaf_is_terminal
+	      && unset_leaf (m, a, get_next_ply_for_leaf (m, old_leaf),
+			     dst_address_byte_index + 1)))
+	{
+	  old_ply->leaves[i] = IP6_FIB_MTRIE_LEAF_EMPTY;
+	  old_ply->dst_address_bits_of_leaves[i] = 0;
+
+	  /* No matter what we just deleted a non-empty leaf. */
+	  ASSERT (!ip6_fib_mtrie_leaf_is_empty (old_leaf));
+	  old_ply->n_non_empty_leafs -= 1;
+
+	  ASSERT (old_ply->n_non_empty_leafs >= 0);
+	  if (old_ply->n_non_empty_leafs == 0 && dst_address_byte_index > 0)
+	    {
+	      pool_put (m->ply_pool, old_ply);
+	      /* Old ply was deleted. */
+	      return 1;
+	    }
+	}
+    }
+
+  /* Old ply was not deleted. */
+  return 0;
+}
+
+void
+ip6_fib_mtrie_init (ip6_fib_mtrie_t * m)
+{
+  ip6_fib_mtrie_leaf_t root;
+  memset (m, 0, sizeof (m[0]));
+  m->default_leaf = IP6_FIB_MTRIE_LEAF_EMPTY;
+  root = ply_create (m, IP6_FIB_MTRIE_LEAF_EMPTY,	/* dst_address_bits_of_leaves */
+		     0);
+  ASSERT (ip6_fib_mtrie_leaf_get_next_ply_index (root) == 0);
+}
+
+void
+ip6_fib_mtrie_free (ip6_fib_mtrie_t * m)
+{
+  pool_free (m->ply_pool);
+  m->default_leaf = IP6_FIB_MTRIE_LEAF_EMPTY;
+}
+
+void
+ip6_fib_mtrie_add_del_route (ip6_fib_mtrie_t * m,
+			     const ip6_address_t * dst_address,
+			     u32 dst_address_length, u32 lb_index, u32 is_del)
+{
+  ip6_fib_mtrie_set_unset_leaf_args_t a;
+  ip6_main_t *im = &ip6_main;
+
+  ASSERT (m->ply_pool != 0);
+
+  /* Honor dst_address_length. Fib masks are in network byte order */
+  a.dst_address.as_u64[0] =
+    dst_address->as_u64[0] & im->fib_masks[dst_address_length].as_u64[0];
+  a.dst_address.as_u64[1] =
+    dst_address->as_u64[1] & im->fib_masks[dst_address_length].as_u64[1];
+  a.dst_address_length = dst_address_length;
+  a.lb_index = lb_index;
+
+  if (!is_del)
+    {
+      if (dst_address_length == 0)
+	m->default_leaf = ip6_fib_mtrie_leaf_set_lb_index (lb_index);
+      else
+	set_leaf (m, &a, /* ply_index */ 0, /* dst_address_byte_index */ 0);
+    }
+  else
+    {
+      if (dst_address_length == 0)
+	m->default_leaf = IP6_FIB_MTRIE_LEAF_EMPTY;
+      else
+	unset_leaf (m, &a, pool_elt_at_index (m->ply_pool, 0), 0);
+    }
+}
+
+/* Returns number of bytes of memory used by mtrie. */
+uword
+ip6_fib_mtrie_memory_usage (ip6_fib_mtrie_t * m)
+{
+  return pool_elts (m->ply_pool) * sizeof (ip6_fib_mtrie_ply_t);
+}
+
+u8 *
+format_ip6_fib_mtrie (u8 * s, va_list * va)
+{
+  ip6_fib_mtrie_t *m = va_arg (*va, ip6_fib_mtrie_t *);
+
+  s = format (s, "%d plies, memory usage %U",
+	      pool_elts (m->ply_pool),
+	      format_memory_size, ip6_fib_mtrie_memory_usage (m));
+  return s;
+}
+
+/*
+ * fd.io coding-style-patch-verification: ON
+ *
+ * Local Variables:
+ * eval: (c-set-style "gnu")
+ * End:
+ */
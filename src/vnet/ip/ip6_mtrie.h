@@ -0,0 +1,164 @@
+/*
+ * Copyright (c) 2017 Cisco and/or its affiliates.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/*
+ * ip/ip6_mtrie.h: ip6 mtrie fib
+ *
+ * The ip4 mtrie extended to 16 8-bit plies. It is an alternative to the
+ * per prefix length hash probing of the ip6 forwarding table, selected
+ * per table: the cost of a lookup depends on the length of the matching
+ * prefix (one load per byte) instead of on the number of distinct prefix
+ * lengths in the tables.
+ */
+
+#ifndef included_ip_ip6_mtrie_h
+#define included_ip_ip6_mtrie_h
+
+#include <vppinfra/cache.h>
+#include <vppinfra/vector.h>
+#include <vppinfra/pool.h>
+#include <vnet/ip/ip6_packet.h>	/* for ip6_address_t */
+
+/* ip6 fib leafs: 16 ply 8-8-...-8 mtrie.
+   1 + 2*lb_index for terminal leaves.
+   0 + 2*next_ply_index for non-terminals.
+   1 => empty, the default route applies. */
+typedef u32 ip6_fib_mtrie_leaf_t;
+
+#define IP6_FIB_MTRIE_LEAF_EMPTY (1 + 2*0)
+
+always_inline u32
+ip6_fib_mtrie_leaf_is_empty (ip6_fib_mtrie_leaf_t n)
+{
+  return n == IP6_FIB_MTRIE_LEAF_EMPTY;
+}
+
+always_inline u32
+ip6_fib_mtrie_leaf_is_terminal (ip6_fib_mtrie_leaf_t n)
+{
+  return n & 1;
+}
+
+always_inline u32
+ip6_fib_mtrie_leaf_is_next_ply (ip6_fib_mtrie_leaf_t n)
+{
+  return (n & 1) == 0;
+}
+
+always_inline u32
+ip6_fib_mtrie_leaf_get_lb_index (ip6_fib_mtrie_leaf_t n)
+{
+  ASSERT (ip6_fib_mtrie_leaf_is_terminal (n));
+  return n >> 1;
+}
+
+always_inline ip6_fib_mtrie_leaf_t
+ip6_fib_mtrie_leaf_set_lb_index (u32 lb_index)
+{
+  ip6_fib_mtrie_leaf_t l;
+  l = 1 + 2 * lb_index;
+  ASSERT (ip6_fib_mtrie_leaf_get_lb_index (l) == lb_index);
+  return l;
+}
+
+always_inline u32
+ip6_fib_mtrie_leaf_get_next_ply_index (ip6_fib_mtrie_leaf_t n)
+{
+  ASSERT (ip6_fib_mtrie_leaf_is_next_ply (n));
+  return n >> 1;
+}
+
+always_inline ip6_fib_mtrie_leaf_t
+ip6_fib_mtrie_leaf_set_next_ply_index (u32 i)
+{
+  ip6_fib_mtrie_leaf_t l;
+  l = 0 + 2 * i;
+  ASSERT (ip6_fib_mtrie_leaf_get_next_ply_index (l) == i);
+  return l;
+}
+
+/* One ply of the 16 ply mtrie fib. */
+typedef struct
+{
+  ip6_fib_mtrie_leaf_t leaves[256];
+
+  /* Prefix length for terminal leaves. */
+  u8 dst_address_bits_of_leaves[256];
+
+  /* Number of non-empty leafs (whether terminal or not). */
+  i32 n_non_empty_leafs;
+
+  /* Pad to cache line boundary. */
+  u8 pad[CLIB_CACHE_LINE_BYTES - 1 * sizeof (i32)];
+}
+ip6_fib_mtrie_ply_t;
+
+STATIC_ASSERT (0 == sizeof (ip6_fib_mtrie_ply_t) % CLIB_CACHE_LINE_BYTES,
+	       "IP6 Mtrie ply cache line");
+
+typedef struct
+{
+  /* Pool of plies.  Index zero is root ply. */
+  ip6_fib_mtrie_ply_t *ply_pool;
+
+  /* Special case leaf for default route ::/0. */
+  ip6_fib_mtrie_leaf_t default_leaf;
+} ip6_fib_mtrie_t;
+
+void ip6_fib_mtrie_init (ip6_fib_mtrie_t * m);
+void ip6_fib_mtrie_free (ip6_fib_mtrie_t * m);
+
+/* Add or remove a prefix. Removing a prefix leaves the address range
+   empty, the caller re-adds the next less specific prefix. */
+void ip6_fib_mtrie_add_del_route (ip6_fib_mtrie_t * m,
+				  const ip6_address_t * dst_address,
+				  u32 dst_address_length,
+				  u32 lb_index, u32 is_del);
+
+uword ip6_fib_mtrie_memory_usage (ip6_fib_mtrie_t * m);
+
+format_function_t format_ip6_fib_mtrie;
+
+/* Returns load-balance index. */
+always_inline u32
+ip6_fib_mtrie_lookup (const ip6_fib_mtrie_t * m,
+		      const ip6_address_t * dst_address)
+{
+  const ip6_fib_mtrie_ply_t *p = m->ply_pool;
+  ip6_fib_mtrie_leaf_t l = IP6_FIB_MTRIE_LEAF_EMPTY;
+  u32 i;
+
+  /* a ply at byte 15 holds terminal leaves only */
+  for (i = 0; i < ARRAY_LEN (dst_address->as_u8); i++)
+    {
+      l = p->leaves[dst_address->as_u8[i]];
+      if (ip6_fib_mtrie_leaf_is_terminal (l))
+	break;
+      p = m->ply_pool + ip6_fib_mtrie_leaf_get_next_ply_index (l);
+    }
+
+  if (ip6_fib_mtrie_leaf_is_empty (l))
+    l = m->default_leaf;
+  return ip6_fib_mtrie_leaf_get_lb_index (l);
+}
+
+#endif /* included_ip_ip6_mtrie_h */
+
+/*
+ * fd.io coding-style-patch-verification: ON
+ *
+ * Local Variables:
+ * eval: (c-set-style "gnu")
+ * End:
+ */
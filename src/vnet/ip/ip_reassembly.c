@@ -0,0 +1,1242 @@
+/*
+ * Copyright (c) 2017 Cisco and/or its affiliates.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/**
+ * @file
+ * @brief IPv4 and IPv6 full and virtual reassembly.
+ */
+
+#include <vnet/ip/ip_reassembly.h>
+
+ip_reass_main_t ip_reass_main;
+
+#define foreach_ip_reass_error                                  \
+_(NONE, "valid packets")                                        \
+_(REASSEMBLED, "datagrams reassembled")                         \
+_(FRAGMENT_HELD, "fragments held")                              \
+_(MALFORMED, "malformed fragments")                             \
+_(DUPLICATE, "duplicate fragments")                             \
+_(OVERLAP, "overlapping fragments")                             \
+_(TOO_MANY_FRAGMENTS, "too many fragments in a datagram")       \
+_(NO_CONTEXT, "reassembly context limit reached")               \
+_(BUFFER_LIMIT, "reassembly buffer limit reached")              \
+_(TIMEOUT, "reassembly timed out")
+
+typedef enum
+{
+#define _(sym,str) IP_REASS_ERROR_##sym,
+  foreach_ip_reass_error
+#undef _
+    IP_REASS_N_ERROR,
+} ip_reass_error_t;
+
+static char *ip_reass_error_strings[] = {
+#define _(sym,string) string,
+  foreach_ip_reass_error
+#undef _
+};
+
+typedef enum
+{
+  IP_REASS_NEXT_DROP,
+  IP_REASS_N_NEXT,
+} ip_reass_next_t;
+
+#define foreach_ip_reass_action         \
+_(PASS, "pass")                         \
+_(HOLD, "hold")                         \
+_(REASSEMBLED, "reassembled")           \
+_(FORWARD, "forward")                   \
+_(DROP, "drop")
+
+typedef enum
+{
+#define _(sym,str) IP_REASS_ACTION_##sym,
+  foreach_ip_reass_action
+#undef _
+} ip_reass_action_t;
+
+typedef struct
+{
+  u32 reass_index;
+  u16 range_first;
+  u16 range_last;
+  u16 l4_src_port;
+  u16 l4_dst_port;
+  u8 action;
+} ip_reass_trace_t;
+
+static u8 *
+format_ip_reass_trace (u8 * s, va_list * args)
+{
+  CLIB_UNUSED (vlib_main_t * vm) = va_arg (*args, vlib_main_t *);
+  CLIB_UNUSED (vlib_node_t * node) = va_arg (*args, vlib_node_t *);
+  ip_reass_trace_t *t = va_arg (*args, ip_reass_trace_t *);
+  char *actions[] = {
+#define _(sym,str) str,
+    foreach_ip_reass_action
+#undef _
+  };
+
+  s = format (s, "%s", actions[t->action]);
+  if (t->action == IP_REASS_ACTION_PASS)
+    return s;
+  s = format (s, " reass %d range [%d, %d) l4 ports %d %d",
+	      t->reass_index, t->range_first, t->range_last,
+	      clib_net_to_host_u16 (t->l4_src_port),
+	      clib_net_to_host_u16 (t->l4_dst_port));
+  return s;
+}
+
+always_inline u32
+ip_reass_timer_ticks (u32 timeout_ms)
+{
+  u32 ticks = timeout_ms / (IP_REASS_TIMER_INTERVAL * 1000);
+
+  return clib_min (clib_max (ticks, 1), IP_REASS_TIMER_MAX_TICKS);
+}
+
+always_inline void
+ip_reass_expired_timer_callback_inline (u32 * expired_timers, int is_ip6)
+{
+  ip_reass_main_t *rm = &ip_reass_main;
+  ip_reass_per_thread_t *pt =
+    vec_elt_at_index (rm->per_thread_data[is_ip6], os_get_cpu_number ());
+  int i;
+
+  /* the buffers are dropped by the node, which has a frame to put them */
+  for (i = 0; i < vec_len (expired_timers); i++)
+    vec_add1 (pt->expired, expired_timers[i] & 0x7FFFFFFF);
+}
+
+static void
+ip4_reass_expired_timer_callback (u32 * expired_timers)
+{
+  ip_reass_expired_timer_callback_inline (expired_timers, 0 /* is_ip6 */ );
+}
+
+static void
+ip6_reass_expired_timer_callback (u32 * expired_timers)
+{
+  ip_reass_expired_timer_callback_inline (expired_timers, 1 /* is_ip6 */ );
+}
+
+always_inline int
+ip_reass_is_fragment (vlib_buffer_t * b, int is_ip6)
+{
+  if (is_ip6)
+    {
+      ip6_header_t *ip = vlib_buffer_get_current (b);
+      return ip->protocol == IP_PROTOCOL_IPV6_FRAGMENTATION;
+    }
+  else
+    {
+      ip4_header_t *ip = vlib_buffer_get_current (b);
+      return ip4_is_fragment (ip);
+    }
+}
+
+/*
+ * Payload range, header length and more flag of a fragment.
+ * Returns 0 if the fragment is malformed.
+ */
+always_inline int
+ip_reass_fragment_info (vlib_main_t * vm, vlib_buffer_t * b, int is_ip6,
+			u32 * first, u32 * len, u32 * hdr_len, int *more)
+{
+  u32 total;
+
+  if (is_ip6)
+    {
+      ip6_header_t *ip = vlib_buffer_get_current (b);
+      ip6_frag_hdr_t *frag = (ip6_frag_hdr_t *) (ip + 1);
+
+      *hdr_len = sizeof (*ip) + sizeof (*frag);
+      total = sizeof (*ip) + clib_net_to_host_u16 (ip->payload_length);
+      *first = 8 * ip6_frag_hdr_offset (frag);
+      *more = ip6_frag_hdr_more (frag);
+    }
+  else
+    {
+      ip4_header_t *ip = vlib_buffer_get_current (b);
+
+      *hdr_len = ip4_header_bytes (ip);
+      total = clib_net_to_host_u16 (ip->length);
+      *first = ip4_get_fragment_offset_bytes (ip);
+      *more = ip4_get_fragment_more (ip) ? 1 : 0;
+    }
+
+  if (total <= *hdr_len)
+    return 0;
+  *len = total - *hdr_len;
+  /* only the last fragment may end on a non 8 byte boundary */
+  if (*more && (*len & 7))
+    return 0;
+  if (*first + *len > 0xffff)
+    return 0;
+  if (b->current_length < *hdr_len ||
+      vlib_buffer_length_in_chain (vm, b) < total)
+    return 0;
+  return 1;
+}
+
+/*
+ * Source and destination ports, in network byte order, of the L4 header
+ * hdr_len bytes into the packet. ICMP echo uses the identifier as both.
+ * Returns 0 if the buffer does not hold the L4 header.
+ */
+always_inline int
+ip_reass_get_l4_ports (vlib_buffer_t * b, u32 hdr_len, u8 proto,
+		       u16 * src_port, u16 * dst_port)
+{
+  u8 *l4 = (u8 *) vlib_buffer_get_current (b) + hdr_len;
+
+  *src_port = *dst_port = 0;
+  switch (proto)
+    {
+    case IP_PROTOCOL_TCP:
+    case IP_PROTOCOL_UDP:
+      if (b->current_length < hdr_len + 4)
+	return 0;
+      *src_port = ((u16 *) l4)[0];
+      *dst_port = ((u16 *) l4)[1];
+      break;
+    case IP_PROTOCOL_ICMP:
+    case IP_PROTOCOL_ICMP6:
+      if (b->current_length < hdr_len + sizeof (icmp46_header_t) + 4)
+	return 0;
+      if (l4[0] == ICMP4_echo_request || l4[0] == ICMP4_echo_reply ||
+	  l4[0] == ICMP6_echo_request || l4[0] == ICMP6_echo_reply)
+	*src_port = *dst_port = ((u16 *) l4)[2];
+      break;
+    default:
+      break;
+    }
+  return 1;
+}
+
+/* L4 info of an unfragmented packet, for the virtual reassembly consumers */
+always_inline void
+ip_reass_set_l4_info_unfragmented (vlib_buffer_t * b, int is_ip6)
+{
+  u16 src_port, dst_port;
+  u32 hdr_len;
+  u8 proto;
+
+  if (is_ip6)
+    {
+      ip6_header_t *ip = vlib_buffer_get_current (b);
+      hdr_len = sizeof (*ip);
+      proto = ip->protocol;
+    }
+  else
+    {
+      ip4_header_t *ip = vlib_buffer_get_current (b);
+      hdr_len = ip4_header_bytes (ip);
+      proto = ip->protocol;
+    }
+  ip_reass_get_l4_ports (b, hdr_len, proto, &src_port, &dst_port);
+  vnet_buffer (b)->ip.reass.l4_src_port = src_port;
+  vnet_buffer (b)->ip.reass.l4_dst_port = dst_port;
+  vnet_buffer (b)->ip.reass.ip_proto = proto;
+  vnet_buffer (b)->ip.reass.is_non_first_fragment = 0;
+  b->flags |= VNET_BUFFER_L4_INFO_VALID;
+}
+
+always_inline void
+ip_reass_make_key (vlib_buffer_t * b, int is_ip6, u64 * key)
+{
+  u32 sw_if_index = vnet_buffer (b)->sw_if_index[VLIB_RX];
+  u64 fib_index;
+
+  memset (key, 0, sizeof (u64) * 6);
+  if (is_ip6)
+    {
+      ip6_header_t *ip = vlib_buffer_get_current (b);
+      ip6_frag_hdr_t *frag = (ip6_frag_hdr_t *) (ip + 1);
+
+      fib_index = vec_elt (ip6_main.fib_index_by_sw_if_index, sw_if_index);
+      key[0] = ip->src_address.as_u64[0];
+      key[1] = ip->src_address.as_u64[1];
+      key[2] = ip->dst_address.as_u64[0];
+      key[3] = ip->dst_address.as_u64[1];
+      key[4] = (fib_index << 32) | frag->identification;
+    }
+  else
+    {
+      ip4_header_t *ip = vlib_buffer_get_current (b);
+
+      fib_index = vec_elt (ip4_main.fib_index_by_sw_if_index, sw_if_index);
+      key[0] = ((u64) ip->dst_address.as_u32 << 32) | ip->src_address.as_u32;
+      key[1] = (fib_index << 32) | ((u64) ip->protocol << 16) |
+	ip->fragment_id;
+    }
+}
+
+static ip_reass_t *
+ip_reass_find_or_create (ip_reass_main_t * rm, ip_reass_per_thread_t * pt,
+			 int is_ip6, u64 * key, u32 * error)
+{
+  ip_reass_t *r;
+  u32 reass_index;
+
+  if (is_ip6)
+    {
+      clib_bihash_kv_48_8_t kv, value;
+      clib_memcpy (kv.key, key, sizeof (kv.key));
+      if (!clib_bihash_search_48_8 (&pt->hash6, &kv, &value))
+	return pool_elt_at_index (pt->pool, value.value);
+    }
+  else
+    {
+      clib_bihash_kv_16_8_t kv, value;
+      clib_memcpy (kv.key, key, sizeof (kv.key));
+      if (!clib_bihash_search_16_8 (&pt->hash4, &kv, &value))
+	return pool_elt_at_index (pt->pool, value.value);
+    }
+
+  if (pool_elts (pt->pool) >= rm->max_reassemblies[is_ip6])
+    {
+      *error = IP_REASS_ERROR_NO_CONTEXT;
+      return 0;
+    }
+
+  pool_get (pt->pool, r);
+  memset (r, 0, sizeof (*r));
+  clib_memcpy (r->key, key, sizeof (r->key));
+  r->first_bi = ~0;
+  r->last_packet_octet = ~0;
+  r->is_virtual = rm->is_virtual[is_ip6];
+  reass_index = r - pt->pool;
+
+  if (is_ip6)
+    {
+      clib_bihash_kv_48_8_t kv;
+      clib_memcpy (kv.key, key, sizeof (kv.key));
+      kv.value = reass_index;
+      clib_bihash_add_del_48_8 (&pt->hash6, &kv, 1 /* is_add */ );
+    }
+  else
+    {
+      clib_bihash_kv_16_8_t kv;
+      clib_memcpy (kv.key, key, sizeof (kv.key));
+      kv.value = reass_index;
+      clib_bihash_add_del_16_8 (&pt->hash4, &kv, 1 /* is_add */ );
+    }
+
+  r->timer_handle =
+    tw_timer_start_2t_1w_2048sl (&pt->timer_wheel, reass_index, 0,
+				 ip_reass_timer_ticks (rm->timeout_ms
+						       [is_ip6]));
+  return r;
+}
+
+/*
+ * Free a context, the fragments it still holds are queued on drop_bi
+ * with the given error.
+ */
+static void
+ip_reass_free (vlib_main_t * vm, ip_reass_per_thread_t * pt, ip_reass_t * r,
+	       int is_ip6, u32 ** drop_bi, vlib_error_t error)
+{
+  vlib_buffer_t *b;
+  u32 bi;
+
+  if (is_ip6)
+    {
+      clib_bihash_kv_48_8_t kv;
+      clib_memcpy (kv.key, r->key, sizeof (kv.key));
+      clib_bihash_add_del_48_8 (&pt->hash6, &kv, 0 /* is_add */ );
+    }
+  else
+    {
+      clib_bihash_kv_16_8_t kv;
+      clib_memcpy (kv.key, r->key, sizeof (kv.key));
+      clib_bihash_add_del_16_8 (&pt->hash4, &kv, 0 /* is_add */ );
+    }
+
+  if (r->timer_handle != ~0)
+    tw_timer_stop_2t_1w_2048sl (&pt->timer_wheel, r->timer_handle);
+
+  bi = r->first_bi;
+  while (bi != ~0)
+    {
+      b = vlib_get_buffer (vm, bi);
+      b->error = error;
+      vec_add1 (*drop_bi, bi);
+      pt->n_buffers--;
+      bi = vnet_buffer (b)->ip.reass.next_range_bi;
+    }
+
+  pool_put (pt->pool, r);
+}
+
+/* Cut a (possibly chained) buffer to len bytes, dropping the padding */
+static void
+ip_reass_trim_buffer (vlib_main_t * vm, vlib_buffer_t * b, u32 len)
+{
+  vlib_buffer_t *cb = b;
+  u32 left = len;
+
+  while (cb->current_length < left)
+    {
+      left -= cb->current_length;
+      cb = vlib_get_buffer (vm, cb->next_buffer);
+    }
+  cb->current_length = left;
+  if (cb->flags & VLIB_BUFFER_NEXT_PRESENT)
+    {
+      vlib_buffer_free (vm, &cb->next_buffer, 1);
+      cb->flags &= ~VLIB_BUFFER_NEXT_PRESENT;
+    }
+
+  if (b->flags & VLIB_BUFFER_NEXT_PRESENT)
+    {
+      b->total_length_not_including_first_buffer = len - b->current_length;
+      b->flags |= VLIB_BUFFER_TOTAL_LENGTH_VALID;
+    }
+  else
+    b->total_length_not_including_first_buffer = 0;
+}
+
+always_inline vlib_buffer_t *
+ip_reass_last_buffer_in_chain (vlib_main_t * vm, vlib_buffer_t * b)
+{
+  while (b->flags & VLIB_BUFFER_NEXT_PRESENT)
+    b = vlib_get_buffer (vm, b->next_buffer);
+  return b;
+}
+
+static int
+ip_reass_is_complete (vlib_main_t * vm, ip_reass_t * r)
+{
+  vlib_buffer_t *b;
+  u32 bi = r->first_bi;
+  u32 expected = 0;
+
+  while (bi != ~0)
+    {
+      b = vlib_get_buffer (vm, bi);
+      if (vnet_buffer (b)->ip.reass.range_first != expected)
+	return 0;
+      expected = vnet_buffer (b)->ip.reass.range_last;
+      bi = vnet_buffer (b)->ip.reass.next_range_bi;
+    }
+  return expected == r->last_packet_octet;
+}
+
+/*
+ * Chain the fragments of a complete datagram behind the first one and
+ * turn its header into the header of the datagram. Frees the context
+ * and returns the buffer of the datagram, ~0 if it was dropped.
+ */
+static u32
+ip_reass_finalize (vlib_main_t * vm, vlib_node_runtime_t * node,
+		   ip_reass_per_thread_t * pt, ip_reass_t * r, int is_ip6,
+		   u32 ** drop_bi)
+{
+  u32 head_bi = r->first_bi;
+  vlib_buffer_t *head = vlib_get_buffer (vm, head_bi);
+  vlib_buffer_t *last, *b;
+  u32 bi, total_len;
+
+  if (is_ip6)
+    total_len = sizeof (ip6_header_t) + sizeof (ip6_frag_hdr_t) +
+      r->last_packet_octet;
+  else
+    {
+      ip4_header_t *ip = vlib_buffer_get_current (head);
+      total_len = ip4_header_bytes (ip) + r->last_packet_octet;
+      if (total_len > 0xffff)
+	{
+	  ip_reass_free (vm, pt, r, is_ip6, drop_bi,
+			 node->errors[IP_REASS_ERROR_MALFORMED]);
+	  return ~0;
+	}
+    }
+
+  last = ip_reass_last_buffer_in_chain (vm, head);
+  bi = vnet_buffer (head)->ip.reass.next_range_bi;
+  while (bi != ~0)
+    {
+      b = vlib_get_buffer (vm, bi);
+      last->next_buffer = bi;
+      last->flags |= VLIB_BUFFER_NEXT_PRESENT;
+      last = ip_reass_last_buffer_in_chain (vm, b);
+      bi = vnet_buffer (b)->ip.reass.next_range_bi;
+    }
+  head->total_length_not_including_first_buffer =
+    total_len - head->current_length;
+  head->flags |= VLIB_BUFFER_TOTAL_LENGTH_VALID;
+
+  if (is_ip6)
+    {
+      ip6_header_t *ip = vlib_buffer_get_current (head);
+      ip6_frag_hdr_t *frag = (ip6_frag_hdr_t *) (ip + 1);
+
+      /* drop the fragment header, only the fixed header is moved */
+      ip->protocol = frag->next_hdr;
+      ip->payload_length = clib_host_to_net_u16 (r->last_packet_octet);
+      memmove ((u8 *) ip + sizeof (*frag), ip, sizeof (*ip));
+      vlib_buffer_advance (head, sizeof (*frag));
+    }
+  else
+    {
+      ip4_header_t *ip = vlib_buffer_get_current (head);
+
+      ip->length = clib_host_to_net_u16 (total_len);
+      ip->flags_and_fragment_offset &=
+	clib_host_to_net_u16 (IP4_HEADER_FLAG_DONT_FRAGMENT);
+      ip->checksum = ip4_header_checksum (ip);
+    }
+
+  pt->n_buffers -= r->n_fragments;
+  pt->n_reassembled++;
+  r->first_bi = ~0;
+  ip_reass_free (vm, pt, r, is_ip6, drop_bi, 0);
+  return head_bi;
+}
+
+/*
+ * Full reassembly of a fragment. Returns the buffer of the datagram when
+ * it is complete, ~0 when the fragment is held or, with *error set,
+ * has to be dropped.
+ */
+static u32
+ip_reass_full (vlib_main_t * vm, vlib_node_runtime_t * node,
+	       ip_reass_main_t * rm, ip_reass_per_thread_t * pt,
+	       ip_reass_t * r, u32 bi, int is_ip6, u32 first, u32 len,
+	       u32 hdr_len, int more, u32 * error, u32 ** drop_bi)
+{
+  vlib_buffer_t *b = vlib_get_buffer (vm, bi);
+  vlib_buffer_t *cb;
+  u32 last = first + len;
+  u32 prev_bi = ~0, cur_bi = r->first_bi;
+
+  /* a datagram has one end */
+  if ((!more && r->last_packet_octet != ~0 && r->last_packet_octet != last)
+      || (r->last_packet_octet != ~0 && last > r->last_packet_octet))
+    {
+      *error = IP_REASS_ERROR_MALFORMED;
+      return ~0;
+    }
+
+  /* find the place in the sorted list, overlaps drop the datagram */
+  while (cur_bi != ~0)
+    {
+      cb = vlib_get_buffer (vm, cur_bi);
+      if (first == vnet_buffer (cb)->ip.reass.range_first &&
+	  last == vnet_buffer (cb)->ip.reass.range_last)
+	{
+	  *error = IP_REASS_ERROR_DUPLICATE;
+	  return ~0;
+	}
+      if (last <= vnet_buffer (cb)->ip.reass.range_first)
+	break;
+      if (first < vnet_buffer (cb)->ip.reass.range_last)
+	{
+	  ip_reass_free (vm, pt, r, is_ip6, drop_bi,
+			 node->errors[IP_REASS_ERROR_OVERLAP]);
+	  *error = IP_REASS_ERROR_OVERLAP;
+	  return ~0;
+	}
+      prev_bi = cur_bi;
+      cur_bi = vnet_buffer (cb)->ip.reass.next_range_bi;
+    }
+
+  if (r->n_fragments >= rm->max_fragments[is_ip6])
+    {
+      ip_reass_free (vm, pt, r, is_ip6, drop_bi,
+		     node->errors[IP_REASS_ERROR_TOO_MANY_FRAGMENTS]);
+      *error = IP_REASS_ERROR_TOO_MANY_FRAGMENTS;
+      return ~0;
+    }
+  if (pt->n_buffers >= rm->max_buffers[is_ip6])
+    {
+      *error = IP_REASS_ERROR_BUFFER_LIMIT;
+      return ~0;
+    }
+
+  /* keep the header of the first fragment only */
+  ip_reass_trim_buffer (vm, b, hdr_len + len);
+  if (first)
+    vlib_buffer_advance (b, hdr_len);
+
+  vnet_buffer (b)->ip.reass.range_first = first;
+  vnet_buffer (b)->ip.reass.range_last = last;
+  vnet_buffer (b)->ip.reass.next_range_bi = cur_bi;
+  if (prev_bi == ~0)
+    r->first_bi = bi;
+  else
+    vnet_buffer (vlib_get_buffer (vm, prev_bi))->ip.reass.next_range_bi =
+      bi;
+
+  if (!more)
+    r->last_packet_octet = last;
+  r->data_len += len;
+  r->n_fragments++;
+  pt->n_buffers++;
+
+  if (r->data_len != r->last_packet_octet || !ip_reass_is_complete (vm, r))
+    return ~0;
+
+  return ip_reass_finalize (vm, node, pt, r, is_ip6, drop_bi);
+}
+
+/*
+ * Virtual reassembly of a fragment. Returns 1 when the fragment can be
+ * forwarded with the L4 info of its datagram, 0 when it is held or,
+ * with *error set, has to be dropped.
+ */
+static int
+ip_reass_virtual (vlib_main_t * vm, vlib_node_runtime_t * node,
+		  ip_reass_main_t * rm, ip_reass_per_thread_t * pt,
+		  ip_reass_t * r, u32 bi, int is_ip6, u32 first, u32 len,
+		  u32 hdr_len, int more, u32 * error, u32 ** drop_bi,
+		  u32 ** loopback_bi)
+{
+  vlib_buffer_t *b = vlib_get_buffer (vm, bi);
+  vlib_buffer_t *hb;
+  u32 held_bi, n_loopback, i;
+  u8 proto;
+
+  if (first == 0 && !r->l4_info_valid)
+    {
+      if (is_ip6)
+	proto = ((ip6_frag_hdr_t *) ((ip6_header_t *)
+				     vlib_buffer_get_current (b) +
+				     1))->next_hdr;
+      else
+	proto = ((ip4_header_t *) vlib_buffer_get_current (b))->protocol;
+
+      if (!ip_reass_get_l4_ports (b, hdr_len, proto, &r->l4_src_port,
+				  &r->l4_dst_port))
+	{
+	  ip_reass_free (vm, pt, r, is_ip6, drop_bi,
+			 node->errors[IP_REASS_ERROR_MALFORMED]);
+	  *error = IP_REASS_ERROR_MALFORMED;
+	  return 0;
+	}
+      r->ip_proto = proto;
+      r->l4_info_valid = 1;
+
+      /* run the held fragments through the node again, in arrival order */
+      n_loopback = vec_len (*loopback_bi);
+      held_bi = r->first_bi;
+      while (held_bi != ~0)
+	{
+	  hb = vlib_get_buffer (vm, held_bi);
+	  vec_add1 (*loopback_bi, held_bi);
+	  held_bi = vnet_buffer (hb)->ip.reass.next_range_bi;
+	}
+      for (i = 0; i < r->n_fragments / 2; i++)
+	{
+	  held_bi = (*loopback_bi)[n_loopback + i];
+	  (*loopback_bi)[n_loopback + i] =
+	    (*loopback_bi)[vec_len (*loopback_bi) - 1 - i];
+	  (*loopback_bi)[vec_len (*loopback_bi) - 1 - i] = held_bi;
+	}
+      pt->n_buffers -= r->n_fragments;
+      r->n_fragments = 0;
+      r->first_bi = ~0;
+    }
+
+  if (!r->l4_info_valid)
+    {
+      if (r->n_fragments >= rm->max_fragments[is_ip6])
+	{
+	  ip_reass_free (vm, pt, r, is_ip6, drop_bi,
+			 node->errors[IP_REASS_ERROR_TOO_MANY_FRAGMENTS]);
+	  *error = IP_REASS_ERROR_TOO_MANY_FRAGMENTS;
+	  return 0;
+	}
+      if (pt->n_buffers >= rm->max_buffers[is_ip6])
+	{
+	  *error = IP_REASS_ERROR_BUFFER_LIMIT;
+	  return 0;
+	}
+      vnet_buffer (b)->ip.reass.next_range_bi = r->first_bi;
+      r->first_bi = bi;
+      r->n_fragments++;
+      pt->n_buffers++;
+      return 0;
+    }
+
+  vnet_buffer (b)->ip.reass.l4_src_port = r->l4_src_port;
+  vnet_buffer (b)->ip.reass.l4_dst_port = r->l4_dst_port;
+  vnet_buffer (b)->ip.reass.ip_proto = r->ip_proto;
+  vnet_buffer (b)->ip.reass.is_non_first_fragment = (first != 0);
+  b->flags |= VNET_BUFFER_L4_INFO_VALID;
+
+  /* the context lives until the whole payload went through */
+  if (!more)
+    r->last_packet_octet = first + len;
+  r->data_len += len;
+  if (r->last_packet_octet != ~0 && r->data_len >= r->last_packet_octet)
+    ip_reass_free (vm, pt, r, is_ip6, drop_bi, 0);
+  return 1;
+}
+
+static void
+ip_reass_send_to_drop (vlib_main_t * vm, vlib_node_runtime_t * node,
+		       u32 * bis)
+{
+  u32 n_left_from, *from, next_index, *to_next, n_left_to_next;
+
+  from = bis;
+  n_left_from = vec_len (bis);
+  next_index = IP_REASS_NEXT_DROP;
+  while (n_left_from > 0)
+    {
+      vlib_get_next_frame (vm, node, next_index, to_next, n_left_to_next);
+      while (n_left_from > 0 && n_left_to_next > 0)
+	{
+	  to_next[0] = from[0];
+	  from += 1;
+	  n_left_from -= 1;
+	  to_next += 1;
+	  n_left_to_next -= 1;
+	}
+      vlib_put_next_frame (vm, node, next_index, n_left_to_next);
+    }
+}
+
+always_inline uword
+ip_reass_inline (vlib_main_t * vm, vlib_node_runtime_t * node,
+		 vlib_frame_t * frame, int is_ip6)
+{
+  ip_reass_main_t *rm = &ip_reass_main;
+  ip_reass_per_thread_t *pt =
+    vec_elt_at_index (rm->per_thread_data[is_ip6], os_get_cpu_number ());
+  u32 n_left_from, *from, next_index, *to_next, n_left_to_next;
+  u32 *drop_bi = 0, *loopback_bi = 0, *pending_bi = 0, *expired;
+  u32 n_reassembled = 0, n_held = 0;
+  ip_reass_t *r;
+
+  /* drop the datagrams which timed out */
+  tw_timer_expire_timers_2t_1w_2048sl (&pt->timer_wheel, vlib_time_now (vm));
+  vec_foreach (expired, pt->expired)
+  {
+    if (pool_is_free_index (pt->pool, *expired))
+      continue;
+    r = pool_elt_at_index (pt->pool, *expired);
+    r->timer_handle = ~0;
+    ip_reass_free (vm, pt, r, is_ip6, &drop_bi,
+		   node->errors[IP_REASS_ERROR_TIMEOUT]);
+    pt->n_timed_out++;
+  }
+  vec_reset_length (pt->expired);
+
+  from = vlib_frame_vector_args (frame);
+  n_left_from = frame->n_vectors;
+  next_index = node->cached_next_index;
+
+  while (n_left_from > 0)
+    {
+      vlib_get_next_frame (vm, node, next_index, to_next, n_left_to_next);
+
+      while (n_left_from > 0 && n_left_to_next > 0)
+	{
+	  u32 bi0, out_bi0, next0;
+	  u32 first0 = 0, len0 = 0, hdr_len0 = 0;
+	  u32 error0 = IP_REASS_ERROR_NONE;
+	  u8 action0 = IP_REASS_ACTION_PASS;
+	  vlib_buffer_t *b0, *out_b0;
+	  ip_reass_t *r0 = 0;
+	  u64 key0[6];
+	  int more0 = 0;
+
+	  bi0 = out_bi0 = from[0];
+	  from += 1;
+	  n_left_from -= 1;
+	  b0 = vlib_get_buffer (vm, bi0);
+
+	  if (PREDICT_TRUE (!ip_reass_is_fragment (b0, is_ip6)))
+	    {
+	      if (rm->is_virtual[is_ip6])
+		ip_reass_set_l4_info_unfragmented (b0, is_ip6);
+	    }
+	  else if (!ip_reass_fragment_info (vm, b0, is_ip6, &first0, &len0,
+					    &hdr_len0, &more0))
+	    error0 = IP_REASS_ERROR_MALFORMED;
+	  else
+	    {
+	      ip_reass_make_key (b0, is_ip6, key0);
+	      r0 = ip_reass_find_or_create (rm, pt, is_ip6, key0, &error0);
+	      if (r0 && r0->is_virtual)
+		{
+		  action0 = IP_REASS_ACTION_FORWARD;
+		  if (!ip_reass_virtual (vm, node, rm, pt, r0, bi0, is_ip6,
+					 first0, len0, hdr_len0, more0,
+					 &error0, &drop_bi, &loopback_bi))
+		    out_bi0 = ~0;
+		}
+	      else if (r0)
+		{
+		  action0 = IP_REASS_ACTION_REASSEMBLED;
+		  out_bi0 = ip_reass_full (vm, node, rm, pt, r0, bi0, is_ip6,
+					   first0, len0, hdr_len0, more0,
+					   &error0, &drop_bi);
+		  n_reassembled += (out_bi0 != ~0);
+		}
+	    }
+
+	  if (error0 != IP_REASS_ERROR_NONE)
+	    {
+	      action0 = IP_REASS_ACTION_DROP;
+	      out_bi0 = bi0;
+	    }
+	  else if (out_bi0 == ~0)
+	    {
+	      action0 = IP_REASS_ACTION_HOLD;
+	      n_held++;
+	    }
+
+	  if (PREDICT_FALSE (b0->flags & VLIB_BUFFER_IS_TRACED))
+	    {
+	      ip_reass_trace_t *t = vlib_add_trace (vm, node, b0, sizeof (*t));
+	      memset (t, 0, sizeof (*t));
+	      t->action = action0;
+	      if (r0 && action0 != IP_REASS_ACTION_DROP)
+		{
+		  t->reass_index = r0 - pt->pool;
+		  t->range_first = first0;
+		  t->range_last = first0 + len0;
+		}
+	      if (action0 == IP_REASS_ACTION_FORWARD)
+		{
+		  t->l4_src_port = vnet_buffer (b0)->ip.reass.l4_src_port;
+		  t->l4_dst_port = vnet_buffer (b0)->ip.reass.l4_dst_port;
+		}
+	    }
+
+	  if (out_bi0 != ~0)
+	    {
+	      out_b0 = vlib_get_buffer (vm, out_bi0);
+	      if (error0 != IP_REASS_ERROR_NONE)
+		{
+		  next0 = IP_REASS_NEXT_DROP;
+		  out_b0->error = node->errors[error0];
+		}
+	      else
+		vnet_feature_next (vnet_buffer (out_b0)->sw_if_index[VLIB_RX],
+				   &next0, out_b0);
+
+	      to_next[0] = out_bi0;
+	      to_next += 1;
+	      n_left_to_next -= 1;
+	      vlib_validate_buffer_enqueue_x1 (vm, node, next_index, to_next,
+					       n_left_to_next, out_bi0,
+					       next0);
+	    }
+
+	  /*
+	   * Held fragments released by a first fragment go round again.
+	   * They are taken from their own vector, the frame is not ours
+	   * to write; fragments released meanwhile go to a new one.
+	   */
+	  if (n_left_from == 0 && vec_len (loopback_bi))
+	    {
+	      vec_free (pending_bi);
+	      pending_bi = loopback_bi;
+	      loopback_bi = 0;
+	      from = pending_bi;
+	      n_left_from = vec_len (pending_bi);
+	    }
+	}
+      vlib_put_next_frame (vm, node, next_index, n_left_to_next);
+    }
+
+  ip_reass_send_to_drop (vm, node, drop_bi);
+
+  vlib_node_increment_counter (vm, node->node_index,
+			       IP_REASS_ERROR_REASSEMBLED, n_reassembled);
+  vlib_node_increment_counter (vm, node->node_index,
+			       IP_REASS_ERROR_FRAGMENT_HELD, n_held);
+  vec_free (drop_bi);
+  vec_free (loopback_bi);
+  vec_free (pending_bi);
+  return frame->n_vectors;
+}
+
+static uword
+ip4_reass (vlib_main_t * vm, vlib_node_runtime_t * node, vlib_frame_t * frame)
+{
+  return ip_reass_inline (vm, node, frame, 0 /* is_ip6 */ );
+}
+
+static uword
+ip6_reass (vlib_main_t * vm, vlib_node_runtime_t * node, vlib_frame_t * frame)
+{
+  return ip_reass_inline (vm, node, frame, 1 /* is_ip6 */ );
+}
+
+/* *INDENT-OFF* */
+VLIB_REGISTER_NODE (ip4_reass_node) = {
+  .function = ip4_reass,
+  .name = "ip4-reassembly",
+  .vector_size = sizeof (u32),
+  .format_trace = format_ip_reass_trace,
+  .type = VLIB_NODE_TYPE_INTERNAL,
+
+  .n_errors = IP_REASS_N_ERROR,
+  .error_strings = ip_reass_error_strings,
+
+  .n_next_nodes = IP_REASS_N_NEXT,
+  .next_nodes = {
+    [IP_REASS_NEXT_DROP] = "ip4-drop",
+  },
+};
+
+VLIB_NODE_FUNCTION_MULTIARCH (ip4_reass_node, ip4_reass);
+
+VNET_FEATURE_INIT (ip4_reass_feature, static) = {
+  .arc_name = "ip4-unicast",
+  .node_name = "ip4-reassembly",
+  .runs_before = VNET_FEATURES ("ip4-flow-classify"),
+};
+
+VLIB_REGISTER_NODE (ip6_reass_node) = {
+  .function = ip6_reass,
+  .name = "ip6-reassembly",
+  .vector_size = sizeof (u32),
+  .format_trace = format_ip_reass_trace,
+  .type = VLIB_NODE_TYPE_INTERNAL,
+
+  .n_errors = IP_REASS_N_ERROR,
+  .error_strings = ip_reass_error_strings,
+
+  .n_next_nodes = IP_REASS_N_NEXT,
+  .next_nodes = {
+    [IP_REASS_NEXT_DROP] = "ip6-drop",
+  },
+};
+
+VLIB_NODE_FUNCTION_MULTIARCH (ip6_reass_node, ip6_reass);
+
+VNET_FEATURE_INIT (ip6_reass_feature, static) = {
+  .arc_name = "ip6-unicast",
+  .node_name = "ip6-reassembly",
+  .runs_before = VNET_FEATURES ("ip6-flow-classify"),
+};
+/* *INDENT-ON* */
+
+/*
+ * The hash only ever holds max-reassemblies contexts, give it a few
+ * times their key/value size for the bucket splits.
+ */
+static uword
+ip_reass_hash_memory_size (ip_reass_main_t * rm, int is_ip6)
+{
+  uword kv_size = is_ip6 ? sizeof (clib_bihash_kv_48_8_t) :
+    sizeof (clib_bihash_kv_16_8_t);
+
+  return clib_max ((uword) rm->max_reassemblies[is_ip6] * kv_size *
+		   IP_REASS_HASH_MEMORY_FACTOR, IP_REASS_HASH_MEMORY_MIN);
+}
+
+static void
+ip_reass_init_per_thread_data (ip_reass_main_t * rm, int is_ip6)
+{
+  vlib_thread_main_t *tm = vlib_get_thread_main ();
+  ip_reass_per_thread_t *pt;
+  u8 *name;
+
+  if (vec_len (rm->per_thread_data[is_ip6]))
+    return;
+
+  vec_validate_aligned (rm->per_thread_data[is_ip6], tm->n_vlib_mains - 1,
+			CLIB_CACHE_LINE_BYTES);
+  vec_foreach (pt, rm->per_thread_data[is_ip6])
+  {
+    name = format (0, "ip%d reassembly %d%c", is_ip6 ? 6 : 4,
+		   pt - rm->per_thread_data[is_ip6], 0);
+    if (is_ip6)
+      clib_bihash_init_48_8 (&pt->hash6, (char *) name,
+			     rm->max_reassemblies[is_ip6],
+			     ip_reass_hash_memory_size (rm, is_ip6));
+    else
+      clib_bihash_init_16_8 (&pt->hash4, (char *) name,
+			     rm->max_reassemblies[is_ip6],
+			     ip_reass_hash_memory_size (rm, is_ip6));
+    tw_timer_wheel_init_2t_1w_2048sl (&pt->timer_wheel,
+				      is_ip6 ?
+				      ip6_reass_expired_timer_callback :
+				      ip4_reass_expired_timer_callback,
+				      IP_REASS_TIMER_INTERVAL,
+				      IP_REASS_MAX_EXPIRATIONS_PER_RUN);
+    pt->timer_wheel.last_run_time = vlib_time_now (rm->vlib_main);
+  }
+}
+
+int
+ip_reass_enable_disable (u32 sw_if_index, u8 is_ip6, int enable_disable)
+{
+  ip_reass_main_t *rm = &ip_reass_main;
+
+  if (enable_disable)
+    ip_reass_init_per_thread_data (rm, is_ip6);
+
+  return vnet_feature_enable_disable (is_ip6 ? "ip6-unicast" : "ip4-unicast",
+				      is_ip6 ? "ip6-reassembly" :
+				      "ip4-reassembly", sw_if_index,
+				      enable_disable, 0, 0);
+}
+
+clib_error_t *
+ip_reass_set (u8 is_ip6, u32 timeout_ms, u32 max_reassemblies,
+	      u32 max_fragments, u32 max_buffers, u8 is_virtual)
+{
+  ip_reass_main_t *rm = &ip_reass_main;
+
+  if (timeout_ms < IP_REASS_TIMER_INTERVAL * 1000 ||
+      timeout_ms > IP_REASS_TIMER_MAX_TICKS * IP_REASS_TIMER_INTERVAL * 1000)
+    return clib_error_return (0, "timeout must be between %d and %d ms",
+			      (u32) (IP_REASS_TIMER_INTERVAL * 1000),
+			      (u32) (IP_REASS_TIMER_MAX_TICKS *
+				     IP_REASS_TIMER_INTERVAL * 1000));
+  if (max_reassemblies == 0 || max_fragments == 0 || max_buffers == 0)
+    return clib_error_return (0, "limits must not be zero");
+  if (max_fragments > 0xffff)
+    return clib_error_return (0, "max-fragments must be below 65536");
+  /* the hash memory was sized for the limit when it was allocated */
+  if (vec_len (rm->per_thread_data[is_ip6]) &&
+      max_reassemblies > rm->max_reassemblies[is_ip6])
+    return clib_error_return (0, "max-reassemblies can't be raised once "
+			      "reassembly was enabled");
+
+  /* contexts in flight keep the mode they were created in */
+  rm->timeout_ms[is_ip6] = timeout_ms;
+  rm->max_reassemblies[is_ip6] = max_reassemblies;
+  rm->max_fragments[is_ip6] = max_fragments;
+  rm->max_buffers[is_ip6] = max_buffers;
+  rm->is_virtual[is_ip6] = is_virtual;
+  return 0;
+}
+
+static clib_error_t *
+ip_reass_init (vlib_main_t * vm)
+{
+  ip_reass_main_t *rm = &ip_reass_main;
+  int is_ip6;
+
+  rm->vlib_main = vm;
+  for (is_ip6 = 0; is_ip6 < 2; is_ip6++)
+    {
+      rm->timeout_ms[is_ip6] = IP_REASS_TIMEOUT_DEFAULT_MS;
+      rm->max_reassemblies[is_ip6] = IP_REASS_MAX_REASSEMBLIES_DEFAULT;
+      rm->max_fragments[is_ip6] = IP_REASS_MAX_FRAGMENTS_DEFAULT;
+      rm->max_buffers[is_ip6] = IP_REASS_MAX_BUFFERS_DEFAULT;
+    }
+  return 0;
+}
+
+VLIB_INIT_FUNCTION (ip_reass_init);
+
+static clib_error_t *
+set_ip_reass_command_fn (vlib_main_t * vm, unformat_input_t * input,
+			 vlib_cli_command_t * cmd)
+{
+  ip_reass_main_t *rm = &ip_reass_main;
+  unformat_input_t _line_input, *line_input = &_line_input;
+  clib_error_t *error = 0;
+  u32 timeout_ms = ~0, max_reassemblies = ~0, max_fragments = ~0;
+  u32 max_buffers = ~0;
+  int is_virtual = -1;
+  u8 is_ip6 = 0;
+
+  if (!unformat_user (input, unformat_line_input, line_input))
+    return 0;
+
+  while (unformat_check_input (line_input) != UNFORMAT_END_OF_INPUT)
+    {
+      if (unformat (line_input, "ip4"))
+	is_ip6 = 0;
+      else if (unformat (line_input, "ip6"))
+	is_ip6 = 1;
+      else if (unformat (line_input, "timeout %u", &timeout_ms))
+	;
+      else if (unformat (line_input, "max-reassemblies %u",
+			 &max_reassemblies))
+	;
+      else if (unformat (line_input, "max-fragments %u", &max_fragments))
+	;
+      else if (unformat (line_input, "max-buffers %u", &max_buffers))
+	;
+      else if (unformat (line_input, "virtual"))
+	is_virtual = 1;
+      else if (unformat (line_input, "full"))
+	is_virtual = 0;
+      else
+	{
+	  error = unformat_parse_error (line_input);
+	  goto done;
+	}
+    }
+
+  error = ip_reass_set (is_ip6,
+			timeout_ms != ~0 ? timeout_ms :
+			rm->timeout_ms[is_ip6],
+			max_reassemblies != ~0 ? max_reassemblies :
+			rm->max_reassemblies[is_ip6],
+			max_fragments != ~0 ? max_fragments :
+			rm->max_fragments[is_ip6],
+			max_buffers != ~0 ? max_buffers :
+			rm->max_buffers[is_ip6],
+			is_virtual >= 0 ? is_virtual : rm->is_virtual[is_ip6]);
+
+done:
+  unformat_free (line_input);
+  return error;
+}
+
+/*?
+ * Set the reassembly parameters of IPv4 or IPv6. The limits apply per
+ * worker, except max-fragments which limits a single datagram. The
+ * default mode is full reassembly, virtual reassembly only learns the
+ * L4 ports of a datagram and forwards the fragments unchanged.
+ *
+ * @cliexpar
+ * @cliexcmd{set ip reassembly ip4 timeout 500 max-reassemblies 4096 virtual}
+?*/
+/* *INDENT-OFF* */
+VLIB_CLI_COMMAND (set_ip_reass_command, static) = {
+  .path = "set ip reassembly",
+  .short_help = "set ip reassembly [ip4|ip6] [timeout <msec>] "
+    "[max-reassemblies <n>] [max-fragments <n>] [max-buffers <n>] "
+    "[full|virtual]",
+  .function = set_ip_reass_command_fn,
+};
+/* *INDENT-ON* */
+
+static clib_error_t *
+set_interface_ip_reass_command_fn (vlib_main_t * vm,
+				   unformat_input_t * input,
+				   vlib_cli_command_t * cmd)
+{
+  unformat_input_t _line_input, *line_input = &_line_input;
+  vnet_main_t *vnm = vnet_get_main ();
+  clib_error_t *error = 0;
+  u32 sw_if_index = ~0;
+  int enable_disable = 1;
+  u8 is_ip6 = 0;
+  int rv;
+
+  if (!unformat_user (input, unformat_line_input, line_input))
+    return 0;
+
+  while (unformat_check_input (line_input) != UNFORMAT_END_OF_INPUT)
+    {
+      if (unformat_user
+	  (line_input, unformat_vnet_sw_interface, vnm, &sw_if_index))
+	;
+      else if (unformat (line_input, "ip4"))
+	is_ip6 = 0;
+      else if (unformat (line_input, "ip6"))
+	is_ip6 = 1;
+      else if (unformat (line_input, "disable"))
+	enable_disable = 0;
+      else
+	{
+	  error = unformat_parse_error (line_input);
+	  goto done;
+	}
+    }
+
+  if (~0 == sw_if_index)
+    {
+      error = clib_error_return (0, "unknown interface `%U'",
+				 format_unformat_error, line_input);
+      goto done;
+    }
+
+  rv = ip_reass_enable_disable (sw_if_index, is_ip6, enable_disable);
+  if (rv)
+    error = clib_error_return (0, "feature enable/disable failed, rv %d",
+			       rv);
+
+done:
+  unformat_free (line_input);
+  return error;
+}
+
+/*?
+ * Enable or disable IPv4 or IPv6 reassembly of the packets received on
+ * an interface.
+ *
+ * @cliexpar
+ * Example of how to enable IPv6 reassembly on an interface:
+ * @cliexcmd{set interface ip reassembly GigabitEthernet2/0/0 ip6}
+?*/
+/* *INDENT-OFF* */
+VLIB_CLI_COMMAND (set_interface_ip_reass_command, static) = {
+  .path = "set interface ip reassembly",
+  .short_help = "set interface ip reassembly <interface> [ip4|ip6] "
+    "[disable]",
+  .function = set_interface_ip_reass_command_fn,
+};
+/* *INDENT-ON* */
+
+static u8 *
+format_ip_reass_config (u8 * s, va_list * args)
+{
+  ip_reass_main_t *rm = &ip_reass_main;
+  int is_ip6 = va_arg (*args, int);
+  ip_reass_per_thread_t *pt;
+
+  s = format (s, "IPv%d %s reassembly: timeout %dms, per worker %d "
+	      "reassemblies %d buffers, %d fragments per datagram\n",
+	      is_ip6 ? 6 : 4, rm->is_virtual[is_ip6] ? "virtual" : "full",
+	      rm->timeout_ms[is_ip6], rm->max_reassemblies[is_ip6],
+	      rm->max_buffers[is_ip6], rm->max_fragments[is_ip6]);
+  vec_foreach (pt, rm->per_thread_data[is_ip6])
+  {
+    s = format (s, "  thread %d: %d reassemblies, %d buffers held, "
+		"%lld reassembled, %lld timed out\n",
+		pt - rm->per_thread_data[is_ip6], pool_elts (pt->pool),
+		pt->n_buffers, pt->n_reassembled, pt->n_timed_out);
+  }
+  return s;
+}
+
+static clib_error_t *
+show_ip_reass_command_fn (vlib_main_t * vm, unformat_input_t * input,
+			  vlib_cli_command_t * cmd)
+{
+  vlib_cli_output (vm, "%U", format_ip_reass_config, 0 /* is_ip6 */ );
+  vlib_cli_output (vm, "%U", format_ip_reass_config, 1 /* is_ip6 */ );
+  return 0;
+}
+
+/*?
+ * Display the reassembly parameters and the per worker state.
+ *
+ * @cliexpar
+ * @cliexcmd{show ip reassembly}
+?*/
+/* *INDENT-OFF* */
+VLIB_CLI_COMMAND (show_ip_reass_command, static) = {
+  .path = "show ip reassembly",
+  .short_help = "show ip reassembly",
+  .function = show_ip_reass_command_fn,
+};
+/* *INDENT-ON* */
+
+/*
+ * fd.io coding-style-patch-verification: ON
+ *
+ * Local Variables:
+ * eval: (c-set-style "gnu")
+ * End:
+ */
@@ -0,0 +1,153 @@
+/*
+ * Copyright (c) 2017 Cisco and/or its affiliates.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/**
+ * @file
+ * @brief IPv4 and IPv6 reassembly.
+ *
+ * The ip4-reassembly and ip6-reassembly features sit at the start of the
+ * ip4-unicast / ip6-unicast arcs. Each worker owns its reassembly
+ * contexts: a pool, a bihash keyed by the addresses, the fragment id
+ * (plus the protocol for IPv4) and the FIB, and a timer wheel which drops
+ * incomplete datagrams after the timeout.
+ *
+ * Full reassembly holds the fragments, sorted by offset and linked
+ * through the buffer opaque, until the datagram is complete. The
+ * fragment buffers are then chained behind the first fragment, nothing
+ * is copied, and the datagram continues on the arc. Overlapping
+ * fragments drop the whole datagram.
+ *
+ * Virtual reassembly only learns the L4 ports from the first fragment
+ * and forwards every fragment on its own, with the ports in
+ * vnet_buffer(b)->ip.reass, flagged with VNET_BUFFER_L4_INFO_VALID.
+ * Fragments arriving before the first one are held until it shows up.
+ * The stateful input ACLs use it to match non-first fragments on their
+ * ports without reassembling the packet.
+ *
+ * Memory is bounded per worker by the number of contexts and of held
+ * buffers, and per datagram by the number of fragments.
+ *
+ * IPv6 fragments are only handled when the fragment header directly
+ * follows the IPv6 header, other fragments pass unchanged.
+ */
+
+#ifndef included_ip_reassembly_h
+#define included_ip_reassembly_h
+
+#include <vnet/vnet.h>
+#include <vnet/ip/ip.h>
+#include <vppinfra/bihash_16_8.h>
+#include <vppinfra/bihash_48_8.h>
+#include <vppinfra/tw_timer_2t_1w_2048sl.h>
+
+#define IP_REASS_TIMEOUT_DEFAULT_MS 200
+#define IP_REASS_MAX_REASSEMBLIES_DEFAULT 1024
+#define IP_REASS_MAX_FRAGMENTS_DEFAULT 16
+#define IP_REASS_MAX_BUFFERS_DEFAULT 2048
+
+/* per worker hash memory, per max-reassemblies key/value */
+#define IP_REASS_HASH_MEMORY_FACTOR 8
+#define IP_REASS_HASH_MEMORY_MIN (1 << 20)
+#define IP_REASS_MAX_EXPIRATIONS_PER_RUN 256
+/* timer wheel: 10ms ticks, a single ring of 2048 slots */
+#define IP_REASS_TIMER_INTERVAL 0.01
+#define IP_REASS_TIMER_MAX_TICKS 2047
+
+typedef struct
+{
+  /* hash key, 2 u64s for IPv4, 6 for IPv6 */
+  u64 key[6];
+  /* held fragments, sorted by offset, linked by ip.reass.next_range_bi */
+  u32 first_bi;
+  /* payload bytes received */
+  u32 data_len;
+  /* payload length of the datagram, ~0 until the last fragment arrived */
+  u32 last_packet_octet;
+  u32 timer_handle;
+  u16 n_fragments;
+  /* mode the context was created in */
+  u8 is_virtual;
+  /* virtual reassembly: L4 info from the first fragment */
+  u8 l4_info_valid;
+  u8 ip_proto;
+  u16 l4_src_port;
+  u16 l4_dst_port;
+} ip_reass_t;
+
+typedef struct
+{
+  CLIB_CACHE_LINE_ALIGN_MARK (cacheline0);
+  ip_reass_t *pool;
+  /* IPv4 contexts are keyed in hash4, IPv6 ones in hash6 */
+  clib_bihash_16_8_t hash4;
+  clib_bihash_48_8_t hash6;
+  tw_timer_wheel_2t_1w_2048sl_t timer_wheel;
+  /* contexts expired by the timer wheel, freed by the node */
+  u32 *expired;
+  /* buffers held by all contexts */
+  u32 n_buffers;
+
+  /* Counters */
+  u64 n_reassembled;
+  u64 n_timed_out;
+} ip_reass_per_thread_t;
+
+typedef struct
+{
+  /* configuration, per address family */
+  u32 timeout_ms[2];
+  u32 max_reassemblies[2];
+  u32 max_fragments[2];
+  u32 max_buffers[2];
+  u8 is_virtual[2];
+
+  /* per-thread data, per address family, created on the first enable */
+  ip_reass_per_thread_t *per_thread_data[2];
+
+  vlib_main_t *vlib_main;
+} ip_reass_main_t;
+
+extern ip_reass_main_t ip_reass_main;
+
+extern vlib_node_registration_t ip4_reass_node;
+extern vlib_node_registration_t ip6_reass_node;
+
+/** \brief Enable or disable reassembly on an interface.
+    @param sw_if_index interface
+    @param is_ip6 IPv6 if non-zero, IPv4 otherwise
+    @param enable_disable enable if non-zero
+*/
+int ip_reass_enable_disable (u32 sw_if_index, u8 is_ip6, int enable_disable);
+
+/** \brief Set the reassembly parameters of an address family.
+    @param is_ip6 IPv6 if non-zero, IPv4 otherwise
+    @param timeout_ms lifetime of an incomplete datagram
+    @param max_reassemblies concurrent datagrams per worker
+    @param max_fragments fragments per datagram
+    @param max_buffers buffers held per worker
+    @param is_virtual virtual reassembly if non-zero, full otherwise
+*/
+clib_error_t *ip_reass_set (u8 is_ip6, u32 timeout_ms, u32 max_reassemblies,
+			    u32 max_fragments, u32 max_buffers,
+			    u8 is_virtual);
+
+#endif /* included_ip_reassembly_h */
+
+/*
+ * fd.io coding-style-patch-verification: ON
+ *
+ * Local Variables:
+ * eval: (c-set-style "gnu")
+ * End:
+ */
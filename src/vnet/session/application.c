@@ -47,12 +47,17 @@ application_api_queue_is_full (application_t * app)
 static void
 application_table_add (application_t * app)
 {
+  /* Built-in apps are not api clients, there may be several of them */
+  if (app->api_client_index == ~0)
+    return;
   hash_set (app_by_api_client_index, app->api_client_index, app->index);
 }
 
 static void
 application_table_del (application_t * app)
 {
+  if (app->api_client_index == ~0)
+    return;
   hash_unset (app_by_api_client_index, app->api_client_index);
 }
 
@@ -75,6 +75,13 @@ typedef struct _application
   /* Stream server mode: accept or connect */
   u8 mode;
 
+  /** Transport congestion control, as per SESSION_OPTIONS_CC_ALGO */
+  u8 cc_algo;
+
+  /** Threads a shared listener takes connections from, as per
+   *  SESSION_OPTIONS_LISTEN_THREADS */
+  u64 listen_thread_mask;
+
   u32 session_manager_index;
 
   /*
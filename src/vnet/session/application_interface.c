@@ -93,7 +93,11 @@ vnet_bind_i (u32 api_client_index, ip46_address_t * ip46, u16 port_host_order,
 				    clib_host_to_net_u16 (port_host_order),
 				    sst);
 
-  if (listener)
+  /* Listeners can only be shared if all parties agree */
+  if (listener
+      && (!(options[SESSION_OPTIONS_FLAGS] & SESSION_OPTIONS_FLAGS_REUSEPORT)
+	  || !(application_get (listener->app_index)->flags
+	       & SESSION_OPTIONS_FLAGS_REUSEPORT)))
     return VNET_API_ERROR_ADDRESS_IN_USE;
 
   if (application_lookup (api_client_index))
@@ -106,9 +110,16 @@ vnet_bind_i (u32 api_client_index, ip46_address_t * ip46, u16 port_host_order,
   if (!ip_is_zero (ip46, is_ip4) && !ip_is_local (ip46, is_ip4))
     return VNET_API_ERROR_INVALID_VALUE;
 
+  /* Only built-in servers can get at vlib buffers */
+  if ((options[SESSION_OPTIONS_FLAGS] & SESSION_OPTIONS_FLAGS_ZERO_COPY)
+      && api_client_index != ~0)
+    return VNET_API_ERROR_INVALID_VALUE;
+
   /* Allocate and initialize stream server */
   server = application_new (APP_SERVER, sst, api_client_index,
 			    options[SESSION_OPTIONS_FLAGS], cb_fns);
+  server->cc_algo = options[SESSION_OPTIONS_CC_ALGO];
+  server->listen_thread_mask = options[SESSION_OPTIONS_LISTEN_THREADS];
 
   application_server_init (server, options[SESSION_OPTIONS_SEGMENT_SIZE],
 			   options[SESSION_OPTIONS_ADD_SEGMENT_SIZE],
@@ -116,8 +127,11 @@ vnet_bind_i (u32 api_client_index, ip46_address_t * ip46, u16 port_host_order,
 			   options[SESSION_OPTIONS_TX_FIFO_SIZE],
 			   &segment_name);
 
-  /* Setup listen path down to transport */
-  stream_session_start_listen (server->index, ip46, port_host_order);
+  /* Setup listen path down to transport, or join the existing one */
+  if (listener)
+    stream_session_share_listen (server->index, listener);
+  else
+    stream_session_start_listen (server->index, ip46, port_host_order);
 
   /*
    * Return values
@@ -131,6 +145,14 @@ vnet_bind_i (u32 api_client_index, ip46_address_t * ip46, u16 port_host_order,
   return 0;
 }
 
+static void
+vnet_unbind_server (application_t * server)
+{
+  /* Clear the listener */
+  stream_session_stop_listen (server->index);
+  application_del (server);
+}
+
 int
 vnet_unbind_i (u32 api_client_index)
 {
@@ -143,10 +165,7 @@ vnet_unbind_i (u32 api_client_index)
   if (!server)
     return VNET_API_ERROR_INVALID_VALUE_2;
 
-  /* Clear the listener */
-  stream_session_stop_listen (server->index);
-  application_del (server);
-
+  vnet_unbind_server (server);
   return 0;
 }
 
@@ -182,6 +201,7 @@ vnet_connect_i (u32 api_client_index, u32 api_context, session_type_t sst,
 			 options[SESSION_OPTIONS_FLAGS], cb_fns);
 
   app->api_context = api_context;
+  app->cc_algo = options[SESSION_OPTIONS_CC_ALGO];
 
   /*
    * Not connecting to a local server. Create regular session
@@ -333,6 +353,13 @@ vnet_unbind_uri (char *uri, u32 api_client_index)
     {
       ASSERT (vl_api_client_index_to_registration (api_client_index));
     }
+  else
+    {
+      /* Built-in servers are only known by their listener. If the port
+       * is shared, the one that owns the listener leaves the group */
+      vnet_unbind_server (application_get (listener->app_index));
+      return 0;
+    }
 
   return vnet_unbind_i (api_client_index);
 }
@@ -98,6 +98,8 @@ typedef enum
   SESSION_OPTIONS_RX_FIFO_SIZE,
   SESSION_OPTIONS_TX_FIFO_SIZE,
   SESSION_OPTIONS_ACCEPT_COOKIE,
+  SESSION_OPTIONS_CC_ALGO,
+  SESSION_OPTIONS_LISTEN_THREADS,
   SESSION_OPTIONS_N_OPTIONS
 } session_options_index_t;
 
@@ -107,6 +109,19 @@ typedef enum
 /** Server wants vpp to add segments when out of memory for fifos */
 #define SESSION_OPTIONS_FLAGS_ADD_SEGMENT   (1<<1)
 
+/** Built-in server takes rx data in the vlib buffers it was received in,
+ *  see stream_session_rx_zero_copy_next () */
+#define SESSION_OPTIONS_FLAGS_ZERO_COPY	(1<<2)
+
+/** Server shares its ip/port with other servers that set the flag.
+ *  Connections received by a thread go to the servers that listed it in
+ *  their SESSION_OPTIONS_LISTEN_THREADS bitmap, 0 means all threads. */
+#define SESSION_OPTIONS_FLAGS_REUSEPORT	(1<<3)
+
+/** Transport congestion control algorithm is passed as algorithm + 1,
+ *  0 leaves the choice to the transport (e.g., tcp_cc_algorithm_type_e) */
+#define SESSION_OPTIONS_CC_ALGO_DEFAULT 0
+
 #define VNET_CONNECT_REDIRECTED	123
 
 int vnet_bind_uri (vnet_bind_args_t *);
@@ -23,7 +23,6 @@
 #include <vppinfra/hash.h>
 #include <vppinfra/error.h>
 #include <vppinfra/elog.h>
-#include <vlibmemory/unix_shared_memory_queue.h>
 
 #include <vnet/udp/udp_packet.h>
 #include <math.h>
@@ -54,7 +53,8 @@ vlib_node_registration_t session_queue_node;
 
 #define foreach_session_queue_error                 \
 _(TX, "Packets transmitted")                    \
-_(TIMER, "Timer events")
+_(TIMER, "Timer events")                        \
+_(SLEEP, "Idle event queue put to sleep")
 
 typedef enum
 {
@@ -77,6 +77,86 @@ static u32 session_type_to_next[] = {
   SESSION_QUEUE_NEXT_IP6_LOOKUP,
 };
 
+/** Payload that fits in the first buffer, after the headers headroom */
+#define SESSION_TX_FIRST_BUF_DATA (VLIB_BUFFER_DATA_SIZE - MAX_HDRS_LEN)
+
+/**
+ * Read the part of a large send that does not fit in the first buffer
+ * into a chain of buffers linked to @a b0.
+ *
+ * @return 0 on success, -1 if the fifo could not be read
+ */
+always_inline int
+session_tx_fifo_chain_tail (vlib_main_t * vm, session_manager_main_t * smm,
+			    stream_session_t * s0, u32 thread_index,
+			    vlib_buffer_t * b0, u32 len_to_deq, u32 rx_offset,
+			    u8 peek_data)
+{
+  vlib_buffer_t *prev_b, *b;
+  u32 n_bufs, bi, len, n_taken = 0;
+  int n_bytes_read;
+
+  n_bufs = vec_len (smm->tx_buffers[thread_index]);
+  prev_b = b0;
+  b0->total_length_not_including_first_buffer = 0;
+
+  while (len_to_deq)
+    {
+      ASSERT (n_bufs > 0);
+      bi = smm->tx_buffers[thread_index][--n_bufs];
+      n_taken++;
+      b = vlib_get_buffer (vm, bi);
+      b->current_data = 0;
+      b->flags = 0;
+      len = clib_min (len_to_deq, VLIB_BUFFER_DATA_SIZE);
+
+      if (peek_data)
+	{
+	  n_bytes_read = svm_fifo_peek (s0->server_tx_fifo, s0->pid,
+					rx_offset, len, b->data);
+	  if (n_bytes_read <= 0)
+	    goto fail;
+	  rx_offset += n_bytes_read;
+	}
+      else
+	{
+	  n_bytes_read = svm_fifo_dequeue_nowait (s0->server_tx_fifo, s0->pid,
+						  len, b->data);
+	  if (n_bytes_read <= 0)
+	    goto fail;
+	}
+
+      b->current_length = n_bytes_read;
+      prev_b->flags |= VLIB_BUFFER_NEXT_PRESENT;
+      prev_b->next_buffer = bi;
+      b0->total_length_not_including_first_buffer += n_bytes_read;
+      len_to_deq -= n_bytes_read;
+      prev_b = b;
+    }
+
+  _vec_len (smm->tx_buffers[thread_index]) = n_bufs;
+  return 0;
+
+fail:
+  /* Chained buffers are still in the vector, just past its end */
+  b0->flags &= ~VLIB_BUFFER_NEXT_PRESENT;
+  _vec_len (smm->tx_buffers[thread_index]) = n_bufs + n_taken;
+  return -1;
+}
+
+/**
+ * Keep an event whose data could not all be sent. Its fifo's event flag
+ * was released before the fifo was read, if a producer has since posted
+ * a new event that one takes over.
+ */
+always_inline void
+session_tx_event_requeue (session_manager_main_t * smm,
+			  session_fifo_event_t * e0, u32 thread_index)
+{
+  if (svm_fifo_set_event (e0->fifo))
+    vec_add1 (smm->evts_partially_read[thread_index], *e0);
+}
+
 always_inline int
 session_tx_fifo_read_and_snd_i (vlib_main_t * vm, vlib_node_runtime_t * node,
 				session_manager_main_t * smm,
@@ -86,12 +166,13 @@ session_tx_fifo_read_and_snd_i (vlib_main_t * vm, vlib_node_runtime_t * node,
 {
   u32 n_trace = vlib_get_trace_count (vm, node);
   u32 left_to_snd0, max_len_to_snd0, len_to_deq0, n_bufs, snd_space0;
-  u32 n_frame_bytes, n_frames_per_evt;
+  u32 n_frame_bytes, n_frames_per_evt, n_bufs_per_pkt, first_len0;
+  u32 max_dequeue0;
   transport_connection_t *tc0;
   transport_proto_vft_t *transport_vft;
   u32 next_index, next0, *to_next, n_left_to_next, bi0;
   vlib_buffer_t *b0;
-  u32 rx_offset;
+  u32 rx_offset = 0;
   u16 snd_mss0;
   u8 *data0;
   int i;
@@ -101,35 +182,46 @@ session_tx_fifo_read_and_snd_i (vlib_main_t * vm, vlib_node_runtime_t * node,
   transport_vft = session_get_transport_vft (s0->session_type);
   tc0 = transport_vft->get_connection (s0->connection_index, thread_index);
 
-  /* Make sure we have space to send and there's something to dequeue */
+  if (peek_data)
+    {
+      /* Offset in rx fifo from where to peek data  */
+      rx_offset = transport_vft->tx_fifo_offset (tc0);
+    }
+
+  /* Events are coalesced per fifo, so send whatever the fifo holds that
+   * hasn't been sent yet. Nothing left, e.g., a previous event for the
+   * fifo covered it, means we're done. */
+  max_dequeue0 = svm_fifo_max_dequeue (s0->server_tx_fifo);
+  if (max_dequeue0 <= rx_offset)
+    return 0;
+  e0->enqueue_length = max_dequeue0 - rx_offset;
+
+  /* Make sure we have space to send */
   snd_space0 = transport_vft->send_space (tc0);
   snd_mss0 = transport_vft->send_mss (tc0);
 
   /* Can't make any progress */
-  if (snd_space0 == 0 || svm_fifo_max_dequeue (s0->server_tx_fifo) == 0
-      || snd_mss0 == 0)
+  if (snd_space0 == 0 || snd_mss0 == 0)
     {
-      vec_add1 (smm->evts_partially_read[thread_index], *e0);
+      session_tx_event_requeue (smm, e0, thread_index);
       return 0;
     }
 
-  ASSERT (e0->enqueue_length > 0);
-
   /* Ensure we're not writing more than transport window allows */
   max_len_to_snd0 = clib_min (e0->enqueue_length, snd_space0);
 
-  if (peek_data)
-    {
-      /* Offset in rx fifo from where to peek data  */
-      rx_offset = transport_vft->tx_fifo_offset (tc0);
-    }
-
   /* TODO check if transport is willing to send len_to_snd0
    * bytes (Nagle) */
 
   n_frame_bytes = snd_mss0 * VLIB_FRAME_SIZE;
   n_frames_per_evt = ceil ((double) max_len_to_snd0 / n_frame_bytes);
 
+  /* Large sends (TSO) don't fit in one buffer and are built as chains */
+  n_bufs_per_pkt = 1;
+  if (PREDICT_FALSE (snd_mss0 > SESSION_TX_FIRST_BUF_DATA))
+    n_bufs_per_pkt += (snd_mss0 - SESSION_TX_FIRST_BUF_DATA
+		       + VLIB_BUFFER_DATA_SIZE - 1) / VLIB_BUFFER_DATA_SIZE;
+
   n_bufs = vec_len (smm->tx_buffers[thread_index]);
   left_to_snd0 = max_len_to_snd0;
   for (i = 0; i < n_frames_per_evt; i++)
@@ -148,12 +240,8 @@ session_tx_fifo_read_and_snd_i (vlib_main_t * vm, vlib_node_runtime_t * node,
 	  if (PREDICT_FALSE (n_bufs < 0.9 * VLIB_FRAME_SIZE))
 	    {
 	      /* Keep track of how much we've dequeued and exit */
-	      if (left_to_snd0 != max_len_to_snd0)
-		{
-		  e0->enqueue_length -= max_len_to_snd0 - left_to_snd0;
-		  vec_add1 (smm->evts_partially_read[thread_index], *e0);
-		}
-
+	      e0->enqueue_length -= max_len_to_snd0 - left_to_snd0;
+	      session_tx_event_requeue (smm, e0, thread_index);
 	      return -1;
 	    }
 
@@ -163,6 +251,26 @@ session_tx_fifo_read_and_snd_i (vlib_main_t * vm, vlib_node_runtime_t * node,
       vlib_get_next_frame (vm, node, next_index, to_next, n_left_to_next);
       while (left_to_snd0 && n_left_to_next)
 	{
+	  /* Make sure a whole chain can be built */
+	  if (PREDICT_FALSE (n_bufs < n_bufs_per_pkt))
+	    {
+	      vec_validate (smm->tx_buffers[thread_index],
+			    n_bufs + VLIB_FRAME_SIZE - 1);
+	      n_bufs +=
+		vlib_buffer_alloc (vm,
+				   &smm->tx_buffers[thread_index][n_bufs],
+				   VLIB_FRAME_SIZE);
+	      _vec_len (smm->tx_buffers[thread_index]) = n_bufs;
+
+	      if (PREDICT_FALSE (n_bufs < n_bufs_per_pkt))
+		{
+		  vlib_put_next_frame (vm, node, next_index, n_left_to_next);
+		  e0->enqueue_length -= max_len_to_snd0 - left_to_snd0;
+		  session_tx_event_requeue (smm, e0, thread_index);
+		  return -1;
+		}
+	    }
+
 	  /* Get free buffer */
 	  n_bufs--;
 	  bi0 = smm->tx_buffers[thread_index][n_bufs];
@@ -209,14 +317,14 @@ session_tx_fifo_read_and_snd_i (vlib_main_t * vm, vlib_node_runtime_t * node,
 	  /* Make room for headers */
 	  data0 = vlib_buffer_make_headroom (b0, MAX_HDRS_LEN);
 
-	  /* Dequeue the data
-	   * TODO 1) peek instead of dequeue
-	   *      2) buffer chains */
+	  /* Dequeue the data. What doesn't fit in the first buffer goes to
+	   * a chain */
+	  first_len0 = clib_min (len_to_deq0, SESSION_TX_FIRST_BUF_DATA);
 	  if (peek_data)
 	    {
 	      int n_bytes_read;
 	      n_bytes_read = svm_fifo_peek (s0->server_tx_fifo, s0->pid,
-					    rx_offset, len_to_deq0, data0);
+					    rx_offset, first_len0, data0);
 	      if (n_bytes_read < 0)
 		goto dequeue_fail;
 
@@ -227,11 +335,21 @@ session_tx_fifo_read_and_snd_i (vlib_main_t * vm, vlib_node_runtime_t * node,
 	  else
 	    {
 	      if (svm_fifo_dequeue_nowait (s0->server_tx_fifo, s0->pid,
-					   len_to_deq0, data0) < 0)
+					   first_len0, data0) < 0)
 		goto dequeue_fail;
 	    }
 
-	  b0->current_length = len_to_deq0;
+	  b0->current_length = first_len0;
+
+	  if (PREDICT_FALSE (len_to_deq0 > first_len0))
+	    {
+	      if (session_tx_fifo_chain_tail (vm, smm, s0, thread_index, b0,
+					      len_to_deq0 - first_len0,
+					      rx_offset, peek_data))
+		goto dequeue_fail;
+	      rx_offset += b0->total_length_not_including_first_buffer;
+	      n_bufs = vec_len (smm->tx_buffers[thread_index]);
+	    }
 
 	  /* Ask transport to push header */
 	  transport_vft->push_header (tc0, b0);
@@ -250,7 +368,7 @@ session_tx_fifo_read_and_snd_i (vlib_main_t * vm, vlib_node_runtime_t * node,
   if (max_len_to_snd0 < e0->enqueue_length)
     {
       e0->enqueue_length -= max_len_to_snd0;
-      vec_add1 (smm->evts_partially_read[thread_index], *e0);
+      session_tx_event_requeue (smm, e0, thread_index);
     }
   return 0;
 
@@ -258,7 +376,7 @@ dequeue_fail:
   /* Can't read from fifo. Store event rx progress, save as partially read,
    * return buff to free list and return  */
   e0->enqueue_length -= max_len_to_snd0 - left_to_snd0;
-  vec_add1 (smm->evts_partially_read[thread_index], *e0);
+  session_tx_event_requeue (smm, e0, thread_index);
 
   to_next -= 1;
   n_left_to_next += 1;
@@ -290,6 +408,55 @@ session_tx_fifo_dequeue_and_snd (vlib_main_t * vm, vlib_node_runtime_t * node,
 					 n_tx_pkts, 0);
 }
 
+/** Main loops without events before session-queue stops polling */
+#define SESSION_QUEUE_IDLE_LOOPS 1024
+
+/** Period of the tcp clock and timers while session-queue sleeps, the
+ *  timer wheel tick */
+#define SESSION_QUEUE_SLEEP_TICK 100e-3
+
+/**
+ * Stop polling an idle event queue. Producers ring the doorbell from now
+ * on, unless events arrived meanwhile.
+ */
+static void
+session_queue_sleep (vlib_main_t * vm, session_manager_main_t * smm,
+		     svm_event_ring_t * q, u32 thread_index)
+{
+  if (smm->doorbell_file_indices[thread_index] == ~0)
+    return;
+
+  if (svm_event_ring_consumer_sleep (q))
+    {
+      smm->n_idle_loops[thread_index] = 0;
+      return;
+    }
+
+  vlib_node_set_state (vm, session_queue_node.index,
+		       VLIB_NODE_STATE_INTERRUPT);
+  vlib_node_increment_counter (vm, session_queue_node.index,
+			       SESSION_QUEUE_ERROR_SLEEP, 1);
+}
+
+/**
+ * Poll the event queue again, after its doorbell rang or to run the tcp
+ * timers. Called on the thread that owns the queue.
+ */
+void
+session_queue_wakeup (vlib_main_t * vm, u32 thread_index)
+{
+  session_manager_main_t *smm = vnet_get_session_manager_main ();
+  vlib_node_runtime_t *rt;
+
+  rt = vlib_node_get_runtime (vm, session_queue_node.index);
+  if (rt->state != VLIB_NODE_STATE_INTERRUPT)
+    return;
+
+  svm_event_ring_consumer_wake (smm->vpp_event_queues[thread_index]);
+  vlib_node_set_state (vm, session_queue_node.index,
+		       VLIB_NODE_STATE_POLLING);
+}
+
 static uword
 session_queue_node_fn (vlib_main_t * vm, vlib_node_runtime_t * node,
 		       vlib_frame_t * frame)
@@ -297,7 +464,7 @@ session_queue_node_fn (vlib_main_t * vm, vlib_node_runtime_t * node,
   session_manager_main_t *smm = vnet_get_session_manager_main ();
   session_fifo_event_t *my_fifo_events, *e;
   u32 n_to_dequeue, n_events;
-  unix_shared_memory_queue_t *q;
+  svm_event_ring_t *q;
   int n_tx_packets = 0;
   u32 my_thread_index = vm->cpu_index;
   int i, rv;
@@ -314,12 +481,18 @@ session_queue_node_fn (vlib_main_t * vm, vlib_node_runtime_t * node,
   if (PREDICT_FALSE (q == 0))
     return 0;
 
-  /* min number of events we can dequeue without blocking */
-  n_to_dequeue = q->cursize;
+  /* max number of events producers have claimed slots for */
+  n_to_dequeue = svm_event_ring_max_dequeue (q);
   my_fifo_events = smm->fifo_events[my_thread_index];
 
   if (n_to_dequeue == 0 && vec_len (my_fifo_events) == 0)
-    return 0;
+    {
+      /* Let the main thread sleep once the queue stays idle */
+      if (++smm->n_idle_loops[my_thread_index] >= SESSION_QUEUE_IDLE_LOOPS)
+	session_queue_sleep (vm, smm, q, my_thread_index);
+      return 0;
+    }
+  smm->n_idle_loops[my_thread_index] = 0;
 
   /*
    * If we didn't manage to process previous events try going
@@ -329,20 +502,10 @@ session_queue_node_fn (vlib_main_t * vm, vlib_node_runtime_t * node,
   if (vec_len (my_fifo_events) >= 100)
     goto skip_dequeue;
 
-  /* See you in the next life, don't be late */
-  if (pthread_mutex_trylock (&q->mutex))
-    return 0;
-
-  for (i = 0; i < n_to_dequeue; i++)
-    {
-      vec_add2 (my_fifo_events, e, 1);
-      unix_shared_memory_queue_sub_raw (q, (u8 *) e);
-    }
-
-  /* The other side of the connection is not polling */
-  if (q->cursize < (q->maxsize / 8))
-    (void) pthread_cond_broadcast (&q->condvar);
-  pthread_mutex_unlock (&q->mutex);
+  /* Take all published events in one go, without a lock */
+  vec_add2 (my_fifo_events, e, n_to_dequeue);
+  n_events = svm_event_ring_dequeue_batch (q, (u8 *) e, n_to_dequeue);
+  _vec_len (my_fifo_events) -= n_to_dequeue - n_events;
 
   smm->fifo_events[my_thread_index] = my_fifo_events;
 
@@ -350,11 +513,15 @@ skip_dequeue:
   n_events = vec_len (my_fifo_events);
   for (i = 0; i < n_events; i++)
     {
-      svm_fifo_t *f0;		/* $$$ prefetch 1 ahead maybe */
+      svm_fifo_t *f0;
       stream_session_t *s0;
       u32 server_session_index0, server_thread_index0;
       session_fifo_event_t *e0;
 
+      if (i + 1 < n_events)
+	CLIB_PREFETCH (my_fifo_events[i + 1].fifo, CLIB_CACHE_LINE_BYTES,
+		       LOAD);
+
       e0 = &my_fifo_events[i];
       f0 = e0->fifo;
       server_session_index0 = f0->server_session_index;
@@ -380,6 +547,9 @@ skip_dequeue:
       switch (e0->event_type)
 	{
 	case FIFO_EVENT_SERVER_TX:
+	  /* Producers post a new event for data enqueued from now on */
+	  svm_fifo_unset_event (f0);
+
 	  /* Spray packets in per session type frames, since they go to
 	   * different nodes */
 	  rv = (smm->session_tx_fns[s0->session_type]) (vm, node, smm, e0, s0,
@@ -397,12 +567,13 @@ skip_dequeue:
 
 done:
 
-  /* Couldn't process all events. Probably out of buffers */
+  /* Couldn't process all events. Probably out of buffers. The event that
+   * failed has already been requeued */
   if (PREDICT_FALSE (i < n_events))
     {
       session_fifo_event_t *partially_read =
 	smm->evts_partially_read[my_thread_index];
-      vec_add (partially_read, &my_fifo_events[i], n_events - i);
+      vec_add (partially_read, &my_fifo_events[i + 1], n_events - i - 1);
       vec_free (my_fifo_events);
       smm->fifo_events[my_thread_index] = partially_read;
       smm->evts_partially_read[my_thread_index] = 0;
@@ -443,6 +614,39 @@ VLIB_REGISTER_NODE (session_queue_node) =
 };
 /* *INDENT-ON* */
 
+/**
+ * Run the tcp clock and timers of threads whose session-queue sleeps.
+ * Waits for session enable before it starts ticking.
+ */
+static uword
+session_queue_process (vlib_main_t * vm, vlib_node_runtime_t * rt,
+		       vlib_frame_t * f)
+{
+  session_manager_main_t *smm = vnet_get_session_manager_main ();
+
+  while (1)
+    {
+      if (smm->is_enabled)
+	vlib_process_wait_for_event_or_clock (vm, SESSION_QUEUE_SLEEP_TICK);
+      else
+	vlib_process_wait_for_event (vm);
+      vlib_process_get_events (vm, 0);
+
+      if (smm->is_enabled && smm->vpp_event_queues[0])
+	session_queue_wakeup (vm, 0);
+    }
+  return 0;
+}
+
+/* *INDENT-OFF* */
+VLIB_REGISTER_NODE (session_queue_process_node) =
+{
+  .function = session_queue_process,
+  .type = VLIB_NODE_TYPE_PROCESS,
+  .name = "session-queue-process",
+};
+/* *INDENT-ON* */
+
 /*
  * fd.io coding-style-patch-verification: ON
  *
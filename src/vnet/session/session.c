@@ -19,11 +19,16 @@
 
 #include <vnet/session/session.h>
 #include <vlibmemory/api.h>
+#include <vlib/unix/unix.h>
+#include <sys/socket.h>
 #include <vnet/dpo/load_balance.h>
 #include <vnet/fib/ip4_fib.h>
 #include <vnet/session/application.h>
+#include <vnet/session/application_interface.h>
 #include <vnet/tcp/tcp.h>
 #include <vnet/session/session_debug.h>
+#include <vppinfra/fifo.h>
+#include <vppinfra/xxhash.h>
 
 /**
  * Per-type vector of transport protocol virtual function tables
@@ -379,6 +384,49 @@ stream_session_lookup_transport6 (ip6_address_t * lcl, ip6_address_t * rmt,
   return 0;
 }
 
+static clib_error_t *
+session_queue_doorbell_read (unix_file_t * uf)
+{
+  u8 buf[64];
+
+  while (recv (uf->file_descriptor, buf, sizeof (buf), MSG_DONTWAIT) > 0)
+    ;
+  session_queue_wakeup (vlib_get_main (), uf->private_data);
+  return 0;
+}
+
+/**
+ * Ring producers use to wake the main thread's session-queue out of
+ * epoll. Workers never wait and keep polling their queue.
+ */
+static void
+session_queue_doorbell_add (session_manager_main_t * smm, u32 thread_index)
+{
+  svm_event_ring_t *q = smm->vpp_event_queues[thread_index];
+  unix_file_t template = { 0 };
+  u8 *name;
+  int fd;
+
+  if (thread_index != 0)
+    return;
+
+  name = format (0, "vpp-session-%d-%d%c", getpid (), thread_index, 0);
+  fd = svm_event_ring_doorbell_open (q, (char *) name);
+  vec_free (name);
+  if (fd < 0)
+    {
+      clib_unix_warning ("session queue doorbell, thread %d keeps polling",
+			 thread_index);
+      return;
+    }
+
+  template.read_function = session_queue_doorbell_read;
+  template.file_descriptor = fd;
+  template.private_data = thread_index;
+  smm->doorbell_file_indices[thread_index] =
+    unix_file_add (&unix_main, &template);
+}
+
 /**
  * Allocate vpp event queue (once) per worker thread
  */
@@ -391,18 +439,16 @@ vpp_session_event_queue_allocate (session_manager_main_t * smm,
 
   if (smm->vpp_event_queues[thread_index] == 0)
     {
-      /* Allocate event fifo in the /vpe-api shared-memory segment */
+      /* Allocate event ring in the /vpe-api shared-memory segment */
       oldheap = svm_push_data_heap (am->vlib_rp);
 
       smm->vpp_event_queues[thread_index] =
-	unix_shared_memory_queue_init (2048 /* nels $$$$ config */ ,
-				       sizeof (session_fifo_event_t),
-				       0 /* consumer pid */ ,
-				       0
-				       /* (do not) send signal when queue non-empty */
-	);
+	svm_event_ring_init (2048 /* nels $$$$ config */ ,
+			     sizeof (session_fifo_event_t));
 
       svm_pop_heap (oldheap);
+
+      session_queue_doorbell_add (smm, thread_index);
     }
 }
 
@@ -688,6 +734,7 @@ stream_session_create_i (session_manager_main_t * smm, application_t * app,
   s->server_segment_index = fifo_segment_index;
   s->thread_index = thread_index;
   s->session_index = pool_index;
+  s->rx_zero_copy = (app->flags & SESSION_OPTIONS_FLAGS_ZERO_COPY) != 0;
 
   /* Attach transport to session */
   s->connection_index = tc->c_index;
@@ -704,34 +751,136 @@ stream_session_create_i (session_manager_main_t * smm, application_t * app,
   return 0;
 }
 
+/**
+ * Queue a buffer chain to a zero-copy session. Only the rx fifo's
+ * accounting is updated, out-of-order data the fifo's tail catches up
+ * with is queued as fifo bytes after the chain.
+ */
+static int
+stream_session_enqueue_zero_copy (vlib_main_t * vm, stream_session_t * s,
+				  vlib_buffer_t * b, u32 len)
+{
+  session_rx_segment_t *seg;
+  int enqueued;
+
+  enqueued = svm_fifo_enqueue_nowait (s->server_rx_fifo, s->pid, len,
+				      0 /* zero-copy */ );
+  ASSERT (enqueued >= len);
+
+  clib_fifo_add2 (s->rx_segments, seg);
+  seg->buffer_index = vlib_get_buffer_index (vm, b);
+  seg->length = len;
+
+  if (enqueued > len)
+    {
+      clib_fifo_add2 (s->rx_segments, seg);
+      seg->buffer_index = ~0;
+      seg->length = enqueued - len;
+    }
+  return enqueued;
+}
+
+/**
+ * Take the next piece of in-order rx data of a zero-copy session
+ *
+ * Data comes in the buffer chains it was received in, ownership of which
+ * passes to the caller, or, for data that could not be kept in buffers,
+ * as bytes at the head of the rx fifo. The latter must be consumed, e.g.,
+ * with svm_fifo_dequeue_nowait(), before asking for the next piece.
+ *
+ * @param s zero-copy session
+ * @param max_bytes pieces longer than this are left in place
+ * @param bi set to the buffer chain holding the data, or ~0 if the data
+ *           is in the rx fifo
+ * @return length of the piece, 0 if nothing (small enough) is pending
+ */
+u32
+stream_session_rx_zero_copy_next (stream_session_t * s, u32 max_bytes,
+				  u32 * bi)
+{
+  session_rx_segment_t *seg;
+  u32 len;
+
+  if (clib_fifo_elts (s->rx_segments) == 0)
+    return 0;
+
+  seg = clib_fifo_head (s->rx_segments);
+  if (seg->length > max_bytes)
+    return 0;
+
+  *bi = seg->buffer_index;
+  len = seg->length;
+  clib_fifo_advance_head (s->rx_segments, 1);
+
+  /* Bytes kept in buffers only reserved space in the fifo */
+  if (*bi != ~0)
+    svm_fifo_dequeue_drop (s->server_rx_fifo, s->pid, len);
+
+  return len;
+}
+
 /*
  * Enqueue data for delivery to session peer. Does not notify peer of enqueue
  * event but on request can queue notification events for later delivery by
  * calling stream_server_flush_enqueue_events().
  *
+ * Data starts at the buffer's current position and may span a buffer
+ * chain, e.g., segments merged by the transport's receive offload. If the
+ * session is in zero-copy mode the data is not copied, the chain is handed
+ * over to the app instead and must not be freed or reused by the caller.
+ *
  * @param tc Transport connection which is to be enqueued data
- * @param data Data to be enqueued
- * @param len Length of data to be enqueued
+ * @param b Buffer (chain) with the data to be enqueued
  * @param queue_event Flag to indicate if peer is to be notified or if event
  *                    is to be queued. The former is useful when more data is
  *                    enqueued and only one event is to be generated.
  * @return Number of bytes enqueued or a negative value if enqueueing failed.
+ *         More bytes than in the chain may be enqueued if out-of-order data
+ *         already in the fifo became in order.
  */
 int
-stream_session_enqueue_data (transport_connection_t * tc, u8 * data, u16 len,
+stream_session_enqueue_data (transport_connection_t * tc, vlib_buffer_t * b,
 			     u8 queue_event)
 {
+  vlib_main_t *vm = vlib_get_main ();
   stream_session_t *s;
-  int enqueued;
+  u32 len, pos = 0;
+  int enqueued, rv;
 
   s = stream_session_get (tc->s_index, tc->thread_index);
+  len = vlib_buffer_length_in_chain (vm, b);
 
   /* Make sure there's enough space left. We might've filled the pipes */
   if (PREDICT_FALSE (len > svm_fifo_max_enqueue (s->server_rx_fifo)))
     return -1;
 
-  enqueued = svm_fifo_enqueue_nowait (s->server_rx_fifo, s->pid, len, data);
+  if (PREDICT_FALSE (s->rx_zero_copy))
+    {
+      enqueued = stream_session_enqueue_zero_copy (vm, s, b, len);
+      goto done;
+    }
 
+  enqueued = svm_fifo_enqueue_nowait (s->server_rx_fifo, s->pid,
+				      b->current_length,
+				      vlib_buffer_get_current (b));
+
+  /* Rest of the chain. Skip what out-of-order data already filled in */
+  while (PREDICT_FALSE (b->flags & VLIB_BUFFER_NEXT_PRESENT) && enqueued > 0)
+    {
+      pos += b->current_length;
+      b = vlib_get_buffer (vm, b->next_buffer);
+      if (enqueued >= pos + b->current_length)
+	continue;
+      rv = svm_fifo_enqueue_nowait (s->server_rx_fifo, s->pid,
+				    pos + b->current_length - enqueued,
+				    vlib_buffer_get_current (b) + enqueued -
+				    pos);
+      if (rv < 0)
+	break;
+      enqueued += rv;
+    }
+
+done:
   if (queue_event)
     {
       /* Queue RX event on this fifo. Eventually these will need to be flushed
@@ -916,6 +1065,88 @@ stream_session_start_listen (u32 server_index, ip46_address_t * ip, u16 port)
   return 0;
 }
 
+/**
+ * Share a listener's ip/port with another server, SO_REUSEPORT style.
+ *
+ * Only the listen session lookups find is known to the transport. It
+ * represents the group and stream_session_accept() spreads its new
+ * connections among the members.
+ */
+int
+stream_session_share_listen (u32 server_index, stream_session_t * listener)
+{
+  session_manager_main_t *smm = &session_manager_main;
+  u32 listener_index = listener->session_index, **group;
+  stream_session_t *s;
+  application_t *srv;
+  u8 sst;
+
+  srv = application_get (server_index);
+  sst = srv->session_type;
+
+  pool_get (smm->listen_sessions[sst], s);
+  memset (s, 0, sizeof (*s));
+
+  /* Pool might've moved */
+  listener = pool_elt_at_index (smm->listen_sessions[sst], listener_index);
+
+  s->session_type = sst;
+  s->session_state = SESSION_STATE_LISTENING;
+  s->session_index = s - smm->listen_sessions[sst];
+  s->app_index = srv->index;
+  s->connection_index = listener->connection_index;
+
+  srv->session_index = s->session_index;
+
+  vec_validate (smm->listener_groups[sst], listener_index);
+  group = &smm->listener_groups[sst][listener_index];
+  if (vec_len (*group) == 0)
+    vec_add1 (*group, listener_index);
+  vec_add1 (*group, s->session_index);
+
+  return 0;
+}
+
+/**
+ * Remove a listen session from its group, if it's in one. The session
+ * lookups find is kept as long as others use the ip/port, it's handed
+ * over to another member instead.
+ *
+ * @return 1 if the listener was shared and has been freed
+ */
+static int
+stream_session_leave_listen_group (session_manager_main_t * smm,
+				   stream_session_t * listener)
+{
+  stream_session_t *member;
+  transport_connection_t *tc;
+  u32 **group, primary, i;
+  u8 sst = listener->session_type;
+
+  tc = tp_vfts[sst].get_listener (listener->connection_index);
+  primary = tc->s_index;
+  if (primary >= vec_len (smm->listener_groups[sst])
+      || vec_len (smm->listener_groups[sst][primary]) == 0)
+    return 0;
+
+  group = &smm->listener_groups[sst][primary];
+  if (listener->session_index == primary)
+    {
+      member = pool_elt_at_index (smm->listen_sessions[sst], (*group)[1]);
+      listener->app_index = member->app_index;
+      application_get (member->app_index)->session_index = primary;
+      listener = member;
+    }
+
+  i = vec_search (*group, listener->session_index);
+  vec_delete (*group, 1, i);
+  if (vec_len (*group) == 1)
+    vec_free (*group);
+
+  pool_put (smm->listen_sessions[sst], listener);
+  return 1;
+}
+
 void
 stream_session_stop_listen (u32 server_index)
 {
@@ -928,6 +1159,10 @@ stream_session_stop_listen (u32 server_index)
   listener = pool_elt_at_index (smm->listen_sessions[srv->session_type],
 				srv->session_index);
 
+  /* Others still listen on the ip/port */
+  if (stream_session_leave_listen_group (smm, listener))
+    return;
+
   tc = tp_vfts[srv->session_type].get_listener (listener->connection_index);
   stream_session_table_del_for_tc (smm, listener->session_type, tc);
 
@@ -1046,6 +1281,20 @@ stream_session_delete (stream_session_t * s)
   /* Delete from the main lookup table. */
   stream_session_table_del (smm, s);
 
+  /* Free zero-copy rx data the app did not take */
+  if (PREDICT_FALSE (s->rx_segments != 0))
+    {
+      session_rx_segment_t *seg;
+
+      /* *INDENT-OFF* */
+      clib_fifo_foreach (seg, s->rx_segments, ({
+	if (seg->buffer_index != ~0)
+	  vlib_buffer_free_one (vlib_get_main (), seg->buffer_index);
+      }));
+      /* *INDENT-ON* */
+      clib_fifo_free (s->rx_segments);
+    }
+
   /* Cleanup fifo segments */
   fifo_segment = svm_fifo_get_segment (s->server_segment_index);
   svm_fifo_segment_free_fifo (fifo_segment, s->server_rx_fifo);
@@ -1121,6 +1370,59 @@ stream_session_reset_notify (transport_connection_t * tc)
   app->cb_fns.session_reset_callback (s);
 }
 
+always_inline int
+stream_session_listener_takes_thread (session_manager_main_t * smm, u8 sst,
+				      u32 listener_index, u32 thread_index)
+{
+  stream_session_t *s;
+  u64 mask;
+
+  s = pool_elt_at_index (smm->listen_sessions[sst], listener_index);
+  mask = application_get (s->app_index)->listen_thread_mask;
+  return mask == 0 || (thread_index < 64 && (mask & (1ULL << thread_index)));
+}
+
+/**
+ * Pick the member of a shared listener a new connection goes to
+ *
+ * RSS steered the flow to the thread that received it. Members listening
+ * on that thread are preferred, so the connection and its app instance
+ * stay on one core. Among those, a hash of the peer decides.
+ */
+static stream_session_t *
+stream_session_listener_select (session_manager_main_t * smm,
+				stream_session_t * listener,
+				transport_connection_t * tc)
+{
+  u32 *group, *li, n_takers = 0, pick;
+  u8 sst = listener->session_type;
+
+  if (PREDICT_TRUE (listener->session_index
+		    >= vec_len (smm->listener_groups[sst])))
+    return listener;
+  group = smm->listener_groups[sst][listener->session_index];
+  if (PREDICT_TRUE (vec_len (group) == 0))
+    return listener;
+
+  vec_foreach (li, group)
+    n_takers += stream_session_listener_takes_thread (smm, sst, *li,
+						      tc->thread_index);
+
+  pick = clib_xxhash (tc->rmt_ip.as_u64[0] ^ tc->rmt_ip.as_u64[1]
+		      ^ tc->rmt_port);
+  pick %= n_takers ? n_takers : vec_len (group);
+
+  vec_foreach (li, group)
+  {
+    if (n_takers && !stream_session_listener_takes_thread (smm, sst, *li,
+							    tc->thread_index))
+      continue;
+    if (pick-- == 0)
+      return pool_elt_at_index (smm->listen_sessions[sst], *li);
+  }
+  return listener;
+}
+
 /**
  * Accept a stream session. Optionally ping the server by callback.
  */
@@ -1136,6 +1438,7 @@ stream_session_accept (transport_connection_t * tc, u32 listener_index,
 
   /* Find the server */
   listener = pool_elt_at_index (smm->listen_sessions[sst], listener_index);
+  listener = stream_session_listener_select (smm, listener, tc);
   server = application_get (listener->app_index);
 
   if ((rv = stream_session_create_i (smm, server, tc, &s)))
@@ -1265,6 +1568,8 @@ session_manager_main_enable (vlib_main_t * vm)
   vec_validate (smm->evts_partially_read, num_threads - 1);
   vec_validate (smm->current_enqueue_epoch, num_threads - 1);
   vec_validate (smm->vpp_event_queues, num_threads - 1);
+  vec_validate (smm->n_idle_loops, num_threads - 1);
+  vec_validate_init_empty (smm->doorbell_file_indices, num_threads - 1, ~0);
 
   /* $$$$ preallocate hack config parameter */
   for (i = 0; i < 200000; i++)
@@ -1305,6 +1610,8 @@ session_manager_main_enable (vlib_main_t * vm)
 clib_error_t *
 vnet_session_enable_disable (vlib_main_t * vm, u8 is_en)
 {
+  clib_error_t *error;
+
   if (is_en)
     {
       if (session_manager_main.is_enabled)
@@ -1313,7 +1620,11 @@ vnet_session_enable_disable (vlib_main_t * vm, u8 is_en)
       vlib_node_set_state (vm, session_queue_node.index,
 			   VLIB_NODE_STATE_POLLING);
 
-      return session_manager_main_enable (vm);
+      error = session_manager_main_enable (vm);
+      if (error == 0)
+	vlib_process_signal_event (vm, session_queue_process_node.index,
+				   0 /* start ticking */ , 0);
+      return error;
     }
   else
     {
@@ -20,6 +20,7 @@
 #include <vlibmemory/api.h>
 #include <vppinfra/sparse_vec.h>
 #include <svm/svm_fifo_segment.h>
+#include <svm/svm_event_ring.h>
 
 #define HALF_OPEN_LOOKUP_INVALID_VALUE ((u64)~0)
 #define INVALID_INDEX ((u32)~0)
@@ -100,6 +101,13 @@ typedef CLIB_PACKED (struct
 		     u32 enqueue_length;
 		     }) session_fifo_event_t;
 
+/** In-order rx data of a zero-copy session */
+typedef struct
+{
+  u32 buffer_index;	/**< Buffer chain holding the data, ~0 if in rx fifo */
+  u32 length;		/**< Data bytes */
+} session_rx_segment_t;
+
 typedef struct _stream_session_t
 {
   /** fifo pointers. Once allocated, these do not move */
@@ -120,6 +128,9 @@ typedef struct _stream_session_t
   /** To avoid n**2 "one event per frame" check */
   u8 enqueue_epoch;
 
+  /** Rx data is handed to the built-in app in vlib buffers */
+  u8 rx_zero_copy;
+
   /** Session index in per_thread pool */
   u32 session_index;
 
@@ -134,6 +145,11 @@ typedef struct _stream_session_t
 
   /** svm segment index */
   u32 server_segment_index;
+
+  /** Zero-copy rx data not yet taken by the app (clib fifo). Accounted
+   *  for in the rx fifo, whose ring only holds data that could not be
+   *  kept in buffers, e.g., data received out of order */
+  session_rx_segment_t *rx_segments;
 } stream_session_t;
 
 typedef struct _session_manager
@@ -200,7 +216,18 @@ struct _session_manager_main
   session_fifo_event_t **fifo_events;
 
   /** vpp fifo event queue */
-  unix_shared_memory_queue_t **vpp_event_queues;
+  svm_event_ring_t **vpp_event_queues;
+
+  /** Per worker-thread main loops session-queue found nothing to do in */
+  u32 *n_idle_loops;
+
+  /** Per worker-thread doorbell of the event queue, ~0 if the thread
+   *  cannot sleep */
+  u32 *doorbell_file_indices;
+
+  /** Listen sessions sharing an ip/port, per session type and indexed by
+   *  the listen session lookups find, which is also a member */
+  u32 **listener_groups[SESSION_N_TYPES];
 
   /** Unique segment name counter */
   u32 unique_segment_name_counter;
@@ -222,6 +249,7 @@ struct _session_manager_main
 
 extern session_manager_main_t session_manager_main;
 extern vlib_node_registration_t session_queue_node;
+extern vlib_node_registration_t session_queue_process_node;
 
 /*
  * Session manager function
@@ -238,7 +266,7 @@ session_manager_get (u32 index)
   return pool_elt_at_index (session_manager_main.session_managers, index);
 }
 
-always_inline unix_shared_memory_queue_t *
+always_inline svm_event_ring_t *
 session_manager_get_vpp_event_queue (u32 thread_index)
 {
   return session_manager_main.vpp_event_queues[thread_index];
@@ -254,6 +282,7 @@ connects_session_manager_get (session_manager_main_t * smm,
 
 void session_manager_get_segment_info (u32 index, u8 ** name, u32 * size);
 int session_manager_flush_enqueue_events (u32 thread_index);
+void session_queue_wakeup (vlib_main_t * vm, u32 thread_index);
 int
 session_manager_add_first_segment (session_manager_main_t * smm,
 				   session_manager_t * sm, u32 segment_size,
@@ -339,6 +368,14 @@ stream_session_max_enqueue (transport_connection_t * tc)
   return svm_fifo_max_enqueue (s->server_rx_fifo);
 }
 
+/** Rx data enqueued to the session is kept in the buffers it came in */
+always_inline u8
+stream_session_rx_zero_copy (transport_connection_t * tc)
+{
+  stream_session_t *s = stream_session_get (tc->s_index, tc->thread_index);
+  return s->rx_zero_copy;
+}
+
 always_inline u32
 stream_session_fifo_size (transport_connection_t * tc)
 {
@@ -348,8 +385,10 @@ stream_session_fifo_size (transport_connection_t * tc)
 
 
 int
-stream_session_enqueue_data (transport_connection_t * tc, u8 * data, u16 len,
+stream_session_enqueue_data (transport_connection_t * tc, vlib_buffer_t * b,
 			     u8 queue_event);
+u32 stream_session_rx_zero_copy_next (stream_session_t * s, u32 max_bytes,
+				      u32 * bi);
 u32
 stream_session_peek_bytes (transport_connection_t * tc, u8 * buffer,
 			   u32 offset, u32 max_bytes);
@@ -373,6 +412,8 @@ void stream_session_cleanup (stream_session_t * s);
 int
 stream_session_start_listen (u32 server_index, ip46_address_t * ip, u16 port);
 void stream_session_stop_listen (u32 server_index);
+int stream_session_share_listen (u32 server_index,
+				 stream_session_t * listener);
 
 u8 *format_stream_session (u8 * s, va_list * args);
 
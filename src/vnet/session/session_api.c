@@ -83,7 +83,8 @@ static int
 send_session_accept_uri_callback (stream_session_t * s)
 {
   vl_api_accept_session_t *mp;
-  unix_shared_memory_queue_t *q, *vpp_queue;
+  unix_shared_memory_queue_t *q;
+  svm_event_ring_t *vpp_queue;
   application_t *server = application_get (s->app_index);
 
   q = vl_api_client_index_to_input_queue (server->api_client_index);
@@ -159,7 +160,7 @@ send_session_connected_uri_callback (u32 api_client_index,
   unix_shared_memory_queue_t *q;
   application_t *app = application_lookup (api_client_index);
   u8 *seg_name;
-  unix_shared_memory_queue_t *vpp_queue;
+  svm_event_ring_t *vpp_queue;
 
   q = vl_api_client_index_to_input_queue (app->api_client_index);
 
@@ -280,7 +281,8 @@ static int
 send_session_accept_callback (stream_session_t * s)
 {
   vl_api_accept_sock_t *mp;
-  unix_shared_memory_queue_t *q, *vpp_queue;
+  unix_shared_memory_queue_t *q;
+  svm_event_ring_t *vpp_queue;
   application_t *server = application_get (s->app_index);
 
   q = vl_api_client_index_to_input_queue (server->api_client_index);
@@ -312,7 +314,7 @@ send_session_connected_callback (u32 api_client_index, stream_session_t * s,
   unix_shared_memory_queue_t *q;
   application_t *app = application_lookup (api_client_index);
   u8 *seg_name;
-  unix_shared_memory_queue_t *vpp_queue;
+  svm_event_ring_t *vpp_queue;
 
   q = vl_api_client_index_to_input_queue (app->api_client_index);
 
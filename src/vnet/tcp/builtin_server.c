@@ -21,8 +21,9 @@
 typedef struct
 {
   u8 *rx_buf;
-  unix_shared_memory_queue_t **vpp_queue;
+  svm_event_ring_t **vpp_queue;
   vlib_main_t *vlib_main;
+  u8 zero_copy;			/**< take rx data in vlib buffers */
 } builtin_server_main_t;
 
 builtin_server_main_t builtin_server_main;
@@ -80,6 +81,52 @@ builtin_redirect_connect_callback (u32 client_index, void *mp)
   return -1;
 }
 
+/**
+ * Echo rx data of a zero-copy session. Buffers are consumed as they are,
+ * only data that arrived out of order is read from the rx fifo.
+ */
+static int
+builtin_server_rx_zero_copy (stream_session_t * s)
+{
+  vlib_main_t *vm = vlib_get_main ();
+  svm_fifo_t *rx_fifo = s->server_rx_fifo;
+  svm_fifo_t *tx_fifo = s->server_tx_fifo;
+  u32 bi, len, n_bytes, total = 0;
+  vlib_buffer_t *b;
+
+  while ((len = stream_session_rx_zero_copy_next (s,
+						  svm_fifo_max_enqueue
+						  (tx_fifo), &bi)))
+    {
+      if (bi != ~0)
+	{
+	  b = vlib_get_buffer (vm, bi);
+	  while (1)
+	    {
+	      svm_fifo_enqueue_nowait (tx_fifo, 0, b->current_length,
+				       vlib_buffer_get_current (b));
+	      if (!(b->flags & VLIB_BUFFER_NEXT_PRESENT))
+		break;
+	      b = vlib_get_buffer (vm, b->next_buffer);
+	    }
+	  vlib_buffer_free_one (vm, bi);
+	}
+      else
+	{
+	  for (n_bytes = 0; n_bytes < len;)
+	    {
+	      u32 n = clib_min (len - n_bytes,
+				svm_fifo_max_dequeue_contiguous (rx_fifo));
+	      svm_fifo_enqueue_nowait (tx_fifo, 0, n, svm_fifo_head (rx_fifo));
+	      svm_fifo_dequeue_drop (rx_fifo, 0, n);
+	      n_bytes += n;
+	    }
+	}
+      total += len;
+    }
+  return total;
+}
+
 int
 builtin_server_rx_callback (stream_session_t * s, session_fifo_event_t * e)
 {
@@ -99,9 +146,19 @@ builtin_server_rx_callback (stream_session_t * s, session_fifo_event_t * e)
 
   tx_fifo = s->server_tx_fifo;
 
+  if (bsm->zero_copy)
+    {
+      total_copy_bytes = builtin_server_rx_zero_copy (s);
+      if (PREDICT_FALSE (total_copy_bytes <= 0))
+	{
+	  clib_warning ("no space in tx fifo, event had %d bytes", bytes);
+	  return 0;
+	}
+      goto send_event;
+    }
+
   /* Number of bytes we're going to copy */
-  total_copy_bytes = (bytes < (tx_fifo->nitems - tx_fifo->cursize)) ? bytes :
-    tx_fifo->nitems - tx_fifo->cursize;
+  total_copy_bytes = clib_min (bytes, svm_fifo_max_enqueue (tx_fifo));
 
   if (PREDICT_FALSE (total_copy_bytes <= 0))
     {
@@ -123,14 +180,18 @@ builtin_server_rx_callback (stream_session_t * s, session_fifo_event_t * e)
   n_written = svm_fifo_enqueue_nowait (tx_fifo, 0, n_read, bsm->rx_buf);
   ASSERT (n_written == total_copy_bytes);
 
-  /* Fabricate TX event, send to vpp */
-  evt.fifo = tx_fifo;
-  evt.event_type = FIFO_EVENT_SERVER_TX;
-  evt.enqueue_length = total_copy_bytes;
-  evt.event_id = serial_number++;
+send_event:
+  /* Fabricate TX event, send to vpp, unless one is pending */
+  if (svm_fifo_set_event (tx_fifo))
+    {
+      evt.fifo = tx_fifo;
+      evt.event_type = FIFO_EVENT_SERVER_TX;
+      evt.enqueue_length = total_copy_bytes;
+      evt.event_id = serial_number++;
 
-  unix_shared_memory_queue_add (bsm->vpp_queue[s->thread_index], (u8 *) & evt,
-				0 /* do wait for mutex */ );
+      svm_event_ring_enqueue (bsm->vpp_queue[s->thread_index],
+			      (u8 *) & evt, 0 /* wait */ );
+    }
 
   return 0;
 }
@@ -167,6 +228,8 @@ server_create (vlib_main_t * vm)
   a->options[SESSION_OPTIONS_SEGMENT_SIZE] = 256 << 10;
   a->options[SESSION_OPTIONS_RX_FIFO_SIZE] = 64 << 10;
   a->options[SESSION_OPTIONS_TX_FIFO_SIZE] = 64 << 10;
+  if (builtin_server_main.zero_copy)
+    a->options[SESSION_OPTIONS_FLAGS] |= SESSION_OPTIONS_FLAGS_ZERO_COPY;
   a->segment_name = segment_name;
   a->segment_name_length = ARRAY_LEN (segment_name);
 
@@ -178,16 +241,16 @@ server_create_command_fn (vlib_main_t * vm,
 			  unformat_input_t * input, vlib_cli_command_t * cmd)
 {
   int rv;
-#if 0
+
+  builtin_server_main.zero_copy = 0;
   while (unformat_check_input (input) != UNFORMAT_END_OF_INPUT)
     {
-      if (unformat (input, "whatever %d", &whatever))
-	;
+      if (unformat (input, "zero-copy"))
+	builtin_server_main.zero_copy = 1;
       else
 	return clib_error_return (0, "unknown input `%U'",
 				  format_unformat_error, input);
     }
-#endif
 
   vnet_session_enable_disable (vm, 1 /* turn on TCP, etc. */ );
   rv = server_create (vm);
@@ -205,7 +268,7 @@ server_create_command_fn (vlib_main_t * vm,
 VLIB_CLI_COMMAND (server_create_command, static) =
 {
   .path = "test server",
-  .short_help = "test server",
+  .short_help = "test server [zero-copy]",
   .function = server_create_command_fn,
 };
 /* *INDENT-ON* */
@@ -15,8 +15,12 @@
 
 #include <vnet/tcp/tcp.h>
 #include <vnet/session/session.h>
+#include <vnet/session/application.h>
+#include <vnet/session/application_interface.h>
 #include <vnet/fib/fib.h>
 #include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 tcp_main_t tcp_main;
 
@@ -26,6 +30,7 @@ tcp_connection_bind (u32 session_index, ip46_address_t * ip,
 {
   tcp_main_t *tm = &tcp_main;
   tcp_connection_t *listener;
+  stream_session_t *s;
 
   pool_get (tm->listener_pool, listener);
   memset (listener, 0, sizeof (*listener));
@@ -43,6 +48,11 @@ tcp_connection_bind (u32 session_index, ip46_address_t * ip,
   listener->state = TCP_STATE_LISTEN;
   listener->c_is_ip4 = 1;
 
+  /* Children inherit the congestion control algorithm of the listener */
+  s = stream_session_listener_get (is_ip4 ? SESSION_TYPE_IP4_TCP :
+				   SESSION_TYPE_IP6_TCP, session_index);
+  listener->cc_algo = tcp_cc_algo_get (tcp_cc_algo_for_app (s->app_index));
+
   tcp_connection_timers_init (listener);
 
   TCP_EVT_DBG (TCP_EVT_BIND, listener);
@@ -116,6 +126,9 @@ tcp_connection_cleanup (tcp_connection_t * tc)
 
   /* Make sure all timers are cleared */
   tcp_connection_timers_reset (tc);
+  tcp_connection_half_open_done (tc);
+
+  pool_free (tc->sack_sb.holes);
 
   /* Check if half-open */
   if (tc->state == TCP_STATE_SYN_SENT)
@@ -149,6 +162,7 @@ tcp_connection_reset (tcp_connection_t * tc)
   if (tc->state == TCP_STATE_CLOSED)
     return;
 
+  tcp_connection_half_open_done (tc);
   tc->state = TCP_STATE_CLOSED;
   stream_session_reset_notify (&tc->connection);
 }
@@ -177,6 +191,7 @@ tcp_connection_close (tcp_connection_t * tc)
     tcp_send_fin (tc);
 
   /* Switch state */
+  tcp_connection_half_open_done (tc);
   if (tc->state == TCP_STATE_ESTABLISHED || tc->state == TCP_STATE_SYN_RCVD)
     tc->state = TCP_STATE_FIN_WAIT_1;
   else if (tc->state == TCP_STATE_SYN_SENT)
@@ -328,10 +343,50 @@ tcp_connection_init_vars (tcp_connection_t * tc)
 {
   tcp_connection_timers_init (tc);
   tcp_set_snd_mss (tc);
-  tc->sack_sb.head = TCP_INVALID_SACK_HOLE_INDEX;
+  scoreboard_init (&tc->sack_sb);
   tcp_cc_init (tc);
 }
 
+/**
+ * Congestion control algorithm for the connections of an app
+ *
+ * Apps pick one with SESSION_OPTIONS_CC_ALGO, otherwise the stack wide
+ * default, configured with "tcp { cc-algo <name> }", applies.
+ */
+tcp_cc_algorithm_type_e
+tcp_cc_algo_for_app (u32 app_index)
+{
+  tcp_main_t *tm = vnet_get_tcp_main ();
+  application_t *app;
+
+  app = application_get_if_valid (app_index);
+  if (app == 0 || app->cc_algo == SESSION_OPTIONS_CC_ALGO_DEFAULT
+      || app->cc_algo > vec_len (tm->cc_algos))
+    return tm->cc_algo;
+
+  return app->cc_algo - 1;
+}
+
+/**
+ * Switch a connection to a different congestion control algorithm
+ *
+ * The new algorithm starts from its initial state, so this is meant to be
+ * used before the connection sends data.
+ */
+void
+tcp_connection_set_cc_algo (tcp_connection_t * tc,
+			    tcp_cc_algorithm_type_e type)
+{
+  tcp_cc_algorithm_t *cc_algo = tcp_cc_algo_get (type);
+
+  if (tc->cc_algo == cc_algo)
+    return;
+
+  tc->cc_algo = cc_algo;
+  memset (tc->cc_data, 0, sizeof (tc->cc_data));
+  tc->cc_algo->init (tc);
+}
+
 int
 tcp_connection_open (ip46_address_t * rmt_addr, u16 rmt_port, u8 is_ip4)
 {
@@ -398,6 +453,9 @@ tcp_connection_open (ip46_address_t * rmt_addr, u16 rmt_port, u8 is_ip4)
   tc->c_c_index = tc - tm->half_open_connections;
   tc->c_is_ip4 = is_ip4;
 
+  /* No session until the connect notification */
+  tc->c_s_index = ~0;
+
   /* The other connection vars will be initialized after SYN ACK */
   tcp_connection_timers_init (tc);
 
@@ -507,6 +565,9 @@ format_tcp_connection_verbose (u8 * s, va_list * args)
   tcp_connection_t *tc = va_arg (*args, tcp_connection_t *);
   s = format (s, "%U %U %U", format_tcp_connection, tc, format_tcp_state,
 	      &tc->state, format_tcp_timers, tc);
+  if (tc->cc_algo)
+    s = format (s, " cc %U cwnd %u ssthresh %u", format_tcp_cc_algo,
+		tc->cc_algo - tcp_main.cc_algos, tc->cwnd, tc->ssthresh);
   return s;
 }
 
@@ -555,6 +616,10 @@ u16
 tcp_session_send_mss (transport_connection_t * trans_conn)
 {
   tcp_connection_t *tc = (tcp_connection_t *) trans_conn;
+
+  /* With TSO, ask for as many full segments as fit in one large send */
+  if (tcp_main.tso_enabled)
+    return (TCP_MAX_GSO_SZ / tc->snd_mss) * tc->snd_mss;
   return tc->snd_mss;
 }
 
@@ -723,6 +788,8 @@ tcp_main_enable (vlib_main_t * vm)
   vlib_thread_main_t *vtm = vlib_get_thread_main ();
   clib_error_t *error = 0;
   u32 num_threads;
+  u64 seed;
+  int fd;
 
   if ((error = vlib_call_init_function (vm, ip_main_init)))
     return error;
@@ -761,8 +828,25 @@ tcp_main_enable (vlib_main_t * vm)
   /* Initialize timer wheels */
   vec_validate (tm->timer_wheels, num_threads - 1);
   tcp_initialize_timer_wheels (tm);
+  vec_validate (tm->time_now, num_threads - 1);
 
   vec_validate (tm->delack_connections, num_threads - 1);
+  vec_validate (tm->n_half_open, num_threads - 1);
+
+  /* Key for SYN cookies. Must not be guessable, the cpu clock is only a
+   * fallback */
+  fd = open ("/dev/urandom", O_RDONLY);
+  if (fd < 0 || read (fd, tm->syn_cookie_secret,
+		       sizeof (tm->syn_cookie_secret))
+      != sizeof (tm->syn_cookie_secret))
+    {
+      clib_warning ("no /dev/urandom, SYN cookie key from the cpu clock");
+      seed = clib_cpu_time_now ();
+      tm->syn_cookie_secret[0] = random_u64 (&seed);
+      tm->syn_cookie_secret[1] = random_u64 (&seed);
+    }
+  if (fd >= 0)
+    close (fd);
 
   /* Initialize clocks per tick for TCP timestamp. Used to compute
    * monotonically increasing timestamps. */
@@ -802,12 +886,298 @@ tcp_init (vlib_main_t * vm)
   tm->vlib_main = vm;
   tm->vnet_main = vnet_get_main ();
   tm->is_enabled = 0;
+  tm->gro_enabled = 1;
+  tm->syn_cookies = TCP_SYN_COOKIES_AUTO;
+  tm->syn_cookie_threshold = TCP_SYN_COOKIE_THRESHOLD;
 
   return 0;
 }
 
 VLIB_INIT_FUNCTION (tcp_init);
 
+static char *tcp_syn_cookies_mode_names[] = {
+#define _(sym, str) str,
+  foreach_tcp_syn_cookies_mode
+#undef _
+};
+
+static uword
+unformat_tcp_syn_cookies_mode (unformat_input_t * input, va_list * args)
+{
+  u8 *result = va_arg (*args, u8 *);
+
+#define _(sym, str)					\
+  if (unformat (input, str))				\
+    {							\
+      *result = TCP_SYN_COOKIES_##sym;			\
+      return 1;						\
+    }
+  foreach_tcp_syn_cookies_mode
+#undef _
+    return 0;
+}
+
+static char *tcp_cc_algo_names[] = {
+#define _(sym, str) str,
+  foreach_tcp_cc_algorithm
+#undef _
+};
+
+u8 *
+format_tcp_cc_algo (u8 * s, va_list * args)
+{
+  u32 type = va_arg (*args, u32);
+
+  if (type >= TCP_CC_N_ALGOS)
+    return format (s, "unknown %u", type);
+  return format (s, "%s", tcp_cc_algo_names[type]);
+}
+
+uword
+unformat_tcp_cc_algo (unformat_input_t * input, va_list * args)
+{
+  u32 *result = va_arg (*args, u32 *);
+
+#define _(sym, str)					\
+  if (unformat (input, str))				\
+    {							\
+      *result = TCP_CC_##sym;				\
+      return 1;						\
+    }
+  foreach_tcp_cc_algorithm
+#undef _
+    return 0;
+}
+
+static clib_error_t *
+tcp_config_fn (vlib_main_t * vm, unformat_input_t * input)
+{
+  tcp_main_t *tm = vnet_get_tcp_main ();
+
+  while (unformat_check_input (input) != UNFORMAT_END_OF_INPUT)
+    {
+      if (unformat (input, "cc-algo %U", unformat_tcp_cc_algo, &tm->cc_algo))
+	;
+      else if (unformat (input, "tso"))
+	tm->tso_enabled = 1;
+      else if (unformat (input, "no-gro"))
+	tm->gro_enabled = 0;
+      else if (unformat (input, "syn-cookies %U",
+			 unformat_tcp_syn_cookies_mode, &tm->syn_cookies))
+	;
+      else if (unformat (input, "syn-cookie-threshold %u",
+			 &tm->syn_cookie_threshold))
+	;
+      else
+	return clib_error_return (0, "unknown input `%U'",
+				  format_unformat_error, input);
+    }
+  return 0;
+}
+
+VLIB_CONFIG_FUNCTION (tcp_config_fn, "tcp");
+
+static clib_error_t *
+tcp_set_cc_algo_command_fn (vlib_main_t * vm, unformat_input_t * input,
+			    vlib_cli_command_t * cmd)
+{
+  tcp_main_t *tm = vnet_get_tcp_main ();
+  u32 cc_algo = ~0;
+
+  while (unformat_check_input (input) != UNFORMAT_END_OF_INPUT)
+    {
+      if (unformat (input, "%U", unformat_tcp_cc_algo, &cc_algo))
+	;
+      else
+	return clib_error_return (0, "unknown input `%U'",
+				  format_unformat_error, input);
+    }
+
+  if (cc_algo == ~0)
+    {
+      vlib_cli_output (vm, "%U", format_tcp_cc_algo, tm->cc_algo);
+      return 0;
+    }
+
+  tm->cc_algo = cc_algo;
+  return 0;
+}
+
+/*?
+ * Set the congestion control algorithm used by new TCP connections whose
+ * application did not select one. Without an argument, the current default
+ * is shown. The startup default is set with the <em>cc-algo</em> parameter
+ * of the <em>tcp</em> startup config stanza.
+ *
+ * @cliexpar
+ * @cliexcmd{set tcp cc-algo cubic}
+?*/
+/* *INDENT-OFF* */
+VLIB_CLI_COMMAND (tcp_set_cc_algo_command, static) =
+{
+  .path = "set tcp cc-algo",
+  .short_help = "set tcp cc-algo [newreno|cubic]",
+  .function = tcp_set_cc_algo_command_fn,
+};
+/* *INDENT-ON* */
+
+static clib_error_t *
+tcp_set_tso_command_fn (vlib_main_t * vm, unformat_input_t * input,
+			vlib_cli_command_t * cmd)
+{
+  tcp_main_t *tm = vnet_get_tcp_main ();
+  u8 tso_enabled = ~0;
+
+  while (unformat_check_input (input) != UNFORMAT_END_OF_INPUT)
+    {
+      if (unformat (input, "on"))
+	tso_enabled = 1;
+      else if (unformat (input, "off"))
+	tso_enabled = 0;
+      else
+	return clib_error_return (0, "unknown input `%U'",
+				  format_unformat_error, input);
+    }
+
+  if (tso_enabled == (u8) ~ 0)
+    {
+      vlib_cli_output (vm, "tso %s", tm->tso_enabled ? "on" : "off");
+      return 0;
+    }
+
+  tm->tso_enabled = tso_enabled;
+  return 0;
+}
+
+/*?
+ * Enable or disable TCP segmentation offload. When on, the session layer
+ * hands TCP up to 64KB of data per packet. Interfaces that support it
+ * segment such packets in hardware, for all others they are segmented in
+ * software by interface-output. Without an argument, the current setting
+ * is shown. Can also be enabled with <em>tso</em> in the <em>tcp</em>
+ * startup config stanza.
+ *
+ * @cliexpar
+ * @cliexcmd{set tcp tso on}
+?*/
+/* *INDENT-OFF* */
+VLIB_CLI_COMMAND (tcp_set_tso_command, static) =
+{
+  .path = "set tcp tso",
+  .short_help = "set tcp tso [on|off]",
+  .function = tcp_set_tso_command_fn,
+};
+/* *INDENT-ON* */
+
+static clib_error_t *
+tcp_set_gro_command_fn (vlib_main_t * vm, unformat_input_t * input,
+			vlib_cli_command_t * cmd)
+{
+  tcp_main_t *tm = vnet_get_tcp_main ();
+  u8 gro_enabled = ~0;
+
+  while (unformat_check_input (input) != UNFORMAT_END_OF_INPUT)
+    {
+      if (unformat (input, "on"))
+	gro_enabled = 1;
+      else if (unformat (input, "off"))
+	gro_enabled = 0;
+      else
+	return clib_error_return (0, "unknown input `%U'",
+				  format_unformat_error, input);
+    }
+
+  if (gro_enabled == (u8) ~ 0)
+    {
+      vlib_cli_output (vm, "gro %s", tm->gro_enabled ? "on" : "off");
+      return 0;
+    }
+
+  tm->gro_enabled = gro_enabled;
+  return 0;
+}
+
+/*?
+ * Enable or disable TCP receive offload. When on, in-order segments of a
+ * connection that arrive back to back in a frame are merged in a buffer
+ * chain and handed to the session layer, and considered for an ACK, only
+ * once. Without an argument, the current setting is shown. On by default,
+ * can be disabled with <em>no-gro</em> in the <em>tcp</em> startup config
+ * stanza.
+ *
+ * @cliexpar
+ * @cliexcmd{set tcp gro off}
+?*/
+/* *INDENT-OFF* */
+VLIB_CLI_COMMAND (tcp_set_gro_command, static) =
+{
+  .path = "set tcp gro",
+  .short_help = "set tcp gro [on|off]",
+  .function = tcp_set_gro_command_fn,
+};
+/* *INDENT-ON* */
+
+static clib_error_t *
+tcp_set_syn_cookies_command_fn (vlib_main_t * vm, unformat_input_t * input,
+				vlib_cli_command_t * cmd)
+{
+  tcp_main_t *tm = vnet_get_tcp_main ();
+  u8 mode = ~0;
+  u32 threshold = ~0, i;
+
+  while (unformat_check_input (input) != UNFORMAT_END_OF_INPUT)
+    {
+      if (unformat (input, "%U", unformat_tcp_syn_cookies_mode, &mode))
+	;
+      else if (unformat (input, "threshold %u", &threshold))
+	;
+      else
+	return clib_error_return (0, "unknown input `%U'",
+				  format_unformat_error, input);
+    }
+
+  if (mode == (u8) ~ 0 && threshold == ~0)
+    {
+      vlib_cli_output (vm, "syn-cookies %s threshold %u",
+		       tcp_syn_cookies_mode_names[tm->syn_cookies],
+		       tm->syn_cookie_threshold);
+      for (i = 0; i < vec_len (tm->n_half_open); i++)
+	vlib_cli_output (vm, "thread %u: %u half-open", i,
+			 tm->n_half_open[i]);
+      return 0;
+    }
+
+  if (mode != (u8) ~ 0)
+    tm->syn_cookies = mode;
+  if (threshold != ~0)
+    tm->syn_cookie_threshold = threshold;
+  return 0;
+}
+
+/*?
+ * Configure SYN cookies. With cookies, tcp-listen answers a SYN without
+ * allocating a connection or a session. The state needed to establish the
+ * connection is encoded in the initial sequence number of the SYN-ACK and
+ * recovered from the peer's ACK. In <em>auto</em> mode, the default,
+ * cookies are only used by a thread once it holds <em>threshold</em>
+ * passive half-open connections. Without an argument, the current
+ * settings and the half-open connections per thread are shown. Also
+ * configurable with <em>syn-cookies</em> and
+ * <em>syn-cookie-threshold</em> in the <em>tcp</em> startup config
+ * stanza.
+ *
+ * @cliexpar
+ * @cliexcmd{set tcp syn-cookies auto threshold 256}
+?*/
+/* *INDENT-OFF* */
+VLIB_CLI_COMMAND (tcp_set_syn_cookies_command, static) =
+{
+  .path = "set tcp syn-cookies",
+  .short_help = "set tcp syn-cookies [on|off|auto] [threshold <n>]",
+  .function = tcp_set_syn_cookies_command_fn,
+};
+/* *INDENT-ON* */
+
 /*
  * fd.io coding-style-patch-verification: ON
  *
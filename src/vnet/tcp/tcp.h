@@ -33,6 +33,8 @@
 #define TCP_DUPACK_THRESHOLD 3
 #define TCP_MAX_RX_FIFO_SIZE 2 << 20
 #define TCP_IW_N_SEGMENTS 10
+#define TCP_MAX_GSO_SZ (65535 - MAX_HDRS_LEN)	/**< Max TSO send size */
+#define TCP_MAX_GRO_SZ 65535	/**< Max payload merged on receive */
 
 /** TCP FSM state definitions as per RFC793. */
 #define foreach_tcp_fsm_state   \
@@ -108,7 +110,9 @@ void tcp_update_time (f64 now, u32 thread_index);
   _(FINSNT, "FIN sent")				\
   _(SENT_RCV_WND0, "Sent 0 receive window")     \
   _(RECOVERY, "Recovery on")                    \
-  _(FAST_RECOVERY, "Fast Recovery on")
+  _(FAST_RECOVERY, "Fast Recovery on")          \
+  _(SACK_RECOVERY, "SACK based recovery")	\
+  _(HALF_OPEN, "Passive open not established")
 
 typedef enum _tcp_connection_flag_bits
 {
@@ -130,6 +134,7 @@ typedef enum _tcp_connection_flag
 #define foreach_tcp_buf_flag                            \
   _ (ACK)       /**< Sending ACK. */                    \
   _ (DUPACK)    /**< Sending DUPACK. */                 \
+  _ (APP_OWNED) /**< Handed over to zero-copy app. */   \
 
 enum
 {
@@ -155,20 +160,52 @@ typedef struct _sack_scoreboard_hole
   u32 prev;		/**< Index for previous entry in linked list */
   u32 start;		/**< Start sequence number */
   u32 end;		/**< End sequence number */
+  u32 left;		/**< Lookup treap child with lower sequence numbers */
+  u32 right;		/**< Lookup treap child with higher sequence numbers */
+  u32 prio;		/**< Lookup treap priority */
 } sack_scoreboard_hole_t;
 
+/**
+ * SACK scoreboard as per RFC6675
+ *
+ * Holes, i.e., the un-SACKed ranges below the highest SACKed sequence
+ * number, are kept in a sequence ordered linked list that's walked to
+ * process acks and retransmit. Holes are also indexed by a treap, so that
+ * the hole a SACK block or the retransmit point falls into is found in
+ * O(log n) with thousands of holes.
+ */
 typedef struct _sack_scoreboard
 {
   sack_scoreboard_hole_t *holes;	/**< Pool of holes */
   u32 head;				/**< Index to first entry */
+  u32 tail;				/**< Index to last entry */
+  u32 root;				/**< Index to lookup treap root */
   u32 sacked_bytes;			/**< Number of bytes sacked in sb */
+  u32 last_sacked_bytes;		/**< Number of bytes sacked by last ack */
+  u32 hole_bytes;			/**< Number of bytes in holes */
+  u32 lost_bytes;			/**< Number of bytes in lost holes */
+  u32 high_sacked;			/**< End of highest SACKed range */
+  u32 high_lost;			/**< End of highest lost hole */
+  u32 high_rxt;				/**< End of highest retransmitted range */
+  u32 rescue_rxt;			/**< End of last rescue retransmission */
+  u32 seed;				/**< Seed for treap priorities */
 } sack_scoreboard_t;
 
+#define foreach_tcp_cc_algorithm		\
+  _(NEWRENO, "newreno")				\
+  _(CUBIC, "cubic")
+
 typedef enum _tcp_cc_algorithm_type
 {
-  TCP_CC_NEWRENO,
+#define _(sym, str) TCP_CC_##sym,
+  foreach_tcp_cc_algorithm
+#undef _
+  TCP_CC_N_ALGOS,
 } tcp_cc_algorithm_type_e;
 
+/** Per connection congestion control algorithm private data size */
+#define TCP_CC_DATA_SZ 24
+
 typedef struct _tcp_cc_algorithm tcp_cc_algorithm_t;
 
 typedef enum _tcp_cc_ack_t
@@ -224,7 +261,9 @@ typedef struct _tcp_connection
   u32 bytes_acked;	/**< Bytes acknowledged by current segment */
   u32 rtx_bytes;	/**< Retransmitted bytes */
   u32 tsecr_last_ack;	/**< Timestamp echoed to us in last healthy ACK */
+  u32 snd_congestion;	/**< snd_una_max when recovery started */
   tcp_cc_algorithm_t *cc_algo;	/**< Congestion control algorithm */
+  u8 cc_data[TCP_CC_DATA_SZ];	/**< Congestion control algo private data */
 
   /* RTT and RTO */
   u32 rto;		/**< Retransmission timeout */
@@ -244,13 +283,15 @@ struct _tcp_cc_algorithm
   void (*congestion) (tcp_connection_t * tc);
   void (*recovered) (tcp_connection_t * tc);
   void (*init) (tcp_connection_t * tc);
+  void (*loss) (tcp_connection_t * tc);	/**< Optional, called on RTO */
 };
 
 #define tcp_fastrecovery_on(tc) (tc)->flags |= TCP_CONN_FAST_RECOVERY
-#define tcp_fastrecovery_off(tc) (tc)->flags &= ~TCP_CONN_FAST_RECOVERY
+#define tcp_fastrecovery_off(tc) (tc)->flags &= ~(TCP_CONN_FAST_RECOVERY | TCP_CONN_SACK_RECOVERY)
 #define tcp_in_fastrecovery(tc) ((tc)->flags & TCP_CONN_FAST_RECOVERY)
+#define tcp_in_sack_recovery(tc) ((tc)->flags & TCP_CONN_SACK_RECOVERY)
 #define tcp_in_recovery(tc) ((tc)->flags & (TCP_CONN_FAST_RECOVERY | TCP_CONN_RECOVERY))
-#define tcp_recovery_off(tc) ((tc)->flags &= ~(TCP_CONN_FAST_RECOVERY | TCP_CONN_RECOVERY))
+#define tcp_recovery_off(tc) ((tc)->flags &= ~(TCP_CONN_FAST_RECOVERY | TCP_CONN_RECOVERY | TCP_CONN_SACK_RECOVERY))
 #define tcp_in_slowstart(tc) (tc->cwnd < tc->ssthresh)
 
 typedef enum
@@ -260,6 +301,22 @@ typedef enum
   TCP_N_AF,
 } tcp_af_t;
 
+/** SYN cookie modes */
+#define foreach_tcp_syn_cookies_mode		\
+  _(OFF, "off")					\
+  _(ON, "on")					\
+  _(AUTO, "auto")
+
+typedef enum _tcp_syn_cookies_mode
+{
+#define _(sym, str) TCP_SYN_COOKIES_##sym,
+  foreach_tcp_syn_cookies_mode
+#undef _
+} tcp_syn_cookies_mode_e;
+
+#define TCP_SYN_COOKIE_THRESHOLD 1024	/**< Default half-opens per thread */
+#define TCP_SYN_COOKIE_PERIOD 64.0	/**< Cookie counter period (s) */
+
 typedef enum _tcp_error
 {
 #define tcp_error(n,s) TCP_ERROR_##n,
@@ -308,9 +365,36 @@ typedef struct _tcp_main
   /* Congestion control algorithms registered */
   tcp_cc_algorithm_t *cc_algos;
 
+  /** Algorithm used by connections whose app did not pick one */
+  tcp_cc_algorithm_type_e cc_algo;
+
+  /** Per worker-thread time, refreshed by tcp_update_time. This is what
+   *  congestion control algorithms see as now */
+  f64 *time_now;
+
   /* Flag that indicates if stack is on or off */
   u8 is_enabled;
 
+  /** Session layer may hand over up to TCP_MAX_GSO_SZ bytes per packet,
+   *  segmented by the nic or by interface-output */
+  u8 tso_enabled;
+
+  /** Coalesce in-order segments received in a frame. On by default */
+  u8 gro_enabled;
+
+  /** When SYNs are answered with cookies, see tcp_syn_cookies_mode_e */
+  u8 syn_cookies;
+
+  /** In auto mode, passive half-open connections a thread holds before
+   *  it answers SYNs with cookies */
+  u32 syn_cookie_threshold;
+
+  /** Per worker-thread number of passive half-open connections */
+  u32 *n_half_open;
+
+  /** Keys the SYN cookie hash */
+  u64 syn_cookie_secret[2];
+
   /* convenience */
   vlib_main_t *vlib_main;
   vnet_main_t *vnet_main;
@@ -350,6 +434,20 @@ tcp_connection_get_if_valid (u32 conn_index, u32 thread_index)
   return pool_elt_at_index (tcp_main.connections[thread_index], conn_index);
 }
 
+/**
+ * Stop counting a passive open as half-open, once it's established or
+ * goes away
+ */
+always_inline void
+tcp_connection_half_open_done (tcp_connection_t * tc)
+{
+  if (tc->flags & TCP_CONN_HALF_OPEN)
+    {
+      tc->flags &= ~TCP_CONN_HALF_OPEN;
+      tcp_main.n_half_open[tc->c_thread_index]--;
+    }
+}
+
 void tcp_connection_close (tcp_connection_t * tc);
 void tcp_connection_cleanup (tcp_connection_t * tc);
 void tcp_connection_del (tcp_connection_t * tc);
@@ -371,12 +469,15 @@ tcp_half_open_connection_get (u32 conn_index)
 }
 
 void tcp_make_ack (tcp_connection_t * ts, vlib_buffer_t * b);
+void tcp_send_ack (tcp_connection_t * tc);
 void tcp_make_fin (tcp_connection_t * tc, vlib_buffer_t * b);
 void tcp_make_synack (tcp_connection_t * ts, vlib_buffer_t * b);
+void tcp_make_synack_cookie (tcp_connection_t * tc, vlib_buffer_t * b);
 void tcp_send_reset (vlib_buffer_t * pkt, u8 is_ip4);
 void tcp_send_syn (tcp_connection_t * tc);
 void tcp_send_fin (tcp_connection_t * tc);
 void tcp_set_snd_mss (tcp_connection_t * tc);
+u32 tcp_initial_window_to_advertise (tcp_connection_t * tc);
 
 always_inline u32
 tcp_end_seq (tcp_header_t * th, u32 len)
@@ -394,11 +495,16 @@ tcp_end_seq (tcp_header_t * th, u32 len)
 #define timestamp_lt(_t1, _t2) ((i32)((_t1)-(_t2)) < 0)
 #define timestamp_leq(_t1, _t2) ((i32)((_t1)-(_t2)) <= 0)
 
+/**
+ * Bytes in flight, the pipe estimate of RFC6675 if SACKs are received.
+ *
+ * Retransmitted bytes are in flight again, SACKed and lost ones are not.
+ */
 always_inline u32
 tcp_flight_size (const tcp_connection_t * tc)
 {
   return tc->snd_una_max - tc->snd_una - tc->sack_sb.sacked_bytes
-    + tc->rtx_bytes;
+    - tc->sack_sb.lost_bytes + tc->rtx_bytes;
 }
 
 /**
@@ -453,7 +559,7 @@ u32 tcp_push_header (transport_connection_t * tconn, vlib_buffer_t * b);
 
 u32
 tcp_prepare_retransmit_segment (tcp_connection_t * tc, vlib_buffer_t * b,
-				u32 max_bytes);
+				u32 offset, u32 max_bytes);
 
 void tcp_connection_timers_init (tcp_connection_t * tc);
 void tcp_connection_timers_reset (tcp_connection_t * tc);
@@ -512,9 +618,18 @@ tcp_timer_is_active (tcp_connection_t * tc, tcp_timers_e timer)
   return tc->timers[timer] != TCP_TIMER_HANDLE_INVALID;
 }
 
-void
-scoreboard_remove_hole (sack_scoreboard_t * sb,
-			sack_scoreboard_hole_t * hole);
+void scoreboard_init (sack_scoreboard_t * sb);
+void scoreboard_clear (sack_scoreboard_t * sb, u32 snd_una);
+void scoreboard_remove_hole (sack_scoreboard_t * sb,
+			     sack_scoreboard_hole_t * hole);
+sack_scoreboard_hole_t *scoreboard_insert_hole (sack_scoreboard_t * sb,
+						sack_scoreboard_hole_t * prev,
+						u32 start, u32 end);
+sack_scoreboard_hole_t *scoreboard_lookup (sack_scoreboard_t * sb, u32 seq);
+void scoreboard_init_rxt (sack_scoreboard_t * sb, u32 snd_una);
+u32 scoreboard_next_rxt_seg (tcp_connection_t * tc, u32 max_bytes,
+			     u8 have_unsent, u32 * seq);
+void tcp_rcv_sacks (tcp_connection_t * tc, u32 ack);
 
 always_inline sack_scoreboard_hole_t *
 scoreboard_next_hole (sack_scoreboard_t * sb, sack_scoreboard_hole_t * hole)
@@ -524,6 +639,14 @@ scoreboard_next_hole (sack_scoreboard_t * sb, sack_scoreboard_hole_t * hole)
   return 0;
 }
 
+always_inline sack_scoreboard_hole_t *
+scoreboard_prev_hole (sack_scoreboard_t * sb, sack_scoreboard_hole_t * hole)
+{
+  if (hole->prev != TCP_INVALID_SACK_HOLE_INDEX)
+    return pool_elt_at_index (sb->holes, hole->prev);
+  return 0;
+}
+
 always_inline sack_scoreboard_hole_t *
 scoreboard_first_hole (sack_scoreboard_t * sb)
 {
@@ -532,14 +655,19 @@ scoreboard_first_hole (sack_scoreboard_t * sb)
   return 0;
 }
 
-always_inline void
-scoreboard_clear (sack_scoreboard_t * sb)
+always_inline sack_scoreboard_hole_t *
+scoreboard_last_hole (sack_scoreboard_t * sb)
 {
-  sack_scoreboard_hole_t *hole = scoreboard_first_hole (sb);
-  while ((hole = scoreboard_first_hole (sb)))
-    {
-      scoreboard_remove_hole (sb, hole);
-    }
+  if (sb->tail != TCP_INVALID_SACK_HOLE_INDEX)
+    return pool_elt_at_index (sb->holes, sb->tail);
+  return 0;
+}
+
+/** RFC6675 IsLost (HighACK + 1), i.e., recovery can start */
+always_inline u8
+scoreboard_first_hole_is_lost (sack_scoreboard_t * sb)
+{
+  return sb->lost_bytes != 0;
 }
 
 always_inline u32
@@ -565,7 +693,26 @@ tcp_cc_algo_get (tcp_cc_algorithm_type_e type)
   return &tm->cc_algos[type];
 }
 
+always_inline void *
+tcp_cc_data (tcp_connection_t * tc)
+{
+  return tc->cc_data;
+}
+
+/** Time, in seconds, as seen by congestion control algorithms */
+always_inline f64
+tcp_cc_time_now (u32 thread_index)
+{
+  return tcp_main.time_now[thread_index];
+}
+
 void tcp_cc_init (tcp_connection_t * tc);
+void tcp_connection_set_cc_algo (tcp_connection_t * tc,
+				 tcp_cc_algorithm_type_e type);
+tcp_cc_algorithm_type_e tcp_cc_algo_for_app (u32 app_index);
+
+format_function_t format_tcp_cc_algo;
+unformat_function_t unformat_tcp_cc_algo;
 
 /**
  * Push TCP header to buffer
@@ -0,0 +1,226 @@
+/*
+ * Copyright (c) 2017 Cisco and/or its affiliates.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * CUBIC congestion control as per RFC8312
+ *
+ * In congestion avoidance the window follows a cubic function of the time
+ * elapsed since the last congestion event, centered on the window at which
+ * that event happened (w_max). Growth thereby does not depend on the RTT,
+ * which lets long fat pipes recover in seconds instead of the thousands of
+ * RTTs NewReno needs. Windows are computed in segments.
+ */
+
+#include <vnet/tcp/tcp.h>
+#include <math.h>
+
+#define cubic_beta 0.7
+#define cubic_c 0.4
+#define cubic_fast_convergence 1
+
+typedef struct cubic_data_
+{
+  /** Window, in segments, before the last congestion event */
+  f64 w_max;
+
+  /** Time period, in seconds, for the window to grow back to w_max */
+  f64 K;
+
+  /** Start time of the current congestion avoidance epoch. 0 if none */
+  f64 t_start;
+} cubic_data_t;
+
+STATIC_ASSERT (sizeof (cubic_data_t) <= TCP_CC_DATA_SZ, "cubic data len");
+
+static inline f64
+cubic_time (u32 thread_index)
+{
+  return tcp_cc_time_now (thread_index);
+}
+
+/**
+ * RFC8312 Eq. 1: W_cubic(t) = C*(t-K)^3 + W_max
+ */
+static inline f64
+W_cubic (cubic_data_t * cd, f64 t)
+{
+  f64 diff = t - cd->K;
+  return cubic_c * diff * diff * diff + cd->w_max;
+}
+
+/**
+ * RFC8312 Eq. 4: W_est(t) = W_max*beta + 3*(1-beta)/(1+beta) * t/RTT
+ *
+ * Window standard TCP would have after t seconds in congestion avoidance.
+ */
+static inline f64
+W_est (cubic_data_t * cd, f64 t, f64 rtt)
+{
+  f64 alpha = 3 * (1 - cubic_beta) / (1 + cubic_beta);
+  return cd->w_max * cubic_beta + alpha * t / rtt;
+}
+
+static void
+cubic_congestion (tcp_connection_t * tc)
+{
+  cubic_data_t *cd = (cubic_data_t *) tcp_cc_data (tc);
+  f64 w = (f64) tc->cwnd / tc->snd_mss;
+
+  /* RFC8312 4.6: release bandwidth to new flows if the window shrank
+   * since the previous congestion event */
+  if (cubic_fast_convergence && w < cd->w_max)
+    cd->w_max = w * (1 + cubic_beta) / 2;
+  else
+    cd->w_max = w;
+
+  cd->t_start = 0;
+  tc->prev_ssthresh = tc->ssthresh;
+  tc->ssthresh = clib_max (cubic_beta * tc->cwnd, 2 * tc->snd_mss);
+}
+
+/**
+ * RFC8312 4.7: on timeout, reduce the window like standard TCP but set
+ * ssthresh with beta. The next epoch starts at the loss window with K = 0
+ */
+static void
+cubic_loss (tcp_connection_t * tc)
+{
+  cubic_data_t *cd = (cubic_data_t *) tcp_cc_data (tc);
+
+  tc->prev_ssthresh = tc->ssthresh;
+  tc->ssthresh = clib_max (cubic_beta * tc->cwnd, 2 * tc->snd_mss);
+  tc->cwnd = tcp_loss_wnd (tc);
+
+  cd->w_max = 0;
+  cd->K = 0;
+  cd->t_start = 0;
+}
+
+static void
+cubic_recovered (tcp_connection_t * tc)
+{
+  tc->cwnd = tc->ssthresh;
+}
+
+/**
+ * Start a congestion avoidance epoch at the current window. Also handles
+ * epochs that do not start at beta * w_max, e.g., after an RTO.
+ */
+static void
+cubic_epoch_start (tcp_connection_t * tc, cubic_data_t * cd)
+{
+  f64 w = (f64) tc->cwnd / tc->snd_mss;
+
+  cd->t_start = cubic_time (tc->c_thread_index);
+  if (w < cd->w_max)
+    cd->K = cbrt ((cd->w_max - w) / cubic_c);
+  else
+    {
+      cd->K = 0;
+      cd->w_max = w;
+    }
+}
+
+static void
+cubic_rcv_ack (tcp_connection_t * tc)
+{
+  cubic_data_t *cd = (cubic_data_t *) tcp_cc_data (tc);
+  f64 t, rtt, w, target, w_est;
+  u32 inc;
+
+  if (tcp_in_slowstart (tc))
+    {
+      tc->cwnd += clib_min (tc->snd_mss, tc->bytes_acked);
+      return;
+    }
+
+  if (cd->t_start == 0)
+    cubic_epoch_start (tc, cd);
+
+  t = cubic_time (tc->c_thread_index) - cd->t_start;
+  rtt = clib_max (tc->srtt * TCP_TICK, TCP_TICK);
+  w = (f64) tc->cwnd / tc->snd_mss;
+
+  /* RFC8312 4.3: aim for the window one RTT from now, but never grow by
+   * more than half a segment per acked segment */
+  target = clib_min (W_cubic (cd, t + rtt), 1.5 * w);
+
+  /* RFC8312 4.2: TCP friendly region, grow at least as fast as NewReno */
+  w_est = W_est (cd, t, rtt);
+  target = clib_max (target, w_est);
+
+  /* RFC8312 4.4: concave/convex regions, cwnd grows by
+   * (target - cwnd)/cwnd per acked segment. Otherwise probe very slowly */
+  if (target > w)
+    inc = (target - w) * tc->bytes_acked / w;
+  else
+    inc = tc->bytes_acked / (100 * w);
+
+  /* Round up to 1 if needed */
+  tc->cwnd += clib_max (inc, 1);
+}
+
+static void
+cubic_rcv_cong_ack (tcp_connection_t * tc, tcp_cc_ack_t ack_type)
+{
+  if (ack_type == TCP_CC_DUPACK)
+    {
+      tc->cwnd += tc->snd_mss;
+    }
+  else if (ack_type == TCP_CC_PARTIALACK)
+    {
+      tc->cwnd -= clib_min (tc->bytes_acked, tc->cwnd);
+      tc->cwnd += tc->snd_mss;
+    }
+}
+
+static void
+cubic_conn_init (tcp_connection_t * tc)
+{
+  cubic_data_t *cd = (cubic_data_t *) tcp_cc_data (tc);
+
+  memset (cd, 0, sizeof (*cd));
+  tc->ssthresh = tc->snd_wnd;
+  tc->cwnd = tcp_initial_cwnd (tc);
+}
+
+const static tcp_cc_algorithm_t tcp_cubic = {
+  .congestion = cubic_congestion,
+  .recovered = cubic_recovered,
+  .rcv_ack = cubic_rcv_ack,
+  .rcv_cong_ack = cubic_rcv_cong_ack,
+  .init = cubic_conn_init,
+  .loss = cubic_loss
+};
+
+clib_error_t *
+cubic_init (vlib_main_t * vm)
+{
+  clib_error_t *error = 0;
+
+  tcp_cc_algo_register (TCP_CC_CUBIC, &tcp_cubic);
+
+  return error;
+}
+
+VLIB_INIT_FUNCTION (cubic_init);
+
+/*
+ * fd.io coding-style-patch-verification: ON
+ *
+ * Local Variables:
+ * eval: (c-set-style "gnu")
+ * End:
+ */
@@ -17,6 +17,7 @@
 #include <vnet/tcp/tcp_packet.h>
 #include <vnet/tcp/tcp.h>
 #include <vnet/session/session.h>
+#include <vppinfra/siphash.h>
 #include <math.h>
 
 static char *tcp_error_strings[] = {
@@ -60,7 +61,10 @@ typedef enum _tcp_listen_next
 #define _(s,n) TCP_LISTEN_NEXT_##s,
   foreach_tcp_state_next
 #undef _
-    TCP_LISTEN_N_NEXT,
+    /* SYN cookie SYN-ACKs have no connection to go through tcp-output */
+    TCP_LISTEN_NEXT_IP4_LOOKUP,
+  TCP_LISTEN_NEXT_IP6_LOOKUP,
+  TCP_LISTEN_N_NEXT,
 } tcp_listen_next_t;
 
 /* Generic, state independent indices */
@@ -404,6 +408,164 @@ tcp_ack_is_dupack (tcp_connection_t * tc, vlib_buffer_t * b, u32 new_snd_wnd)
 	  && (new_snd_wnd == tc->snd_wnd));
 }
 
+/*
+ * SACK scoreboard hole lookup treap. Holes are ordered by start sequence
+ * number, priorities are random so the expected depth is O(log n).
+ */
+
+static void
+scoreboard_treap_rotate_left (sack_scoreboard_t * sb, u32 * rootp)
+{
+  sack_scoreboard_hole_t *root, *pivot;
+  u32 pivot_index;
+
+  root = pool_elt_at_index (sb->holes, *rootp);
+  pivot_index = root->right;
+  pivot = pool_elt_at_index (sb->holes, pivot_index);
+  root->right = pivot->left;
+  pivot->left = *rootp;
+  *rootp = pivot_index;
+}
+
+static void
+scoreboard_treap_rotate_right (sack_scoreboard_t * sb, u32 * rootp)
+{
+  sack_scoreboard_hole_t *root, *pivot;
+  u32 pivot_index;
+
+  root = pool_elt_at_index (sb->holes, *rootp);
+  pivot_index = root->left;
+  pivot = pool_elt_at_index (sb->holes, pivot_index);
+  root->left = pivot->right;
+  pivot->right = *rootp;
+  *rootp = pivot_index;
+}
+
+static void
+scoreboard_treap_insert (sack_scoreboard_t * sb, u32 * rootp, u32 index)
+{
+  sack_scoreboard_hole_t *root, *hole, *child;
+
+  if (*rootp == TCP_INVALID_SACK_HOLE_INDEX)
+    {
+      *rootp = index;
+      return;
+    }
+
+  root = pool_elt_at_index (sb->holes, *rootp);
+  hole = pool_elt_at_index (sb->holes, index);
+  if (seq_lt (hole->start, root->start))
+    {
+      scoreboard_treap_insert (sb, &root->left, index);
+      child = pool_elt_at_index (sb->holes, root->left);
+      if (child->prio > root->prio)
+	scoreboard_treap_rotate_right (sb, rootp);
+    }
+  else
+    {
+      scoreboard_treap_insert (sb, &root->right, index);
+      child = pool_elt_at_index (sb->holes, root->right);
+      if (child->prio > root->prio)
+	scoreboard_treap_rotate_left (sb, rootp);
+    }
+}
+
+static void
+scoreboard_treap_remove (sack_scoreboard_t * sb, u32 * rootp, u32 index)
+{
+  sack_scoreboard_hole_t *root, *hole, *left, *right;
+
+  ASSERT (*rootp != TCP_INVALID_SACK_HOLE_INDEX);
+  root = pool_elt_at_index (sb->holes, *rootp);
+
+  if (*rootp != index)
+    {
+      hole = pool_elt_at_index (sb->holes, index);
+      if (seq_lt (hole->start, root->start))
+	scoreboard_treap_remove (sb, &root->left, index);
+      else
+	scoreboard_treap_remove (sb, &root->right, index);
+      return;
+    }
+
+  /* Rotate the hole down until it has at most one child */
+  if (root->left == TCP_INVALID_SACK_HOLE_INDEX)
+    {
+      *rootp = root->right;
+      return;
+    }
+  if (root->right == TCP_INVALID_SACK_HOLE_INDEX)
+    {
+      *rootp = root->left;
+      return;
+    }
+
+  left = pool_elt_at_index (sb->holes, root->left);
+  right = pool_elt_at_index (sb->holes, root->right);
+  if (left->prio > right->prio)
+    {
+      scoreboard_treap_rotate_right (sb, rootp);
+      root = pool_elt_at_index (sb->holes, *rootp);
+      scoreboard_treap_remove (sb, &root->right, index);
+    }
+  else
+    {
+      scoreboard_treap_rotate_left (sb, rootp);
+      root = pool_elt_at_index (sb->holes, *rootp);
+      scoreboard_treap_remove (sb, &root->left, index);
+    }
+}
+
+/**
+ * Find the last hole that starts at or before @a seq
+ */
+sack_scoreboard_hole_t *
+scoreboard_lookup (sack_scoreboard_t * sb, u32 seq)
+{
+  sack_scoreboard_hole_t *hole, *result = 0;
+  u32 index = sb->root;
+
+  while (index != TCP_INVALID_SACK_HOLE_INDEX)
+    {
+      hole = pool_elt_at_index (sb->holes, index);
+      if (seq_leq (hole->start, seq))
+	{
+	  result = hole;
+	  index = hole->right;
+	}
+      else
+	index = hole->left;
+    }
+  return result;
+}
+
+void
+scoreboard_init (sack_scoreboard_t * sb)
+{
+  sb->head = TCP_INVALID_SACK_HOLE_INDEX;
+  sb->tail = TCP_INVALID_SACK_HOLE_INDEX;
+  sb->root = TCP_INVALID_SACK_HOLE_INDEX;
+  sb->sacked_bytes = 0;
+  sb->last_sacked_bytes = 0;
+  sb->hole_bytes = 0;
+  sb->lost_bytes = 0;
+  if (sb->seed == 0)
+    sb->seed = clib_cpu_time_now ();
+}
+
+/**
+ * Drop all SACK state. Sequence markers restart at snd_una, as if
+ * nothing above it was ever SACKed or retransmitted
+ */
+void
+scoreboard_clear (sack_scoreboard_t * sb, u32 snd_una)
+{
+  pool_free (sb->holes);
+  scoreboard_init (sb);
+  sb->high_sacked = snd_una;
+  scoreboard_init_rxt (sb, snd_una);
+}
+
 void
 scoreboard_remove_hole (sack_scoreboard_t * sb, sack_scoreboard_hole_t * hole)
 {
@@ -414,6 +576,10 @@ scoreboard_remove_hole (sack_scoreboard_t * sb, sack_scoreboard_hole_t * hole)
       next = pool_elt_at_index (sb->holes, hole->next);
       next->prev = hole->prev;
     }
+  else
+    {
+      sb->tail = hole->prev;
+    }
 
   if (hole->prev != TCP_INVALID_SACK_HOLE_INDEX)
     {
@@ -425,149 +591,312 @@ scoreboard_remove_hole (sack_scoreboard_t * sb, sack_scoreboard_hole_t * hole)
       sb->head = hole->next;
     }
 
+  scoreboard_treap_remove (sb, &sb->root, hole - sb->holes);
+  sb->hole_bytes -= scoreboard_hole_bytes (hole);
   pool_put (sb->holes, hole);
 }
 
+/**
+ * Insert hole after @a prev, or as first hole if @a prev is 0.
+ *
+ * The pool may grow, so pointers to other holes are invalidated.
+ */
 sack_scoreboard_hole_t *
 scoreboard_insert_hole (sack_scoreboard_t * sb, sack_scoreboard_hole_t * prev,
 			u32 start, u32 end)
 {
   sack_scoreboard_hole_t *hole, *next;
-  u32 hole_index;
+  u32 hole_index, prev_index;
+
+  prev_index = prev ? prev - sb->holes : TCP_INVALID_SACK_HOLE_INDEX;
 
   pool_get (sb->holes, hole);
   memset (hole, 0, sizeof (*hole));
 
   hole->start = start;
   hole->end = end;
+  hole->left = hole->right = TCP_INVALID_SACK_HOLE_INDEX;
+  hole->prio = random_u32 (&sb->seed);
   hole_index = hole - sb->holes;
 
-  if (prev)
+  if (prev_index != TCP_INVALID_SACK_HOLE_INDEX)
     {
-      hole->prev = prev - sb->holes;
+      prev = pool_elt_at_index (sb->holes, prev_index);
+      hole->prev = prev_index;
       hole->next = prev->next;
-
-      if ((next = scoreboard_next_hole (sb, hole)))
-	next->prev = hole_index;
-
       prev->next = hole_index;
     }
   else
     {
-      sb->head = hole_index;
       hole->prev = TCP_INVALID_SACK_HOLE_INDEX;
-      hole->next = TCP_INVALID_SACK_HOLE_INDEX;
+      hole->next = sb->head;
+      sb->head = hole_index;
     }
 
+  if ((next = scoreboard_next_hole (sb, hole)))
+    next->prev = hole_index;
+  else
+    sb->tail = hole_index;
+
+  scoreboard_treap_insert (sb, &sb->root, hole_index);
+  sb->hole_bytes += end - start;
+
   return hole;
 }
 
-static void
-tcp_rcv_sacks (tcp_connection_t * tc, u32 ack)
+/**
+ * Bytes of [start, end) that have been retransmitted in this recovery
+ */
+always_inline u32
+scoreboard_rxt_bytes (sack_scoreboard_t * sb, u32 start, u32 end)
+{
+  if (!seq_lt (start, sb->high_rxt))
+    return 0;
+  return (seq_lt (end, sb->high_rxt) ? end : sb->high_rxt) - start;
+}
+
+/**
+ * Mark [start, end) as delivered, either cumulatively acked or SACKed.
+ * Trims, splits or removes the holes it overlaps, walking down from the
+ * last hole that starts before @a end. Returns the number of bytes that
+ * were in holes.
+ */
+static u32
+scoreboard_fill (tcp_connection_t * tc, u32 start, u32 end)
 {
   sack_scoreboard_t *sb = &tc->sack_sb;
-  sack_block_t *blk, tmp;
-  sack_scoreboard_hole_t *hole, *next_hole;
-  u32 blk_index = 0;
-  int i, j;
+  sack_scoreboard_hole_t *hole, *prev;
+  u32 fill_start, fill_end, filled = 0, n_bytes, rxt_bytes;
 
-  if (!tcp_opts_sack (tc) && sb->head == TCP_INVALID_SACK_HOLE_INDEX)
-    return;
+  hole = scoreboard_lookup (sb, end - 1);
+  while (hole && seq_gt (hole->end, start))
+    {
+      prev = scoreboard_prev_hole (sb, hole);
+      fill_start = seq_gt (hole->start, start) ? hole->start : start;
+      fill_end = seq_lt (hole->end, end) ? hole->end : end;
+      n_bytes = fill_end - fill_start;
 
-  /* Remove invalid blocks */
-  vec_foreach (blk, tc->opt.sacks)
-  {
-    if (seq_lt (blk->start, blk->end)
-	&& seq_gt (blk->start, tc->snd_una)
-	&& seq_gt (blk->start, ack) && seq_lt (blk->end, tc->snd_nxt))
-      continue;
+      /* Retransmitted bytes delivered leave the pipe */
+      rxt_bytes = scoreboard_rxt_bytes (sb, fill_start, fill_end);
+      tc->rtx_bytes -= clib_min (tc->rtx_bytes, rxt_bytes);
 
-    vec_del1 (tc->opt.sacks, blk - tc->opt.sacks);
-  }
+      if (fill_start == hole->start && fill_end == hole->end)
+	{
+	  scoreboard_remove_hole (sb, hole);
+	}
+      else if (fill_start == hole->start)
+	{
+	  hole->start = fill_end;
+	  sb->hole_bytes -= n_bytes;
+	}
+      else if (fill_end == hole->end)
+	{
+	  hole->end = fill_start;
+	  sb->hole_bytes -= n_bytes;
+	}
+      else
+	{
+	  u32 hole_end = hole->end;
+	  u32 prev_index = prev ? prev - sb->holes : ~0;
+	  hole->end = fill_start;
+	  sb->hole_bytes -= hole_end - fill_start;
+	  scoreboard_insert_hole (sb, hole, fill_end, hole_end);
+	  prev = prev_index != ~0 ? pool_elt_at_index (sb->holes, prev_index)
+	    : 0;
+	}
 
-  /* Add block for cumulative ack */
-  if (seq_gt (ack, tc->snd_una))
-    {
-      tmp.start = tc->snd_una;
-      tmp.end = ack;
-      vec_add1 (tc->opt.sacks, tmp);
+      filled += n_bytes;
+      hole = prev;
     }
 
-  if (vec_len (tc->opt.sacks) == 0)
-    return;
+  return filled;
+}
 
-  /* Make sure blocks are ordered */
-  for (i = 0; i < vec_len (tc->opt.sacks); i++)
-    for (j = i; j < vec_len (tc->opt.sacks); j++)
-      if (seq_lt (tc->opt.sacks[j].start, tc->opt.sacks[i].start))
+/**
+ * Find the lost holes as per RFC6675 IsLost(): a hole is lost if at least
+ * DupThresh discontiguous ranges, or more than (DupThresh - 1) * SMSS
+ * bytes, are SACKed above it. Lost holes are thereby all the holes up to
+ * some hole, found by walking down from the last one at most DupThresh
+ * holes.
+ */
+static void
+scoreboard_update_lost (sack_scoreboard_t * sb, u32 snd_mss)
+{
+  sack_scoreboard_hole_t *hole;
+  u32 sacked = 0, n_ranges = 0, bytes_above = 0, next_start;
+
+  sb->lost_bytes = 0;
+  next_start = sb->high_sacked;
+  hole = scoreboard_last_hole (sb);
+  while (hole)
+    {
+      sacked += next_start - hole->end;
+      n_ranges++;
+      if (n_ranges >= TCP_DUPACK_THRESHOLD
+	  || sacked > (TCP_DUPACK_THRESHOLD - 1) * snd_mss)
 	{
-	  tmp = tc->opt.sacks[i];
-	  tc->opt.sacks[i] = tc->opt.sacks[j];
-	  tc->opt.sacks[j] = tmp;
+	  sb->lost_bytes = sb->hole_bytes - bytes_above;
+	  sb->high_lost = hole->end;
+	  return;
 	}
+      bytes_above += scoreboard_hole_bytes (hole);
+      next_start = hole->start;
+      hole = scoreboard_prev_hole (sb, hole);
+    }
+}
 
-  /* If no holes, insert the first that covers all outstanding bytes */
-  if (sb->head == TCP_INVALID_SACK_HOLE_INDEX)
+/**
+ * Update the scoreboard with the cumulative ack and the SACK blocks of an
+ * ACK, as per RFC6675. Computes the bytes SACKed and deemed lost that
+ * tcp_flight_size() uses to estimate the pipe.
+ */
+void
+tcp_rcv_sacks (tcp_connection_t * tc, u32 ack)
+{
+  sack_scoreboard_t *sb = &tc->sack_sb;
+  sack_block_t blks[TCP_MAX_SACK_BLOCKS], *blk, tmp;
+  u32 n_blks = 0, start;
+  int i, j;
+
+  sb->last_sacked_bytes = 0;
+
+  /* Keep the blocks that SACK data above the ack that we've sent */
+  if (tcp_opts_sack (&tc->opt))
     {
-      scoreboard_insert_hole (sb, 0, tc->snd_una, tc->snd_una_max);
+      vec_foreach (blk, tc->opt.sacks)
+      {
+	if (n_blks == ARRAY_LEN (blks))
+	  break;
+	if (!seq_lt (blk->start, blk->end) || !seq_gt (blk->end, ack)
+	    || seq_gt (blk->end, tc->snd_una_max))
+	  continue;
+	blks[n_blks] = *blk;
+	if (seq_lt (blks[n_blks].start, ack))
+	  blks[n_blks].start = ack;
+	n_blks++;
+      }
     }
 
-  /* Walk the holes with the SACK blocks */
-  hole = pool_elt_at_index (sb->holes, sb->head);
-  while (hole && blk_index < vec_len (tc->opt.sacks))
+  if (n_blks == 0 && sb->head == TCP_INVALID_SACK_HOLE_INDEX)
+    return;
+
+  /* Cumulative ack. Holes below it are filled */
+  if (sb->head != TCP_INVALID_SACK_HOLE_INDEX)
+    {
+      if (seq_gt (ack, tc->snd_una))
+	scoreboard_fill (tc, tc->snd_una, ack);
+    }
+  else
     {
-      blk = &tc->opt.sacks[blk_index];
+      /* Empty scoreboard, nothing SACKed above the ack */
+      sb->high_sacked = ack;
+    }
+  if (seq_lt (sb->high_rxt, ack))
+    sb->high_rxt = ack;
 
-      if (seq_leq (blk->start, hole->start))
-	{
-	  /* Block covers hole. Remove hole */
-	  if (seq_geq (blk->end, hole->end))
-	    {
-	      next_hole = scoreboard_next_hole (sb, hole);
+  /* Make sure blocks are ordered */
+  for (i = 1; i < n_blks; i++)
+    for (j = i; j > 0 && seq_lt (blks[j].start, blks[j - 1].start); j--)
+      {
+	tmp = blks[j];
+	blks[j] = blks[j - 1];
+	blks[j - 1] = tmp;
+      }
 
-	      /* Byte accounting */
-	      if (seq_lt (hole->end, ack))
-		{
-		  /* Bytes lost because snd wnd left edge advances */
-		  if (seq_lt (next_hole->start, ack))
-		    sb->sacked_bytes -= next_hole->start - hole->end;
-		  else
-		    sb->sacked_bytes -= ack - hole->end;
-		}
-	      else
-		{
-		  sb->sacked_bytes += scoreboard_hole_bytes (hole);
-		}
+  for (i = 0; i < n_blks; i++)
+    {
+      blk = &blks[i];
 
-	      scoreboard_remove_hole (sb, hole);
-	      hole = next_hole;
-	    }
-	  /* Partial overlap */
-	  else
-	    {
-	      sb->sacked_bytes += blk->end - hole->start;
-	      hole->start = blk->end;
-	      blk_index++;
-	    }
-	}
-      else
+      /* Above the highest SACKed byte. New hole if not contiguous */
+      if (seq_gt (blk->end, sb->high_sacked))
 	{
-	  /* Hole must be split */
-	  if (seq_leq (blk->end, hole->end))
-	    {
-	      sb->sacked_bytes += blk->end - blk->start;
-	      scoreboard_insert_hole (sb, hole, blk->end, hole->end);
-	      hole->end = blk->start - 1;
-	      blk_index++;
-	    }
-	  else
-	    {
-	      sb->sacked_bytes += hole->end - blk->start + 1;
-	      hole->end = blk->start - 1;
-	      hole = scoreboard_next_hole (sb, hole);
-	    }
+	  start = seq_gt (blk->start, sb->high_sacked) ?
+	    blk->start : sb->high_sacked;
+	  if (seq_gt (start, sb->high_sacked))
+	    scoreboard_insert_hole (sb, scoreboard_last_hole (sb),
+				    sb->high_sacked, start);
+	  sb->last_sacked_bytes += blk->end - start;
+	  tmp.end = sb->high_sacked;
+	  sb->high_sacked = blk->end;
+	  blk->end = tmp.end;
 	}
+
+      /* Below it, fill holes */
+      if (seq_lt (blk->start, blk->end))
+	sb->last_sacked_bytes += scoreboard_fill (tc, blk->start, blk->end);
     }
+
+  if (seq_gt (sb->high_sacked, ack))
+    sb->sacked_bytes = sb->high_sacked - ack - sb->hole_bytes;
+  else
+    sb->sacked_bytes = 0;
+
+  scoreboard_update_lost (sb, tc->snd_mss);
+}
+
+void
+scoreboard_init_rxt (sack_scoreboard_t * sb, u32 snd_una)
+{
+  sb->high_rxt = snd_una;
+  sb->rescue_rxt = snd_una - 1;
+}
+
+/**
+ * RFC6675 NextSeg()
+ *
+ * Picks, in order: (1) the first not yet retransmitted bytes of a lost
+ * hole, (2) nothing, if there is new data to send, (3) the first not yet
+ * retransmitted bytes of any hole, (4) once per window, a rescue
+ * retransmission of the last unSACKed bytes.
+ *
+ * @param tc connection in SACK based recovery
+ * @param max_bytes max number of bytes to retransmit
+ * @param have_unsent there is new data, not yet sent
+ * @param seq first sequence number to retransmit
+ * @return number of bytes to retransmit, 0 if none
+ */
+u32
+scoreboard_next_rxt_seg (tcp_connection_t * tc, u32 max_bytes,
+			 u8 have_unsent, u32 * seq)
+{
+  sack_scoreboard_t *sb = &tc->sack_sb;
+  sack_scoreboard_hole_t *hole;
+  u32 start, floor, n_bytes;
+  u8 is_lost;
+
+  /* First hole that ends after the highest retransmitted byte */
+  hole = scoreboard_lookup (sb, sb->high_rxt);
+  if (!hole)
+    hole = scoreboard_first_hole (sb);
+  else if (!seq_gt (hole->end, sb->high_rxt))
+    hole = scoreboard_next_hole (sb, hole);
+
+  if (hole)
+    {
+      is_lost = sb->lost_bytes && seq_leq (hole->end, sb->high_lost);
+      if (!is_lost && have_unsent)
+	return 0;
+
+      start = seq_gt (hole->start, sb->high_rxt) ? hole->start : sb->high_rxt;
+      n_bytes = clib_min (max_bytes, hole->end - start);
+      *seq = start;
+      sb->high_rxt = start + n_bytes;
+      return n_bytes;
+    }
+
+  /* Rescue retransmission */
+  if (have_unsent || !seq_lt (sb->rescue_rxt, tc->snd_una))
+    return 0;
+
+  floor = seq_gt (sb->high_sacked, sb->high_rxt) ?
+    sb->high_sacked : sb->high_rxt;
+  if (!seq_lt (floor, tc->snd_una_max))
+    return 0;
+
+  n_bytes = clib_min (max_bytes, tc->snd_una_max - floor);
+  *seq = tc->snd_una_max - n_bytes;
+  sb->rescue_rxt = tc->snd_una_max;
+  return n_bytes;
 }
 
 /** Update snd_wnd
@@ -613,13 +942,19 @@ tcp_cc_rcv_ack (tcp_connection_t * tc)
 
   if (tcp_in_recovery (tc))
     {
-      partial_ack = seq_lt (tc->snd_una, tc->snd_una_max);
+      partial_ack = seq_lt (tc->snd_una, tc->snd_congestion);
       if (!partial_ack)
 	{
 	  /* Clear retransmitted bytes. */
 	  tc->rtx_bytes = 0;
 	  tcp_cc_recover (tc);
 	}
+      else if (tcp_in_sack_recovery (tc))
+	{
+	  /* The scoreboard accounts for retransmitted bytes. The ack left
+	   * room in the pipe, use it */
+	  tcp_fast_retransmit (tc);
+	}
       else
 	{
 	  /* Clear retransmitted bytes. XXX should we clear all? */
@@ -642,10 +977,28 @@ tcp_cc_rcv_ack (tcp_connection_t * tc)
 static void
 tcp_cc_rcv_dupack (tcp_connection_t * tc, u32 ack)
 {
+  sack_scoreboard_t *sb = &tc->sack_sb;
+  u8 is_sack;
+
   ASSERT (tc->snd_una == ack);
 
   tc->rcv_dupacks++;
-  if (tc->rcv_dupacks == TCP_DUPACK_THRESHOLD)
+
+  if (tcp_in_fastrecovery (tc))
+    {
+      /* With SACKs the pipe estimate, not cwnd inflation, clocks out
+       * retransmissions and new data */
+      if (tcp_in_sack_recovery (tc))
+	tcp_fast_retransmit (tc);
+      else
+	tc->cc_algo->rcv_cong_ack (tc, TCP_CC_DUPACK);
+      return;
+    }
+
+  /* RFC6675: recovery starts after DupThresh dupacks or as soon as the
+   * scoreboard says the first unacked segment is lost */
+  if (tc->rcv_dupacks == TCP_DUPACK_THRESHOLD
+      || scoreboard_first_hole_is_lost (sb))
     {
       /* RFC6582 NewReno heuristic to avoid multiple fast retransmits */
       if (tc->opt.tsecr != tc->tsecr_last_ack)
@@ -655,9 +1008,24 @@ tcp_cc_rcv_dupack (tcp_connection_t * tc, u32 ack)
 	}
 
       tcp_fastrecovery_on (tc);
+      tc->snd_congestion = tc->snd_una_max;
 
       /* Handle congestion and dupack */
       tcp_cc_congestion (tc);
+
+      /* Peers may negotiate SACKs and still not send any. If so, fall
+       * back to NewReno for this recovery */
+      is_sack = tcp_opts_sack_permitted (&tc->opt)
+	&& sb->head != TCP_INVALID_SACK_HOLE_INDEX;
+      if (is_sack)
+	{
+	  tc->flags |= TCP_CONN_SACK_RECOVERY;
+	  tc->cwnd = tc->ssthresh;
+	  scoreboard_init_rxt (sb, tc->snd_una);
+	  tcp_fast_retransmit (tc);
+	  return;
+	}
+
       tc->cc_algo->rcv_cong_ack (tc, TCP_CC_DUPACK);
 
       tcp_fast_retransmit (tc);
@@ -667,21 +1035,31 @@ tcp_cc_rcv_dupack (tcp_connection_t * tc, u32 ack)
        * buffered at the receiver */
       tc->cwnd = tc->ssthresh + TCP_DUPACK_THRESHOLD * tc->snd_mss;
     }
-  else if (tc->rcv_dupacks > TCP_DUPACK_THRESHOLD)
-    {
-      ASSERT (tcp_in_fastrecovery (tc));
-
-      tc->cc_algo->rcv_cong_ack (tc, TCP_CC_DUPACK);
-    }
 }
 
 void
 tcp_cc_init (tcp_connection_t * tc)
 {
-  tc->cc_algo = tcp_cc_algo_get (TCP_CC_NEWRENO);
+  /* Passive opens inherit the algorithm from the listener */
+  if (!tc->cc_algo)
+    tc->cc_algo = tcp_cc_algo_get (tcp_main.cc_algo);
   tc->cc_algo->init (tc);
 }
 
+/**
+ * Apply the congestion control algorithm picked by the app once an active
+ * open has a session, i.e., after the connect notification.
+ */
+static void
+tcp_cc_connected (tcp_connection_t * tc)
+{
+  stream_session_t *s;
+
+  s = stream_session_get_if_valid (tc->c_s_index, tc->c_thread_index);
+  if (s)
+    tcp_connection_set_cc_algo (tc, tcp_cc_algo_for_app (s->app_index));
+}
+
 static int
 tcp_rcv_ack (tcp_connection_t * tc, vlib_buffer_t * b,
 	     tcp_header_t * th, u32 * next, u32 * error)
@@ -808,9 +1186,13 @@ tcp_session_enqueue_data (tcp_connection_t * tc, vlib_buffer_t * b,
       return TCP_ERROR_PURE_ACK;
     }
 
-  written = stream_session_enqueue_data (&tc->connection,
-					 vlib_buffer_get_current (b),
-					 data_len, 1 /* queue event */ );
+  written = stream_session_enqueue_data (&tc->connection, b,
+					 1 /* queue event */ );
+
+  /* Zero-copy apps keep the buffer if the data was enqueued */
+  if (PREDICT_FALSE (stream_session_rx_zero_copy (&tc->connection))
+      && written >= data_len)
+    vnet_buffer (b)->tcp.flags |= TCP_BUF_FLAG_APP_OWNED;
 
   /* Update rcv_nxt */
   if (PREDICT_TRUE (written == data_len))
@@ -949,8 +1331,17 @@ tcp_segment_rcv (tcp_main_t * tm, tcp_connection_t * tc, vlib_buffer_t * b,
        * output */
       if ((tc->flags & TCP_CONN_BURSTACK) == 0)
 	{
-	  *next0 = tcp_next_output (tc->c_is_ip4);
-	  tcp_make_ack (tc, b);
+	  /* Buffer belongs to the app now, can't be turned into the ACK */
+	  if (PREDICT_FALSE (vnet_buffer (b)->tcp.flags
+			     & TCP_BUF_FLAG_APP_OWNED))
+	    {
+	      tcp_send_ack (tc);
+	    }
+	  else
+	    {
+	      *next0 = tcp_next_output (tc->c_is_ip4);
+	      tcp_make_ack (tc, b);
+	    }
 	  error = TCP_ERROR_ENQUEUED;
 
 	  /* TODO: maybe add counter to ensure N acks will be sent/burst */
@@ -983,12 +1374,116 @@ delack_timers_init (tcp_main_t * tm, u32 thread_index)
   vec_reset_length (tm->delack_connections[thread_index]);
 }
 
+/**
+ * Locate the TCP header of a received packet, whose current position is
+ * the IP header, and compute its header and payload lengths.
+ */
+always_inline tcp_header_t *
+tcp_buffer_hdr_and_lens (vlib_buffer_t * b, u32 * n_advance_bytes,
+			 u32 * n_data_bytes, int is_ip4)
+{
+  tcp_header_t *th;
+
+  if (is_ip4)
+    {
+      ip4_header_t *ip4 = vlib_buffer_get_current (b);
+      th = ip4_next_header (ip4);
+      *n_advance_bytes = ip4_header_bytes (ip4) + tcp_header_bytes (th);
+      *n_data_bytes = clib_net_to_host_u16 (ip4->length) - *n_advance_bytes;
+    }
+  else
+    {
+      ip6_header_t *ip6 = vlib_buffer_get_current (b);
+      th = ip6_next_header (ip6);
+      *n_advance_bytes = tcp_header_bytes (th);
+      *n_data_bytes = clib_net_to_host_u16 (ip6->payload_length)
+	- *n_advance_bytes;
+      *n_advance_bytes += sizeof (ip6[0]);
+    }
+  return th;
+}
+
+/**
+ * Receive offload (GRO)
+ *
+ * Chain to @a b0 the segments that directly follow it in the frame and
+ * continue its sequence space, so that the whole run gets a single fifo
+ * enqueue and a single ACK decision. The head must be in order. Merged
+ * segments must carry only data, ACK and PSH, and the same ACK, window
+ * and options as the head. That way, processing the head's header once
+ * is equivalent to processing all of them. Runs are limited to the
+ * receive window and to TCP_MAX_GRO_SZ bytes.
+ *
+ * @return number of buffers merged, to be consumed from @a from
+ */
+always_inline u32
+tcp_gro_merge (vlib_main_t * vm, tcp_connection_t * tc0, vlib_buffer_t * b0,
+	       tcp_header_t * th0, u32 n_advance_bytes0, u32 * n_data_bytes0,
+	       u32 * from, u32 n_left_from, int is_ip4)
+{
+  vlib_buffer_t *b1, *last = b0;
+  tcp_header_t *th1;
+  u32 n_merged = 0, n_advance_bytes1, n_data_bytes1, seq_end, max_end;
+  u32 hdr_len0;
+
+  if (tc0->state != TCP_STATE_ESTABLISHED || *n_data_bytes0 == 0
+      || (th0->flags & ~TCP_FLAG_PSH) != TCP_FLAG_ACK
+      || (b0->flags & VLIB_BUFFER_NEXT_PRESENT)
+      || vnet_buffer (b0)->tcp.seq_number != tc0->rcv_nxt)
+    return 0;
+
+  hdr_len0 = tcp_header_bytes (th0);
+  seq_end = tc0->rcv_nxt + *n_data_bytes0;
+  max_end = tc0->rcv_nxt + clib_min (tc0->rcv_wnd, TCP_MAX_GRO_SZ);
+
+  while (n_merged < n_left_from)
+    {
+      b1 = vlib_get_buffer (vm, from[n_merged]);
+      if (vnet_buffer (b1)->tcp.connection_index != tc0->c_c_index
+	  || vnet_buffer (b1)->tcp.seq_number != seq_end
+	  || (b1->flags & VLIB_BUFFER_NEXT_PRESENT))
+	break;
+
+      th1 = tcp_buffer_hdr_and_lens (b1, &n_advance_bytes1, &n_data_bytes1,
+				     is_ip4);
+      if ((th1->flags & ~TCP_FLAG_PSH) != TCP_FLAG_ACK
+	  || th1->ack_number != th0->ack_number
+	  || th1->window != th0->window
+	  || tcp_header_bytes (th1) != hdr_len0
+	  || memcmp (th1 + 1, th0 + 1, hdr_len0 - sizeof (tcp_header_t))
+	  || n_data_bytes1 == 0 || seq_gt (seq_end + n_data_bytes1, max_end))
+	break;
+
+      if (n_merged == 0)
+	{
+	  /* Drop any l2 padding, the chain must only hold payload */
+	  b0->current_length = n_advance_bytes0 + *n_data_bytes0;
+	  b0->total_length_not_including_first_buffer = 0;
+	  b0->flags |= VLIB_BUFFER_TOTAL_LENGTH_VALID;
+	}
+
+      vlib_buffer_advance (b1, n_advance_bytes1);
+      b1->current_length = n_data_bytes1;
+      last->next_buffer = from[n_merged];
+      last->flags |= VLIB_BUFFER_NEXT_PRESENT;
+      last = b1;
+
+      b0->total_length_not_including_first_buffer += n_data_bytes1;
+      *n_data_bytes0 += n_data_bytes1;
+      seq_end += n_data_bytes1;
+      n_merged++;
+    }
+
+  return n_merged;
+}
+
 always_inline uword
 tcp46_established_inline (vlib_main_t * vm, vlib_node_runtime_t * node,
 			  vlib_frame_t * from_frame, int is_ip4)
 {
   u32 n_left_from, next_index, *from, *to_next;
-  u32 my_thread_index = vm->cpu_index, errors = 0;
+  u32 my_thread_index = vm->cpu_index, errors = 0, n_gro_merged = 0;
+  u32 n_app_owned = 0;
   tcp_main_t *tm = vnet_get_tcp_main ();
 
   from = vlib_frame_vector_args (from_frame);
@@ -1008,9 +1503,7 @@ tcp46_established_inline (vlib_main_t * vm, vlib_node_runtime_t * node,
 	  vlib_buffer_t *b0;
 	  tcp_header_t *th0 = 0;
 	  tcp_connection_t *tc0;
-	  ip4_header_t *ip40;
-	  ip6_header_t *ip60;
-	  u32 n_advance_bytes0, n_data_bytes0;
+	  u32 n_advance_bytes0, n_data_bytes0, n_merged0;
 	  u32 next0 = TCP_ESTABLISHED_NEXT_DROP, error0 = TCP_ERROR_ENQUEUED;
 
 	  bi0 = from[0];
@@ -1030,25 +1523,22 @@ tcp46_established_inline (vlib_main_t * vm, vlib_node_runtime_t * node,
 	      goto drop;
 	    }
 
+	  /* Flags were overloaded with the connection state by tcp-input */
+	  vnet_buffer (b0)->tcp.flags = 0;
+
 	  /* Checksum computed by ipx_local no need to compute again */
+	  th0 = tcp_buffer_hdr_and_lens (b0, &n_advance_bytes0,
+					 &n_data_bytes0, is_ip4);
 
-	  if (is_ip4)
+	  /* Coalesce the in-order segments that follow */
+	  if (tm->gro_enabled && n_left_from > 0)
 	    {
-	      ip40 = vlib_buffer_get_current (b0);
-	      th0 = ip4_next_header (ip40);
-	      n_advance_bytes0 = (ip4_header_bytes (ip40)
-				  + tcp_header_bytes (th0));
-	      n_data_bytes0 = clib_net_to_host_u16 (ip40->length)
-		- n_advance_bytes0;
-	    }
-	  else
-	    {
-	      ip60 = vlib_buffer_get_current (b0);
-	      th0 = ip6_next_header (ip60);
-	      n_advance_bytes0 = tcp_header_bytes (th0);
-	      n_data_bytes0 = clib_net_to_host_u16 (ip60->payload_length)
-		- n_advance_bytes0;
-	      n_advance_bytes0 += sizeof (ip60[0]);
+	      n_merged0 = tcp_gro_merge (vm, tc0, b0, th0, n_advance_bytes0,
+					 &n_data_bytes0, from, n_left_from,
+					 is_ip4);
+	      from += n_merged0;
+	      n_left_from -= n_merged0;
+	      n_gro_merged += n_merged0;
 	    }
 
 	  /* SYNs, FINs and data consume sequence numbers */
@@ -1088,6 +1578,16 @@ tcp46_established_inline (vlib_main_t * vm, vlib_node_runtime_t * node,
 	      tcp_timer_set (tc0, TCP_TIMER_WAITCLOSE, TCP_CLOSEWAIT_TIME);
 	    }
 
+	  /* Zero-copy app took the buffer, don't pass it on */
+	  if (PREDICT_FALSE (vnet_buffer (b0)->tcp.flags
+			     & TCP_BUF_FLAG_APP_OWNED))
+	    {
+	      to_next -= 1;
+	      n_left_to_next += 1;
+	      n_app_owned += 1;
+	      continue;
+	    }
+
 	drop:
 	  b0->error = node->errors[error0];
 	  if (PREDICT_FALSE (b0->flags & VLIB_BUFFER_IS_TRACED))
@@ -1113,6 +1613,16 @@ tcp46_established_inline (vlib_main_t * vm, vlib_node_runtime_t * node,
 				     TCP_ERROR_EVENT_FIFO_FULL, errors);
     }
 
+  if (n_gro_merged)
+    vlib_node_increment_counter (vm, is_ip4 ? tcp4_established_node.index :
+				 tcp6_established_node.index,
+				 TCP_ERROR_GRO_MERGED, n_gro_merged);
+
+  if (n_app_owned)
+    vlib_node_increment_counter (vm, is_ip4 ? tcp4_established_node.index :
+				 tcp6_established_node.index,
+				 TCP_ERROR_ZERO_COPY, n_app_owned);
+
   delack_timers_init (tm, my_thread_index);
 
   return from_frame->n_vectors;
@@ -1360,6 +1870,7 @@ tcp46_syn_sent_inline (vlib_main_t * vm, vlib_node_runtime_t * node,
 
 	      /* Notify app that we have connection */
 	      stream_session_connect_notify (&new_tc0->connection, sst, 0);
+	      tcp_cc_connected (new_tc0);
 
 	      /* Make sure after data segment processing ACK is sent */
 	      new_tc0->flags |= TCP_CONN_SNDACK;
@@ -1371,6 +1882,7 @@ tcp46_syn_sent_inline (vlib_main_t * vm, vlib_node_runtime_t * node,
 
 	      /* Notify app that we have connection */
 	      stream_session_connect_notify (&new_tc0->connection, sst, 0);
+	      tcp_cc_connected (new_tc0);
 
 	      tcp_make_synack (new_tc0, b0);
 	      next0 = tcp_next_output (is_ip4);
@@ -1589,6 +2101,7 @@ tcp46_rcv_process_inline (vlib_main_t * vm, vlib_node_runtime_t * node,
 		  goto drop;
 		}
 	      /* Switch state to ESTABLISHED */
+	      tcp_connection_half_open_done (tc0);
 	      tc0->state = TCP_STATE_ESTABLISHED;
 
 	      /* Initialize session variables */
@@ -1714,6 +2227,7 @@ tcp46_rcv_process_inline (vlib_main_t * vm, vlib_node_runtime_t * node,
 	    case TCP_STATE_SYN_RCVD:
 	      /* Send FIN-ACK notify app and enter CLOSE-WAIT */
 	      tcp_connection_timers_reset (tc0);
+	      tcp_connection_half_open_done (tc0);
 	      tcp_make_fin (tc0, b0);
 	      next0 = tcp_next_output (tc0->c_is_ip4);
 	      stream_session_disconnect_notify (&tc0->connection);
@@ -1833,6 +2347,244 @@ VLIB_NODE_FUNCTION_MULTIARCH (tcp6_rcv_process_node, tcp6_rcv_process);
 vlib_node_registration_t tcp4_listen_node;
 vlib_node_registration_t tcp6_listen_node;
 
+/** MSS values a SYN cookie can encode */
+static const u16 tcp_syn_cookie_mss[] = { 536, 1220, 1440, 1460 };
+
+#define TCP_SYN_COOKIE_DATA_BITS 9
+#define TCP_SYN_COOKIE_NO_WSCALE 0xf
+
+/**
+ * Fill in the addresses of a connection for a segment a listener received
+ */
+always_inline void
+tcp_listen_connection_init (tcp_connection_t * tc, tcp_connection_t * lc,
+			    vlib_buffer_t * b, u32 thread_index, u8 is_ip4)
+{
+  tcp_header_t *th;
+
+  memset (tc, 0, sizeof (*tc));
+
+  if (is_ip4)
+    {
+      ip4_header_t *ip4 = vlib_buffer_get_current (b);
+      th = ip4_next_header (ip4);
+      tc->c_lcl_ip4.as_u32 = ip4->dst_address.as_u32;
+      tc->c_rmt_ip4.as_u32 = ip4->src_address.as_u32;
+    }
+  else
+    {
+      ip6_header_t *ip6 = vlib_buffer_get_current (b);
+      th = ip6_next_header (ip6);
+      clib_memcpy (&tc->c_lcl_ip6, &ip6->dst_address,
+		   sizeof (ip6_address_t));
+      clib_memcpy (&tc->c_rmt_ip6, &ip6->src_address,
+		   sizeof (ip6_address_t));
+    }
+
+  tc->c_lcl_port = lc->c_lcl_port;
+  tc->c_rmt_port = th->src_port;
+  tc->c_is_ip4 = is_ip4;
+  tc->c_thread_index = thread_index;
+  tc->cc_algo = lc->cc_algo;
+}
+
+/**
+ * Create the session of a passive open
+ */
+static int
+tcp_listen_session_accept (tcp_connection_t * child, tcp_connection_t * lc,
+			   u8 sst, u32 thread_index)
+{
+  stream_session_t *s;
+
+  if (stream_session_accept (&child->connection, lc->c_s_index, sst,
+			     0 /* notify */ ))
+    return -1;
+
+  /* Shared listeners hand the connection to one of their apps */
+  s = stream_session_get (child->c_s_index, thread_index);
+  if (s->app_index != stream_session_listener_get (sst,
+						   lc->c_s_index)->app_index)
+    child->cc_algo = tcp_cc_algo_get (tcp_cc_algo_for_app (s->app_index));
+  return 0;
+}
+
+/**
+ * MAC of a connection's addresses and the peer's iss, plus the counter
+ * and options a SYN cookie carries. SipHash keyed with the secret, so
+ * cookies cannot be forged without it
+ */
+static u32
+tcp_syn_cookie_hash (tcp_connection_t * tc, u32 count, u32 data)
+{
+  tcp_main_t *tm = vnet_get_tcp_main ();
+  struct
+  {
+    ip46_address_t rmt_ip, lcl_ip;
+    u16 rmt_port, lcl_port;
+    u32 irs, count, data;
+  } m;
+
+  m.rmt_ip = tc->c_rmt_ip;
+  m.lcl_ip = tc->c_lcl_ip;
+  m.rmt_port = tc->c_rmt_port;
+  m.lcl_port = tc->c_lcl_port;
+  m.irs = tc->irs;
+  m.count = count;
+  m.data = data;
+
+  return clib_siphash24 (tm->syn_cookie_secret, &m, sizeof (m));
+}
+
+/**
+ * Make the iss of a SYN-ACK sent without allocating a connection.
+ *
+ * The low TCP_SYN_COOKIE_DATA_BITS carry what must be known once the peer
+ * acks it: the peer's MSS, rounded down to a tcp_syn_cookie_mss entry,
+ * window scale and SACK permitted. Also the low bits of a counter that
+ * ticks every TCP_SYN_COOKIE_PERIOD, so cookies expire. The high bits are
+ * a hash that covers all of it.
+ */
+static u32
+tcp_syn_cookie_make (tcp_connection_t * tc, u32 count)
+{
+  u32 data = 0, i;
+
+  for (i = 1; i < ARRAY_LEN (tcp_syn_cookie_mss); i++)
+    if (tc->opt.mss >= tcp_syn_cookie_mss[i])
+      data = i;
+  data |= (tcp_opts_wscale (&tc->opt) ? tc->opt.wscale
+	   : TCP_SYN_COOKIE_NO_WSCALE) << 2;
+  data |= (tcp_opts_sack_permitted (&tc->opt) != 0) << 6;
+  data |= (count & 3) << 7;
+
+  return tcp_syn_cookie_hash (tc, count, data) << TCP_SYN_COOKIE_DATA_BITS
+    | data;
+}
+
+/**
+ * Check a SYN cookie and restore the options it carries
+ *
+ * @return 0 if the cookie is valid and no older than two periods
+ */
+static int
+tcp_syn_cookie_check (tcp_connection_t * tc, u32 cookie, u32 now)
+{
+  u32 data, count, wscale;
+
+  data = cookie & ((1 << TCP_SYN_COOKIE_DATA_BITS) - 1);
+  count = now - ((now - (data >> 7)) & 3);
+  if (now - count > 1)
+    return -1;
+
+  if ((tcp_syn_cookie_hash (tc, count, data) << TCP_SYN_COOKIE_DATA_BITS)
+      != (cookie & ~((1 << TCP_SYN_COOKIE_DATA_BITS) - 1)))
+    return -1;
+
+  tc->opt.flags |= TCP_OPTS_FLAG_MSS;
+  tc->opt.mss = tcp_syn_cookie_mss[data & 3];
+  wscale = (data >> 2) & 0xf;
+  if (wscale != TCP_SYN_COOKIE_NO_WSCALE)
+    {
+      tc->opt.flags |= TCP_OPTS_FLAG_WSCALE;
+      tc->opt.wscale = wscale;
+    }
+  if (data & (1 << 6))
+    tc->opt.flags |= TCP_OPTS_FLAG_SACK_PERMITTED;
+  return 0;
+}
+
+always_inline u32
+tcp_syn_cookie_count (vlib_main_t * vm)
+{
+  return vlib_time_now (vm) / TCP_SYN_COOKIE_PERIOD;
+}
+
+/**
+ * Answer a SYN with a cookie, reusing its buffer
+ */
+static void
+tcp_listen_syn_cookie_synack (vlib_main_t * vm, tcp_connection_t * lc,
+			      vlib_buffer_t * b, tcp_header_t * th, u8 is_ip4)
+{
+  tcp_connection_t _tc, *tc = &_tc;
+
+  tcp_listen_connection_init (tc, lc, b, vm->cpu_index, is_ip4);
+  tcp_options_parse (th, &tc->opt);
+
+  tc->irs = vnet_buffer (b)->tcp.seq_number;
+  tc->rcv_nxt = tc->irs + 1;
+  if (tcp_opts_tstamp (&tc->opt))
+    tc->tsval_recent = tc->opt.tsval;
+
+  tc->iss = tcp_syn_cookie_make (tc, tcp_syn_cookie_count (vm));
+  tcp_make_synack_cookie (tc, b);
+}
+
+/**
+ * Establish a connection whose SYN was answered with a cookie, if the
+ * peer acked a valid one. Data the ACK carries is dropped, the peer
+ * retransmits it.
+ */
+static u32
+tcp_listen_syn_cookie_ack (vlib_main_t * vm, tcp_connection_t * lc,
+			   vlib_buffer_t * b, tcp_header_t * th, u8 is_ip4)
+{
+  tcp_main_t *tm = vnet_get_tcp_main ();
+  tcp_connection_t _tc, *tc = &_tc, *child;
+  u32 thread_index = vm->cpu_index;
+  u8 sst = is_ip4 ? SESSION_TYPE_IP4_TCP : SESSION_TYPE_IP6_TCP;
+
+  tcp_listen_connection_init (tc, lc, b, thread_index, is_ip4);
+  tc->irs = vnet_buffer (b)->tcp.seq_number - 1;
+  if (tcp_syn_cookie_check (tc, vnet_buffer (b)->tcp.ack_number - 1,
+			    tcp_syn_cookie_count (vm)))
+    return TCP_ERROR_SYN_COOKIE_INVALID;
+
+  pool_get (tm->connections[thread_index], child);
+  clib_memcpy (child, tc, sizeof (*child));
+  child->c_c_index = child - tm->connections[thread_index];
+
+  if (tcp_listen_session_accept (child, lc, sst, thread_index))
+    {
+      pool_put (tm->connections[thread_index], child);
+      return TCP_ERROR_CREATE_SESSION_FAIL;
+    }
+
+  /* Keeps the options restored from the cookie */
+  tcp_options_parse (th, &child->opt);
+
+  child->rcv_nxt = vnet_buffer (b)->tcp.seq_number;
+  child->iss = vnet_buffer (b)->tcp.ack_number - 1;
+  child->snd_una = vnet_buffer (b)->tcp.ack_number;
+  child->snd_nxt = child->snd_una;
+  child->snd_una_max = child->snd_una;
+
+  if (tcp_opts_tstamp (&child->opt))
+    {
+      child->tsval_recent = child->opt.tsval;
+      child->tsval_recent_age = tcp_time_now ();
+    }
+
+  if (tcp_opts_wscale (&child->opt))
+    child->snd_wscale = child->opt.wscale;
+
+  /* Same receive window scale the SYN-ACK advertised */
+  tcp_initial_window_to_advertise (child);
+
+  child->snd_wnd = clib_net_to_host_u16 (th->window) << child->snd_wscale;
+  child->snd_wl1 = vnet_buffer (b)->tcp.seq_number;
+  child->snd_wl2 = vnet_buffer (b)->tcp.ack_number;
+  child->state = TCP_STATE_ESTABLISHED;
+
+  tcp_connection_init_vars (child);
+
+  TCP_EVT_DBG (TCP_EVT_SYN_RCVD, child);
+
+  stream_session_accept_notify (&child->connection);
+  return TCP_ERROR_SYN_COOKIES_RCVD;
+}
+
 /**
  * LISTEN state processing as per RFC 793 p. 65
  */
@@ -1888,47 +2640,45 @@ tcp46_listen_inline (vlib_main_t * vm, vlib_node_runtime_t * node,
 	      th0 = ip6_next_header (ip60);
 	    }
 
-	  /* Create child session. For syn-flood protection use filter */
-
 	  /* 1. first check for an RST */
 	  if (tcp_rst (th0))
 	    goto drop;
 
-	  /* 2. second check for an ACK */
+	  /* 2. second check for an ACK. Might be for a SYN cookie */
 	  if (tcp_ack (th0))
 	    {
-	      tcp_send_reset (b0, is_ip4);
+	      if (tm->syn_cookies != TCP_SYN_COOKIES_OFF)
+		error0 = tcp_listen_syn_cookie_ack (vm, lc0, b0, th0, is_ip4);
+	      if (error0 != TCP_ERROR_SYN_COOKIES_RCVD)
+		tcp_send_reset (b0, is_ip4);
 	      goto drop;
 	    }
 
 	  /* 3. check for a SYN (did that already) */
 
+	  /* Don't allocate anything for the SYN if the thread holds too
+	   * many half-open connections, answer with a cookie instead */
+	  if (PREDICT_FALSE (tm->syn_cookies == TCP_SYN_COOKIES_ON
+			     || (tm->syn_cookies == TCP_SYN_COOKIES_AUTO
+				 && tm->n_half_open[my_thread_index]
+				 >= tm->syn_cookie_threshold)))
+	    {
+	      tcp_listen_syn_cookie_synack (vm, lc0, b0, th0, is_ip4);
+	      error0 = TCP_ERROR_SYN_COOKIES_SENT;
+	      next0 = is_ip4 ? TCP_LISTEN_NEXT_IP4_LOOKUP
+		: TCP_LISTEN_NEXT_IP6_LOOKUP;
+	      goto drop;
+	    }
+
 	  /* Create child session and send SYN-ACK */
 	  pool_get (tm->connections[my_thread_index], child0);
-	  memset (child0, 0, sizeof (*child0));
-
+	  tcp_listen_connection_init (child0, lc0, b0, my_thread_index,
+				      is_ip4);
 	  child0->c_c_index = child0 - tm->connections[my_thread_index];
-	  child0->c_lcl_port = lc0->c_lcl_port;
-	  child0->c_rmt_port = th0->src_port;
-	  child0->c_is_ip4 = is_ip4;
-	  child0->c_thread_index = my_thread_index;
-
-	  if (is_ip4)
-	    {
-	      child0->c_lcl_ip4.as_u32 = ip40->dst_address.as_u32;
-	      child0->c_rmt_ip4.as_u32 = ip40->src_address.as_u32;
-	    }
-	  else
-	    {
-	      clib_memcpy (&child0->c_lcl_ip6, &ip60->dst_address,
-			   sizeof (ip6_address_t));
-	      clib_memcpy (&child0->c_rmt_ip6, &ip60->src_address,
-			   sizeof (ip6_address_t));
-	    }
 
-	  if (stream_session_accept (&child0->connection, lc0->c_s_index, sst,
-				     0 /* notify */ ))
+	  if (tcp_listen_session_accept (child0, lc0, sst, my_thread_index))
 	    {
+	      pool_put (tm->connections[my_thread_index], child0);
 	      error0 = TCP_ERROR_CREATE_SESSION_FAIL;
 	      goto drop;
 	    }
@@ -1938,6 +2688,8 @@ tcp46_listen_inline (vlib_main_t * vm, vlib_node_runtime_t * node,
 	  child0->irs = vnet_buffer (b0)->tcp.seq_number;
 	  child0->rcv_nxt = vnet_buffer (b0)->tcp.seq_number + 1;
 	  child0->state = TCP_STATE_SYN_RCVD;
+	  child0->flags |= TCP_CONN_HALF_OPEN;
+	  tm->n_half_open[my_thread_index]++;
 
 	  /* RFC1323: TSval timestamps sent on {SYN} and {SYN,ACK}
 	   * segments are used to initialize PAWS. */
@@ -2009,6 +2761,8 @@ VLIB_REGISTER_NODE (tcp4_listen_node) =
 #define _(s,n) [TCP_LISTEN_NEXT_##s] = n,
     foreach_tcp_state_next
 #undef _
+    [TCP_LISTEN_NEXT_IP4_LOOKUP] = "ip4-lookup",
+    [TCP_LISTEN_NEXT_IP6_LOOKUP] = "ip6-lookup",
   },
 };
 /* *INDENT-ON* */
@@ -2030,6 +2784,8 @@ VLIB_REGISTER_NODE (tcp6_listen_node) =
 #define _(s,n) [TCP_LISTEN_NEXT_##s] = n,
     foreach_tcp_state_next
 #undef _
+    [TCP_LISTEN_NEXT_IP4_LOOKUP] = "ip4-lookup",
+    [TCP_LISTEN_NEXT_IP6_LOOKUP] = "ip6-lookup",
   },
 };
 /* *INDENT-ON* */
@@ -2265,6 +3021,7 @@ void
 tcp_update_time (f64 now, u32 thread_index)
 {
   tcp_main_t *tm = vnet_get_tcp_main ();
+  tm->time_now[thread_index] = now;
   tw_timer_expire_timers_16t_2w_512sl (&tm->timer_wheels[thread_index], now);
 }
 
@@ -2287,6 +3044,8 @@ do {                                                       	\
 
   /* SYNs for new connections -> tcp-listen. */
   _(LISTEN, TCP_FLAG_SYN, TCP_INPUT_NEXT_LISTEN, TCP_ERROR_NONE);
+  /* ACKs for SYN cookies -> tcp-listen. */
+  _(LISTEN, TCP_FLAG_ACK, TCP_INPUT_NEXT_LISTEN, TCP_ERROR_NONE);
   /* ACK for for a SYN-ACK -> tcp-rcv-process. */
   _(SYN_RCVD, TCP_FLAG_ACK, TCP_INPUT_NEXT_RCV_PROCESS, TCP_ERROR_NONE);
   /* SYN-ACK for a SYN */
@@ -384,15 +384,15 @@ do {                                                                    \
 always_inline void
 tcp_reuse_buffer (vlib_main_t * vm, vlib_buffer_t * b)
 {
-  vlib_buffer_t *it = b;
-  do
+  /* Received buffers may be chains of merged segments */
+  if (PREDICT_FALSE (b->flags & VLIB_BUFFER_NEXT_PRESENT))
     {
-      it->current_data = 0;
-      it->current_length = 0;
-      it->total_length_not_including_first_buffer = 0;
+      vlib_buffer_free_one (vm, b->next_buffer);
+      b->flags &= ~VLIB_BUFFER_NEXT_PRESENT;
     }
-  while ((it->flags & VLIB_BUFFER_NEXT_PRESENT)
-	 && (it = vlib_get_buffer (vm, it->next_buffer)));
+  b->current_data = 0;
+  b->current_length = 0;
+  b->total_length_not_including_first_buffer = 0;
 
   /* Leave enough space for headers */
   vlib_buffer_make_headroom (b, MAX_HDRS_LEN);
@@ -462,10 +462,10 @@ tcp_make_fin (tcp_connection_t * tc, vlib_buffer_t * b)
 }
 
 /**
- * Convert buffer to SYN-ACK
+ * Write SYN-ACK headers, with the connection's iss, to buffer
  */
-void
-tcp_make_synack (tcp_connection_t * tc, vlib_buffer_t * b)
+static void
+tcp_make_synack_i (tcp_connection_t * tc, vlib_buffer_t * b)
 {
   tcp_main_t *tm = vnet_get_tcp_main ();
   vlib_main_t *vm = tm->vlib_main;
@@ -473,20 +473,11 @@ tcp_make_synack (tcp_connection_t * tc, vlib_buffer_t * b)
   u8 tcp_opts_len, tcp_hdr_opts_len;
   tcp_header_t *th;
   u16 initial_wnd;
-  u32 time_now;
 
   memset (snd_opts, 0, sizeof (*snd_opts));
 
   tcp_reuse_buffer (vm, b);
 
-  /* Set random initial sequence */
-  time_now = tcp_time_now ();
-
-  tc->iss = random_u32 (&time_now);
-  tc->snd_una = tc->iss;
-  tc->snd_nxt = tc->iss + 1;
-  tc->snd_una_max = tc->snd_nxt;
-
   initial_wnd = tcp_initial_window_to_advertise (tc);
 
   /* Make and write options */
@@ -498,6 +489,25 @@ tcp_make_synack (tcp_connection_t * tc, vlib_buffer_t * b)
 			     TCP_FLAG_SYN | TCP_FLAG_ACK, initial_wnd);
 
   tcp_options_write ((u8 *) (th + 1), snd_opts);
+}
+
+/**
+ * Convert buffer to SYN-ACK
+ */
+void
+tcp_make_synack (tcp_connection_t * tc, vlib_buffer_t * b)
+{
+  u32 time_now;
+
+  /* Set random initial sequence */
+  time_now = tcp_time_now ();
+
+  tc->iss = random_u32 (&time_now);
+  tc->snd_una = tc->iss;
+  tc->snd_nxt = tc->iss + 1;
+  tc->snd_una_max = tc->snd_nxt;
+
+  tcp_make_synack_i (tc, b);
 
   vnet_buffer (b)->tcp.connection_index = tc->c_c_index;
   vnet_buffer (b)->tcp.flags = TCP_BUF_FLAG_ACK;
@@ -723,6 +733,27 @@ tcp_push_ip_hdr (tcp_main_t * tm, tcp_connection_t * tc, vlib_buffer_t * b)
     }
 }
 
+/**
+ * Convert buffer to SYN-ACK whose iss is a SYN cookie
+ *
+ * The connection only lives on the caller's stack, so the packet does not
+ * go through tcp-output. It gets its ip header here and should be sent to
+ * ip lookup. Nothing is retransmitted, the peer retries the SYN instead.
+ */
+void
+tcp_make_synack_cookie (tcp_connection_t * tc, vlib_buffer_t * b)
+{
+  tcp_main_t *tm = vnet_get_tcp_main ();
+
+  tcp_make_synack_i (tc, b);
+  tcp_push_ip_hdr (tm, tc, b);
+
+  b->flags |= VNET_BUFFER_LOCALLY_ORIGINATED;
+
+  /* Default FIB for now */
+  vnet_buffer (b)->sw_if_index[VLIB_TX] = 0;
+}
+
 /**
  *  Send SYN
  *
@@ -860,6 +891,8 @@ tcp_push_hdr_i (tcp_connection_t * tc, vlib_buffer_t * b,
   tcp_header_t *th;
 
   data_len = b->current_length;
+  if (PREDICT_FALSE (b->flags & VLIB_BUFFER_NEXT_PRESENT))
+    data_len += b->total_length_not_including_first_buffer;
   vnet_buffer (b)->tcp.flags = 0;
 
   /* Make and write options */
@@ -880,6 +913,14 @@ tcp_push_hdr_i (tcp_connection_t * tc, vlib_buffer_t * b,
 
   ASSERT (opts_write_len == tcp_opts_len);
 
+  /* Large send, to be cut in snd_mss segments further down */
+  if (PREDICT_FALSE (data_len > tc->snd_mss))
+    {
+      b->flags |= VNET_BUFFER_GSO;
+      vnet_buffer2 (b)->gso_size = tc->snd_mss;
+      vnet_buffer2 (b)->gso_l4_hdr_sz = tcp_hdr_opts_len;
+    }
+
   /* Tag the buffer with the connection index  */
   vnet_buffer (b)->tcp.connection_index = tc->c_c_index;
 
@@ -887,78 +928,76 @@ tcp_push_hdr_i (tcp_connection_t * tc, vlib_buffer_t * b,
   TCP_EVT_DBG (TCP_EVT_PKTIZE, tc);
 }
 
-/* Send delayed ACK when timer expires */
+/**
+ * Send ACK in a newly allocated buffer
+ */
 void
-tcp_timer_delack_handler (u32 index)
+tcp_send_ack (tcp_connection_t * tc)
 {
   tcp_main_t *tm = vnet_get_tcp_main ();
   vlib_main_t *vm = tm->vlib_main;
-  u32 thread_index = os_get_cpu_number ();
-  tcp_connection_t *tc;
   vlib_buffer_t *b;
   u32 bi;
 
-  tc = tcp_connection_get (index, thread_index);
-
   /* Get buffer */
   tcp_get_free_buffer_index (tm, &bi);
   b = vlib_get_buffer (vm, bi);
 
   /* Fill in the ACK */
   tcp_make_ack (tc, b);
+  tcp_enqueue_to_output (vm, b, bi, tc->c_is_ip4);
+}
+
+void
+tcp_timer_delack_handler (u32 index)
+{
+  u32 thread_index = os_get_cpu_number ();
+  tcp_connection_t *tc;
+
+  tc = tcp_connection_get (index, thread_index);
+  tcp_send_ack (tc);
 
   tc->timers[TCP_TIMER_DELACK] = TCP_TIMER_HANDLE_INVALID;
   tc->flags &= ~TCP_CONN_DELACK;
-
-  tcp_enqueue_to_output (vm, b, bi, tc->c_is_ip4);
 }
 
-/** Build a retransmit segment
+/**
+ * Build a retransmit segment
  *
- * @return the number of bytes in the segment or 0 if there's nothing to
- *         retransmit
- * */
+ * @param tc connection
+ * @param b buffer to build the segment in
+ * @param offset offset of the first byte to retransmit from snd_una
+ * @param max_bytes max number of bytes to retransmit
+ * @return number of bytes in the segment, 0 if nothing to retransmit
+ */
 u32
 tcp_prepare_retransmit_segment (tcp_connection_t * tc, vlib_buffer_t * b,
-				u32 max_bytes)
+				u32 offset, u32 max_bytes)
 {
   tcp_main_t *tm = vnet_get_tcp_main ();
   vlib_main_t *vm = tm->vlib_main;
-  u32 n_bytes, offset = 0;
-  sack_scoreboard_hole_t *hole;
-  u32 hole_size;
+  u32 n_bytes, n_unacked;
 
   tcp_reuse_buffer (vm, b);
 
   ASSERT (tc->state >= TCP_STATE_ESTABLISHED);
   ASSERT (max_bytes != 0);
 
-  if (tcp_opts_sack_permitted (&tc->opt))
-    {
-      /* XXX get first hole not retransmitted yet  */
-      hole = scoreboard_first_hole (&tc->sack_sb);
-      if (!hole)
-	return 0;
-
-      offset = hole->start - tc->snd_una;
-      hole_size = hole->end - hole->start;
-
-      ASSERT (hole_size);
-
-      if (hole_size < max_bytes)
-	max_bytes = hole_size;
-    }
-  else
-    {
-      if (seq_geq (tc->snd_nxt, tc->snd_una_max))
-	return 0;
-    }
+  /* Only data that has been sent can be retransmitted */
+  n_unacked = tc->snd_una_max - tc->snd_una;
+  if (offset >= n_unacked)
+    return 0;
+  max_bytes = clib_min (max_bytes, n_unacked - offset);
 
   n_bytes = stream_session_peek_bytes (&tc->connection,
 				       vlib_buffer_get_current (b), offset,
 				       max_bytes);
-  ASSERT (n_bytes != 0);
+  if (n_bytes == 0)
+    return 0;
+  b->current_length = n_bytes;
 
+  /* Segment starts at snd_una + offset. Callers restore snd_nxt */
+  tc->snd_nxt = tc->snd_una + offset;
   tcp_push_hdr_i (tc, b, tc->state);
 
   return n_bytes;
@@ -1000,6 +1039,10 @@ tcp_timer_retransmit_handler_i (u32 index, u8 is_syn)
     {
       tcp_fastrecovery_off (tc);
 
+      /* First timeout of this segment, let congestion control react */
+      if (tc->rto_boff == 1 && tc->cc_algo->loss)
+	tc->cc_algo->loss (tc);
+
       /* Exponential backoff */
       tc->rto = clib_min (tc->rto << 1, TCP_RTO_MAX);
 
@@ -1010,14 +1053,22 @@ tcp_timer_retransmit_handler_i (u32 index, u8 is_syn)
       if (max_bytes == 0)
 	{
 	  clib_warning ("no wnd to retransmit");
+	  vec_add1 (tm->tx_buffers[thread_index], bi);
+	  return;
+	}
+      max_bytes = tcp_prepare_retransmit_segment (tc, b, 0, max_bytes);
+
+      /* Nothing to retransmit */
+      if (max_bytes == 0)
+	{
+	  vec_add1 (tm->tx_buffers[thread_index], bi);
 	  return;
 	}
-      tcp_prepare_retransmit_segment (tc, b, max_bytes);
 
       tc->rtx_bytes += max_bytes;
 
-      /* No fancy recovery for now! */
-      scoreboard_clear (&tc->sack_sb);
+      /* RFC6675: SACK information is discarded after an RTO */
+      scoreboard_clear (&tc->sack_sb, tc->snd_una);
     }
   else
     {
@@ -1087,11 +1138,62 @@ tcp_retransmit_first_unacked (tcp_connection_t * tc)
   tcp_get_free_buffer_index (tm, &bi);
   b = vlib_get_buffer (tm->vlib_main, bi);
 
-  tcp_prepare_retransmit_segment (tc, b, tc->snd_mss);
+  tc->rtx_bytes += tcp_prepare_retransmit_segment (tc, b, 0, tc->snd_mss);
   tcp_enqueue_to_output (tm->vlib_main, b, bi, tc->c_is_ip4);
 
   tc->snd_nxt = snd_nxt;
-  tc->rtx_bytes += tc->snd_mss;
+}
+
+always_inline u8
+tcp_session_has_unsent_data (tcp_connection_t * tc)
+{
+  stream_session_t *s =
+    stream_session_get (tc->c_s_index, tc->c_thread_index);
+  return svm_fifo_max_dequeue (s->server_tx_fifo)
+    > tc->snd_una_max - tc->snd_una;
+}
+
+/**
+ * RFC6675 SACK based loss recovery. Retransmits what NextSeg() picks
+ * while the pipe estimate leaves room in the congestion window
+ */
+static void
+tcp_fast_retransmit_sack (tcp_connection_t * tc)
+{
+  tcp_main_t *tm = vnet_get_tcp_main ();
+  u32 snd_space, max_bytes, n_bytes, bi, seq, snd_nxt = tc->snd_nxt;
+  vlib_buffer_t *b;
+  u8 have_unsent;
+
+  have_unsent = tcp_session_has_unsent_data (tc);
+  snd_space = tcp_available_snd_space (tc);
+
+  while (snd_space)
+    {
+      max_bytes = clib_min (tc->snd_mss, snd_space);
+      max_bytes = scoreboard_next_rxt_seg (tc, max_bytes, have_unsent, &seq);
+      if (max_bytes == 0)
+	break;
+
+      tcp_get_free_buffer_index (tm, &bi);
+      b = vlib_get_buffer (tm->vlib_main, bi);
+
+      n_bytes = tcp_prepare_retransmit_segment (tc, b, seq - tc->snd_una,
+						max_bytes);
+      if (n_bytes == 0)
+	{
+	  vec_add1 (tm->tx_buffers[tm->vlib_main->cpu_index], bi);
+	  break;
+	}
+
+      tcp_enqueue_to_output (tm->vlib_main, b, bi, tc->c_is_ip4);
+
+      tc->rtx_bytes += n_bytes;
+      snd_space = tcp_available_snd_space (tc);
+    }
+
+  /* If window allows, new data goes after the retransmissions */
+  tc->snd_nxt = snd_nxt;
 }
 
 void
@@ -1103,7 +1205,11 @@ tcp_fast_retransmit (tcp_connection_t * tc)
 
   ASSERT (tcp_in_fastrecovery (tc));
 
-  clib_warning ("fast retransmit!");
+  if (tcp_in_sack_recovery (tc))
+    {
+      tcp_fast_retransmit_sack (tc);
+      return;
+    }
 
   /* Start resending from first un-acked segment */
   tc->snd_nxt = tc->snd_una;
@@ -1116,11 +1222,16 @@ tcp_fast_retransmit (tcp_connection_t * tc)
       b = vlib_get_buffer (tm->vlib_main, bi);
 
       max_bytes = clib_min (tc->snd_mss, snd_space);
-      n_bytes = tcp_prepare_retransmit_segment (tc, b, max_bytes);
+      n_bytes = tcp_prepare_retransmit_segment (tc, b,
+						tc->snd_nxt - tc->snd_una,
+						max_bytes);
 
       /* Nothing left to retransmit */
       if (n_bytes == 0)
-	return;
+	{
+	  vec_add1 (tm->tx_buffers[tm->vlib_main->cpu_index], bi);
+	  break;
+	}
 
       tcp_enqueue_to_output (tm->vlib_main, b, bi, tc->c_is_ip4);
 
@@ -1191,7 +1302,17 @@ tcp46_output_inline (vlib_main_t * vm,
 	      ip4_header_t *ih0;
 	      ih0 = vlib_buffer_push_ip4 (vm, b0, &tc0->c_lcl_ip4,
 					  &tc0->c_rmt_ip4, IP_PROTOCOL_TCP);
-	      th0->checksum = ip4_tcp_udp_compute_checksum (vm, b0, ih0);
+	      /* Segments get their checksums when the packet is cut. A
+	       * packet delivered locally is never cut, like a loopback
+	       * offload it is marked as not needing a check */
+	      if (PREDICT_FALSE (b0->flags & VNET_BUFFER_GSO))
+		{
+		  th0->checksum = 0;
+		  b0->flags |= IP_BUFFER_L4_CHECKSUM_COMPUTED
+		    | IP_BUFFER_L4_CHECKSUM_CORRECT;
+		}
+	      else
+		th0->checksum = ip4_tcp_udp_compute_checksum (vm, b0, ih0);
 	    }
 	  else
 	    {
@@ -1200,9 +1321,18 @@ tcp46_output_inline (vlib_main_t * vm,
 
 	      ih0 = vlib_buffer_push_ip6 (vm, b0, &tc0->c_lcl_ip6,
 					  &tc0->c_rmt_ip6, IP_PROTOCOL_TCP);
-	      th0->checksum = ip6_tcp_udp_icmp_compute_checksum (vm, b0, ih0,
-								 &bogus);
-	      ASSERT (!bogus);
+	      if (PREDICT_FALSE (b0->flags & VNET_BUFFER_GSO))
+		{
+		  th0->checksum = 0;
+		  b0->flags |= IP_BUFFER_L4_CHECKSUM_COMPUTED
+		    | IP_BUFFER_L4_CHECKSUM_CORRECT;
+		}
+	      else
+		{
+		  th0->checksum =
+		    ip6_tcp_udp_icmp_compute_checksum (vm, b0, ih0, &bogus);
+		  ASSERT (!bogus);
+		}
 	    }
 
 	  /* Filter out DUPACKs if there are no OOO segments left */
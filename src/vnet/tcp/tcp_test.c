@@ -0,0 +1,797 @@
+/*
+ * Copyright (c) 2017 Cisco and/or its affiliates.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <vnet/tcp/tcp.h>
+#include <vnet/session/application_interface.h>
+
+/**
+ * Emulated bottleneck path for congestion control algorithm tests
+ */
+typedef struct
+{
+  f64 rate;		/**< bottleneck rate, bits/s */
+  f64 rtt;		/**< base round trip time, s */
+  f64 buffer;		/**< bottleneck buffer, fraction of the BDP */
+  f64 duration;		/**< emulated time, s */
+  u32 mss;		/**< segment size */
+} tcp_test_path_t;
+
+typedef struct
+{
+  f64 throughput;	/**< bits/s delivered */
+  u32 n_losses;		/**< congestion events */
+  u32 max_cwnd;		/**< largest window, segments */
+} tcp_test_cc_result_t;
+
+/**
+ * Run one algorithm over the emulated path, one RTT round at a time.
+ *
+ * Every round the whole window is sent. If it exceeds what the path
+ * holds (BDP plus buffer), the excess is dropped and the algorithm goes
+ * through fast retransmit/recovery, as driven by tcp-input. Otherwise
+ * every segment is acked, spread over the round, and the queueing delay
+ * added by the buffer stretches the round. The algorithms run on
+ * simulated time, so long fat paths are emulated in a fraction of a
+ * second.
+ */
+static void
+tcp_test_cc_run (tcp_cc_algorithm_type_e type, tcp_test_path_t * path,
+		 tcp_test_cc_result_t * res)
+{
+  tcp_main_t *tm = vnet_get_tcp_main ();
+  tcp_connection_t _tc, *tc = &_tc;
+  f64 bdp, capacity, now, rtt, delivered = 0, saved_now;
+  u32 i, w, n_acked;
+
+  memset (tc, 0, sizeof (*tc));
+  memset (res, 0, sizeof (*res));
+
+  /* Path in segments */
+  bdp = path->rate * path->rtt / (8 * path->mss);
+  capacity = bdp * (1 + path->buffer);
+
+  tc->snd_mss = path->mss;
+  tc->snd_wnd = ~0;
+  tc->srtt = path->rtt / TCP_TICK;
+  scoreboard_init (&tc->sack_sb);
+
+  /* Run on simulated time. Connection is on thread 0, whose tcp time the
+   * session queue node refreshes once we return */
+  vec_validate (tm->time_now, 0);
+  saved_now = tm->time_now[0];
+  now = 1;
+  tm->time_now[0] = now;
+  tcp_connection_set_cc_algo (tc, type);
+
+  while (now < 1 + path->duration)
+    {
+      w = tc->cwnd / tc->snd_mss;
+      rtt = path->rtt * clib_max (1.0, (f64) w / bdp);
+      res->max_cwnd = clib_max (res->max_cwnd, w);
+
+      if (w > capacity)
+	{
+	  /* Tail drop. Fast retransmit after 3 dupacks, recovery ends
+	   * one round later with a full ack */
+	  res->n_losses++;
+	  tc->snd_una = 0;
+	  tc->snd_una_max = tc->cwnd;
+	  tc->cc_algo->congestion (tc);
+	  tc->cc_algo->rcv_cong_ack (tc, TCP_CC_DUPACK);
+	  tc->cwnd = tc->ssthresh + TCP_DUPACK_THRESHOLD * tc->snd_mss;
+
+	  now += rtt;
+	  tm->time_now[0] = now;
+	  tc->cc_algo->recovered (tc);
+	  tc->snd_una = tc->snd_una_max = 0;
+
+	  delivered += capacity;
+	  continue;
+	}
+
+      n_acked = clib_max (w, 1);
+      tc->bytes_acked = tc->snd_mss;
+      for (i = 0; i < n_acked; i++)
+	{
+	  tm->time_now[0] = now + rtt * i / n_acked;
+	  tc->cc_algo->rcv_ack (tc);
+	}
+
+      delivered += n_acked;
+      now += rtt;
+    }
+
+  tm->time_now[0] = saved_now;
+  res->throughput = delivered * path->mss * 8 / path->duration;
+}
+
+static clib_error_t *
+tcp_test_cc_command_fn (vlib_main_t * vm, unformat_input_t * input,
+			vlib_cli_command_t * cmd)
+{
+  tcp_main_t *tm = vnet_get_tcp_main ();
+  tcp_test_path_t _path, *path = &_path;
+  tcp_test_cc_result_t res;
+  u32 type, cc_algo = ~0;
+  f64 rate_mbps = 10000, rtt_ms = 40;
+
+  path->buffer = 0.1;
+  path->duration = 60;
+  path->mss = 1460;
+
+  while (unformat_check_input (input) != UNFORMAT_END_OF_INPUT)
+    {
+      if (unformat (input, "%U", unformat_tcp_cc_algo, &cc_algo))
+	;
+      else if (unformat (input, "rate %f", &rate_mbps))
+	;
+      else if (unformat (input, "rtt %f", &rtt_ms))
+	;
+      else if (unformat (input, "buffer %f", &path->buffer))
+	;
+      else if (unformat (input, "duration %f", &path->duration))
+	;
+      else if (unformat (input, "mss %u", &path->mss))
+	;
+      else
+	return clib_error_return (0, "unknown input `%U'",
+				  format_unformat_error, input);
+    }
+
+  if (rate_mbps <= 0 || rtt_ms < 1 || path->duration <= 0
+      || path->buffer < 0 || path->mss < 64)
+    return clib_error_return (0, "invalid path parameters");
+
+  path->rate = rate_mbps * 1e6;
+  path->rtt = rtt_ms * 1e-3;
+
+  vlib_cli_output (vm, "path: %.0f Mbps, rtt %.1f ms, buffer %.2f BDP, "
+		   "mss %u, %.0f s", rate_mbps, rtt_ms, path->buffer,
+		   path->mss, path->duration);
+
+  for (type = 0; type < vec_len (tm->cc_algos); type++)
+    {
+      if (cc_algo != ~0 && type != cc_algo)
+	continue;
+      tcp_test_cc_run (type, path, &res);
+      vlib_cli_output (vm, "%-8U throughput %.2f Mbps utilization %.1f%% "
+		       "losses %u max-cwnd %u", format_tcp_cc_algo, type,
+		       res.throughput * 1e-6,
+		       100 * res.throughput / path->rate, res.n_losses,
+		       res.max_cwnd);
+    }
+
+  return 0;
+}
+
+/*?
+ * Compare congestion control algorithms over an emulated bottleneck path,
+ * by default a 10G link with 40 ms RTT and a buffer of 10% of the BDP.
+ * Throughput is what the algorithm delivers over the emulated duration,
+ * including slow start.
+ *
+ * @cliexpar
+ * @cliexstart{test tcp cc rate 10000 rtt 40 duration 60}
+ * path: 10000 Mbps, rtt 40.0 ms, buffer 0.10 BDP, mss 1460, 60 s
+ * newreno  throughput 7994.42 Mbps utilization 79.9% losses 2 max-cwnd 49152
+ * cubic    throughput 9159.53 Mbps utilization 91.6% losses 5 max-cwnd 49152
+ * @cliexend
+?*/
+/* *INDENT-OFF* */
+VLIB_CLI_COMMAND (tcp_test_cc_command, static) =
+{
+  .path = "test tcp cc",
+  .short_help = "test tcp cc [newreno|cubic] [rate <Mbps>] [rtt <ms>] "
+    "[buffer <fraction-of-bdp>] [duration <s>] [mss <n>]",
+  .function = tcp_test_cc_command_fn,
+};
+/* *INDENT-ON* */
+
+/**
+ * Loss recovery emulation. The link carries one segment per tick and
+ * the RTT is as many ticks as the window has segments, so a window that
+ * is never reduced keeps the link busy and any capacity lost is down to
+ * the recovery mechanism.
+ */
+typedef struct
+{
+  u64 time;		/**< tick the ack reaches the sender */
+  u32 ack;		/**< cumulative ack */
+  u32 n_blks;		/**< SACK blocks in the ack */
+  sack_block_t blks[TCP_MAX_SACK_BLOCKS];
+} tcp_test_ack_t;
+
+typedef struct
+{
+  f64 loss;		/**< random loss probability */
+  u32 n_segs;		/**< segments to deliver */
+  u32 window;		/**< window and RTT, in segments/ticks */
+  u32 seed;		/**< loss pattern seed */
+  u32 mss;		/**< segment size */
+} tcp_test_loss_path_t;
+
+typedef struct
+{
+  u64 n_ticks;		/**< ticks until all segments were delivered */
+  u32 n_sent;		/**< segments sent, including retransmissions */
+  u32 n_dups;		/**< segments the receiver already had */
+  u32 n_timeouts;	/**< retransmit timeouts */
+} tcp_test_loss_result_t;
+
+/**
+ * Receiver side. Record the segment and build its ack with RFC2018 SACK
+ * blocks: the first one holds the segment just received, the others are
+ * the blocks most recently reported.
+ */
+static void
+tcp_test_loss_rcv (uword ** rcvd, u32 * rcv_nxt, u32 seg, sack_block_t * last,
+		   u32 * n_last, tcp_test_ack_t * a, u32 mss)
+{
+  sack_block_t blks[TCP_MAX_SACK_BLOCKS + 1];
+  u32 i, j, k, start, end, n_blks = 0;
+
+  *rcvd = clib_bitmap_set (*rcvd, seg, 1);
+  while (clib_bitmap_get (*rcvd, *rcv_nxt))
+    (*rcv_nxt)++;
+
+  if (seg > *rcv_nxt)
+    {
+      blks[n_blks].start = seg;
+      n_blks++;
+    }
+  for (i = 0; i < *n_last; i++)
+    blks[n_blks++] = last[i];
+
+  /* Current extent of each block, drop the stale and repeated ones */
+  for (i = 0, j = 0; i < n_blks && j < TCP_MAX_SACK_BLOCKS; i++)
+    {
+      start = blks[i].start;
+      if (start < *rcv_nxt || !clib_bitmap_get (*rcvd, start))
+	continue;
+      while (clib_bitmap_get (*rcvd, start - 1))
+	start--;
+      for (k = 0; k < j; k++)
+	if (last[k].start == start)
+	  break;
+      if (k < j)
+	continue;
+      end = start + 1;
+      while (clib_bitmap_get (*rcvd, end))
+	end++;
+      last[j].start = start;
+      last[j].end = end;
+      j++;
+    }
+  *n_last = j;
+
+  a->ack = *rcv_nxt * mss;
+  a->n_blks = j;
+  for (i = 0; i < j; i++)
+    {
+      a->blks[i].start = last[i].start * mss;
+      a->blks[i].end = last[i].end * mss;
+    }
+}
+
+/**
+ * Run a bulk transfer over a lossy path, with the scoreboard driven
+ * through the same calls tcp-input and tcp-output make. Without SACKs,
+ * the sender goes back to the first unacked segment after three dupacks
+ * and resends everything from there. Retransmit timeouts, after three
+ * RTTs without acks, go back N in both cases.
+ */
+static void
+tcp_test_loss_run (tcp_test_loss_path_t * path, u8 is_sack,
+		   tcp_test_loss_result_t * res)
+{
+  tcp_connection_t _tc, *tc = &_tc;
+  sack_scoreboard_t *sb = &tc->sack_sb;
+  tcp_test_ack_t *acks = 0, *a;
+  sack_block_t last[TCP_MAX_SACK_BLOCKS];
+  u32 n_last = 0, rcv_nxt = 0, ack_head = 0, seed = path->seed;
+  u32 mss = path->mss, total = path->n_segs * mss;
+  u32 snd_nxt = 0, seq, n_bytes, seg, i;
+  u64 now, last_ack = 0, rto = 3 * path->window;
+  uword *rcvd = 0;
+  u8 have_unsent;
+
+  memset (tc, 0, sizeof (*tc));
+  memset (res, 0, sizeof (*res));
+
+  tc->snd_mss = mss;
+  tc->snd_wnd = ~0;
+  tc->cwnd = path->window * mss;
+  tc->opt.flags = is_sack ? TCP_OPTS_FLAG_SACK_PERMITTED : 0;
+  tc->snd_congestion = tc->snd_una - 1;
+  scoreboard_init (sb);
+
+  for (now = 0; rcv_nxt < path->n_segs; now++)
+    {
+      /* Acks arriving this tick */
+      while (ack_head < vec_len (acks) && acks[ack_head].time == now)
+	{
+	  a = &acks[ack_head++];
+
+	  if (is_sack)
+	    {
+	      tc->opt.flags = TCP_OPTS_FLAG_SACK_PERMITTED;
+	      vec_reset_length (tc->opt.sacks);
+	      for (i = 0; i < a->n_blks; i++)
+		vec_add1 (tc->opt.sacks, a->blks[i]);
+	      if (a->n_blks)
+		tc->opt.flags |= TCP_OPTS_FLAG_SACK;
+	      tcp_rcv_sacks (tc, a->ack);
+	    }
+
+	  if (seq_gt (a->ack, tc->snd_una))
+	    {
+	      tc->snd_una = a->ack;
+	      tc->rcv_dupacks = 0;
+	      last_ack = now;
+	      if (seq_lt (snd_nxt, tc->snd_una))
+		snd_nxt = tc->snd_una;
+	      if (tcp_in_fastrecovery (tc)
+		  && !seq_lt (tc->snd_una, tc->snd_congestion))
+		{
+		  tc->rtx_bytes = 0;
+		  tcp_recovery_off (tc);
+		}
+	      continue;
+	    }
+
+	  /* RFC6582 recover check, dupacks for data sent before the last
+	   * recovery, e.g., after going back N, do not start a new one */
+	  if (tcp_in_fastrecovery (tc) || tc->snd_una == tc->snd_una_max
+	      || !seq_gt (tc->snd_una, tc->snd_congestion))
+	    continue;
+
+	  tc->rcv_dupacks++;
+	  if (tc->rcv_dupacks == TCP_DUPACK_THRESHOLD
+	      || (is_sack && scoreboard_first_hole_is_lost (sb)))
+	    {
+	      tcp_fastrecovery_on (tc);
+	      tc->snd_congestion = tc->snd_una_max;
+	      if (is_sack && sb->head != TCP_INVALID_SACK_HOLE_INDEX)
+		{
+		  tc->flags |= TCP_CONN_SACK_RECOVERY;
+		  scoreboard_init_rxt (sb, tc->snd_una);
+		}
+	      else
+		snd_nxt = tc->snd_una;
+	    }
+	}
+
+      /* No progress for too long, retransmit timeout */
+      if (tc->snd_una != tc->snd_una_max && now - last_ack > rto)
+	{
+	  res->n_timeouts++;
+	  scoreboard_clear (sb, tc->snd_una);
+	  tcp_recovery_off (tc);
+	  tc->rtx_bytes = 0;
+	  tc->rcv_dupacks = 0;
+	  snd_nxt = tc->snd_una;
+	  last_ack = now;
+	}
+
+      /* Pick what to send this tick, if anything */
+      seq = snd_nxt;
+      n_bytes = 0;
+      have_unsent = seq_lt (tc->snd_una_max, total);
+      if (seq_lt (snd_nxt, tc->snd_una_max))
+	{
+	  /* Going back N */
+	  if (snd_nxt - tc->snd_una < tc->cwnd)
+	    n_bytes = mss;
+	}
+      else if (tcp_in_sack_recovery (tc))
+	{
+	  if (tcp_available_snd_space (tc) >= mss)
+	    {
+	      n_bytes = scoreboard_next_rxt_seg (tc, mss, have_unsent, &seq);
+	      tc->rtx_bytes += n_bytes;
+	      if (!n_bytes && have_unsent)
+		n_bytes = mss;
+	    }
+	}
+      else if (have_unsent)
+	{
+	  if (is_sack ? tcp_available_snd_space (tc) >= mss :
+	      tc->snd_una_max - tc->snd_una < tc->cwnd)
+	    n_bytes = mss;
+	}
+
+      if (!n_bytes)
+	continue;
+
+      /* Retransmissions are always of full segments */
+      ASSERT (n_bytes == mss && seq % mss == 0);
+      if (seq == tc->snd_una_max)
+	tc->snd_una_max += mss;
+      if (seq == snd_nxt)
+	snd_nxt += mss;
+      res->n_sent++;
+
+      if (random_f64 (&seed) < path->loss)
+	continue;
+
+      seg = seq / mss;
+      if (clib_bitmap_get (rcvd, seg))
+	res->n_dups++;
+
+      vec_add2 (acks, a, 1);
+      a->time = now + path->window;
+      tcp_test_loss_rcv (&rcvd, &rcv_nxt, seg, last, &n_last, a, mss);
+    }
+
+  res->n_ticks = now;
+
+  pool_free (sb->holes);
+  vec_free (tc->opt.sacks);
+  vec_free (acks);
+  clib_bitmap_free (rcvd);
+}
+
+static clib_error_t *
+tcp_test_sack_command_fn (vlib_main_t * vm, unformat_input_t * input,
+			  vlib_cli_command_t * cmd)
+{
+  tcp_test_loss_path_t _path, *path = &_path;
+  tcp_test_loss_result_t res;
+  f64 loss_pct = 1;
+  u8 is_sack;
+
+  path->n_segs = 100000;
+  path->window = 100;
+  path->seed = 1;
+  path->mss = 1460;
+
+  while (unformat_check_input (input) != UNFORMAT_END_OF_INPUT)
+    {
+      if (unformat (input, "loss %f", &loss_pct))
+	;
+      else if (unformat (input, "segments %u", &path->n_segs))
+	;
+      else if (unformat (input, "window %u", &path->window))
+	;
+      else if (unformat (input, "seed %u", &path->seed))
+	;
+      else
+	return clib_error_return (0, "unknown input `%U'",
+				  format_unformat_error, input);
+    }
+
+  if (loss_pct < 0 || loss_pct > 20 || path->window < 4
+      || path->n_segs == 0 || (u64) path->n_segs * path->mss > 1 << 30)
+    return clib_error_return (0, "invalid path parameters");
+
+  path->loss = loss_pct / 100;
+
+  vlib_cli_output (vm, "path: loss %.2f%%, window %u, %u segments, seed %u",
+		   loss_pct, path->window, path->n_segs, path->seed);
+
+  for (is_sack = 0; is_sack < 2; is_sack++)
+    {
+      tcp_test_loss_run (path, is_sack, &res);
+      vlib_cli_output (vm, "%-8s goodput %.1f%% sent %u duplicates %u "
+		       "timeouts %u", is_sack ? "sack" : "go-back-n",
+		       100.0 * path->n_segs / res.n_ticks, res.n_sent,
+		       res.n_dups, res.n_timeouts);
+    }
+
+  return 0;
+}
+
+/*?
+ * Compare SACK based loss recovery with going back N over an emulated
+ * path with random loss and a window that fills it. Goodput is the
+ * fraction of the link capacity used for segments the receiver did not
+ * have yet.
+ *
+ * @cliexpar
+ * @cliexstart{test tcp sack loss 1}
+ * path: loss 1.00%, window 100, 100000 segments, seed 1
+ * go-back-n goodput 62.6% sent 153702 duplicates 52129 timeouts 19
+ * sack     goodput 96.7% sent 102846 duplicates 1813 timeouts 9
+ * @cliexend
+?*/
+/* *INDENT-OFF* */
+VLIB_CLI_COMMAND (tcp_test_sack_command, static) =
+{
+  .path = "test tcp sack",
+  .short_help = "test tcp sack [loss <percent>] [segments <n>] "
+    "[window <n>] [seed <n>]",
+  .function = tcp_test_sack_command_fn,
+};
+/* *INDENT-ON* */
+
+static int
+tcp_test_listen_accept_callback (stream_session_t * s)
+{
+  s->session_state = SESSION_STATE_READY;
+  return 0;
+}
+
+static void
+tcp_test_listen_disconnect_callback (stream_session_t * s)
+{
+}
+
+/* *INDENT-OFF* */
+static session_cb_vft_t tcp_test_listen_cb_vft = {
+  .session_accept_callback = tcp_test_listen_accept_callback,
+  .session_disconnect_callback = tcp_test_listen_disconnect_callback,
+  .session_reset_callback = tcp_test_listen_disconnect_callback,
+};
+/* *INDENT-ON* */
+
+static int
+tcp_test_listen_bind (char *uri, u8 reuseport)
+{
+  vnet_bind_args_t _a, *a = &_a;
+  u64 options[SESSION_OPTIONS_N_OPTIONS];
+  char segment_name[128];
+
+  memset (a, 0, sizeof (*a));
+  memset (options, 0, sizeof (options));
+
+  a->uri = uri;
+  a->api_client_index = ~0;
+  a->session_cb_vft = &tcp_test_listen_cb_vft;
+  a->options = options;
+  a->options[SESSION_OPTIONS_SEGMENT_SIZE] = 256 << 10;
+  a->options[SESSION_OPTIONS_RX_FIFO_SIZE] = 4 << 10;
+  a->options[SESSION_OPTIONS_TX_FIFO_SIZE] = 4 << 10;
+  if (reuseport)
+    a->options[SESSION_OPTIONS_FLAGS] = SESSION_OPTIONS_FLAGS_REUSEPORT;
+  a->segment_name = segment_name;
+  a->segment_name_length = ARRAY_LEN (segment_name);
+
+  return vnet_bind_uri (a);
+}
+
+/**
+ * Have tcp-listen accept n connections from distinct peers on the
+ * listener of lcl/port. The app that got each one is added to app_indices,
+ * the connection to conn_indices.
+ */
+static void
+tcp_test_listen_accept (ip4_address_t * lcl, u16 port, u32 n, u32 * peer,
+			u32 ** conn_indices, u32 ** app_indices)
+{
+  tcp_main_t *tm = vnet_get_tcp_main ();
+  stream_session_t *listener, *s;
+  ip46_address_t ip46;
+  tcp_connection_t *tc;
+  u32 i;
+
+  memset (&ip46, 0, sizeof (ip46));
+  ip46.ip4.as_u32 = lcl->as_u32;
+  listener = stream_session_lookup_listener (&ip46, port,
+					     SESSION_TYPE_IP4_TCP);
+
+  for (i = 0; i < n; i++, (*peer)++)
+    {
+      pool_get (tm->connections[0], tc);
+      memset (tc, 0, sizeof (*tc));
+      tc->c_c_index = tc - tm->connections[0];
+      tc->c_thread_index = 0;
+      tc->c_is_ip4 = 1;
+      tc->c_proto = SESSION_TYPE_IP4_TCP;
+      tc->c_lcl_ip4.as_u32 = lcl->as_u32;
+      tc->c_lcl_port = port;
+      tc->c_rmt_ip4.as_u32 = clib_host_to_net_u32 (0x0a000000 + *peer);
+      tc->c_rmt_port = clib_host_to_net_u16 (1024 + (*peer & 0x7fff));
+      tc->state = TCP_STATE_ESTABLISHED;
+      tcp_connection_timers_init (tc);
+
+      stream_session_accept (&tc->connection, listener->session_index,
+			     SESSION_TYPE_IP4_TCP, 1 /* notify */ );
+
+      s = stream_session_get (tc->c_s_index, 0);
+      vec_add1 (*conn_indices, tc->c_c_index);
+      vec_add1 (*app_indices, s->app_index);
+    }
+}
+
+static void
+tcp_test_listen_close (u32 ** conn_indices)
+{
+  u32 *ci;
+
+  vec_foreach (ci, *conn_indices)
+    tcp_connection_del (tcp_connection_get (*ci, 0));
+  vec_reset_length (*conn_indices);
+}
+
+static clib_error_t *
+tcp_test_listen_group_command_fn (vlib_main_t * vm, unformat_input_t * input,
+				  vlib_cli_command_t * cmd)
+{
+  session_manager_main_t *smm = vnet_get_session_manager_main ();
+  u32 n_conns = 64, port = 4321, peer = 1, primary, *group;
+  u32 *conn_indices = 0, *app_indices = 0, *ai;
+  u32 apps[2], n_taken[2] = { 0 }, n_bound = 0;
+  clib_error_t *error = 0;
+  stream_session_t *listener;
+  ip46_address_t ip46;
+  ip4_address_t lcl;
+  char *uri;
+  int rv;
+
+  while (unformat_check_input (input) != UNFORMAT_END_OF_INPUT)
+    {
+      if (unformat (input, "connections %u", &n_conns))
+	;
+      else if (unformat (input, "port %u", &port))
+	;
+      else
+	return clib_error_return (0, "unknown input `%U'",
+				  format_unformat_error, input);
+    }
+
+  if (n_conns == 0 || port == 0 || port > 65535)
+    return clib_error_return (0, "invalid parameters");
+
+  vnet_session_enable_disable (vm, 1 /* turn on TCP, etc. */ );
+
+  uri = (char *) format (0, "tcp://0.0.0.0/%u%c", port, 0);
+  memset (&ip46, 0, sizeof (ip46));
+  lcl.as_u32 = clib_host_to_net_u32 (0x0a000001);
+  port = clib_host_to_net_u16 (port);
+
+  if ((rv = tcp_test_listen_bind (uri, 1 /* reuseport */ )))
+    {
+      error = clib_error_return (0, "bind returned %d", rv);
+      goto done;
+    }
+  n_bound++;
+  if (tcp_test_listen_bind (uri, 0) != VNET_API_ERROR_ADDRESS_IN_USE)
+    {
+      error = clib_error_return (0, "port shared without reuseport");
+      goto done;
+    }
+  if ((rv = tcp_test_listen_bind (uri, 1 /* reuseport */ )))
+    {
+      error = clib_error_return (0, "second bind returned %d", rv);
+      goto done;
+    }
+  n_bound++;
+
+  listener = stream_session_lookup_listener (&ip46, port,
+					     SESSION_TYPE_IP4_TCP);
+  primary = listener->session_index;
+  group = smm->listener_groups[SESSION_TYPE_IP4_TCP][primary];
+  if (vec_len (group) != 2)
+    {
+      error = clib_error_return (0, "listener group has %u members",
+				 vec_len (group));
+      goto done;
+    }
+  apps[0] = stream_session_listener_get (SESSION_TYPE_IP4_TCP,
+					 group[0])->app_index;
+  apps[1] = stream_session_listener_get (SESSION_TYPE_IP4_TCP,
+					 group[1])->app_index;
+
+  /* Connections are spread over the group */
+  tcp_test_listen_accept (&lcl, port, n_conns, &peer, &conn_indices,
+			  &app_indices);
+  vec_foreach (ai, app_indices)
+  {
+    if (*ai != apps[0] && *ai != apps[1])
+      {
+	error = clib_error_return (0, "accepted by app %u, not in the "
+				   "group", *ai);
+	goto done;
+      }
+    n_taken[*ai == apps[1]]++;
+  }
+  vlib_cli_output (vm, "group of 2: app %u took %u, app %u took %u",
+		   apps[0], n_taken[0], apps[1], n_taken[1]);
+  if (n_taken[0] == 0 || n_taken[1] == 0)
+    {
+      error = clib_error_return (0, "connections not spread");
+      goto done;
+    }
+  tcp_test_listen_close (&conn_indices);
+  vec_reset_length (app_indices);
+
+  /* The app that owns the listener leaves, the other one takes it over */
+  if ((rv = vnet_unbind_uri (uri, ~0)))
+    {
+      error = clib_error_return (0, "unbind returned %d", rv);
+      goto done;
+    }
+  n_bound--;
+  listener = stream_session_lookup_listener (&ip46, port,
+					     SESSION_TYPE_IP4_TCP);
+  if (!listener || listener->session_index != primary
+      || listener->app_index != apps[1])
+    {
+      error = clib_error_return (0, "listener not handed over");
+      goto done;
+    }
+  if (primary < vec_len (smm->listener_groups[SESSION_TYPE_IP4_TCP])
+      && vec_len (smm->listener_groups[SESSION_TYPE_IP4_TCP][primary]))
+    {
+      error = clib_error_return (0, "group of 1 not freed");
+      goto done;
+    }
+
+  tcp_test_listen_accept (&lcl, port, n_conns, &peer, &conn_indices,
+			  &app_indices);
+  n_taken[1] = 0;
+  vec_foreach (ai, app_indices) n_taken[1] += *ai == apps[1];
+  vlib_cli_output (vm, "after leave: app %u took %u of %u", apps[1],
+		   n_taken[1], n_conns);
+  if (n_taken[1] != n_conns)
+    {
+      error = clib_error_return (0, "accepted by an app that left");
+      goto done;
+    }
+  tcp_test_listen_close (&conn_indices);
+
+  /* The last one leaving frees the port */
+  if ((rv = vnet_unbind_uri (uri, ~0)))
+    {
+      error = clib_error_return (0, "last unbind returned %d", rv);
+      goto done;
+    }
+  n_bound--;
+  if (stream_session_lookup_listener (&ip46, port, SESSION_TYPE_IP4_TCP))
+    {
+      error = clib_error_return (0, "listener left behind");
+      goto done;
+    }
+  vlib_cli_output (vm, "listener removed");
+
+done:
+  tcp_test_listen_close (&conn_indices);
+  while (n_bound--)
+    vnet_unbind_uri (uri, ~0);
+  vec_free (conn_indices);
+  vec_free (app_indices);
+  vec_free (uri);
+  return error;
+}
+
+/*?
+ * Bind two built-in servers to the same port with reuseport, have tcp
+ * accept connections from distinct peers and check that both servers
+ * get some. The server that owns the listener then unbinds: the other
+ * takes the listener over and gets every new connection, until it
+ * unbinds too and the port is free.
+ *
+ * @cliexpar
+ * @cliexstart{test tcp listen-group}
+ * group of 2: app 0 took 29, app 1 took 35
+ * after leave: app 1 took 64 of 64
+ * listener removed
+ * @cliexend
+?*/
+/* *INDENT-OFF* */
+VLIB_CLI_COMMAND (tcp_test_listen_group_command, static) =
+{
+  .path = "test tcp listen-group",
+  .short_help = "test tcp listen-group [connections <n>] [port <n>]",
+  .function = tcp_test_listen_group_command_fn,
+};
+/* *INDENT-ON* */
+
+/*
+ * fd.io coding-style-patch-verification: ON
+ *
+ * Local Variables:
+ * eval: (c-set-style "gnu")
+ * End:
+ */
@@ -46,7 +46,7 @@ builtin_server_rx_callback (stream_session_t * s, session_fifo_event_t * ep)
   int actual_transfer;
   u8 *my_copy_buffer;
   session_fifo_event_t evt;
-  unix_shared_memory_queue_t *q;
+  svm_event_ring_t *q;
 
   my_copy_buffer = copy_buffers[s->thread_index];
   rx_fifo = s->server_rx_fifo;
@@ -67,14 +67,17 @@ builtin_server_rx_callback (stream_session_t * s, session_fifo_event_t * ep)
 
   copy_buffers[s->thread_index] = my_copy_buffer;
 
-  /* Fabricate TX event, send to ourselves */
-  evt.fifo = tx_fifo;
-  evt.event_type = FIFO_EVENT_SERVER_TX;
-  /* $$$$ for event logging */
-  evt.enqueue_length = actual_transfer;
-  evt.event_id = 0;
-  q = session_manager_get_vpp_event_queue (s->thread_index);
-  unix_shared_memory_queue_add (q, (u8 *) & evt, 0 /* do wait for mutex */ );
+  /* Fabricate TX event, send to ourselves, unless one is pending */
+  if (svm_fifo_set_event (tx_fifo))
+    {
+      evt.fifo = tx_fifo;
+      evt.event_type = FIFO_EVENT_SERVER_TX;
+      /* $$$$ for event logging */
+      evt.enqueue_length = actual_transfer;
+      evt.event_id = 0;
+      q = session_manager_get_vpp_event_queue (s->thread_index);
+      svm_event_ring_enqueue (q, (u8 *) & evt, 0 /* wait */ );
+    }
 
   return 0;
 }
@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) 2017 Cisco and/or its affiliates.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/*
+  SipHash-2-4, a keyed pseudorandom function for short inputs.
+  J.-P. Aumasson and D. J. Bernstein, "SipHash: a fast short-input PRF",
+  INDOCRYPT 2012.
+
+  Unlike clib_xxhash(), outputs cannot be predicted or forged without the
+  128 bit key, so it is fit for MACs such as SYN cookies.
+*/
+
+#ifndef __included_siphash_h__
+#define __included_siphash_h__
+
+#include <vppinfra/types.h>
+#include <vppinfra/byte_order.h>
+
+#define SIPHASH_ROTL(x,b) (u64) (((x) << (b)) | ((x) >> (64 - (b))))
+
+#define SIPHASH_ROUND(v0,v1,v2,v3)				\
+do {								\
+  v0 += v1; v1 = SIPHASH_ROTL (v1, 13); v1 ^= v0;		\
+  v0 = SIPHASH_ROTL (v0, 32);					\
+  v2 += v3; v3 = SIPHASH_ROTL (v3, 16); v3 ^= v2;		\
+  v0 += v3; v3 = SIPHASH_ROTL (v3, 21); v3 ^= v0;		\
+  v2 += v1; v1 = SIPHASH_ROTL (v1, 17); v1 ^= v2;		\
+  v2 = SIPHASH_ROTL (v2, 32);					\
+} while (0)
+
+/**
+ * SipHash-2-4 of @a len bytes at @a data, with a 128 bit key given as two
+ * u64s, key[0] holding its first 8 bytes read as a little endian number
+ */
+static inline u64
+clib_siphash24 (const u64 key[2], const void *data, uword len)
+{
+  const u8 *p = data;
+  u64 v0 = key[0] ^ 0x736f6d6570736575ULL;
+  u64 v1 = key[1] ^ 0x646f72616e646f6dULL;
+  u64 v2 = key[0] ^ 0x6c7967656e657261ULL;
+  u64 v3 = key[1] ^ 0x7465646279746573ULL;
+  u64 m, b = (u64) len << 56;
+  uword i;
+
+  for (; len >= 8; len -= 8, p += 8)
+    {
+      m = clib_little_to_host_unaligned_mem_u64 ((u64 *) p);
+      v3 ^= m;
+      SIPHASH_ROUND (v0, v1, v2, v3);
+      SIPHASH_ROUND (v0, v1, v2, v3);
+      v0 ^= m;
+    }
+
+  for (i = 0; i < len; i++)
+    b |= (u64) p[i] << (8 * i);
+
+  v3 ^= b;
+  SIPHASH_ROUND (v0, v1, v2, v3);
+  SIPHASH_ROUND (v0, v1, v2, v3);
+  v0 ^= b;
+
+  v2 ^= 0xff;
+  SIPHASH_ROUND (v0, v1, v2, v3);
+  SIPHASH_ROUND (v0, v1, v2, v3);
+  SIPHASH_ROUND (v0, v1, v2, v3);
+  SIPHASH_ROUND (v0, v1, v2, v3);
+
+  return v0 ^ v1 ^ v2 ^ v3;
+}
+
+#endif /* __included_siphash_h__ */
+
+/*
+ * fd.io coding-style-patch-verification: ON
+ *
+ * Local Variables:
+ * eval: (c-set-style "gnu")
+ * End:
+ */
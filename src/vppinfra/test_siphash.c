@@ -0,0 +1,93 @@
+/*
+ * Copyright (c) 2017 Cisco and/or its affiliates.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <vppinfra/format.h>
+#include <vppinfra/error.h>
+#include <vppinfra/siphash.h>
+
+/*
+ * Reference vectors of the SipHash paper: the key is bytes 0x00 to 0x0f,
+ * a message of n bytes is bytes 0x00 to n - 1
+ */
+static clib_error_t *
+siphash_test_suite (void)
+{
+  typedef struct
+  {
+    uword len;
+    u64 output;
+  } siphash_test_t;
+
+  static siphash_test_t tests[] = {
+    {.len = 0,.output = 0x726fdb47dd0e0e31ULL,},
+    {.len = 1,.output = 0x74f839c593dc67fdULL,},
+    {.len = 7,.output = 0xab0200f58b01d137ULL,},
+    {.len = 8,.output = 0x93f5f5799a932462ULL,},
+    {.len = 15,.output = 0xa129ca6149be45e5ULL,},
+    {.len = 16,.output = 0x3f2acc7f57c29bdbULL,},
+    {.len = 63,.output = 0x958a324ceb064572ULL,},
+  };
+
+  u64 key[2] = { 0x0706050403020100ULL, 0x0f0e0d0c0b0a0908ULL };
+  u8 data[64];
+  u64 h;
+  int i;
+
+  for (i = 0; i < ARRAY_LEN (data); i++)
+    data[i] = i;
+
+  for (i = 0; i < ARRAY_LEN (tests); i++)
+    {
+      /* Unaligned input must hash the same */
+      u8 unaligned[ARRAY_LEN (data) + 1];
+      clib_memcpy (unaligned + 1, data, tests[i].len);
+
+      h = clib_siphash24 (key, data, tests[i].len);
+      if (h != tests[i].output)
+	return clib_error_return (0, "len %d -> 0x%Lx expected 0x%Lx",
+				  tests[i].len, h, tests[i].output);
+      h = clib_siphash24 (key, unaligned + 1, tests[i].len);
+      if (h != tests[i].output)
+	return clib_error_return (0, "unaligned len %d -> 0x%Lx "
+				  "expected 0x%Lx", tests[i].len, h,
+				  tests[i].output);
+    }
+
+  return 0;
+}
+
+int
+main (int argc, char *argv[])
+{
+  clib_error_t *e;
+
+  e = siphash_test_suite ();
+  if (e)
+    {
+      clib_error_report (e);
+      exit (1);
+    }
+
+  fformat (stdout, "siphash test OK\n");
+  return 0;
+}
+
+/*
+ * fd.io coding-style-patch-verification: ON
+ *
+ * Local Variables:
+ * eval: (c-set-style "gnu")
+ * End:
+ */
@@ -4,6 +4,8 @@
 
 import unittest
 import random
+import re
+import socket
 
 from scapy.packet import Raw
 from scapy.layers.l2 import Ether
@@ -432,6 +434,17 @@ class TestACLplugin(VppTestCase):
                     capture = dst_if.get_capture(0)
                     self.assertEqual(len(capture), 0)
 
+    def run_both_lookups(self, run, *args):
+        """ Run the same traffic through the linear and the hash lookup """
+        for use_hash in [0, 1]:
+            self.vapi.cli("set acl-plugin use-hash-acl-matching %d" %
+                          use_hash)
+            self.reset_packet_infos()
+            try:
+                run(*args)
+            finally:
+                self.vapi.cli("set acl-plugin use-hash-acl-matching 1")
+
     def api_acl_add_replace(self, acl_index, r, count, tag='',
                             expected_retval=0):
         """Add/replace an ACL
@@ -1011,5 +1024,228 @@ class TestACLplugin(VppTestCase):
 
         self.logger.info("ACLP_TEST_FINISH_0020")
 
+    def test_0021_ip6_prefix_not_byte_aligned(self):
+        """ IPv6 prefix which does not end on a byte boundary
+        """
+        self.logger.info("ACLP_TEST_START_0021")
+
+        # 2017:dead:10::/44 covers 2017:dead:1x::, not the pg1 hosts
+        # at 2017:dead:2::
+        rules = []
+        rules.append(self.create_rule(self.IPV6, self.DENY, self.PORTS_ALL,
+                                      self.proto[self.IP][self.UDP],
+                                      d_prefix=44,
+                                      d_ip=socket.inet_pton(
+                                          socket.AF_INET6,
+                                          "2017:dead:10::")))
+        rules.append(self.create_rule(self.IPV6, self.PERMIT,
+                                      self.PORTS_ALL, 0))
+        self.apply_rules(rules, "deny ip6 udp 2017:dead:10::/44")
+
+        # Traffic should still pass
+        self.run_both_lookups(self.run_verify_test, self.IP, self.IPV6,
+                              self.proto[self.IP][self.UDP])
+
+        # 2017:dead::/46 does cover 2017:dead:2::
+        rules[0] = self.create_rule(self.IPV6, self.DENY, self.PORTS_ALL,
+                                    self.proto[self.IP][self.UDP],
+                                    d_prefix=46,
+                                    d_ip=socket.inet_pton(socket.AF_INET6,
+                                                          "2017:dead::"))
+        self.apply_rules(rules, "deny ip6 udp 2017:dead::/46")
+
+        # Traffic should not pass
+        self.run_both_lookups(self.run_verify_negat_test, self.IP,
+                              self.IPV6, self.proto[self.IP][self.UDP])
+
+        self.logger.info("ACLP_TEST_FINISH_0021")
+
+    def test_0022_rule_address_host_bits(self):
+        """ rule addresses with host bits set beyond the prefix
+        """
+        self.logger.info("ACLP_TEST_START_0022")
+
+        # the host bits of the rule address must not matter
+        rules = []
+        rules.append(self.create_rule(self.IPV4, self.DENY, self.PORTS_ALL,
+                                      self.proto[self.IP][self.UDP],
+                                      d_prefix=24,
+                                      d_ip=socket.inet_pton(
+                                          socket.AF_INET,
+                                          "172.17.102.255")))
+        rules.append(self.create_rule(self.IPV6, self.DENY, self.PORTS_ALL,
+                                      self.proto[self.IP][self.UDP],
+                                      d_prefix=64,
+                                      d_ip=socket.inet_pton(
+                                          socket.AF_INET6,
+                                          "2017:dead:2::ffff")))
+        rules.append(self.create_rule(self.IPV4, self.PERMIT,
+                                      self.PORTS_ALL, 0))
+        rules.append(self.create_rule(self.IPV6, self.PERMIT,
+                                      self.PORTS_ALL, 0))
+        self.apply_rules(rules, "deny udp to pg1 with host bits")
+
+        # Traffic should not pass
+        self.run_both_lookups(self.run_verify_negat_test, self.IP,
+                              self.IPRANDOM, self.proto[self.IP][self.UDP])
+
+        self.logger.info("ACLP_TEST_FINISH_0022")
+
+    def test_0023_tcp_flags_on_udp_rule(self):
+        """ TCP flags are ignored on a non-TCP rule
+        """
+        self.logger.info("ACLP_TEST_START_0023")
+
+        # UDP has no flags, the rule must match every UDP packet
+        rules = []
+        rule = self.create_rule(self.IPV4, self.DENY, self.PORTS_ALL,
+                                self.proto[self.IP][self.UDP])
+        rule['tcp_flags_mask'] = 0xff
+        rule['tcp_flags_value'] = 0x12
+        rules.append(rule)
+        rules.append(self.create_rule(self.IPV4, self.PERMIT,
+                                      self.PORTS_ALL, 0))
+        self.apply_rules(rules, "deny udp with tcp flags")
+
+        # Traffic should not pass
+        self.run_both_lookups(self.run_verify_negat_test, self.IP,
+                              self.IPV4, self.proto[self.IP][self.UDP])
+
+        self.logger.info("ACLP_TEST_FINISH_0023")
+
+
+class TestACLReflect(VppTestCase):
+    """ ACL plugin reflexive sessions Test Case """
+
+    PERMIT_REFLECT = 2
+
+    @classmethod
+    def setUpClass(cls):
+        super(TestACLReflect, cls).setUpClass()
+
+        try:
+            # pg0 is inside, pg1 outside; both are routed
+            cls.create_pg_interfaces(range(2))
+            for i in cls.pg_interfaces:
+                i.admin_up()
+                i.config_ip4()
+                i.resolve_arp()
+                i.config_ip6()
+                i.resolve_ndp()
+        except Exception:
+            super(TestACLReflect, cls).tearDownClass()
+            raise
+
+    def tearDown(self):
+        super(TestACLReflect, self).tearDown()
+        if not self.vpp_dead:
+            self.logger.info(self.vapi.ppcli("show acl-plugin sessions"))
+
+    def rule(self, is_ip6, is_permit, proto=0):
+        addr = '\x00' * 16 if is_ip6 else '\x00' * 4
+        return {'is_permit': is_permit, 'is_ipv6': is_ip6, 'proto': proto,
+                'srcport_or_icmptype_first': 0,
+                'srcport_or_icmptype_last': 65535,
+                'src_ip_prefix_len': 0, 'src_ip_addr': addr,
+                'dstport_or_icmpcode_first': 0,
+                'dstport_or_icmpcode_last': 65535,
+                'dst_ip_prefix_len': 0, 'dst_ip_addr': addr}
+
+    def add_acl(self, rules, tag):
+        reply = self.vapi.api(self.vapi.papi.acl_add_replace,
+                              {'acl_index': 4294967295, 'r': rules,
+                               'count': len(rules), 'tag': tag})
+        return reply.acl_index
+
+    def set_acls(self, sw_if_index, acls_in, acls_out):
+        self.vapi.api(self.vapi.papi.acl_interface_set_acl_list,
+                      {'sw_if_index': sw_if_index,
+                       'count': len(acls_in) + len(acls_out),
+                       'n_input': len(acls_in),
+                       'acls': acls_in + acls_out})
+
+    def create_stream(self, src_if, dst_if, is_ip6, sport, dport, count=5):
+        pkts = []
+        for i in range(count):
+            p = Ether(dst=src_if.local_mac, src=src_if.remote_mac)
+            if is_ip6:
+                p /= IPv6(src=src_if.remote_ip6, dst=dst_if.remote_ip6)
+            else:
+                p /= IP(src=src_if.remote_ip4, dst=dst_if.remote_ip4)
+            p /= UDP(sport=sport, dport=dport) / Raw("reflect %d" % i)
+            pkts.append(p)
+        return pkts
+
+    def send(self, src_if, dst_if, is_ip6, sport, dport):
+        pkts = self.create_stream(src_if, dst_if, is_ip6, sport, dport)
+        src_if.add_stream(pkts)
+        self.pg_enable_capture(self.pg_interfaces)
+        self.pg_start()
+        return pkts
+
+    def verify_capture(self, capture, is_ip6, sport, dport):
+        ip = IPv6 if is_ip6 else IP
+        for p in capture:
+            self.assertEqual(p[UDP].sport, sport)
+            self.assertEqual(p[UDP].dport, dport)
+            self.assertTrue(p[Raw].load.startswith("reflect"))
+            self.assertIn(ip, p)
+
+    def sessions_added(self):
+        out = self.vapi.cli("show acl-plugin sessions")
+        return sum(int(n) for n in re.findall(r"sessions added: (\d+)", out))
+
+    def run_reflect(self, is_ip6):
+        """ Only replies to flows opened from the inside may come in """
+        inside = self.pg0
+        outside = self.pg1
+        sport = 1234 + is_ip6
+        dport = 5678
+
+        # inside: reflect outgoing UDP; towards the inside: deny all
+        reflect = self.add_acl([self.rule(is_ip6, self.PERMIT_REFLECT, 17)],
+                               "reflect udp")
+        deny = self.add_acl([self.rule(0, 0), self.rule(1, 0)], "deny all")
+        self.set_acls(inside.sw_if_index, [reflect], [deny])
+        added = self.sessions_added()
+
+        try:
+            # unsolicited traffic from the outside is dropped
+            self.send(outside, inside, is_ip6, dport, sport)
+            inside.assert_nothing_captured(remark="no session yet")
+
+            # the inside opens the flow, which creates the session
+            pkts = self.send(inside, outside, is_ip6, sport, dport)
+            capture = outside.get_capture(len(pkts))
+            self.verify_capture(capture, is_ip6, sport, dport)
+
+            # the replies now hit the session on the way in
+            pkts = self.send(outside, inside, is_ip6, dport, sport)
+            capture = inside.get_capture(len(pkts))
+            self.verify_capture(capture, is_ip6, dport, sport)
+
+            # as do further packets from the inside
+            pkts = self.send(inside, outside, is_ip6, sport, dport)
+            outside.get_capture(len(pkts))
+
+            # other ports from the outside stay blocked
+            self.send(outside, inside, is_ip6, dport + 1, sport)
+            inside.assert_nothing_captured(remark="not part of the flow")
+
+            # one session served the whole flow
+            self.assertEqual(self.sessions_added(), added + 1)
+        finally:
+            self.set_acls(inside.sw_if_index, [], [])
+            self.vapi.api(self.vapi.papi.acl_del, {'acl_index': deny})
+            self.vapi.api(self.vapi.papi.acl_del, {'acl_index': reflect})
+
+    def test_reflect_ip4(self):
+        """ reflexive ACL session in both directions, IPv4 """
+        self.run_reflect(0)
+
+    def test_reflect_ip6(self):
+        """ reflexive ACL session in both directions, IPv6 """
+        self.run_reflect(1)
+
 if __name__ == '__main__':
     unittest.main(testRunner=VppTestRunner)
@@ -26,5 +26,13 @@ class TestFIB(VppTestCase):
             self.logger.critical(error)
         self.assertEqual(error.find("Failed"), -1)
 
+    def test_ip4_mtrie_layouts(self):
+        """ IPv4 mtrie layouts agree after adds and deletes """
+        reply = self.vapi.cli("test ip mtrie-bench routes 5000 "
+                              "lookups 50000")
+        self.logger.info(reply)
+        self.assertIn("routes added", reply)
+        self.assertEqual(reply.count(" 0 mismatches"), 3)
+
 if __name__ == '__main__':
     unittest.main(testRunner=VppTestRunner)
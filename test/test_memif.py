@@ -0,0 +1,136 @@
+#!/usr/bin/env python
+
+import re
+import subprocess
+import time
+import unittest
+
+from framework import VppTestCase, VppTestRunner
+from vpp_pg_interface import is_ipv6_misc
+
+from scapy.packet import Raw
+from scapy.layers.l2 import Ether
+from scapy.layers.inet import IP, UDP
+
+
+class MemifZeroCopyTestCase(VppTestCase):
+    """ Zero-copy memif master, echoed by a vpp slave """
+
+    # extra arguments of the slave's create memif
+    peer_args = ""
+
+    @classmethod
+    def setUpConstants(cls):
+        super(MemifZeroCopyTestCase, cls).setUpConstants()
+        # zero-copy buffers are remapped over fake dma pages
+        cls.vpp_cmdline.extend(["physmem", "{", "no-huge", "}"])
+
+    @classmethod
+    def setUpClass(cls):
+        super(MemifZeroCopyTestCase, cls).setUpClass()
+
+        cls.socket = "%s/memif.sock" % cls.tempdir
+        cls.create_pg_interfaces(range(1))
+        cls.pg0.admin_up()
+
+        cls.vapi.cli("create memif key 0x1 socket %s master zero-copy" %
+                     cls.socket)
+        cls.vapi.cli("set interface state memif0 up")
+        cls.vapi.cli("set interface l2 xconnect pg0 memif0")
+        cls.vapi.cli("set interface l2 xconnect memif0 pg0")
+
+        # the slave is a second vpp which sends everything back
+        config = "%s/peer.conf" % cls.tempdir
+        with open(config, "w") as f:
+            f.write("create memif key 0x1 socket %s slave%s\n" %
+                    (cls.socket, cls.peer_args))
+            f.write("set interface state memif0 up\n")
+            f.write("set interface l2 xconnect memif0 memif0\n")
+        cmdline = [cls.vpp_bin, "unix", "{", "nodaemon",
+                   "startup-config", config, "}",
+                   "api-segment", "{", "prefix", cls.shm_prefix + "-peer",
+                   "}", "plugins", "{", "plugin", "dpdk_plugin.so", "{",
+                   "disable", "}", "}"]
+        if cls.plugin_path is not None:
+            cmdline.extend(["plugin_path", cls.plugin_path])
+        cls.peer = subprocess.Popen(cmdline, stdout=subprocess.PIPE,
+                                    stderr=subprocess.PIPE)
+
+    @classmethod
+    def tearDownClass(cls):
+        if hasattr(cls, "peer"):
+            cls.peer.terminate()
+            cls.peer.communicate()
+        super(MemifZeroCopyTestCase, cls).tearDownClass()
+
+    def wait_connected(self, timeout=15):
+        """ The slave retries its connection every few seconds """
+        deadline = time.time() + timeout
+        while time.time() < deadline:
+            reply = self.vapi.cli("show memif")
+            if "zero-copy buffer region" in reply:
+                return reply
+            self.sleep(0.5, "waiting for the memif slave")
+        self.fail("memif slave did not connect: %s" % reply)
+
+    def create_stream(self, sizes):
+        pkts = []
+        for i, size in enumerate(sizes):
+            payload = "memif %d " % i
+            pkts.append(Ether(dst=self.pg0.local_mac,
+                              src=self.pg0.remote_mac) /
+                        IP(src="10.0.0.1", dst="10.0.0.2") /
+                        UDP(sport=1234, dport=5678) /
+                        Raw(payload + "x" * (size - len(payload))))
+        return pkts
+
+
+class TestMemifZeroCopy(MemifZeroCopyTestCase):
+    """ Zero-copy memif master Test Case """
+
+    def test_zero_copy_echo(self):
+        """ Packets cross a zero-copy master both ways """
+        self.wait_connected()
+
+        pkts = self.create_stream([10 + i * 10 for i in range(100)])
+        self.pg0.add_stream(pkts)
+        self.pg_enable_capture(self.pg_interfaces)
+        self.pg_start()
+        rx = self.pg0.get_capture(len(pkts), filter_out_fn=is_ipv6_misc)
+
+        self.assertEqual(sorted(p[Raw].load for p in rx),
+                         sorted(p[Raw].load for p in pkts))
+
+        # posted buffers are the ones shared with the slave
+        self.assertIn("zero-copy buffer region", self.vapi.cli("show memif"))
+        self.assertNotIn("no free zero-copy buffers",
+                         self.vapi.cli("show errors"))
+
+
+class TestMemifZeroCopyOversized(MemifZeroCopyTestCase):
+    """ Zero-copy memif master, slave writing past its buffers Test Case """
+
+    # the slave asks for 1024 byte buffers but still writes whole frames
+    peer_args = " buffer-size 1024"
+
+    def test_oversized_dropped(self):
+        """ Descriptors longer than their buffer are dropped """
+        self.wait_connected()
+
+        small = self.create_stream([100] * 10)
+        large = self.create_stream([1400] * 10)
+        self.pg0.add_stream(small + large)
+        self.pg_enable_capture(self.pg_interfaces)
+        self.pg_start()
+        rx = self.pg0.get_capture(len(small), filter_out_fn=is_ipv6_misc)
+
+        self.assertEqual(sorted(p[Raw].load for p in rx),
+                         sorted(p[Raw].load for p in small))
+        m = re.search(r"(\d+)\s+memif-input\s+descriptor longer than its "
+                      r"buffer", self.vapi.cli("show errors"))
+        self.assertIsNotNone(m)
+        self.assertEqual(int(m.group(1)), len(large))
+
+
+if __name__ == '__main__':
+    unittest.main(testRunner=VppTestRunner)
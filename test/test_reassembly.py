@@ -0,0 +1,155 @@
+#!/usr/bin/env python
+
+import unittest
+
+from framework import VppTestCase, VppTestRunner
+
+from scapy.layers.l2 import Ether, Raw
+from scapy.layers.inet import IP, UDP, fragment
+from scapy.layers.inet6 import IPv6, IPv6ExtHdrFragment, fragment6
+
+
+class TestIPReassembly(VppTestCase):
+    """ IP Reassembly Test Case """
+
+    def setUp(self):
+        super(TestIPReassembly, self).setUp()
+
+        self.create_pg_interfaces(range(2))
+        for i in self.pg_interfaces:
+            i.admin_up()
+            i.config_ip4()
+            i.resolve_arp()
+            i.config_ip6()
+            i.resolve_ndp()
+
+        self.vapi.cli("set interface ip reassembly pg0 ip4")
+        self.vapi.cli("set interface ip reassembly pg0 ip6")
+
+    def tearDown(self):
+        super(TestIPReassembly, self).tearDown()
+        if not self.vpp_dead:
+            self.logger.info(self.vapi.cli("show ip reassembly"))
+            self.vapi.cli("set ip reassembly ip4 full")
+            self.vapi.cli("set interface ip reassembly pg0 ip4 disable")
+            self.vapi.cli("set interface ip reassembly pg0 ip6 disable")
+            for i in self.pg_interfaces:
+                i.unconfig_ip4()
+                i.unconfig_ip6()
+                i.admin_down()
+
+    def create_ip4_packet(self, payload_len):
+        return (Ether(dst=self.pg0.local_mac, src=self.pg0.remote_mac) /
+                IP(src=self.pg0.remote_ip4, dst=self.pg1.remote_ip4,
+                   id=1234) /
+                UDP(sport=1234, dport=5678) /
+                Raw('\xa5' * payload_len))
+
+    def create_ip6_packet(self, payload_len):
+        return (Ether(dst=self.pg0.local_mac, src=self.pg0.remote_mac) /
+                IPv6(src=self.pg0.remote_ip6, dst=self.pg1.remote_ip6) /
+                IPv6ExtHdrFragment(id=1234) /
+                UDP(sport=1234, dport=5678) /
+                Raw('\xa5' * payload_len))
+
+    def test_ip4_reassembly(self):
+        """ IPv4 fragments out of order are reassembled """
+        p = self.create_ip4_packet(3000)
+        frags = fragment(p, fragsize=1000)
+        frags.reverse()
+
+        self.pg0.add_stream(frags)
+        self.pg_enable_capture(self.pg_interfaces)
+        self.pg_start()
+
+        rx = self.pg1.get_capture(1)[0]
+        self.assertEqual(rx[IP].flags & 1, 0)
+        self.assertEqual(rx[IP].frag, 0)
+        self.assertEqual(rx[IP].len, len(p[IP]))
+        self.assertEqual(rx[UDP].sport, 1234)
+        self.assertEqual(str(rx[Raw]), '\xa5' * 3000)
+
+    def test_ip4_overlap(self):
+        """ IPv4 overlapping fragments are dropped """
+        p = self.create_ip4_packet(3000)
+        frags = fragment(p, fragsize=1000)
+        overlap = frags[1].copy()
+        overlap[IP].frag -= 1
+
+        self.pg0.add_stream([frags[0], overlap] + frags[1:])
+        self.pg_enable_capture(self.pg_interfaces)
+        self.pg_start()
+
+        self.pg1.assert_nothing_captured(remark="overlapping fragments")
+
+    def test_ip4_virtual_reassembly(self):
+        """ IPv4 virtual reassembly forwards the fragments """
+        self.vapi.cli("set ip reassembly ip4 virtual")
+        p = self.create_ip4_packet(3000)
+        frags = fragment(p, fragsize=1000)
+        frags.reverse()
+
+        self.pg0.add_stream(frags)
+        self.pg_enable_capture(self.pg_interfaces)
+        self.pg_start()
+
+        rx = self.pg1.get_capture(len(frags))
+        self.assertEqual(sorted(r[IP].frag for r in rx),
+                         sorted(f[IP].frag for f in frags))
+
+    def test_ip4_virtual_reassembly_acl(self):
+        """ Input ACL matches IPv4 fragments on their ports """
+        self.vapi.cli("set ip reassembly ip4 virtual")
+        rules = [{'is_permit': 1, 'is_ipv6': 0, 'proto': 17,
+                  'srcport_or_icmptype_first': 0,
+                  'srcport_or_icmptype_last': 65535,
+                  'src_ip_prefix_len': 0,
+                  'src_ip_addr': '\x00\x00\x00\x00',
+                  'dstport_or_icmpcode_first': 5678,
+                  'dstport_or_icmpcode_last': 5678,
+                  'dst_ip_prefix_len': 0,
+                  'dst_ip_addr': '\x00\x00\x00\x00'}]
+        reply = self.vapi.api(self.vapi.papi.acl_add_replace,
+                              {'acl_index': 4294967295, 'r': rules,
+                               'count': len(rules), 'tag': ''})
+        self.vapi.api(self.vapi.papi.acl_interface_set_acl_list,
+                      {'sw_if_index': self.pg0.sw_if_index, 'count': 1,
+                       'n_input': 1, 'acls': [reply.acl_index]})
+        try:
+            p = self.create_ip4_packet(3000)
+            frags = fragment(p, fragsize=1000)
+            frags.reverse()
+
+            self.pg0.add_stream(frags)
+            self.pg_enable_capture(self.pg_interfaces)
+            self.pg_start()
+
+            # without the ports, the non-first fragments would be denied
+            rx = self.pg1.get_capture(len(frags))
+            self.assertEqual(sorted(r[IP].frag for r in rx),
+                             sorted(f[IP].frag for f in frags))
+        finally:
+            self.vapi.api(self.vapi.papi.acl_interface_set_acl_list,
+                          {'sw_if_index': self.pg0.sw_if_index, 'count': 0,
+                           'n_input': 0, 'acls': []})
+            self.vapi.api(self.vapi.papi.acl_del,
+                          {'acl_index': reply.acl_index})
+
+    def test_ip6_reassembly(self):
+        """ IPv6 fragments out of order are reassembled """
+        p = self.create_ip6_packet(3000)
+        frags = fragment6(p, 1000)
+        frags.reverse()
+
+        self.pg0.add_stream(frags)
+        self.pg_enable_capture(self.pg_interfaces)
+        self.pg_start()
+
+        rx = self.pg1.get_capture(1)[0]
+        self.assertFalse(rx.haslayer(IPv6ExtHdrFragment))
+        self.assertEqual(rx[UDP].dport, 5678)
+        self.assertEqual(str(rx[Raw]), '\xa5' * 3000)
+
+
+if __name__ == '__main__':
+    unittest.main(testRunner=VppTestRunner)
@@ -3,6 +3,8 @@
 import socket
 import unittest
 import struct
+import re
+import multiprocessing
 
 from framework import VppTestCase, VppTestRunner
 from scapy.layers.inet import IP, TCP, UDP, ICMP
@@ -1032,6 +1034,38 @@ class TestSNAT(VppTestCase):
         # verify number of translated packet
         self.pg1.get_capture(pkts_num)
 
+    def test_idle_session_expires(self):
+        """ SNAT idle session freed without further traffic """
+
+        self.snat_add_address(self.snat_addr)
+        self.vapi.snat_interface_add_del_feature(self.pg0.sw_if_index)
+        self.vapi.snat_interface_add_del_feature(self.pg1.sw_if_index,
+                                                 is_inside=0)
+        self.vapi.cli("set snat timeout udp 2")
+
+        try:
+            p = (Ether(dst=self.pg0.local_mac, src=self.pg0.remote_mac) /
+                 IP(src=self.pg0.remote_ip4, dst=self.pg1.remote_ip4) /
+                 UDP(sport=self.udp_port_in, dport=20))
+            self.pg0.add_stream(p)
+            self.pg_enable_capture(self.pg_interfaces)
+            self.pg_start()
+            self.pg1.get_capture(1)
+
+            users = self.vapi.snat_user_dump()
+            self.assertEqual(len(users), 1)
+            self.assertEqual(users[0].nsessions, 1)
+
+            # nothing is sent any more, the timer wheel runs regardless
+            self.sleep(5, "waiting for the session to age out")
+
+            self.assertEqual(len(self.vapi.snat_user_dump()), 0)
+            out = self.vapi.cli("show snat session-rate")
+            expired = re.findall(r"(\d+) expired", out)
+            self.assertGreater(sum(int(n) for n in expired), 0)
+        finally:
+            self.vapi.cli("set snat timeout udp 300")
+
     def test_interface_addr(self):
         """ Acquire SNAT addresses from interface """
         self.vapi.snat_add_interface_addr(self.pg7.sw_if_index)
@@ -1330,10 +1364,91 @@ class TestDeterministicNAT(VppTestCase):
         self.assertEqual(out_addr_n, dsm.out_addr[:4])
         self.assertEqual(out_plen, dsm.out_plen)
 
+    def test_deterministic_translation(self):
+        """ S-NAT deterministic mode translation of many subscribers """
+        nat_ip = '10.0.0.3'
+        nat_ip_n = socket.inet_aton(nat_ip)
+        ports_in = [6303, 6304, 6305]
+
+        self.pg0.generate_remote_hosts(200)
+        self.pg0.configure_ipv4_neighbors()
+
+        self.vapi.snat_add_det_map(self.pg0.remote_hosts[0].ip4n, 24,
+                                   nat_ip_n, 32)
+        self.vapi.snat_interface_add_del_feature(self.pg0.sw_if_index)
+        self.vapi.snat_interface_add_del_feature(self.pg1.sw_if_index,
+                                                 is_inside=0)
+
+        # in2out, every host opens a few sessions
+        pkts = []
+        for host in self.pg0.remote_hosts:
+            for port in ports_in:
+                p = (Ether(dst=self.pg0.local_mac, src=host.mac) /
+                     IP(src=host.ip4, dst=self.pg1.remote_ip4) /
+                     TCP(sport=port, dport=80, flags='S'))
+                pkts.append(p)
+        self.pg0.add_stream(pkts)
+        self.pg_enable_capture(self.pg_interfaces)
+        self.pg_start()
+        capture = self.pg1.get_capture(len(pkts))
+
+        out_ports = []
+        for packet in capture:
+            try:
+                self.assertEqual(packet[IP].src, nat_ip)
+                out_port = packet[TCP].sport
+                rep = self.vapi.snat_det_reverse(nat_ip_n, out_port)
+                host = self.pg0.host_by_ip4(socket.inet_ntoa(
+                    rep.in_addr[:4]))
+                rep = self.vapi.snat_det_forward(host.ip4n)
+                self.assertTrue(rep.out_port_lo <= out_port <=
+                                rep.out_port_hi)
+                out_ports.append(out_port)
+            except:
+                self.logger.error(ppp("Unexpected or invalid packet:",
+                                      packet))
+                raise
+        self.assertEqual(len(set(out_ports)), len(pkts))
+
+        # out2in, the replies hit the sessions
+        pkts = []
+        for out_port in out_ports:
+            p = (Ether(dst=self.pg1.local_mac, src=self.pg1.remote_mac) /
+                 IP(src=self.pg1.remote_ip4, dst=nat_ip) /
+                 TCP(sport=80, dport=out_port, flags='SA'))
+            pkts.append(p)
+        self.pg1.add_stream(pkts)
+        self.pg_enable_capture(self.pg_interfaces)
+        self.pg_start()
+        capture = self.pg0.get_capture(len(pkts))
+
+        received = set()
+        for packet in capture:
+            try:
+                self.assertEqual(packet[IP].src, self.pg1.remote_ip4)
+                self.assertIn(packet[TCP].dport, ports_in)
+                received.add((packet[IP].dst, packet[TCP].dport))
+            except:
+                self.logger.error(ppp("Unexpected or invalid packet:",
+                                      packet))
+                raise
+        sent = set((host.ip4, port) for host in self.pg0.remote_hosts
+                   for port in ports_in)
+        self.assertEqual(received, sent)
+
+        dms = self.vapi.snat_det_map_dump()
+        self.assertEqual(len(dms), 1)
+
     def clear_snat(self):
         """
         Clear SNAT configuration.
         """
+        interfaces = self.vapi.snat_interface_dump()
+        for intf in interfaces:
+            self.vapi.snat_interface_add_del_feature(intf.sw_if_index,
+                                                     intf.is_inside,
+                                                     is_add=0)
+
         deterministic_mappings = self.vapi.snat_det_map_dump()
         for dsm in deterministic_mappings:
             self.vapi.snat_add_det_map(dsm.in_addr,
@@ -1348,5 +1463,207 @@ class TestDeterministicNAT(VppTestCase):
             self.logger.info(self.vapi.cli("show snat detail"))
             self.clear_snat()
 
+
+@unittest.skipUnless(multiprocessing.cpu_count() > 2, "needs two workers")
+class TestSNATWorkers(VppTestCase):
+    """ SNAT with sessions on several workers Test Cases """
+
+    @classmethod
+    def setUpConstants(cls):
+        super(TestSNATWorkers, cls).setUpConstants()
+        cls.vpp_cmdline.extend(["cpu", "{", "workers", "2", "}"])
+
+    @classmethod
+    def setUpClass(cls):
+        super(TestSNATWorkers, cls).setUpClass()
+
+        try:
+            cls.snat_addr = '10.0.0.3'
+
+            cls.create_pg_interfaces(range(2))
+            cls.interfaces = list(cls.pg_interfaces)
+
+            for i in cls.interfaces:
+                i.admin_up()
+                i.config_ip4()
+                i.resolve_arp()
+
+            # each inside host is a user, spread round-robin on workers
+            cls.pg0.generate_remote_hosts(4)
+            cls.pg0.configure_ipv4_neighbors()
+
+        except Exception:
+            super(TestSNATWorkers, cls).tearDownClass()
+            raise
+
+    def active_sessions_per_thread(self):
+        """ Active sessions of each thread, from show snat session-rate """
+        out = self.vapi.cli("show snat session-rate")
+        return dict((int(t), int(n)) for t, n in
+                    re.findall(r"Thread (\d+) .* (\d+) active", out))
+
+    def test_sessions_on_workers(self):
+        """ SNAT sessions created on different workers """
+        snat_addr_n = socket.inet_pton(socket.AF_INET, self.snat_addr)
+        self.vapi.snat_add_address_range(snat_addr_n, snat_addr_n)
+        self.vapi.snat_interface_add_del_feature(self.pg0.sw_if_index)
+        self.vapi.snat_interface_add_del_feature(self.pg1.sw_if_index,
+                                                 is_inside=0)
+
+        hosts = self.pg0.remote_hosts
+        sport = 5000
+
+        # in2out, one flow per user
+        pkts = []
+        for h in hosts:
+            p = (Ether(dst=self.pg0.local_mac, src=h.mac) /
+                 IP(src=h.ip4, dst=self.pg1.remote_ip4) /
+                 UDP(sport=sport, dport=53))
+            pkts.append(p)
+        self.pg0.add_stream(pkts)
+        self.pg_enable_capture(self.pg_interfaces)
+        self.pg_start()
+        capture = self.pg1.get_capture(len(pkts))
+
+        out_ports = []
+        for p in capture:
+            self.assertEqual(p[IP].src, self.snat_addr)
+            out_ports.append(p[UDP].sport)
+        self.assertEqual(len(set(out_ports)), len(hosts))
+
+        # the users landed on both workers, none on the main thread
+        active = self.active_sessions_per_thread()
+        self.assertEqual(active.get(0, 0), 0)
+        self.assertEqual(sum(active.values()), len(hosts))
+        self.assertEqual(len([t for t in active if active[t] > 0]), 2)
+
+        # out2in is handed off to the worker owning each session
+        pkts = []
+        for port in out_ports:
+            p = (Ether(dst=self.pg1.local_mac, src=self.pg1.remote_mac) /
+                 IP(src=self.pg1.remote_ip4, dst=self.snat_addr) /
+                 UDP(sport=53, dport=port))
+            pkts.append(p)
+        self.pg1.add_stream(pkts)
+        self.pg_enable_capture(self.pg_interfaces)
+        self.pg_start()
+        capture = self.pg0.get_capture(len(pkts))
+
+        self.assertEqual(sorted(p[IP].dst for p in capture),
+                         sorted(h.ip4 for h in hosts))
+        for p in capture:
+            self.assertEqual(p[UDP].dport, sport)
+
+        # the replies refreshed the sessions, they did not add any
+        self.assertEqual(sum(self.active_sessions_per_thread().values()),
+                         len(hosts))
+
+    def tearDown(self):
+        super(TestSNATWorkers, self).tearDown()
+        if not self.vpp_dead:
+            self.logger.info(self.vapi.cli("show snat verbose"))
+            self.logger.info(self.vapi.cli("show snat session-rate"))
+
+
+class TestSNATEndpointDependent(VppTestCase):
+    """ Endpoint-dependent SNAT Test Cases """
+
+    @classmethod
+    def setUpConstants(cls):
+        super(TestSNATEndpointDependent, cls).setUpConstants()
+        cls.vpp_cmdline.extend(["snat", "{", "endpoint-dependent", "}"])
+
+    @classmethod
+    def setUpClass(cls):
+        super(TestSNATEndpointDependent, cls).setUpClass()
+
+        try:
+            cls.snat_addrs = ['10.0.0.3', '10.0.0.4']
+
+            cls.create_pg_interfaces(range(2))
+            cls.interfaces = list(cls.pg_interfaces)
+
+            for i in cls.interfaces:
+                i.admin_up()
+                i.config_ip4()
+                i.resolve_arp()
+
+            cls.pg1.generate_remote_hosts(4)
+            cls.pg1.configure_ipv4_neighbors()
+
+        except Exception:
+            super(TestSNATEndpointDependent, cls).tearDownClass()
+            raise
+
+    def send_in2out(self, flows):
+        """ Send one UDP packet per (sport, remote host), return capture """
+        pkts = []
+        for sport, host in flows:
+            p = (Ether(dst=self.pg0.local_mac, src=self.pg0.remote_mac) /
+                 IP(src=self.pg0.remote_ip4, dst=host.ip4) /
+                 UDP(sport=sport, dport=53))
+            pkts.append(p)
+        self.pg0.add_stream(pkts)
+        self.pg_enable_capture(self.pg_interfaces)
+        self.pg_start()
+        return self.pg1.get_capture(len(pkts))
+
+    def test_port_overloading(self):
+        """ Endpoint-dependent SNAT port overloading on one address """
+        for addr in self.snat_addrs:
+            addr_n = socket.inet_pton(socket.AF_INET, addr)
+            self.vapi.snat_add_address_range(addr_n, addr_n)
+        self.vapi.snat_interface_add_del_feature(self.pg0.sw_if_index)
+        self.vapi.snat_interface_add_del_feature(self.pg1.sw_if_index,
+                                                 is_inside=0)
+
+        hosts = self.pg1.remote_hosts
+
+        # different inside ports towards different remote hosts
+        flows = [(5000 + i, h) for i, h in enumerate(hosts)]
+        capture = self.send_in2out(flows)
+
+        # they all share the outside address and port of the user
+        nat_addrs = set(p[IP].src for p in capture)
+        nat_ports = set(p[UDP].sport for p in capture)
+        self.assertEqual(len(nat_addrs), 1)
+        self.assertEqual(len(nat_ports), 1)
+        nat_addr = nat_addrs.pop()
+        nat_port = nat_ports.pop()
+        self.assertIn(nat_addr, self.snat_addrs)
+
+        # the remote endpoint tells the sessions apart on the way back
+        pkts = []
+        for h in hosts:
+            p = (Ether(dst=self.pg1.local_mac, src=h.mac) /
+                 IP(src=h.ip4, dst=nat_addr) /
+                 UDP(sport=53, dport=nat_port))
+            pkts.append(p)
+        self.pg1.add_stream(pkts)
+        self.pg_enable_capture(self.pg_interfaces)
+        self.pg_start()
+        capture = self.pg0.get_capture(len(pkts))
+        for p in capture:
+            self.assertEqual(p[IP].dst, self.pg0.remote_ip4)
+        self.assertEqual(sorted(p[UDP].dport for p in capture),
+                         [sport for sport, h in flows])
+
+        # many flows to one remote host need distinct ports, but the
+        # user still stays on its address, the other one is unused
+        flows = [(7000 + i, hosts[0]) for i in range(16)]
+        capture = self.send_in2out(flows)
+        self.assertEqual(set(p[IP].src for p in capture), set([nat_addr]))
+        self.assertEqual(len(set(p[UDP].sport for p in capture)),
+                         len(flows))
+
+        users = self.vapi.snat_user_dump()
+        self.assertEqual(len(users), 1)
+        self.assertEqual(users[0].nsessions, len(hosts) + len(flows))
+
+    def tearDown(self):
+        super(TestSNATEndpointDependent, self).tearDown()
+        if not self.vpp_dead:
+            self.logger.info(self.vapi.cli("show snat verbose"))
+
 if __name__ == '__main__':
     unittest.main(testRunner=VppTestRunner)
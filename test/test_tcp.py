@@ -0,0 +1,391 @@
+#!/usr/bin/env python
+
+import re
+import time
+import unittest
+
+from framework import VppTestCase, VppTestRunner
+from vpp_pg_interface import is_ipv6_misc
+
+from scapy.packet import Raw
+from scapy.layers.l2 import Ether
+from scapy.layers.inet import IP, TCP
+
+
+class TestTCPCongestionControl(VppTestCase):
+    """ TCP Congestion Control Test Case """
+
+    def tearDown(self):
+        super(TestTCPCongestionControl, self).tearDown()
+        if not self.vpp_dead:
+            self.vapi.cli("set tcp cc-algo newreno")
+
+    def run_cc(self, args):
+        """ Run the emulated path test, return utilization per algorithm """
+        reply = self.vapi.cli("test tcp cc %s" % args)
+        self.logger.info(reply)
+        return dict((m.group(1), float(m.group(2))) for m in
+                    re.finditer(r"(\w+)\s+throughput \S+ Mbps "
+                                r"utilization ([\d.]+)%", reply))
+
+    def test_cc_high_bdp(self):
+        """ CUBIC fills a high BDP path faster than NewReno """
+        util = self.run_cc("rate 10000 rtt 40 buffer 0.1 duration 60")
+        self.assertIn("newreno", util)
+        self.assertIn("cubic", util)
+        self.assertGreater(util["cubic"], util["newreno"])
+        self.assertGreater(util["cubic"], 90)
+
+    def test_cc_deep_buffer(self):
+        """ NewReno and CUBIC both fill a path with a BDP of buffer """
+        util = self.run_cc("rate 100 rtt 10 buffer 1 duration 30")
+        for algo in ("newreno", "cubic"):
+            self.assertGreater(util[algo], 95)
+
+    def test_cc_default(self):
+        """ Default congestion control algorithm """
+        self.assertIn("newreno", self.vapi.cli("set tcp cc-algo"))
+        self.vapi.cli("set tcp cc-algo cubic")
+        self.assertIn("cubic", self.vapi.cli("set tcp cc-algo"))
+
+
+class TestTCPSack(VppTestCase):
+    """ TCP SACK Loss Recovery Test Case """
+
+    def run_loss(self, args):
+        """ Run the emulated lossy path test, return goodput per mode """
+        reply = self.vapi.cli("test tcp sack %s" % args)
+        self.logger.info(reply)
+        return dict((m.group(1), float(m.group(2))) for m in
+                    re.finditer(r"(\S+)\s+goodput ([\d.]+)%", reply))
+
+    def test_sack_no_loss(self):
+        """ Nothing is retransmitted without loss """
+        reply = self.vapi.cli("test tcp sack loss 0 segments 10000")
+        self.assertEqual(reply.count("duplicates 0 timeouts 0"), 2)
+
+    def test_sack_random_loss(self):
+        """ SACK recovery sustains goodput under 1% random loss """
+        goodput = self.run_loss("loss 1 segments 50000")
+        self.assertGreater(goodput["sack"], 90)
+        self.assertGreater(goodput["sack"], goodput["go-back-n"])
+
+    def test_sack_high_loss(self):
+        """ SACK recovery under 5% random loss with a large window """
+        goodput = self.run_loss("loss 5 window 500 segments 50000 seed 7")
+        self.assertGreater(goodput["sack"], goodput["go-back-n"])
+
+
+class TestTCPListenGroup(VppTestCase):
+    """ TCP Shared Listener Test Case """
+
+    def test_listen_group(self):
+        """ Two servers on one port share connections until one leaves """
+        reply = self.vapi.cli("test tcp listen-group connections 100")
+        self.logger.info(reply)
+        m = re.search(r"group of 2: app \d+ took (\d+), app \d+ took (\d+)",
+                      reply)
+        self.assertIsNotNone(m, reply)
+        self.assertGreater(int(m.group(1)), 0)
+        self.assertGreater(int(m.group(2)), 0)
+        self.assertEqual(int(m.group(1)) + int(m.group(2)), 100)
+        self.assertIsNotNone(
+            re.search(r"after leave: app \d+ took 100 of 100", reply), reply)
+        self.assertIn("listener removed", reply)
+
+
+class TCPPeerTestCase(VppTestCase):
+    """ Scapy peer of the builtin echo server, listening on port 1234 """
+
+    server_args = ""
+
+    @classmethod
+    def setUpClass(cls):
+        super(TCPPeerTestCase, cls).setUpClass()
+
+        cls.create_pg_interfaces(range(1))
+        cls.pg0.admin_up()
+        cls.pg0.config_ip4()
+        cls.pg0.resolve_arp()
+
+        cls.vapi.cli("test server %s" % cls.server_args)
+
+    def create_tcp(self, sport, flags, seq, ack, load=None, options=[]):
+        p = (Ether(dst=self.pg0.local_mac, src=self.pg0.remote_mac) /
+             IP(src=self.pg0.remote_ip4, dst=self.pg0.local_ip4) /
+             TCP(sport=sport, dport=1234, flags=flags, seq=seq, ack=ack,
+                 window=65535, options=options))
+        if load:
+            p = p / Raw(load)
+        return p
+
+    def send(self, pkts):
+        self.pg0.add_stream(pkts)
+        self.pg_enable_capture(self.pg_interfaces)
+        self.pg_start()
+
+    def connect(self, sport, mss):
+        """ Open a connection, return the next seq of the peer and of vpp """
+        self.send([self.create_tcp(sport, "S", 0, 0,
+                                   options=[("MSS", mss)])])
+        synack = self.pg0.get_capture(1)[0]
+        self.assertEqual(synack[TCP].flags, 0x12)
+        self.send([self.create_tcp(sport, "A", 1, synack[TCP].seq + 1)])
+        return 1, synack[TCP].seq + 1
+
+    def send_data(self, sport, seq, ack, data, sizes):
+        """ Send data in back-to-back segments of the given sizes """
+        pkts = []
+        for n in sizes:
+            pkts.append(self.create_tcp(sport, "A", seq, ack, data[:n]))
+            seq += n
+            data = data[n:]
+        self.send(pkts)
+
+    def get_data_segments(self, count):
+        """ Capture segments carrying data, pure ACKs are left out """
+        return self.pg0.get_capture(
+            count, filter_out_fn=lambda p: (is_ipv6_misc(p) or
+                                            (TCP in p and Raw not in p)))
+
+    def assert_checksums(self, p):
+        ip = p[IP].copy()
+        del ip.chksum
+        del ip[TCP].chksum
+        ip = IP(str(ip))
+        self.assertEqual(ip.chksum, p[IP].chksum)
+        self.assertEqual(ip[TCP].chksum, p[TCP].chksum)
+
+    def error_count(self, reason):
+        reply = self.vapi.cli("show errors")
+        return sum(int(n) for n in
+                   re.findall(r"(\d+)\s+\S+\s+%s" % reason, reply))
+
+
+class TestTCPTso(TCPPeerTestCase):
+    """ TCP Segmentation Offload Test Case """
+
+    def tearDown(self):
+        super(TestTCPTso, self).tearDown()
+        if not self.vpp_dead:
+            self.vapi.cli("set tcp tso off")
+
+    def test_tso_toggle(self):
+        """ TSO is off by default and can be switched on """
+        self.assertIn("tso off", self.vapi.cli("set tcp tso"))
+        self.vapi.cli("set tcp tso on")
+        self.assertIn("tso on", self.vapi.cli("set tcp tso"))
+        self.vapi.cli("set tcp tso off")
+        self.assertIn("tso off", self.vapi.cli("set tcp tso"))
+
+    def test_tso_segments(self):
+        """ A large send is cut in MSS segments on the wire """
+        mss = 300
+        data = "".join(chr(i % 251) for i in range(1000))
+        self.vapi.cli("set tcp tso on")
+
+        # the echo fits in the initial window and leaves as one packet
+        seq, ack = self.connect(40000, mss)
+        self.send_data(40000, seq, ack, data, [250] * 4)
+        rx = self.get_data_segments(4)
+
+        offset = 0
+        for p in rx:
+            self.assertEqual(p[TCP].seq, ack + offset)
+            self.assertEqual(p[TCP].ack, seq + len(data))
+            self.assertEqual(len(p[Raw].load),
+                             min(mss, len(data) - offset))
+            self.assertEqual(p[IP].len, len(p[IP]))
+            self.assert_checksums(p)
+            offset += len(p[Raw].load)
+        self.assertEqual("".join(p[Raw].load for p in rx), data)
+
+
+class TestTCPGro(TCPPeerTestCase):
+    """ TCP Receive Offload Test Case """
+
+    def tearDown(self):
+        super(TestTCPGro, self).tearDown()
+        if not self.vpp_dead:
+            self.vapi.cli("set tcp gro on")
+
+    def test_gro_toggle(self):
+        """ GRO is on by default and can be switched off """
+        self.assertIn("gro on", self.vapi.cli("set tcp gro"))
+        self.vapi.cli("set tcp gro off")
+        self.assertIn("gro off", self.vapi.cli("set tcp gro"))
+
+    def test_gro_merge(self):
+        """ Back-to-back in-order segments are merged and acked at once """
+        data = "".join(chr(i % 251) for i in range(1000))
+        seq, ack = self.connect(41000, 300)
+        merged = self.error_count("Segments merged by receive offload")
+
+        self.send_data(41000, seq, ack, data, [250] * 4)
+        rx = self.get_data_segments(4)
+
+        self.assertEqual(
+            self.error_count("Segments merged by receive offload"),
+            merged + 3)
+        # the first echoed segment already acks the whole run
+        for p in rx:
+            self.assertEqual(p[TCP].ack, seq + len(data))
+        self.assertEqual("".join(p[Raw].load for p in rx), data)
+
+
+class TestTCPZeroCopy(TCPPeerTestCase):
+    """ TCP Zero-Copy Receive Test Case """
+
+    server_args = "zero-copy"
+
+    def echo(self, sport, order):
+        """ Send 4 segments in the given order, check the echo """
+        data = "".join(chr(i % 251) for i in range(1000))
+        seq, ack = self.connect(sport, 300)
+        handed_over = self.error_count("Packets handed over to zero-copy")
+
+        pkts = [self.create_tcp(sport, "A", seq + 250 * i, ack,
+                                data[250 * i:250 * (i + 1)])
+                for i in order]
+        self.send(pkts)
+        rx = self.get_data_segments(4)
+
+        self.assertEqual("".join(p[Raw].load for p in rx), data)
+        for p in rx:
+            self.assertEqual(p[TCP].ack, seq + len(data))
+        self.assertGreater(
+            self.error_count("Packets handed over to zero-copy"),
+            handed_over)
+
+    def test_zero_copy_in_order(self):
+        """ In-order data is echoed from the buffers it arrived in """
+        self.echo(42000, [0, 1, 2, 3])
+
+    def test_zero_copy_out_of_order(self):
+        """ Out-of-order data caught up with is echoed in order """
+        self.echo(42001, [1, 2, 3, 0])
+
+
+class TestTCPSessionQueue(TCPPeerTestCase):
+    """ Session Event Queue Test Case """
+
+    def session_queue_sleeping(self):
+        return re.search(r"session-queue\s+interrupt wait",
+                         self.vapi.cli("show runtime")) is not None
+
+    def test_sleep_and_wakeup(self):
+        """ An idle session-queue sleeps and app events wake it up """
+        self.sleep(0.5, "session-queue going idle")
+        sleeps = self.error_count("Idle event queue put to sleep")
+        self.assertGreater(sleeps, 0)
+        self.assertTrue(self.session_queue_sleeping())
+
+        # the echo server's tx event rings the doorbell
+        data = "".join(chr(i % 251) for i in range(1000))
+        seq, ack = self.connect(43000, 300)
+        self.send_data(43000, seq, ack, data, [250] * 4)
+        rx = self.get_data_segments(4)
+        self.assertEqual("".join(p[Raw].load for p in rx), data)
+
+        # and it goes back to sleep once idle again
+        self.sleep(0.5, "session-queue going idle")
+        self.assertGreater(
+            self.error_count("Idle event queue put to sleep"), sleeps)
+        self.assertTrue(self.session_queue_sleeping())
+
+
+class TestTCPSynCookies(VppTestCase):
+    """ TCP SYN Cookies Test Case """
+
+    @classmethod
+    def setUpClass(cls):
+        super(TestTCPSynCookies, cls).setUpClass()
+
+        cls.create_pg_interfaces(range(1))
+        cls.pg0.admin_up()
+        cls.pg0.config_ip4()
+        cls.pg0.resolve_arp()
+
+        # builtin server listens on port 1234
+        cls.vapi.cli("test server")
+
+    def tearDown(self):
+        super(TestTCPSynCookies, self).tearDown()
+        if not self.vpp_dead:
+            self.logger.info(self.vapi.cli("set tcp syn-cookies"))
+            self.vapi.cli("set tcp syn-cookies auto threshold 1024")
+
+    def create_syns(self, count, sport):
+        return [(Ether(dst=self.pg0.local_mac, src=self.pg0.remote_mac) /
+                 IP(src=self.pg0.remote_ip4, dst=self.pg0.local_ip4) /
+                 TCP(sport=sport + i, dport=1234, flags="S", seq=i,
+                     options=[("MSS", 1460), ("WScale", 7),
+                              ("SAckOK", "")]))
+                for i in range(count)]
+
+    def create_ack(self, sport, seq, ack):
+        return (Ether(dst=self.pg0.local_mac, src=self.pg0.remote_mac) /
+                IP(src=self.pg0.remote_ip4, dst=self.pg0.local_ip4) /
+                TCP(sport=sport, dport=1234, flags="A", seq=seq, ack=ack))
+
+    def send_and_capture(self, pkts, count):
+        self.pg0.add_stream(pkts)
+        self.pg_enable_capture(self.pg_interfaces)
+        self.pg_start()
+        return self.pg0.get_capture(count)
+
+    def half_open(self):
+        reply = self.vapi.cli("set tcp syn-cookies")
+        return sum(int(n) for n in re.findall(r"(\d+) half-open", reply))
+
+    def syn_cookie_synack(self, sport):
+        self.vapi.cli("set tcp syn-cookies on")
+        rx = self.send_and_capture(self.create_syns(1, sport), 1)[0]
+        self.assertEqual(rx[TCP].flags, 0x12)
+        self.assertEqual(rx[TCP].ack, 1)
+        return rx
+
+    def test_cookie_handshake(self):
+        """ ACK of a SYN cookie establishes the connection """
+        half_open = self.half_open()
+        synack = self.syn_cookie_synack(20000)
+        self.assertEqual(self.half_open(), half_open)
+
+        ack = self.create_ack(20000, 1, synack[TCP].seq + 1)
+        self.pg0.add_stream([ack])
+        self.pg_enable_capture(self.pg_interfaces)
+        self.pg_start()
+        self.pg0.assert_nothing_captured(remark="valid SYN cookie")
+        self.assertIn("Valid SYN cookies received",
+                      self.vapi.cli("show errors"))
+
+    def test_cookie_invalid(self):
+        """ ACK of a bad SYN cookie is reset """
+        synack = self.syn_cookie_synack(30000)
+
+        ack = self.create_ack(30000, 1, synack[TCP].seq + 2)
+        rx = self.send_and_capture([ack], 1)[0]
+        self.assertTrue(rx[TCP].flags & 0x04)
+        self.assertEqual(rx[TCP].seq, synack[TCP].seq + 2)
+
+    def test_syn_flood(self):
+        """ SYN flood past the half-open threshold is answered statelessly """
+        threshold = 16
+        n_syns = 500
+        self.vapi.cli("set tcp syn-cookies auto threshold %u" % threshold)
+        half_open = self.half_open()
+
+        start = time.time()
+        rx = self.send_and_capture(self.create_syns(n_syns, 10000), n_syns)
+        self.logger.info("%u SYNs answered in %.2fs" %
+                         (n_syns, time.time() - start))
+
+        for p in rx:
+            self.assertEqual(p[TCP].flags, 0x12)
+            self.assertEqual(p[TCP].ack, p[TCP].dport - 10000 + 1)
+        self.assertLessEqual(self.half_open(), max(half_open, threshold))
+        self.assertIn("SYN cookies sent", self.vapi.cli("show errors"))
+
+
+if __name__ == '__main__':
+    unittest.main(testRunner=VppTestRunner)